@@ -0,0 +1,156 @@
+/*
+ * File: category.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "alloc.h"
+#include "category.h"
+#include <string.h>
+
+category_t* category_init(category_t* buffer,
+                          log_t* log,
+                          category_t* parent,
+                          const char* name)
+{
+    size_t name_len = strlen(name);
+    size_t parent_len = parent ? strlen(parent->name) + 1 : 0;
+    if (parent_len + name_len >= LG_MAX_CATEGORY_NAME_SIZE)
+    {
+        return NULL;
+    }
+
+    category_t* category = buffer;
+    if (!category)
+    {
+        category = LG_alloc(sizeof(category_t));
+        if (!category)
+        {
+            return NULL;
+        }
+        category->is_dynamic = true;
+    }
+    else
+    {
+        category->is_dynamic = false;
+    }
+
+    category->log = log;
+    category->parent = parent;
+    if (parent)
+    {
+        memcpy(category->name, parent->name, parent_len - 1);
+        category->name[parent_len - 1] = '.';
+    }
+    memcpy(category->name + parent_len, name, name_len + 1);
+    category->threshold = LG_NO_LEVEL;
+
+    LG_mutex_lock(&log->config_lock);
+    category->next = log->categories;
+    log->categories = category;
+    category_resolve_all(log);
+    LG_mutex_unlock(&log->config_lock);
+
+    return category;
+}
+
+void category_free(category_t* category)
+{
+    log_t* log = category->log;
+    LG_mutex_lock(&log->config_lock);
+    category_t** link = &log->categories;
+    while (*link && *link != category)
+    {
+        link = &(*link)->next;
+    }
+    if (*link)
+    {
+        *link = category->next;
+    }
+    LG_mutex_unlock(&log->config_lock);
+
+    if (category->is_dynamic)
+    {
+        LG_dealloc(category);
+    }
+}
+
+category_t* category_find(log_t* log, const char* name)
+{
+    LG_mutex_lock(&log->config_lock);
+    category_t* category = log->categories;
+    while (category && strcmp(category->name, name) != 0)
+    {
+        category = category->next;
+    }
+    LG_mutex_unlock(&log->config_lock);
+    return category;
+}
+
+bool category_set_threshold(category_t* category, LG_LEVEL threshold)
+{
+    log_t* log = category->log;
+    LG_mutex_lock(&log->config_lock);
+    category->threshold = threshold;
+    category_resolve_all(log);
+    LG_mutex_unlock(&log->config_lock);
+    return true;
+}
+
+LG_LEVEL category_threshold(category_t* category)
+{
+    return category->threshold;
+}
+
+LG_LEVEL category_effective_threshold(category_t* category)
+{
+    return (LG_LEVEL)LG_ATOMIC_LOAD(&category->effective);
+}
+
+bool category_enabled(category_t* category, LG_LEVEL level)
+{
+    return LG_CATEGORY_ENABLED(category, level);
+}
+
+bool category_write(category_t* category, LG_LEVEL level, const char* message)
+{
+    return category_writekv(category, level, message, NULL, 0);
+}
+
+bool category_writekv(category_t* category,
+                      LG_LEVEL level,
+                      const char* message,
+                      const kv_t* kvs,
+                      size_t kv_count)
+{
+    if (!LG_CATEGORY_ENABLED(category, level))
+    {
+        LG_STATS_ADD(&category->log->handlers[level].stats, entries_filtered, 1);
+        return false;
+    }
+    return log_write_threshold(category->log, level, LG_TRACE, NULL,
+                               message, kvs, kv_count);
+}
+
+void category_resolve_all(log_t* log)
+{
+    for (category_t* category = log->categories;
+         category;
+         category = category->next)
+    {
+        /* The nearest threshold up the hierarchy applies. */
+        LG_LEVEL threshold =
+            ((const log_config_t*)snapshot_current(&log->config))->threshold;
+        for (category_t* ancestor = category; ancestor; ancestor = ancestor->parent)
+        {
+            if (ancestor->threshold != LG_NO_LEVEL)
+            {
+                threshold = ancestor->threshold;
+                break;
+            }
+        }
+        LG_ATOMIC_STORE(&category->effective, (uint64_t)threshold);
+    }
+}
@@ -0,0 +1,102 @@
+/*
+ * File: category.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains categories, the named child loggers of a log.
+ * A category shares the handlers and formatters of its log but has a
+ * threshold of its own, so that a subsystem can be made more or less
+ * verbose than the rest of the application without a log of its own.
+ * Categories form a hierarchy with dotted names: a category created
+ * under "db" with the name "pool" is called "db.pool", and unless it
+ * has a threshold of its own it inherits the threshold of "db", which
+ * in turn inherits the threshold of the log.
+ *
+ * The effective threshold of every category is resolved whenever a
+ * threshold changes and cached in the category, so checking whether
+ * a category is enabled is a single atomic load and a comparison and
+ * the write path takes no locks, see LG_CATEGORY_ENABLED.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_CATEGORY_H
+#define LG_CATEGORY_H
+
+#include "log.h"
+#include "thread.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct category_s
+{
+    log_t*             log;
+
+    /* The parent category, or NULL if the parent is the log itself. */
+    struct category_s* parent;
+
+    /* The categories of a log are linked through this. */
+    struct category_s* next;
+
+    /* The full dotted name. */
+    char               name[LG_MAX_CATEGORY_NAME_SIZE];
+
+    /* The threshold of the category, or LG_NO_LEVEL if it is
+    inherited from the parent. */
+    LG_LEVEL           threshold;
+
+    /* The resolved threshold, accessed atomically. */
+    uint64_t           effective;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool               is_dynamic;
+} category_t;
+
+/* Evaluates to true if entries of the level pass the threshold of the
+category. */
+#define LG_CATEGORY_ENABLED(category, level) \
+    ((uint64_t)(level) >= LG_ATOMIC_LOAD(&(category)->effective))
+
+/* Creates a category of log called name under parent, or directly
+under the log if parent is NULL. Returns NULL if the full name is too
+long. */
+category_t* category_init(category_t* buffer,
+                          log_t* log,
+                          category_t* parent,
+                          const char* name);
+
+/* Removes the category from its log. The categories under it must be
+freed first. */
+void category_free(category_t* category);
+
+/* Returns the category of log with the full dotted name, or NULL. */
+category_t* category_find(log_t* log, const char* name);
+
+/* Sets the threshold of the category and the categories under it that
+inherit it. LG_NO_LEVEL makes the category inherit the threshold of its
+parent again. */
+bool category_set_threshold(category_t* category, LG_LEVEL threshold);
+
+LG_LEVEL category_threshold(category_t* category);
+
+/* Returns the threshold the entries of the category are filtered by. */
+LG_LEVEL category_effective_threshold(category_t* category);
+
+bool category_enabled(category_t* category, LG_LEVEL level);
+
+/* Writes message to the log of the category if it passes the threshold
+of the category. */
+bool category_write(category_t* category, LG_LEVEL level, const char* message);
+
+/* Like category_write, with key-value pairs, see log_writekv. */
+bool category_writekv(category_t* category,
+                      LG_LEVEL level,
+                      const char* message,
+                      const kv_t* kvs,
+                      size_t kv_count);
+
+/* Resolves and caches the effective thresholds of all categories of
+log. The config lock of the log must be held. */
+void category_resolve_all(log_t* log);
+
+#endif /* LG_CATEGORY_H */
@@ -0,0 +1,385 @@
+/*
+ * File: compress.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "alloc.h"
+#include "compress.h"
+#include "macros.h"
+#include "os.h"
+#include "thread.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LG_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#define LG_COMPRESS_CHUNK_SIZE 65536
+
+#ifdef LG_USE_ZLIB
+/* A log file written in compressed form. */
+typedef struct
+{
+    gzFile file;
+
+    /* The descriptor of the file. Owned by file. */
+    int    fd;
+
+    /* The amount of uncompressed data after which the compressed
+    block is flushed in the file. */
+    size_t block_size;
+
+    /* The amount of uncompressed data written since the last flush. */
+    size_t pending_size;
+} LG_gz_t;
+#endif
+
+/* A file waiting to be compressed. */
+typedef struct LG_cjob_s
+{
+    /* The path of the log file the job's file was rotated out of. */
+    char              base_path[LG_MAX_FPATH_SIZE];
+
+    /* The current rotation index of the file. Updated by
+    LG_compressor_shift. */
+    size_t            index;
+
+    struct LG_cjob_s* next;
+} LG_cjob_t;
+
+/* The state of the background worker. */
+static LG_mutex_t  LG_cmp_mutex;
+static LG_cond_t   LG_cmp_cond;
+static LG_thread_t LG_cmp_thread;
+static LG_cjob_t*  LG_cmp_head = NULL;
+static LG_cjob_t*  LG_cmp_tail = NULL;
+static LG_cjob_t*  LG_cmp_active = NULL;
+static bool        LG_cmp_is_initialized = false;
+static bool        LG_cmp_is_running = false;
+
+static void LG_compressor_init(void)
+{
+    /* Called before any background thread exists, so there is
+    nothing to race with. */
+    if (!LG_cmp_is_initialized)
+    {
+        LG_mutex_init(&LG_cmp_mutex);
+        LG_cond_init(&LG_cmp_cond);
+        LG_cmp_is_initialized = true;
+    }
+}
+
+#ifdef LG_USE_ZLIB
+/* Writes the path of the file job refers to in dest of the given size. */
+static void LG_cjob_path(const LG_cjob_t* job,
+                         char* dest,
+                         size_t size,
+                         bool compressed)
+{
+    snprintf(dest, size, "%s.%u%s", job->base_path, (unsigned)job->index,
+             compressed ? LG_COMPRESSED_EXT : "");
+}
+
+/* Copies everything in src into dst. */
+static bool LG_compress_stream(FILE* src, gzFile dst)
+{
+    char* chunk = LG_alloc(LG_COMPRESS_CHUNK_SIZE);
+    bool success = chunk != NULL;
+    size_t read_size = 0;
+    while (success
+           && (read_size = fread(chunk, 1, LG_COMPRESS_CHUNK_SIZE, src)) > 0)
+    {
+        success = gzwrite(dst, chunk, (unsigned)read_size) == (int)read_size;
+    }
+
+    if (chunk) { LG_dealloc(chunk); }
+    return success && !ferror(src);
+}
+#endif
+
+static void LG_compressor_routine(void* arg)
+{
+#ifdef LG_USE_ZLIB
+    char path[LG_MAX_FPATH_SIZE + 32];
+
+    (void)arg;
+    LG_mutex_lock(&LG_cmp_mutex);
+    for (;;)
+    {
+        while (!LG_cmp_head && LG_cmp_is_running)
+        {
+            LG_cond_wait(&LG_cmp_cond, &LG_cmp_mutex);
+        }
+        if (!LG_cmp_head)
+        {
+            break;
+        }
+
+        LG_cmp_active = LG_cmp_head;
+        LG_cmp_head = LG_cmp_head->next;
+        if (!LG_cmp_head)
+        {
+            LG_cmp_tail = NULL;
+        }
+
+        /* The names are only stable while the lock is held, so both
+        files are opened now. Rotation may rename them while they are
+        being compressed, which is why the source is looked up again
+        by its current index before it is removed. */
+        LG_cjob_path(LG_cmp_active, path, sizeof(path), false);
+        FILE* src = fopen(path, "rb");
+        LG_cjob_path(LG_cmp_active, path, sizeof(path), true);
+        gzFile dst = src ? gzopen(path, "wb") : NULL;
+        LG_mutex_unlock(&LG_cmp_mutex);
+
+        bool success = dst && LG_compress_stream(src, dst);
+        if (dst) { success = gzclose(dst) == Z_OK && success; }
+        if (src) { fclose(src); }
+
+        /* Remove the original on success and the partial archive
+        on failure. */
+        LG_mutex_lock(&LG_cmp_mutex);
+        LG_cjob_path(LG_cmp_active, path, sizeof(path), !success);
+        if (src) { _remove_file(path); }
+        LG_dealloc(LG_cmp_active);
+        LG_cmp_active = NULL;
+        LG_cond_broadcast(&LG_cmp_cond);
+    }
+    LG_mutex_unlock(&LG_cmp_mutex);
+#else
+    (void)arg;
+#endif
+}
+
+bool LG_compression_supported(void)
+{
+#ifdef LG_USE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+bool LG_compress_file(const char* src_path, const char* dst_path)
+{
+#ifdef LG_USE_ZLIB
+    FILE* src = fopen(src_path, "rb");
+    if (!src)
+    {
+        return false;
+    }
+    gzFile dst = gzopen(dst_path, "wb");
+    if (!dst)
+    {
+        fclose(src);
+        return false;
+    }
+
+    bool success = LG_compress_stream(src, dst);
+    fclose(src);
+    return gzclose(dst) == Z_OK && success;
+#else
+    (void)src_path;
+    (void)dst_path;
+    return false;
+#endif
+}
+
+bool LG_compressor_submit(const char* base_path, size_t index)
+{
+    if (!LG_compression_supported())
+    {
+        return false;
+    }
+
+    LG_cjob_t* job = LG_alloc(sizeof(LG_cjob_t));
+    if (!job)
+    {
+        return false;
+    }
+    snprintf(job->base_path, sizeof(job->base_path), "%s", base_path);
+    job->index = index;
+    job->next = NULL;
+
+    if (!LG_cmp_is_running)
+    {
+        LG_cmp_is_running = LG_thread_create(&LG_cmp_thread,
+                                             LG_compressor_routine,
+                                             NULL);
+        if (!LG_cmp_is_running)
+        {
+            LG_dealloc(job);
+            return false;
+        }
+        atexit(LG_compressor_stop);
+    }
+
+    if (LG_cmp_tail)
+    {
+        LG_cmp_tail->next = job;
+    }
+    else
+    {
+        LG_cmp_head = job;
+    }
+    LG_cmp_tail = job;
+    LG_cond_broadcast(&LG_cmp_cond);
+    return true;
+}
+
+void LG_compressor_shift(const char* base_path)
+{
+    for (LG_cjob_t* job = LG_cmp_head; job; job = job->next)
+    {
+        if (strcmp(job->base_path, base_path) == 0)
+        {
+            ++job->index;
+        }
+    }
+    if (LG_cmp_active && strcmp(LG_cmp_active->base_path, base_path) == 0)
+    {
+        ++LG_cmp_active->index;
+    }
+}
+
+void LG_compressor_lock(void)
+{
+    LG_compressor_init();
+    LG_mutex_lock(&LG_cmp_mutex);
+}
+
+void LG_compressor_unlock(void)
+{
+    LG_mutex_unlock(&LG_cmp_mutex);
+}
+
+void LG_compressor_wait(void)
+{
+    if (!LG_cmp_is_initialized)
+    {
+        return;
+    }
+    LG_mutex_lock(&LG_cmp_mutex);
+    while (LG_cmp_head || LG_cmp_active)
+    {
+        LG_cond_wait(&LG_cmp_cond, &LG_cmp_mutex);
+    }
+    LG_mutex_unlock(&LG_cmp_mutex);
+}
+
+void LG_compressor_stop(void)
+{
+    if (!LG_cmp_is_initialized)
+    {
+        return;
+    }
+    LG_mutex_lock(&LG_cmp_mutex);
+    bool was_running = LG_cmp_is_running;
+    LG_cmp_is_running = false;
+    LG_cond_broadcast(&LG_cmp_cond);
+    LG_mutex_unlock(&LG_cmp_mutex);
+
+    if (was_running)
+    {
+        /* The worker drains the queue before it exits. */
+        LG_thread_join(&LG_cmp_thread);
+    }
+}
+
+void* LG_gz_open(const char* path, const char* mode, size_t bsize)
+{
+#ifdef LG_USE_ZLIB
+    LG_gz_t* gz = LG_alloc(sizeof(LG_gz_t));
+    if (!gz)
+    {
+        return NULL;
+    }
+    bool is_append = mode[0] == 'a';
+    gz->fd = _open_shared_file(path, !is_append);
+    gz->file = gz->fd >= 0 ? gzdopen(gz->fd, is_append ? "ab" : "wb") : NULL;
+    if (!gz->file)
+    {
+        if (gz->fd >= 0) { _close_shared_file(gz->fd); }
+        LG_dealloc(gz);
+        return NULL;
+    }
+    gz->block_size = bsize > 0 ? bsize : 1;
+    gz->pending_size = 0;
+    return gz;
+#else
+    (void)path;
+    (void)mode;
+    (void)bsize;
+    return NULL;
+#endif
+}
+
+bool LG_gz_write(void* gz, const char* data, size_t size)
+{
+#ifdef LG_USE_ZLIB
+    LG_gz_t* stream = gz;
+    if (gzwrite(stream->file, data, (unsigned)size) != (int)size)
+    {
+        return false;
+    }
+    stream->pending_size += size;
+    if (stream->pending_size >= stream->block_size)
+    {
+        return LG_gz_flush(gz);
+    }
+    return true;
+#else
+    (void)gz;
+    (void)data;
+    (void)size;
+    return false;
+#endif
+}
+
+bool LG_gz_flush(void* gz)
+{
+#ifdef LG_USE_ZLIB
+    LG_gz_t* stream = gz;
+    stream->pending_size = 0;
+    return gzflush(stream->file, Z_SYNC_FLUSH) == Z_OK;
+#else
+    (void)gz;
+    return false;
+#endif
+}
+
+size_t LG_gz_size(void* gz)
+{
+#ifdef LG_USE_ZLIB
+    z_off_t offset = gzoffset(((LG_gz_t*)gz)->file);
+    return offset < 0 ? 0 : (size_t)offset;
+#else
+    (void)gz;
+    return 0;
+#endif
+}
+
+int LG_gz_fd(void* gz)
+{
+#ifdef LG_USE_ZLIB
+    return ((LG_gz_t*)gz)->fd;
+#else
+    (void)gz;
+    return -1;
+#endif
+}
+
+void LG_gz_close(void* gz)
+{
+#ifdef LG_USE_ZLIB
+    gzclose(((LG_gz_t*)gz)->file);
+    LG_dealloc(gz);
+#else
+    (void)gz;
+#endif
+}
@@ -0,0 +1,77 @@
+/*
+ * File: compress.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains gzip compression of log files.
+ * Compression requires zlib and is only available when
+ * LG_USE_ZLIB has been defined (see flags.h). Without it
+ * every function in this module reports failure.
+ *
+ * Files that are rotated out are compressed by a background
+ * worker so that the thread writing in the log is not slowed
+ * down. The worker compresses <base>.<n> into <base>.<n>.gz
+ * and removes the original. Because rotation keeps renaming
+ * files while the worker runs, the rotating side must hold the
+ * compressor lock while it shifts the file names and report
+ * the shift with LG_compressor_shift.
+ *
+ * Log files can also be written in compressed form directly,
+ * see the LG_gz_* functions below.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_COMPRESS_H
+#define LG_COMPRESS_H
+
+#include "flags.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* The extension of compressed log files. */
+#define LG_COMPRESSED_EXT ".gz"
+
+/* Returns true if the library was built with compression support. */
+bool LG_compression_supported(void);
+
+/* Compresses the file in src_path into a new gzip file in dst_path. */
+bool LG_compress_file(const char* src_path, const char* dst_path);
+
+/* Queues <base_path>.<index> to be compressed by the background
+worker. The caller must hold the compressor lock. */
+bool LG_compressor_submit(const char* base_path, size_t index);
+
+/* Must be called (with the compressor lock held) after every file
+rotated out of base_path has been shifted up by one index. */
+void LG_compressor_shift(const char* base_path);
+
+void LG_compressor_lock(void);
+
+void LG_compressor_unlock(void);
+
+/* Blocks until every queued file has been compressed. */
+void LG_compressor_wait(void);
+
+/* Finishes the queued work and stops the background worker. */
+void LG_compressor_stop(void);
+
+/* Opens a gzip stream in path. Mode is "w" or "a" as in fopen.
+Data is compressed in blocks: every time bsize bytes of uncompressed
+data have been written, the compressed block is flushed in the file.
+A crash therefore loses at most one block. */
+void* LG_gz_open(const char* path, const char* mode, size_t bsize);
+
+bool LG_gz_write(void* gz, const char* data, size_t size);
+
+bool LG_gz_flush(void* gz);
+
+/* Returns the number of compressed bytes flushed in the file so far. */
+size_t LG_gz_size(void* gz);
+
+/* Returns the file descriptor the stream writes in. */
+int LG_gz_fd(void* gz);
+
+void LG_gz_close(void* gz);
+
+#endif /* LG_COMPRESS_H */
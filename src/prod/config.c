@@ -0,0 +1,1004 @@
+/*
+ * File: config.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+/* Exposes sigaction. */
+#define _GNU_SOURCE
+
+#include "alloc.h"
+#include "config.h"
+#include "thread.h"
+#include <ctype.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef LG_USE_WINAPI
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+/* The maximum number of settings in a configuration. */
+#define LG_MAX_CONFIG_SETTINGS 512
+
+typedef enum {
+    LG_CONF_BOOL,
+    LG_CONF_LEVEL,
+    LG_CONF_ENUM,
+    LG_CONF_FORMAT,
+    LG_CONF_SIZE,
+    LG_CONF_UINT,
+    /* A number, optionally followed by a slash and another number. */
+    LG_CONF_PAIR,
+    /* A time mode, or an offset from UTC that stands for the fixed
+    mode. */
+    LG_CONF_TMODE
+} LG_CONF_TYPE;
+
+typedef enum {
+    LG_CK_THRESHOLD,
+    LG_CK_RING_DUMP_LEVEL,
+    LG_CK_SYNC_THRESHOLD,
+    LG_CK_ENABLED,
+    LG_CK_ENTRY_FORMAT,
+    LG_CK_EMODE,
+    LG_CK_TMODE,
+    LG_CK_FILE,
+    LG_CK_STDOUT,
+    LG_CK_STDERR,
+    LG_CK_FLOCK,
+    LG_CK_PREALLOC,
+    LG_CK_URING,
+    LG_CK_TBUF,
+    LG_CK_TBUF_MERGE,
+    LG_CK_CRASH_FLUSH,
+    LG_CK_DEDUP,
+    LG_CK_TIMING,
+    LG_CK_DNAME_FORMAT,
+    LG_CK_FNAME_FORMAT,
+    LG_CK_BMODE,
+    LG_CK_FMODE,
+    LG_CK_CMODE,
+    LG_CK_DMODE,
+    LG_CK_MAX_FSIZE,
+    LG_CK_BSIZE,
+    LG_CK_RING,
+    LG_CK_TBUF_TIMEOUT,
+    LG_CK_DEDUP_TIMEOUT,
+    LG_CK_SAMPLING,
+    LG_CK_RATE_LIMIT,
+    LG_CK_SYNC_INTERVAL
+} LG_CONF_KEY;
+
+typedef struct {
+    const char*        name;
+    LG_CONF_KEY        id;
+    LG_CONF_TYPE       type;
+
+    /* Indicates whether the setting applies to the log rather than
+    to levels. */
+    bool               is_global;
+
+    /* For LG_CONF_ENUM, the names of the values, terminated by NULL,
+    and the value of each name. */
+    const char* const* names;
+    const int*         codes;
+} conf_key_t;
+
+/* A setting that is applied to the handlers of levels. */
+typedef struct {
+    const conf_key_t* key;
+
+    /* The levels the setting applies to, one bit per level. */
+    uint32_t          levels;
+
+    uint64_t          value;
+    uint64_t          value2;
+    const char*       str;
+} conf_setting_t;
+
+static const char* const LG_CONF_LEVEL_NAMES[LG_VALID_LVL_COUNT + 1] =
+{ "trace", "debug", "info", "notice", "warning",
+  "error", "critical", "alert", "emergency", "fatal", NULL };
+static const int LG_CONF_LEVEL_CODES[LG_VALID_LVL_COUNT] =
+{ LG_TRACE, LG_DEBUG, LG_INFO, LG_NOTICE, LG_WARNING,
+  LG_ERROR, LG_CRITICAL, LG_ALERT, LG_EMERGENCY, LG_FATAL };
+
+static const char* const LG_CONF_BOOL_NAMES[] =
+{ "true", "on", "yes", "1", "false", "off", "no", "0", NULL };
+static const int LG_CONF_BOOL_CODES[] =
+{ 1, 1, 1, 1, 0, 0, 0, 0 };
+
+static const char* const LG_CONF_EMODE_NAMES[] =
+{ "text", "json", "logfmt", NULL };
+static const int LG_CONF_EMODE_CODES[] =
+{ LG_EMODE_TEXT, LG_EMODE_JSON, LG_EMODE_LOGFMT };
+
+static const char* const LG_CONF_TMODE_NAMES[] =
+{ "local", "utc", "fixed", NULL };
+static const int LG_CONF_TMODE_CODES[] =
+{ LG_TMODE_LOCAL, LG_TMODE_UTC, LG_TMODE_FIXED };
+
+static const char* const LG_CONF_BMODE_NAMES[] =
+{ "none", "line", "full", NULL };
+static const int LG_CONF_BMODE_CODES[] =
+{ _IONBF, _IOLBF, _IOFBF };
+
+static const char* const LG_CONF_FMODE_NAMES[] =
+{ "manual", "rewrite", "rotate", NULL };
+static const int LG_CONF_FMODE_CODES[] =
+{ LG_FMODE_MANUAL, LG_FMODE_REWRITE, LG_FMODE_ROTATE };
+
+static const char* const LG_CONF_CMODE_NAMES[] =
+{ "none", "rotated", "inline", NULL };
+static const int LG_CONF_CMODE_CODES[] =
+{ LG_CMODE_NONE, LG_CMODE_ROTATED, LG_CMODE_INLINE };
+
+static const char* const LG_CONF_DMODE_NAMES[] =
+{ "none", "periodic", "sync", NULL };
+static const int LG_CONF_DMODE_CODES[] =
+{ LG_DMODE_NONE, LG_DMODE_PERIODIC, LG_DMODE_SYNC };
+
+#define LG_CONF_LEVEL_ENUM LG_CONF_LEVEL_NAMES, LG_CONF_LEVEL_CODES
+#define LG_CONF_BOOL_ENUM LG_CONF_BOOL_NAMES, LG_CONF_BOOL_CODES
+
+static const conf_key_t LG_CONF_KEYS[] =
+{
+    { "threshold",       LG_CK_THRESHOLD,       LG_CONF_LEVEL,  true,  LG_CONF_LEVEL_ENUM },
+    { "ring_dump_level", LG_CK_RING_DUMP_LEVEL, LG_CONF_LEVEL,  true,  LG_CONF_LEVEL_ENUM },
+    { "sync_threshold",  LG_CK_SYNC_THRESHOLD,  LG_CONF_LEVEL,  true,  LG_CONF_LEVEL_ENUM },
+    { "enabled",         LG_CK_ENABLED,         LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "entry_format",    LG_CK_ENTRY_FORMAT,    LG_CONF_FORMAT, false, NULL, NULL },
+    { "emode",           LG_CK_EMODE,           LG_CONF_ENUM,   false, LG_CONF_EMODE_NAMES,
+                                                                       LG_CONF_EMODE_CODES },
+    { "tmode",           LG_CK_TMODE,           LG_CONF_TMODE,  false, LG_CONF_TMODE_NAMES,
+                                                                       LG_CONF_TMODE_CODES },
+    { "file",            LG_CK_FILE,            LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "stdout",          LG_CK_STDOUT,          LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "stderr",          LG_CK_STDERR,          LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "flock",           LG_CK_FLOCK,           LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "prealloc",        LG_CK_PREALLOC,        LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "uring",           LG_CK_URING,           LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "tbuf",            LG_CK_TBUF,            LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "tbuf_merge",      LG_CK_TBUF_MERGE,      LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "crash_flush",     LG_CK_CRASH_FLUSH,     LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "dedup",           LG_CK_DEDUP,           LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "timing",          LG_CK_TIMING,          LG_CONF_BOOL,   false, LG_CONF_BOOL_ENUM },
+    { "dname_format",    LG_CK_DNAME_FORMAT,    LG_CONF_FORMAT, false, NULL, NULL },
+    { "fname_format",    LG_CK_FNAME_FORMAT,    LG_CONF_FORMAT, false, NULL, NULL },
+    { "bmode",           LG_CK_BMODE,           LG_CONF_ENUM,   false, LG_CONF_BMODE_NAMES,
+                                                                       LG_CONF_BMODE_CODES },
+    { "fmode",           LG_CK_FMODE,           LG_CONF_ENUM,   false, LG_CONF_FMODE_NAMES,
+                                                                       LG_CONF_FMODE_CODES },
+    { "cmode",           LG_CK_CMODE,           LG_CONF_ENUM,   false, LG_CONF_CMODE_NAMES,
+                                                                       LG_CONF_CMODE_CODES },
+    { "dmode",           LG_CK_DMODE,           LG_CONF_ENUM,   false, LG_CONF_DMODE_NAMES,
+                                                                       LG_CONF_DMODE_CODES },
+    { "max_fsize",       LG_CK_MAX_FSIZE,       LG_CONF_SIZE,   false, NULL, NULL },
+    { "bsize",           LG_CK_BSIZE,           LG_CONF_SIZE,   false, NULL, NULL },
+    { "ring",            LG_CK_RING,            LG_CONF_SIZE,   false, NULL, NULL },
+    { "tbuf_timeout",    LG_CK_TBUF_TIMEOUT,    LG_CONF_UINT,   false, NULL, NULL },
+    { "dedup_timeout",   LG_CK_DEDUP_TIMEOUT,   LG_CONF_UINT,   false, NULL, NULL },
+    { "sampling",        LG_CK_SAMPLING,        LG_CONF_UINT,   false, NULL, NULL },
+    { "rate_limit",      LG_CK_RATE_LIMIT,      LG_CONF_PAIR,   false, NULL, NULL },
+    { "sync_interval",   LG_CK_SYNC_INTERVAL,   LG_CONF_PAIR,   false, NULL, NULL }
+};
+#define LG_CONF_KEY_COUNT (sizeof(LG_CONF_KEYS) / sizeof(LG_CONF_KEYS[0]))
+
+#define LG_CONF_ALL_LEVELS ((1u << LG_VALID_LVL_COUNT) - 1)
+
+/* Compares the first len characters of str with name, ignoring case. */
+static bool _config_equals(const char* str, size_t len, const char* name)
+{
+    size_t i = 0;
+    for (; i < len && name[i] != '\0'; ++i)
+    {
+        if (tolower((unsigned char)str[i]) != name[i])
+        {
+            return false;
+        }
+    }
+    return i == len && name[i] == '\0';
+}
+
+static bool _config_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+}
+
+/* Returns the index of the name that the first len characters of str
+equal, or -1. */
+static int _config_find_name(const char* const* names, const char* str, size_t len)
+{
+    for (int i = 0; names[i]; ++i)
+    {
+        if (_config_equals(str, len, names[i]))
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Parses a non-negative number of at most max at str and stores it in
+dest. Stores the end of the number in end. */
+static bool _config_parse_number(const char* str,
+                                 const char** end,
+                                 uint64_t max,
+                                 uint64_t* dest)
+{
+    if (!isdigit((unsigned char)*str))
+    {
+        return false;
+    }
+    errno = 0;
+    unsigned long long value = strtoull(str, (char**)end, 10);
+    if (errno != 0 || value > max)
+    {
+        return false;
+    }
+    *dest = value;
+    return true;
+}
+
+/* Parses an offset from UTC of the form +HH:MM or +HH, or the same
+with a minus sign, at str and stores it in dest in seconds. */
+static bool _config_parse_offset(const char* str, uint64_t* dest)
+{
+    if (*str != '+' && *str != '-')
+    {
+        return false;
+    }
+    int64_t sign = *str == '-' ? -1 : 1;
+    const char* end = NULL;
+    uint64_t hours = 0;
+    uint64_t minutes = 0;
+    if (!_config_parse_number(str + 1, &end, 14, &hours))
+    {
+        return false;
+    }
+    if (*end == ':' && !_config_parse_number(end + 1, &end, 59, &minutes))
+    {
+        return false;
+    }
+    *dest = (uint64_t)(sign * (int64_t)(hours * 3600 + minutes * 60));
+    return *end == '\0';
+}
+
+/* Parses value as key and stores the result in setting. */
+static bool _config_parse_value(const conf_key_t* key,
+                                const char* value,
+                                conf_setting_t* setting)
+{
+    size_t len = strlen(value);
+    const char* end = NULL;
+    int index = 0;
+    unsigned shift = 0;
+    setting->str = value;
+    setting->value2 = 0;
+
+    switch (key->type)
+    {
+        case LG_CONF_BOOL:
+        case LG_CONF_LEVEL:
+        case LG_CONF_ENUM:
+            index = _config_find_name(key->names, value, len);
+            setting->value = (uint64_t)key->codes[index < 0 ? 0 : index];
+            return index >= 0;
+        case LG_CONF_FORMAT:
+            return true;
+        case LG_CONF_TMODE:
+            /* The fixed mode keeps the offset of local time at the
+            moment the setting is applied. */
+            index = _config_find_name(key->names, value, len);
+            if (index >= 0)
+            {
+                setting->value = (uint64_t)key->codes[index];
+                setting->value2 = (uint64_t)(int64_t)LG_TZ_CURRENT;
+                return true;
+            }
+            setting->value = LG_TMODE_FIXED;
+            return _config_parse_offset(value, &setting->value2);
+        case LG_CONF_SIZE:
+            if (!_config_parse_number(value, &end, SIZE_MAX, &setting->value))
+            {
+                return false;
+            }
+            switch (tolower((unsigned char)*end))
+            {
+                case 'g':
+                    shift += 10;
+                    /* Fall through. */
+                case 'm':
+                    shift += 10;
+                    /* Fall through. */
+                case 'k':
+                    shift += 10;
+                    ++end;
+                    break;
+            }
+            if (setting->value > (SIZE_MAX >> shift))
+            {
+                return false;
+            }
+            setting->value <<= shift;
+            return *end == '\0';
+        case LG_CONF_UINT:
+            if (!_config_parse_number(value, &end, UINT32_MAX, &setting->value))
+            {
+                return false;
+            }
+            if (key->id == LG_CK_TBUF_TIMEOUT && setting->value == 0)
+            {
+                return false;
+            }
+            return *end == '\0';
+        case LG_CONF_PAIR:
+            if (!_config_parse_number(value, &end, UINT32_MAX, &setting->value))
+            {
+                return false;
+            }
+            if (*end == '/')
+            {
+                if (!_config_parse_number(end + 1, &end, SIZE_MAX, &setting->value2))
+                {
+                    return false;
+                }
+            }
+            else if (key->id == LG_CK_RATE_LIMIT)
+            {
+                /* The burst defaults to one second's worth of entries. */
+                setting->value2 = setting->value;
+            }
+            if (key->id == LG_CK_SYNC_INTERVAL && setting->value == 0)
+            {
+                return false;
+            }
+            return *end == '\0';
+    }
+    return false;
+}
+
+/* Applies setting to config if it belongs to the configuration that
+the write path reads. Returns false if it makes a format invalid. */
+static bool _config_apply_entry(log_config_t* config,
+                                const conf_setting_t* setting,
+                                const char** error)
+{
+    if (setting->key->id == LG_CK_THRESHOLD)
+    {
+        config->threshold = (LG_LEVEL)setting->value;
+        return true;
+    }
+    if (setting->key->id == LG_CK_RING_DUMP_LEVEL)
+    {
+        config->ring_dump_level = (LG_LEVEL)setting->value;
+        return true;
+    }
+
+    for (size_t level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        if (!(setting->levels & (1u << level)))
+        {
+            continue;
+        }
+        formatter_t* formatter = &config->formatters[level];
+        switch (setting->key->id)
+        {
+            case LG_CK_ENABLED:
+                config->is_enabled[level] = setting->value != 0;
+                break;
+            case LG_CK_TIMING:
+                config->is_timed[level] = setting->value != 0;
+                break;
+            case LG_CK_ENTRY_FORMAT:
+                if (!formatter_set(formatter, setting->str))
+                {
+                    *error = "invalid entry format";
+                    return false;
+                }
+                break;
+            case LG_CK_EMODE:
+                /* The format is compiled for the mode once all settings
+                are in, so that the order of the two does not matter. */
+                formatter->emode = (LG_EMODE)setting->value;
+                break;
+            case LG_CK_TMODE:
+                formatter_set_tmode(formatter, (LG_TMODE)setting->value,
+                                    (int32_t)(int64_t)setting->value2);
+                break;
+            default:
+                return true;
+        }
+    }
+    return true;
+}
+
+/* Applies setting to the handlers of log. */
+static bool _config_apply_handlers(log_t* log, const conf_setting_t* setting)
+{
+    bool failed = false;
+    size_t value = (size_t)setting->value;
+    bool is_on = setting->value != 0;
+
+    if (setting->key->id == LG_CK_SYNC_THRESHOLD)
+    {
+        return log_set_sync_threshold(log, (LG_LEVEL)setting->value);
+    }
+
+    for (LG_LEVEL level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        bool success = true;
+        if (!(setting->levels & (1u << level)))
+        {
+            continue;
+        }
+        switch (setting->key->id)
+        {
+            case LG_CK_FILE:
+                success = is_on ? log_file_enable(log, level)
+                                : log_file_disable(log, level);
+                break;
+            case LG_CK_STDOUT:
+                success = is_on ? log_stdout_enable(log, level)
+                                : log_stdout_disable(log, level);
+                break;
+            case LG_CK_STDERR:
+                success = is_on ? log_stderr_enable(log, level)
+                                : log_stderr_disable(log, level);
+                break;
+            case LG_CK_FLOCK:
+                success = is_on ? log_flock_enable(log, level)
+                                : log_flock_disable(log, level);
+                break;
+            case LG_CK_PREALLOC:
+                success = is_on ? log_prealloc_enable(log, level)
+                                : log_prealloc_disable(log, level);
+                break;
+            case LG_CK_URING:
+                success = is_on ? log_uring_enable(log, level)
+                                : log_uring_disable(log, level);
+                break;
+            case LG_CK_TBUF:
+                success = is_on ? log_tbuf_enable(log, level)
+                                : log_tbuf_disable(log, level);
+                break;
+            case LG_CK_TBUF_MERGE:
+                success = is_on ? log_tbuf_merge_enable(log, level)
+                                : log_tbuf_merge_disable(log, level);
+                break;
+            case LG_CK_CRASH_FLUSH:
+                success = is_on ? log_crash_flush_enable(log, level)
+                                : log_crash_flush_disable(log, level);
+                break;
+            case LG_CK_DEDUP:
+                success = is_on ? log_dedup_enable(log, level)
+                                : log_dedup_disable(log, level);
+                break;
+            case LG_CK_TMODE:
+                success = log_set_tmode(log, level, (LG_TMODE)value,
+                                        (int32_t)(int64_t)setting->value2);
+                break;
+            case LG_CK_DNAME_FORMAT:
+                success = log_set_dname_format(log, level, setting->str);
+                break;
+            case LG_CK_FNAME_FORMAT:
+                success = log_set_fname_format(log, level, setting->str);
+                break;
+            case LG_CK_BMODE:
+                success = log_set_bmode(log, level, (int)setting->value);
+                break;
+            case LG_CK_FMODE:
+                success = log_set_fmode(log, level, (LG_FMODE)setting->value);
+                break;
+            case LG_CK_CMODE:
+                success = log_set_cmode(log, level, (LG_CMODE)setting->value);
+                break;
+            case LG_CK_DMODE:
+                success = log_set_dmode(log, level, (LG_DMODE)setting->value);
+                break;
+            case LG_CK_MAX_FSIZE:
+                success = log_set_max_fsize(log, level, value);
+                break;
+            case LG_CK_BSIZE:
+                success = log_set_bsize(log, level, value);
+                break;
+            case LG_CK_RING:
+                success = value > 0 ? log_ring_enable(log, level, value)
+                                    : log_ring_disable(log, level);
+                break;
+            case LG_CK_TBUF_TIMEOUT:
+                success = log_set_tbuf_timeout(log, level, (uint32_t)value);
+                break;
+            case LG_CK_DEDUP_TIMEOUT:
+                success = log_set_dedup_timeout(log, level, (uint32_t)value);
+                break;
+            case LG_CK_SAMPLING:
+                success = log_set_sampling(log, level, (uint32_t)value);
+                break;
+            case LG_CK_RATE_LIMIT:
+                success = log_set_rate_limit(log, level, (uint32_t)value,
+                                             (uint32_t)setting->value2);
+                break;
+            case LG_CK_SYNC_INTERVAL:
+                success = log_set_sync_interval(log, level, (uint32_t)value,
+                                                (size_t)setting->value2);
+                break;
+            default:
+                break;
+        }
+        failed = !success || failed;
+    }
+    return !failed;
+}
+
+/* Unquotes the value at str in place. Returns the value, or NULL if
+the quotes are not balanced. */
+static char* _config_unquote(char* str)
+{
+    char* src = str + 1;
+    char* dest = str;
+    while (*src != '"')
+    {
+        if (*src == '\0')
+        {
+            return NULL;
+        }
+        if (*src == '\\' && src[1] != '\0')
+        {
+            ++src;
+            *src = *src == 'n' ? '\n' : *src == 't' ? '\t' : *src;
+        }
+        *(dest++) = *(src++);
+    }
+    for (++src; _config_is_space(*src); ++src)
+    {
+    }
+    if (*src != '\0')
+    {
+        return NULL;
+    }
+    *dest = '\0';
+    return str;
+}
+
+/* Parses the line at line in place into setting. */
+static bool _config_parse_line(char* line,
+                               conf_setting_t* setting,
+                               const char** error)
+{
+    char* equals = strchr(line, '=');
+    if (!equals)
+    {
+        *error = "expected key = value";
+        return false;
+    }
+
+    /* The key, optionally prefixed with a level. */
+    char* key_end = equals;
+    while (key_end > line && _config_is_space(key_end[-1]))
+    {
+        --key_end;
+    }
+    char* name = line;
+    const char* dot = memchr(line, '.', key_end - line);
+    setting->levels = LG_CONF_ALL_LEVELS;
+    if (dot)
+    {
+        int level = _config_find_name(LG_CONF_LEVEL_NAMES, line, dot - line);
+        if (level >= 0)
+        {
+            setting->levels = 1u << level;
+        }
+        else if (!_config_equals(line, dot - line, "all"))
+        {
+            *error = "unknown level";
+            return false;
+        }
+        name = (char*)dot + 1;
+    }
+
+    setting->key = NULL;
+    for (size_t i = 0; i < LG_CONF_KEY_COUNT; ++i)
+    {
+        if (_config_equals(name, key_end - name, LG_CONF_KEYS[i].name))
+        {
+            setting->key = &LG_CONF_KEYS[i];
+            break;
+        }
+    }
+    if (!setting->key)
+    {
+        *error = "unknown setting";
+        return false;
+    }
+    if (setting->key->is_global && dot)
+    {
+        *error = "the setting does not apply to levels";
+        return false;
+    }
+
+    char* value = equals + 1;
+    while (_config_is_space(*value))
+    {
+        ++value;
+    }
+    if (*value == '"')
+    {
+        value = _config_unquote(value);
+        if (!value)
+        {
+            *error = "unbalanced quotes";
+            return false;
+        }
+    }
+    else
+    {
+        char* value_end = value + strlen(value);
+        while (value_end > value && _config_is_space(value_end[-1]))
+        {
+            --value_end;
+        }
+        *value_end = '\0';
+    }
+
+    if (!_config_parse_value(setting->key, value, setting))
+    {
+        *error = "invalid value";
+        return false;
+    }
+    if (setting->key->id == LG_CK_DNAME_FORMAT
+        || setting->key->id == LG_CK_FNAME_FORMAT)
+    {
+        formatter_t formatter;
+        if (!formatter_init(&formatter, value, LG_FORMAT_PATHS))
+        {
+            *error = "invalid path format";
+            return false;
+        }
+        formatter_free(&formatter);
+    }
+    return true;
+}
+
+/* Configures log from text, which is modified. Settings are separated
+by newlines, and also by semicolons outside quotes if semicolons is
+true. If is_reload is true, only the configuration that the write path
+reads is changed: the handlers must not be reconfigured while other
+threads may be writing through them, so their settings are validated
+but not applied. */
+static bool _config_load(log_t* log,
+                         char* text,
+                         bool semicolons,
+                         bool is_reload)
+{
+    char error_msg[LG_MAX_ERR_MSG_SIZE];
+    const char* error = NULL;
+    size_t setting_count = 0;
+    unsigned line_number = 0;
+
+    log_config_t* config = LG_alloc(sizeof(log_config_t));
+    conf_setting_t* settings =
+        LG_alloc(LG_MAX_CONFIG_SETTINGS * sizeof(conf_setting_t));
+    if (!config || !settings)
+    {
+        LG_dealloc(config);
+        LG_dealloc(settings);
+        return false;
+    }
+    log_config(log, config);
+
+    char* line = text;
+    while (line && !error)
+    {
+        /* Find the end of the line. */
+        bool is_quoted = false;
+        char* end = line;
+        while (*end != '\0' && *end != '\n'
+               && !(semicolons && *end == ';' && !is_quoted))
+        {
+            if (*end == '"' && (end == line || end[-1] != '\\'))
+            {
+                is_quoted = !is_quoted;
+            }
+            ++end;
+        }
+        char* next = *end != '\0' ? end + 1 : NULL;
+        *end = '\0';
+        ++line_number;
+
+        while (_config_is_space(*line))
+        {
+            ++line;
+        }
+        if (*line != '\0' && *line != '#')
+        {
+            conf_setting_t* setting = &settings[setting_count];
+            if (setting_count == LG_MAX_CONFIG_SETTINGS)
+            {
+                error = "too many settings";
+            }
+            else if (_config_parse_line(line, setting, &error)
+                     && _config_apply_entry(config, setting, &error))
+            {
+                ++setting_count;
+            }
+        }
+        line = next;
+    }
+
+    for (size_t level = 0; level < LG_VALID_LVL_COUNT && !error; ++level)
+    {
+        formatter_t* formatter = &config->formatters[level];
+        if (!formatter_set_emode(formatter, formatter->emode))
+        {
+            error = "an entry format is not a list of fields";
+        }
+    }
+
+    bool success = !error;
+    if (success)
+    {
+        log_set_config(log, config);
+        for (size_t i = 0; i < setting_count && !is_reload; ++i)
+        {
+            success = _config_apply_handlers(log, &settings[i]) && success;
+        }
+    }
+    else
+    {
+        snprintf(error_msg, sizeof(error_msg), "line %u: %s", line_number, error);
+        log_set_error(log, LG_E_INVALID_CONFIG, error_msg);
+    }
+    LG_dealloc(config);
+    LG_dealloc(settings);
+    return success;
+}
+
+/* Reads the file at path in a new buffer. */
+static char* _config_read_file(const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file)
+    {
+        return NULL;
+    }
+    char* text = LG_alloc(LG_MAX_CONFIG_SIZE + 1);
+    size_t size = text ? fread(text, 1, LG_MAX_CONFIG_SIZE + 1, file) : 0;
+    fclose(file);
+    if (text && size > LG_MAX_CONFIG_SIZE)
+    {
+        LG_dealloc(text);
+        return NULL;
+    }
+    if (text)
+    {
+        text[size] = '\0';
+    }
+    return text;
+}
+
+log_t* log_init_from_config(log_t* buffer, const char* path)
+{
+    log_t* log = log_init(buffer);
+    if (log && !log_load_config(log, path))
+    {
+        log_free(log);
+        return NULL;
+    }
+    return log;
+}
+
+/* Configures log from a copy of text, see _config_load. */
+static bool _config_load_str(log_t* log, const char* text, bool is_reload)
+{
+    size_t size = strlen(text);
+    char* copy = LG_alloc(size + 1);
+    if (!copy)
+    {
+        return false;
+    }
+    memcpy(copy, text, size + 1);
+    bool success = _config_load(log, copy, true, is_reload);
+    LG_dealloc(copy);
+    return success;
+}
+
+/* Configures log from the file at path or from the environment, see
+_config_load. */
+static bool _config_load_path(log_t* log, const char* path, bool is_reload)
+{
+    if (!path)
+    {
+        const char* env = getenv(LG_CONFIG_ENV);
+        return env && _config_load_str(log, env, is_reload);
+    }
+
+    char* text = _config_read_file(path);
+    if (!text)
+    {
+        log_set_error(log, LG_E_INVALID_CONFIG, "could not read the file");
+        return false;
+    }
+    bool success = _config_load(log, text, false, is_reload);
+    LG_dealloc(text);
+    return success;
+}
+
+bool log_load_config(log_t* log, const char* path)
+{
+    return _config_load_path(log, path, false);
+}
+
+bool log_load_config_str(log_t* log, const char* text)
+{
+    return _config_load_str(log, text, false);
+}
+
+#ifdef LG_USE_WINAPI
+
+bool log_reload_on_sighup(log_t* log, const char* path)
+{
+    (void)log;
+    (void)path;
+    return false;
+}
+
+void LG_config_unwatch(log_t* log)
+{
+    (void)log;
+}
+
+#else
+
+/* A log that reloads its configuration on SIGHUP. */
+typedef struct {
+    log_t* log;
+    char   path[LG_MAX_FPATH_SIZE];
+    bool   has_path;
+} LG_config_watch_t;
+
+static LG_config_watch_t LG_config_watches[LG_MAX_CONFIG_WATCHES];
+static LG_mutex_t        LG_config_mutex;
+static LG_once_t         LG_config_once = LG_ONCE_INIT;
+
+/* Indicates whether the reloading thread runs, accessed atomically. */
+static uint64_t          LG_config_is_installed = 0;
+static LG_thread_t       LG_config_thread;
+
+/* The signal handler wakes up the reloading thread through the pipe. */
+static int               LG_config_pipe[2];
+
+static void LG_config_sighup(int sig)
+{
+    int saved_errno = errno;
+    char byte = 0;
+    (void)sig;
+    if (write(LG_config_pipe[1], &byte, 1) < 0)
+    {
+        /* The pipe is full, so a reload is pending anyway. */
+    }
+    errno = saved_errno;
+}
+
+static void LG_config_routine(void* arg)
+{
+    char bytes[64];
+    (void)arg;
+    for (;;)
+    {
+        if (read(LG_config_pipe[0], bytes, sizeof(bytes)) <= 0 && errno != EINTR)
+        {
+            return;
+        }
+
+        LG_mutex_lock(&LG_config_mutex);
+        for (size_t i = 0; i < LG_MAX_CONFIG_WATCHES; ++i)
+        {
+            LG_config_watch_t* watch = &LG_config_watches[i];
+            if (watch->log)
+            {
+                _config_load_path(watch->log,
+                                  watch->has_path ? watch->path : NULL,
+                                  true);
+            }
+        }
+        LG_mutex_unlock(&LG_config_mutex);
+    }
+}
+
+static bool LG_config_install(void)
+{
+    if (pipe(LG_config_pipe) != 0)
+    {
+        return false;
+    }
+    fcntl(LG_config_pipe[1], F_SETFL, O_NONBLOCK);
+    fcntl(LG_config_pipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(LG_config_pipe[1], F_SETFD, FD_CLOEXEC);
+    if (!LG_thread_create(&LG_config_thread, LG_config_routine, NULL))
+    {
+        close(LG_config_pipe[0]);
+        close(LG_config_pipe[1]);
+        return false;
+    }
+
+    struct sigaction action;
+    action.sa_handler = LG_config_sighup;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGHUP, &action, NULL);
+    return true;
+}
+
+/* Run once, by the first log_reload_on_sighup. If the reloading thread
+cannot be started, reloading stays unavailable. */
+static void LG_config_init(void)
+{
+    LG_mutex_init(&LG_config_mutex);
+    LG_ATOMIC_STORE(&LG_config_is_installed, LG_config_install() ? 1 : 0);
+}
+
+bool log_reload_on_sighup(log_t* log, const char* path)
+{
+    if (path && strlen(path) >= LG_MAX_FPATH_SIZE)
+    {
+        return false;
+    }
+    LG_once(&LG_config_once, LG_config_init);
+    if (!LG_ATOMIC_LOAD(&LG_config_is_installed))
+    {
+        return false;
+    }
+
+    LG_mutex_lock(&LG_config_mutex);
+    LG_config_watch_t* slot = NULL;
+    for (size_t i = 0; i < LG_MAX_CONFIG_WATCHES; ++i)
+    {
+        if (LG_config_watches[i].log == log)
+        {
+            slot = &LG_config_watches[i];
+            break;
+        }
+        if (!slot && !LG_config_watches[i].log)
+        {
+            slot = &LG_config_watches[i];
+        }
+    }
+    if (slot)
+    {
+        slot->log = log;
+        slot->has_path = path != NULL;
+        if (path)
+        {
+            strcpy(slot->path, path);
+        }
+    }
+    LG_mutex_unlock(&LG_config_mutex);
+    return slot != NULL;
+}
+
+void LG_config_unwatch(log_t* log)
+{
+    if (!LG_ATOMIC_LOAD(&LG_config_is_installed))
+    {
+        return;
+    }
+
+    LG_mutex_lock(&LG_config_mutex);
+    for (size_t i = 0; i < LG_MAX_CONFIG_WATCHES; ++i)
+    {
+        if (LG_config_watches[i].log == log)
+        {
+            LG_config_watches[i].log = NULL;
+            break;
+        }
+    }
+    LG_mutex_unlock(&LG_config_mutex);
+}
+
+#endif
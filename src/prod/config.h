@@ -0,0 +1,77 @@
+/*
+ * File: config.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module configures a log from text, read from a file or from
+ * the environment variable LG_CONFIG_ENV. Every line is a setting:
+ *
+ *     # Comments start with a hash.
+ *     threshold = info
+ *     entry_format = "%(LVL) %(MSG)\n"
+ *     error.file = on
+ *     all.fname_format = app_%(year)%(month)%(mday).log
+ *     debug.enabled = no
+ *
+ * A setting without a level prefix applies to all levels, or to the
+ * log itself for threshold, ring_dump_level and sync_threshold. Values
+ * may be quoted, in which case \n, \t, \" and \\ are unescaped. In the
+ * environment variable the settings may be separated by semicolons.
+ *
+ * The whole text is parsed and validated before anything is applied,
+ * and the entry formats are compiled into a copy of the configuration
+ * of the log that is published in one step, see log_set_config. An
+ * invalid text leaves the log untouched and sets its error, with the
+ * number of the offending line in the error message.
+ *
+ * The recognized settings are: enabled, file, stdout, stderr, flock,
+ * prealloc, uring, tbuf, tbuf_merge, crash_flush, dedup, timing
+ * (booleans); entry_format, dname_format, fname_format (formats);
+ * emode (text, json, logfmt); tmode (local, utc, fixed, or an offset
+ * from UTC such as +05:30 or -08; fixed keeps the offset of local time
+ * at the moment the configuration is loaded); bmode (none, line,
+ * full); fmode (manual, rewrite, rotate); cmode (none, rotated,
+ * inline); dmode (none, periodic, sync); max_fsize, bsize, ring
+ * (sizes, optionally suffixed with K, M or G); tbuf_timeout,
+ * dedup_timeout, sampling (numbers; a tbuf_timeout of zero is
+ * invalid); rate_limit and sync_interval (a number, optionally
+ * followed by a slash and the burst or the interval size; a sync
+ * interval of zero is invalid); threshold, ring_dump_level and
+ * sync_threshold (level names).
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_CONFIG_H
+#define LG_CONFIG_H
+
+#include "log.h"
+#include <stdbool.h>
+
+/* Initializes a log like log_init and configures it from the file at
+path, or from the environment variable LG_CONFIG_ENV if path is NULL.
+Returns NULL if the configuration could not be read or is invalid. */
+log_t* log_init_from_config(log_t* buffer, const char* path);
+
+/* Configures log from the file at path, or from the environment
+variable LG_CONFIG_ENV if path is NULL. */
+bool log_load_config(log_t* log, const char* path);
+
+/* Configures log from text. */
+bool log_load_config_str(log_t* log, const char* text);
+
+/* Makes log reload its configuration from path, or from the environment
+variable LG_CONFIG_ENV if path is NULL, whenever the process receives
+SIGHUP. The reload happens in a background thread while other threads
+may be writing, so it only changes what is published in the log's
+configuration snapshot: threshold, ring_dump_level, enabled,
+entry_format, emode and tmode. The other settings are validated but
+ignored until the configuration is loaded with log_load_config. Not
+supported on Windows, where false is returned. */
+bool log_reload_on_sighup(log_t* log, const char* path);
+
+/* Stops reloading the configuration of log. Returns after any reload
+of log that is in progress has finished. */
+void LG_config_unwatch(log_t* log);
+
+#endif /* LG_CONFIG_H */
@@ -0,0 +1,162 @@
+/*
+ * File: crash.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+/* Exposes sigaction. */
+#define _GNU_SOURCE
+
+#include "crash.h"
+#include "os.h"
+#include "thread.h"
+#include <signal.h>
+#include <stdlib.h>
+
+#ifdef LG_USE_WINAPI
+typedef void (*LG_sigaction_t)(int);
+static const int LG_CRASH_SIGNALS[] = {
+    SIGSEGV, SIGABRT, SIGFPE, SIGILL
+};
+#else
+typedef struct sigaction LG_sigaction_t;
+static const int LG_CRASH_SIGNALS[] = {
+    SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL
+};
+#endif
+#define LG_CRASH_SIGNAL_COUNT \
+    (sizeof(LG_CRASH_SIGNALS) / sizeof(LG_CRASH_SIGNALS[0]))
+
+/* The registered handlers. Unused slots are NULL. */
+static handler_t* volatile LG_crash_handlers[LG_MAX_CRASH_HANDLERS];
+static LG_mutex_t          LG_crash_mutex;
+static bool                LG_crash_is_initialized = false;
+
+/* The handlers of the signals before they were installed. */
+static LG_sigaction_t      LG_crash_prev[LG_CRASH_SIGNAL_COUNT];
+
+/* Set by the first thread that catches a fatal signal. */
+static volatile sig_atomic_t LG_crash_is_crashing = 0;
+
+static void LG_crash_restore(void)
+{
+    for (size_t i = 0; i < LG_CRASH_SIGNAL_COUNT; ++i)
+    {
+#ifdef LG_USE_WINAPI
+        signal(LG_CRASH_SIGNALS[i], LG_crash_prev[i]);
+#else
+        sigaction(LG_CRASH_SIGNALS[i], &LG_crash_prev[i], NULL);
+#endif
+    }
+}
+
+static void LG_crash_routine(int sig)
+{
+    /* A signal caught while salvaging, or by another thread meanwhile,
+    goes straight to the previous handler. */
+    LG_crash_restore();
+    if (!LG_crash_is_crashing)
+    {
+        LG_crash_is_crashing = 1;
+        for (size_t i = 0; i < LG_MAX_CRASH_HANDLERS; ++i)
+        {
+            handler_t* handler = LG_crash_handlers[i];
+            if (handler)
+            {
+                handler_crash_flush(handler);
+            }
+        }
+
+        size_t size = 0;
+        const char* pending = _stream_pending(stdout, &size);
+        if (pending)
+        {
+            _write_shared_file(_stream_fd(stdout), pending, size);
+        }
+    }
+    raise(sig);
+}
+
+static void LG_crash_install(void)
+{
+    for (size_t i = 0; i < LG_CRASH_SIGNAL_COUNT; ++i)
+    {
+#ifdef LG_USE_WINAPI
+        LG_crash_prev[i] = signal(LG_CRASH_SIGNALS[i], LG_crash_routine);
+#else
+        struct sigaction action;
+        action.sa_handler = LG_crash_routine;
+        action.sa_flags = SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        sigaction(LG_CRASH_SIGNALS[i], &action, &LG_crash_prev[i]);
+#endif
+    }
+}
+
+/* Flushes the registered handlers at normal exit. */
+static void LG_crash_exit(void)
+{
+    for (size_t i = 0; i < LG_MAX_CRASH_HANDLERS; ++i)
+    {
+        LG_mutex_lock(&LG_crash_mutex);
+        handler_t* handler = LG_crash_handlers[i];
+        if (handler)
+        {
+            handler_flush(handler);
+        }
+        LG_mutex_unlock(&LG_crash_mutex);
+    }
+}
+
+bool LG_crash_register(handler_t* handler)
+{
+    if (!LG_crash_is_initialized)
+    {
+        LG_mutex_init(&LG_crash_mutex);
+        LG_crash_install();
+        atexit(LG_crash_exit);
+        LG_crash_is_initialized = true;
+    }
+
+    LG_mutex_lock(&LG_crash_mutex);
+    handler_t** slot = NULL;
+    for (size_t i = 0; i < LG_MAX_CRASH_HANDLERS; ++i)
+    {
+        if (LG_crash_handlers[i] == handler)
+        {
+            LG_mutex_unlock(&LG_crash_mutex);
+            return true;
+        }
+        if (!slot && !LG_crash_handlers[i])
+        {
+            slot = (handler_t**)&LG_crash_handlers[i];
+        }
+    }
+    if (slot)
+    {
+        *slot = handler;
+    }
+    LG_mutex_unlock(&LG_crash_mutex);
+    return slot != NULL;
+}
+
+void LG_crash_unregister(handler_t* handler)
+{
+    if (!LG_crash_is_initialized)
+    {
+        return;
+    }
+
+    LG_mutex_lock(&LG_crash_mutex);
+    for (size_t i = 0; i < LG_MAX_CRASH_HANDLERS; ++i)
+    {
+        if (LG_crash_handlers[i] == handler)
+        {
+            LG_crash_handlers[i] = NULL;
+            break;
+        }
+    }
+    LG_mutex_unlock(&LG_crash_mutex);
+}
@@ -0,0 +1,34 @@
+/*
+ * File: crash.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module salvages the buffered data of handlers when the
+ * process dies. On the first registration it installs handlers
+ * for SIGSEGV, SIGABRT, SIGBUS, SIGFPE and SIGILL that write out
+ * the data of every registered handler with handler_crash_flush,
+ * restore the previous handlers of the signals and raise the
+ * signal again. At normal exit the registered handlers are
+ * flushed with handler_flush instead.
+ *
+ * The registry has room for LG_MAX_CRASH_HANDLERS handlers. It
+ * is a fixed array, so that a signal handler can walk it while
+ * another thread registers a handler.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_CRASH_H
+#define LG_CRASH_H
+
+#include "handler.h"
+#include <stdbool.h>
+
+/* Starts flushing handler when the process dies. Returns false if the
+registry is full. */
+bool LG_crash_register(handler_t* handler);
+
+/* Stops flushing handler when the process dies. */
+void LG_crash_unregister(handler_t* handler);
+
+#endif /* LG_CRASH_H */
@@ -0,0 +1,115 @@
+/*
+ * File: dedup.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "alloc.h"
+#include "dedup.h"
+#include "macros.h"
+#include "os.h"
+
+dedup_t* dedup_init(dedup_t* buffer)
+{
+    dedup_t* dedup = buffer;
+    if (!dedup)
+    {
+        dedup = LG_alloc(sizeof(dedup_t));
+        if (!dedup)
+        {
+            return NULL;
+        }
+        dedup->is_dynamic = true;
+    }
+    else
+    {
+        dedup->is_dynamic = false;
+    }
+
+    LG_mutex_init(&dedup->lock);
+    dedup->timeout_ms = LG_DEF_DEDUP_TIMEOUT_MS;
+    dedup->hash = 0;
+    dedup->has_hash = false;
+    dedup->repeats = 0;
+    dedup->report_time = 0;
+    dedup->is_enabled = false;
+
+    return dedup;
+}
+
+void dedup_free(dedup_t* dedup)
+{
+    LG_mutex_free(&dedup->lock);
+    if (dedup->is_dynamic)
+    {
+        LG_dealloc(dedup);
+    }
+}
+
+void dedup_enable(dedup_t* dedup)
+{
+    LG_mutex_lock(&dedup->lock);
+    dedup->has_hash = false;
+    dedup->repeats = 0;
+    dedup->is_enabled = true;
+    LG_mutex_unlock(&dedup->lock);
+}
+
+void dedup_disable(dedup_t* dedup)
+{
+    LG_mutex_lock(&dedup->lock);
+    dedup->is_enabled = false;
+    LG_mutex_unlock(&dedup->lock);
+}
+
+bool dedup_enabled(dedup_t* dedup)
+{
+    return dedup->is_enabled;
+}
+
+void dedup_set_timeout(dedup_t* dedup, uint32_t timeout_ms)
+{
+    dedup->timeout_ms = timeout_ms;
+}
+
+bool dedup_check(dedup_t* dedup, uint64_t hash, uint64_t* repeats)
+{
+    *repeats = 0;
+    if (!dedup->is_enabled)
+    {
+        return true;
+    }
+
+    uint64_t now = _monotonic_time_ns();
+    bool is_new = true;
+    LG_mutex_lock(&dedup->lock);
+    if (dedup->has_hash && dedup->hash == hash)
+    {
+        ++dedup->repeats;
+        is_new = false;
+        if (now < dedup->report_time)
+        {
+            LG_mutex_unlock(&dedup->lock);
+            return false;
+        }
+    }
+
+    *repeats = dedup->repeats;
+    dedup->repeats = 0;
+    dedup->hash = hash;
+    dedup->has_hash = true;
+    dedup->report_time = now + (uint64_t)dedup->timeout_ms * 1000000;
+    LG_mutex_unlock(&dedup->lock);
+    return is_new;
+}
+
+uint64_t dedup_take(dedup_t* dedup)
+{
+    LG_mutex_lock(&dedup->lock);
+    uint64_t repeats = dedup->repeats;
+    dedup->repeats = 0;
+    LG_mutex_unlock(&dedup->lock);
+    return repeats;
+}
@@ -0,0 +1,69 @@
+/*
+ * File: dedup.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains the duplicate detector that the log uses
+ * to collapse runs of identical entries. Messages are compared by
+ * a hash computed before formatting, so that a repeated message
+ * is neither formatted nor written: only the first message of a
+ * run is, and the number of repetitions is reported when the run
+ * ends, when the run has gone on for the timeout, or when the
+ * pending count is taken with dedup_take.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_DEDUP_H
+#define LG_DEDUP_H
+
+#include "thread.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    /* Serializes checks. */
+    LG_mutex_t lock;
+
+    /* The longest time in milliseconds a run goes unreported. */
+    uint32_t   timeout_ms;
+
+    /* The hash of the last message written, if has_hash is true. */
+    uint64_t   hash;
+    bool       has_hash;
+
+    /* The number of repetitions of the last message not reported yet. */
+    uint64_t   repeats;
+
+    /* The time by which the repetitions are reported at the latest. */
+    uint64_t   report_time;
+
+    bool       is_enabled;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool       is_dynamic;
+} dedup_t;
+
+dedup_t* dedup_init(dedup_t* buffer);
+
+void dedup_free(dedup_t* dedup);
+
+void dedup_enable(dedup_t* dedup);
+
+/* Stops collapsing messages. The repetitions not reported yet must be
+taken with dedup_take first. */
+void dedup_disable(dedup_t* dedup);
+
+bool dedup_enabled(dedup_t* dedup);
+
+void dedup_set_timeout(dedup_t* dedup, uint32_t timeout_ms);
+
+/* Returns true if the message with the given hash should be written,
+or false if it repeats the last one. Stores the number of repetitions
+that should be reported before the message, or zero, in repeats. */
+bool dedup_check(dedup_t* dedup, uint64_t hash, uint64_t* repeats);
+
+/* Returns the number of repetitions not reported yet and resets it. */
+uint64_t dedup_take(dedup_t* dedup);
+
+#endif /* LG_DEDUP_H */
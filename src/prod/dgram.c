@@ -0,0 +1,297 @@
+/*
+ * File: dgram.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+/* Exposes sendmmsg. */
+#define _GNU_SOURCE
+
+#include "alloc.h"
+#include "dgram.h"
+#include "os.h"
+#include "thread.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#ifndef LG_USE_WINAPI
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+static bool _dgram_sink_write(void* ctx, const sink_entry_t* entries, size_t count);
+static void _dgram_sink_close(void* ctx);
+
+const sink_vtable_t LG_DGRAM_SINK = { _dgram_sink_write, NULL, _dgram_sink_close };
+
+/* The syslog severities of the levels, from LG_TRACE to LG_FATAL. */
+static const int _LG_SEVERITIES[LG_VALID_LVL_COUNT] = {
+    7, 7, 6, 5, 4, 3, 2, 1, 0, 0
+};
+
+int dgram_severity(LG_LEVEL level)
+{
+    return _LG_SEVERITIES[level];
+}
+
+uint64_t dgram_dropped(dgram_t* dgram)
+{
+    return LG_ATOMIC_LOAD(&dgram->dropped);
+}
+
+#ifdef LG_USE_WINAPI
+
+dgram_t* dgram_init(dgram_t* buffer,
+                    LG_DGRAM_PROTO proto,
+                    const char* path,
+                    LG_LEVEL level,
+                    const char* ident)
+{
+    return NULL;
+}
+
+void dgram_free(dgram_t* dgram)
+{
+}
+
+bool dgram_send(dgram_t* dgram, const sink_entry_t* entries, size_t count)
+{
+    return false;
+}
+
+#else
+
+static bool _dgram_connect(dgram_t* dgram);
+static bool _dgram_send_all(dgram_t* dgram, struct mmsghdr* msgs, size_t count);
+
+dgram_t* dgram_init(dgram_t* buffer,
+                    LG_DGRAM_PROTO proto,
+                    const char* path,
+                    LG_LEVEL level,
+                    const char* ident)
+{
+    if (!path)
+    {
+        path = proto == LG_DGRAM_JOURNALD ? LG_JOURNALD_PATH : LG_SYSLOG_PATH;
+    }
+    if (!ident)
+    {
+        ident = LG_DEF_DGRAM_IDENT;
+    }
+    if (strlen(path) >= sizeof(((struct sockaddr_un*)0)->sun_path))
+    {
+        return NULL;
+    }
+
+    dgram_t* dgram = buffer;
+    if (!dgram)
+    {
+        dgram = LG_alloc(sizeof(dgram_t));
+        if (!dgram)
+        {
+            return NULL;
+        }
+        dgram->is_dynamic = true;
+    }
+    else
+    {
+        dgram->is_dynamic = false;
+    }
+
+    dgram->proto = proto;
+    strcpy(dgram->path, path);
+
+    int len;
+    if (proto == LG_DGRAM_JOURNALD)
+    {
+        len = snprintf(dgram->header,
+                       LG_MAX_DGRAM_HEADER_SIZE,
+                       "PRIORITY=%d\nSYSLOG_IDENTIFIER=%s\nSYSLOG_PID=%ld\nMESSAGE\n",
+                       dgram_severity(level),
+                       ident,
+                       (long)getpid());
+    }
+    else
+    {
+        len = snprintf(dgram->header,
+                       LG_MAX_DGRAM_HEADER_SIZE,
+                       "<%d>%s[%ld]: ",
+                       LG_DGRAM_FACILITY * 8 + dgram_severity(level),
+                       ident,
+                       (long)getpid());
+    }
+    if (len < 0 || len >= LG_MAX_DGRAM_HEADER_SIZE)
+    {
+        if (dgram->is_dynamic)
+        {
+            LG_dealloc(dgram);
+        }
+        return NULL;
+    }
+    dgram->header_len = (size_t)len;
+
+    dgram->fd = -1;
+    dgram->dropped = 0;
+    _dgram_connect(dgram);
+    return dgram;
+}
+
+void dgram_free(dgram_t* dgram)
+{
+    if (dgram->fd >= 0)
+    {
+        close(dgram->fd);
+    }
+    if (dgram->is_dynamic)
+    {
+        LG_dealloc(dgram);
+    }
+}
+
+bool dgram_send(dgram_t* dgram, const sink_entry_t* entries, size_t count)
+{
+    struct mmsghdr msgs[LG_MAX_DGRAM_BATCH];
+    struct iovec iovs[LG_MAX_DGRAM_BATCH][4];
+    /* The little-endian lengths of the binary journald messages. */
+    uint8_t lens[LG_MAX_DGRAM_BATCH][8];
+
+    bool failed = false;
+    size_t n = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const char* data = entries[i].data;
+        size_t size = entries[i].size;
+        while (size > 0 && (data[size - 1] == '\n' || data[size - 1] == '\r'))
+        {
+            --size;
+        }
+
+        struct iovec* iov = iovs[n];
+        size_t iov_count = 0;
+        iov[iov_count].iov_base = dgram->header;
+        iov[iov_count++].iov_len = dgram->header_len;
+        if (dgram->proto == LG_DGRAM_JOURNALD)
+        {
+            for (size_t b = 0; b < 8; ++b)
+            {
+                lens[n][b] = (uint8_t)((uint64_t)size >> (8 * b));
+            }
+            iov[iov_count].iov_base = lens[n];
+            iov[iov_count++].iov_len = 8;
+        }
+        iov[iov_count].iov_base = (void*)data;
+        iov[iov_count++].iov_len = size;
+        if (dgram->proto == LG_DGRAM_JOURNALD)
+        {
+            iov[iov_count].iov_base = "\n";
+            iov[iov_count++].iov_len = 1;
+        }
+
+        memset(&msgs[n], 0, sizeof(struct mmsghdr));
+        msgs[n].msg_hdr.msg_iov = iov;
+        msgs[n].msg_hdr.msg_iovlen = iov_count;
+        if (++n == LG_MAX_DGRAM_BATCH)
+        {
+            failed = !_dgram_send_all(dgram, msgs, n) || failed;
+            n = 0;
+        }
+    }
+    if (n > 0)
+    {
+        failed = !_dgram_send_all(dgram, msgs, n) || failed;
+    }
+    return !failed;
+}
+
+bool _dgram_connect(dgram_t* dgram)
+{
+    if (dgram->fd >= 0)
+    {
+        close(dgram->fd);
+    }
+    dgram->fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (dgram->fd < 0)
+    {
+        return false;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, dgram->path);
+    if (connect(dgram->fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(dgram->fd);
+        dgram->fd = -1;
+        return false;
+    }
+    return true;
+}
+
+/* Sends the messages, connecting the socket again once if the
+receiver has gone away. The messages that do not fit in the socket
+buffer are dropped. */
+bool _dgram_send_all(dgram_t* dgram, struct mmsghdr* msgs, size_t count)
+{
+    bool has_reconnected = false;
+    if (dgram->fd < 0)
+    {
+        has_reconnected = true;
+        if (!_dgram_connect(dgram))
+        {
+            return false;
+        }
+    }
+
+    size_t sent = 0;
+    while (sent < count)
+    {
+#ifdef __linux__
+        int result = sendmmsg(dgram->fd, msgs + sent, count - sent, MSG_DONTWAIT);
+#else
+        int result = sendmsg(dgram->fd, &msgs[sent].msg_hdr, MSG_DONTWAIT) < 0 ? -1 : 1;
+#endif
+        if (result > 0)
+        {
+            sent += (size_t)result;
+            continue;
+        }
+        if (result < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            /* The receiver is not keeping up. Waiting for it would
+            hold up every writer of the handler. */
+            LG_ATOMIC_ADD(&dgram->dropped, count - sent);
+            return false;
+        }
+        bool is_gone = result < 0
+                       && (errno == ECONNREFUSED
+                           || errno == ENOTCONN
+                           || errno == ENOENT);
+        if (!is_gone || has_reconnected || !_dgram_connect(dgram))
+        {
+            return false;
+        }
+        has_reconnected = true;
+    }
+    return true;
+}
+
+#endif /* LG_USE_WINAPI */
+
+bool _dgram_sink_write(void* ctx, const sink_entry_t* entries, size_t count)
+{
+    return dgram_send((dgram_t*)ctx, entries, count);
+}
+
+void _dgram_sink_close(void* ctx)
+{
+    dgram_free((dgram_t*)ctx);
+}
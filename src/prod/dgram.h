@@ -0,0 +1,87 @@
+/*
+ * File: dgram.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains a sink that sends entries to a local datagram
+ * socket, either to the syslog daemon or to journald using its native
+ * protocol. Every entry becomes one datagram with the severity of the
+ * level it was written at. A batch of entries is sent with a single
+ * sendmmsg call where it is available.
+ *
+ * The module is only available on POSIX systems. The socket path can
+ * be anything, so the sink can also be pointed at a socket of the
+ * application's own, such as a test receiver.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_DGRAM_H
+#define LG_DGRAM_H
+
+#include "log_level.h"
+#include "macros.h"
+#include "sink.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    /* RFC 3164 messages as the local syslog daemon expects them:
+    "<PRI>IDENT[PID]: MSG". */
+    LG_DGRAM_SYSLOG = 0,
+    /* Journald's native protocol, with the message as a binary field
+    so that it may contain newlines. */
+    LG_DGRAM_JOURNALD
+} LG_DGRAM_PROTO;
+
+typedef struct {
+    /* The connected socket, or -1 if it could not be connected. */
+    int            fd;
+
+    LG_DGRAM_PROTO proto;
+
+    char           path[LG_MAX_FPATH_SIZE];
+
+    /* The part of the datagram before the message. It is the same
+    for every entry. */
+    char           header[LG_MAX_DGRAM_HEADER_SIZE];
+    size_t         header_len;
+
+    /* The number of entries dropped because the socket buffer was
+    full, accessed atomically. */
+    uint64_t       dropped;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool           is_dynamic;
+} dgram_t;
+
+/* A sink that writes in the dgram_t given as the context and frees it
+when closed. */
+extern const sink_vtable_t LG_DGRAM_SINK;
+
+/* Connects a socket to path, or to the default path of the protocol if
+path is NULL. The entries are sent with the syslog severity that
+corresponds to level, and the identifier ident, or LG_DEF_DGRAM_IDENT
+if ident is NULL. The daemon does not need to be running yet: the
+socket is connected again when a send fails. */
+dgram_t* dgram_init(dgram_t* buffer,
+                    LG_DGRAM_PROTO proto,
+                    const char* path,
+                    LG_LEVEL level,
+                    const char* ident);
+
+void dgram_free(dgram_t* dgram);
+
+/* Sends every entry as a datagram of its own. Trailing newlines of the
+entries are not sent. The send never blocks: the entries that do not
+fit in the socket buffer are dropped, and false is returned. */
+bool dgram_send(dgram_t* dgram, const sink_entry_t* entries, size_t count);
+
+/* The number of entries dropped because the receiver did not keep up. */
+uint64_t dgram_dropped(dgram_t* dgram);
+
+/* Returns the syslog severity of a level. */
+int dgram_severity(LG_LEVEL level);
+
+#endif /* LG_DGRAM_H */
@@ -14,7 +14,8 @@
 #define LG_ERROR_H
 
 typedef enum {
-    LG_E_NO_ERROR = 0
+    LG_E_NO_ERROR = 0,
+    LG_E_INVALID_CONFIG
 } LG_ERRNO;
 
 #endif /* LG_ERROR_H */
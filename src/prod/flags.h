@@ -1,4 +1,22 @@
+/*
+ * File: flags.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains compile-time switches for optional
+ * features that depend on third-party libraries. The switches
+ * can be defined here or on the compiler command line.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
 #ifndef FLAGS_H
 #define FLAGS_H
 
+/* Enables gzip compression of log files. Requires zlib. */
+/* #define LG_USE_ZLIB */
+
+/* Enables the io_uring file output backend. Linux only. */
+/* #define LG_USE_IO_URING */
+
 #endif /* FLAGS_H */
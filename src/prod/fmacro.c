@@ -27,5 +27,13 @@ const fm_info_t _FM_TABLE[LG_FM_COUNT] =
     { LG_FM_LVL_N_S,     LG_FM_LVL_MAX_LEN     },
     { LG_FM_LVL_F_S,     LG_FM_LVL_MAX_LEN     },
     { LG_FM_LVL_A_S,     LG_FM_LVL_MAX_LEN     },
-    { LG_FM_MSG_S,       LG_FM_MSG_MAX_LEN     }
+    { LG_FM_MSG_S,       LG_FM_MSG_MAX_LEN     },
+    { LG_FM_TID_S,       LG_FM_TID_MAX_LEN     },
+    { LG_FM_PID_S,       LG_FM_PID_MAX_LEN     },
+    { LG_FM_HOST_S,      LG_FM_HOST_MAX_LEN    },
+    { LG_FM_SEQ_S,       LG_FM_SEQ_MAX_LEN     },
+    { LG_FM_THREAD_NAME_S, LG_FM_THREAD_NAME_MAX_LEN },
+    { LG_FM_FILE_S,      LG_FM_FILE_MAX_LEN    },
+    { LG_FM_LINE_S,      LG_FM_LINE_MAX_LEN    },
+    { LG_FM_FUNC_S,      LG_FM_FUNC_MAX_LEN    }
 };
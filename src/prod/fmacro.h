@@ -25,6 +25,7 @@
 
 #include "macros.h"
 #include <stddef.h>
+#include <stdint.h>
 
 typedef enum
 {
@@ -52,12 +53,24 @@ typedef enum
     LG_FM_LVL_N, /* "trace" */
     LG_FM_LVL_F, /* "Trace" */
     LG_FM_LVL_A, /* "TRACE" */
-    LG_FM_MSG /* "\nThis Is Some Weird Log_message\n\n" */
+    LG_FM_MSG, /* "\nThis Is Some Weird Log_message\n\n" */
+    LG_FM_TID, /* "3", see LG_thread_id */
+    LG_FM_PID, /* "4711" */
+    LG_FM_HOST, /* "buildhost" */
+    LG_FM_SEQ, /* "1234", the number of entries written in the log before */
+    LG_FM_THREAD_NAME, /* "worker", or the thread ID if the thread has no name */
+    LG_FM_FILE, /* "main.c", the file name of the call site without directories */
+    LG_FM_LINE, /* "42" */
+    LG_FM_FUNC /* "main" */
 } LG_FM_ID;
 /* Because the valid macros values start from 1 (above)
 the last macro in the list gives the number of
 valid format macros. */
-#define LG_FM_COUNT LG_FM_MSG
+#define LG_FM_COUNT LG_FM_FUNC
+
+/* The macros that expand to parts of the time, as a mask of 1 << id. */
+#define LG_FM_TIME_MACROS (((uint64_t)1 << (LG_FM_WDAY_L_A + 1)) \
+                           - ((uint64_t)1 << LG_FM_YEAR))
 
 /* Every format macro must begin with this character.
 This character CAN be used normally, however -
@@ -79,7 +92,7 @@ typedef struct
     LG_FM_ID    id;
 } fm_info_t;
 
-const fm_info_t _FM_TABLE[LG_FM_COUNT];
+extern const fm_info_t _FM_TABLE[LG_FM_COUNT];
 
 /* The body of each macro. */
 #define LG_FM_YEAR_S "year"
@@ -112,6 +125,22 @@ const fm_info_t _FM_TABLE[LG_FM_COUNT];
 #define LG_FM_LVL_MAX_LEN 9 /* strlen("EMERGENCY") */
 #define LG_FM_MSG_S "MSG"
 #define LG_FM_MSG_MAX_LEN LG_MAX_MSG_SIZE
+#define LG_FM_TID_S "tid"
+#define LG_FM_TID_MAX_LEN 20 /* UINT64_MAX */
+#define LG_FM_PID_S "pid"
+#define LG_FM_PID_MAX_LEN 20
+#define LG_FM_HOST_S "host"
+#define LG_FM_HOST_MAX_LEN (LG_MAX_HOST_SIZE - 1)
+#define LG_FM_SEQ_S "seq"
+#define LG_FM_SEQ_MAX_LEN 20
+#define LG_FM_THREAD_NAME_S "thread_name"
+#define LG_FM_THREAD_NAME_MAX_LEN (LG_MAX_THREAD_NAME_SIZE - 1)
+#define LG_FM_FILE_S "file"
+#define LG_FM_FILE_MAX_LEN 64
+#define LG_FM_LINE_S "line"
+#define LG_FM_LINE_MAX_LEN 10
+#define LG_FM_FUNC_S "func"
+#define LG_FM_FUNC_MAX_LEN 64
 
 /* The maximum length of a format macro
 in the unexpanded form. */
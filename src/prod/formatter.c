@@ -9,7 +9,10 @@
 #include "alloc.h"
 #include "fmacro.h"
 #include "formatter.h"
+#include "os.h"
 #include "string_util.h"
+#include "thread.h"
+#include "tz.h"
 #include <assert.h>
 #include <string.h>
 #include <stdio.h>
@@ -18,19 +21,44 @@ static const char* const MONTHS[12] =
 { "JANUARY", "FEBRUARY", "MARCH", "APRIL", "MAY", "JUNE",
   "JULY", "AUGUST", "SEPTEMBER", "OCTOBER", "NOVEMBER", "DECEMBER" };
 
-/* Starts from Sunday because in the struct tm returned by localtime()
-tm_day value of 0 equals Sunday. */
+/* Starts from Sunday because in struct tm a tm_wday value of 0 equals
+Sunday. */
 static const char* const WEEKDAYS[7] =
 { "SUNDAY", "MONDAY", "TUESDAY", "WEDNESDAY",
   "THURSDAY", "FRIDAY", "SATURDAY" };
 
+/* The arguments of the entry being formatted. */
+typedef struct {
+    const char* msg;
+    size_t      msg_len;
+    LG_LEVEL    lvl;
+    const kv_t* kvs;
+    size_t      kv_count;
+
+    /* The time the time macros are expanded with. */
+    const struct tm* time;
+
+    const fm_meta_t* meta;
+} fm_entry_t;
+
+/* The process ID and the host name, rendered once by the first
+formatter_init so that expanding them is a copy. The process ID is
+rendered again in the child after a fork. The state is 0 before
+rendering, 1 during it and 2 after it. */
+static char     LG_fm_pid[LG_FM_PID_MAX_LEN + 1];
+static size_t   LG_fm_pid_len = 0;
+static char     LG_fm_host[LG_MAX_HOST_SIZE];
+static size_t   LG_fm_host_len = 0;
+static uint64_t LG_fm_process_state = 0;
+
+/* The ID of the calling thread, rendered on first use. */
+static LG_THREAD_LOCAL char   LG_fm_tid[LG_FM_TID_MAX_LEN + 1];
+static LG_THREAD_LOCAL size_t LG_fm_tid_len = 0;
+
 static size_t _formatter_expand_fm(const formatter_t* formatter,
                                    char* dest,
                                    LG_FM_ID fm,
-                                   const char* msg,
-                                   LG_LEVEL lvl);
-
-static void _formatter_get_time(formatter_t* formatter);
+                                   const fm_entry_t* entry);
 
 static size_t _formatter_fm_as_str(const formatter_t* formatter,
                                    char* dest,
@@ -39,16 +67,21 @@ static size_t _formatter_fm_as_str(const formatter_t* formatter,
 static fm_info_t _formatter_recognize_fm(const formatter_t* formatter,
                                          const char* src);
 
-static char* _formatter_do_format(formatter_t* formatter,
+static char* _formatter_do_format(const formatter_t* formatter,
                                   char* dest,
-                                  const char* msg,
-                                  LG_LEVEL lvl);
+                                  const fm_entry_t* entry);
+
+static bool _formatter_compile(const formatter_t* formatter,
+                               const char* format,
+                               LG_EMODE emode,
+                               fm_field_t* fields,
+                               size_t* field_count);
 
-static char* _formatter_get_mname(const formatter_t* formatter,
+static char* _formatter_get_mname(const struct tm* time,
                                   char* dest,
                                   char* decapitalize_from);
 
-static char* _formatter_get_wday(const formatter_t* formatter,
+static char* _formatter_get_wday(const struct tm* time,
                                  char* dest,
                                  char* decapitalize_from);
 
@@ -58,6 +91,16 @@ static char* _get_lvl(LG_LEVEL lvl,
 
 bool _formatter_is_valid_format(const formatter_t* formatter, const char* format);
 
+static uint64_t _formatter_scan_macros(const formatter_t* formatter,
+                                       const char* format);
+
+static void _formatter_render_process(void);
+static void _formatter_render_pid(void);
+
+static size_t _formatter_u64(char* dest, uint64_t value);
+
+static size_t _formatter_basename(char* dest, const char* path, size_t len);
+
 formatter_t* formatter_init(formatter_t* buffer, const char* format, uint16_t flags)
 {
     formatter_t* formatter = buffer;
@@ -75,8 +118,12 @@ formatter_t* formatter_init(formatter_t* buffer, const char* format, uint16_t fl
         formatter->is_dynamic = false;
     }
 
+    _formatter_render_process();
     formatter->flags = flags;
-    memset(&(formatter->time), 0x00, sizeof(struct tm));
+    formatter->emode = LG_DEF_EMODE;
+    formatter->tmode = LG_DEF_TMODE;
+    formatter->utc_offset_s = 0;
+    formatter->field_count = 0;
     if (formatter_set(formatter, format))
     {
         return formatter;
@@ -95,42 +142,131 @@ void formatter_free(formatter_t* formatter)
 
 bool formatter_set(formatter_t* formatter, const char* format)
 {
-    if (!_formatter_is_valid_format(formatter, format))
+    fm_field_t fields[LG_MAX_FIELDS];
+    size_t field_count = 0;
+    if (!_formatter_is_valid_format(formatter, format)
+        || !_formatter_compile(formatter, format, formatter->emode,
+                               fields, &field_count))
     {
         return false;
     }
     
     strcpy(formatter->format, format);
+    memcpy(formatter->fields, fields, field_count * sizeof(fm_field_t));
+    formatter->field_count = field_count;
+    formatter->macros = _formatter_scan_macros(formatter, format);
 
     return true;
 }
 
-char* formatter_get(formatter_t* formatter, char* dest)
+bool formatter_set_emode(formatter_t* formatter, LG_EMODE mode)
+{
+    fm_field_t fields[LG_MAX_FIELDS];
+    size_t field_count = 0;
+    if (!_formatter_compile(formatter, formatter->format, mode,
+                            fields, &field_count))
+    {
+        return false;
+    }
+
+    memcpy(formatter->fields, fields, field_count * sizeof(fm_field_t));
+    formatter->field_count = field_count;
+    formatter->emode = mode;
+    return true;
+}
+
+LG_EMODE formatter_emode(const formatter_t* formatter)
+{
+    return formatter->emode;
+}
+
+bool formatter_set_tmode(formatter_t* formatter, LG_TMODE mode, int32_t offset_s)
+{
+    if (mode == LG_TMODE_FIXED && offset_s == LG_TZ_CURRENT)
+    {
+        offset_s = tz_local_offset((int64_t)time(NULL));
+    }
+    formatter->tmode = mode;
+    formatter->utc_offset_s = mode == LG_TMODE_FIXED ? offset_s : 0;
+    return true;
+}
+
+LG_TMODE formatter_tmode(const formatter_t* formatter)
+{
+    return formatter->tmode;
+}
+
+bool formatter_uses(const formatter_t* formatter, LG_FM_ID fm)
+{
+    return (formatter->macros & ((uint64_t)1 << fm)) != 0;
+}
+
+char* formatter_get(const formatter_t* formatter, char* dest)
 {
     strcpy(dest, formatter->format);
     return dest;
 }
 
-char* formatter_entry(formatter_t* formatter,
+char* formatter_entry(const formatter_t* formatter,
                    char* dest,
                    const char* msg,
                    LG_LEVEL lvl)
 {
+    fm_entry_t entry = { msg, LG_MAX_MSG_SIZE, lvl, NULL, 0, NULL, NULL };
+    assert(formatter->flags & LG_FORMAT_ENTRIES);
+    return _formatter_do_format(formatter, dest, &entry);
+}
+
+char* formatter_entry_at(const formatter_t* formatter,
+                         char* dest,
+                         const char* msg,
+                         size_t msg_len,
+                         LG_LEVEL lvl,
+                         const struct tm* time)
+{
+    fm_entry_t entry = { msg, msg_len, lvl, NULL, 0, time, NULL };
     assert(formatter->flags & LG_FORMAT_ENTRIES);
-    return _formatter_do_format(formatter, dest, msg, lvl);
+    return _formatter_do_format(formatter, dest, &entry);
 }
 
-char* formatter_path(formatter_t* formatter, char* dest)
+char* formatter_entry_kv(const formatter_t* formatter,
+                         char* dest,
+                         const char* msg,
+                         size_t msg_len,
+                         LG_LEVEL lvl,
+                         const struct tm* time,
+                         const kv_t* kvs,
+                         size_t kv_count,
+                         const fm_meta_t* meta)
 {
+    fm_entry_t entry = { msg, msg_len, lvl, kvs, kv_count, time, meta };
+    assert(formatter->flags & LG_FORMAT_ENTRIES);
+    return _formatter_do_format(formatter, dest, &entry);
+}
+
+char* formatter_path(const formatter_t* formatter, char* dest)
+{
+    fm_entry_t entry = { NULL, 0, LG_NO_LEVEL, NULL, 0, NULL, NULL };
     assert(formatter->flags & LG_FORMAT_PATHS);
-    return _formatter_do_format(formatter, dest, NULL, LG_NO_LEVEL);
+    return _formatter_do_format(formatter, dest, &entry);
 }
 
-static void _formatter_get_time(formatter_t* formatter)
+struct tm* formatter_time(const formatter_t* formatter, time_t t, struct tm* dest)
 {
-    time_t raw_time;
-    time(&raw_time);
-    memcpy(&(formatter->time), localtime(&raw_time), sizeof(struct tm));
+    switch (formatter->tmode)
+    {
+        case LG_TMODE_UTC:
+            return tz_utc((int64_t)t, dest);
+        case LG_TMODE_FIXED:
+            return tz_fixed((int64_t)t, formatter->utc_offset_s, dest);
+        default:
+            return tz_local((int64_t)t, dest);
+    }
+}
+
+struct tm* formatter_now(const formatter_t* formatter, struct tm* dest)
+{
+    return formatter_time(formatter, time(NULL), dest);
 }
 
 size_t _formatter_fm_as_str(const formatter_t* formatter, char* dest, const char* src)
@@ -180,67 +316,297 @@ static fm_info_t _formatter_recognize_fm(const formatter_t* formatter, const cha
     return fm;
 }
 
-static char* _formatter_do_format(formatter_t* formatter,
-                                  char* dest,
-                                  const char* msg,
-                                  LG_LEVEL lvl)
+/* Expands src_len characters of src in dest and null-terminates the
+result. Returns the length of the result. */
+static size_t _formatter_expand(const formatter_t* formatter,
+                                char* dest,
+                                const char* src,
+                                size_t src_len,
+                                const fm_entry_t* entry)
 {
-    _formatter_get_time(formatter);
-
     char* orig_dest = dest;
-    char* src = formatter->format;
-    char* src_fm_begin = strchr(src, LG_FM_BEGIN_INDIC);
-    while (src_fm_begin != NULL)
+    const char* src_end = src + src_len;
+    while (src < src_end)
     {
-        /* TODO Optimize */
-        while (src != src_fm_begin)
+        /* Copy the text up to the next macro at once. */
+        const char* src_fm_begin = memchr(src, LG_FM_BEGIN_INDIC, src_end - src);
+        size_t text_len = (src_fm_begin ? src_fm_begin : src_end) - src;
+        memcpy(dest, src, text_len);
+        dest += text_len;
+        src += text_len;
+        if (!src_fm_begin)
         {
-            *(dest++) = *(src++);
+            break;
         }
+
         fm_info_t fm = _formatter_recognize_fm(formatter, src_fm_begin);
-        if (fm.id != LG_FM_NO_MACRO)
+        if (fm.id != LG_FM_NO_MACRO && src + fm.len <= src_end)
         {
-            dest += _formatter_expand_fm(formatter, dest, fm.id, msg, lvl);
+            dest += _formatter_expand_fm(formatter, dest, fm.id, entry);
             src += fm.len;
         }
         else
         {
             *(dest++) = *(src++);
         }
-        src_fm_begin = strchr(src, LG_FM_BEGIN_INDIC);
     }
-    while (*src != '\0')
+    *dest = '\0';
+    return dest - orig_dest;
+}
+
+/* Writes the fields of the format and the key-value pairs of the entry
+in dest as a structured entry. */
+static char* _formatter_do_format_fields(const formatter_t* formatter,
+                                         char* dest,
+                                         const fm_entry_t* entry)
+{
+    char value[LG_MAX_ENTRY_SIZE + LG_MAX_MSG_SIZE];
+    LG_EMODE mode = formatter->emode;
+
+    /* Leave room for the closing brace, the newline and the null. */
+    char* dest_end = dest + LG_MAX_ENTRY_SIZE + LG_MAX_MSG_SIZE - 3;
+    char* pos = dest;
+    if (mode == LG_EMODE_JSON)
+    {
+        *(pos++) = '{';
+    }
+    char* fields_begin = pos;
+
+    for (size_t i = 0; i < formatter->field_count; ++i)
+    {
+        const fm_field_t* field = &formatter->fields[i];
+
+        /* A key without at least an empty value would break the
+        syntax. */
+        if (field->key_len + 2 > (size_t)(dest_end - pos))
+        {
+            break;
+        }
+        memcpy(pos, field->key, field->key_len);
+        pos += field->key_len;
+
+        size_t value_len = _formatter_expand(formatter,
+                                             value,
+                                             formatter->format + field->value_pos,
+                                             field->value_len,
+                                             entry);
+
+        /* The padding of the level names is of no use in a field. */
+        while (value_len > 0 && value[value_len - 1] == ' ')
+        {
+            --value_len;
+        }
+        pos += kv_encode_str(pos, dest_end - pos, value, value_len, mode);
+    }
+
+    for (size_t i = 0; i < entry->kv_count; ++i)
+    {
+        size_t kv_len = kv_encode(pos, dest_end - pos, &entry->kvs[i],
+                                  mode, pos == fields_begin);
+        if (kv_len == 0)
+        {
+            break;
+        }
+        pos += kv_len;
+    }
+
+    if (mode == LG_EMODE_JSON)
+    {
+        *(pos++) = '}';
+    }
+    *(pos++) = '\n';
+    *pos = '\0';
+    return dest;
+}
+
+/* Expands the format in dest. The time macros are expanded with the
+time of the entry, or with the current time if it is NULL. The formatter
+is only read, so that it can be shared by threads. */
+static char* _formatter_do_format(const formatter_t* formatter,
+                                  char* dest,
+                                  const fm_entry_t* entry)
+{
+    struct tm now;
+    fm_entry_t timed_entry = *entry;
+    if (!timed_entry.time && formatter->macros & LG_FM_TIME_MACROS)
+    {
+        timed_entry.time = formatter_now(formatter, &now);
+    }
+
+    if (formatter->emode != LG_EMODE_TEXT
+        && formatter->flags & LG_FORMAT_ENTRIES)
+    {
+        return _formatter_do_format_fields(formatter, dest, &timed_entry);
+    }
+    _formatter_expand(formatter, dest, formatter->format,
+                      strlen(formatter->format), &timed_entry);
+    return dest;
+}
+
+/* Encodes the key of a field of a structured format. */
+static bool _formatter_encode_key(fm_field_t* field,
+                                  const char* key,
+                                  size_t key_len,
+                                  LG_EMODE emode,
+                                  bool is_first)
+{
+    field->key_len = kv_encode_key(field->key, LG_MAX_FIELD_KEY_SIZE,
+                                   key, key_len, emode, is_first);
+    return field->key_len > 0;
+}
+
+/* Splits a structured format into fields. The format is a list of
+fields separated by whitespace. A field is either key=value, where value
+may contain macros, or a single macro, which is then keyed by its name
+in lowercase. */
+static bool _formatter_compile(const formatter_t* formatter,
+                               const char* format,
+                               LG_EMODE emode,
+                               fm_field_t* fields,
+                               size_t* field_count)
+{
+    *field_count = 0;
+    if (emode == LG_EMODE_TEXT || !(formatter->flags & LG_FORMAT_ENTRIES))
+    {
+        return true;
+    }
+
+    const char* pos = format;
+    for (;;)
     {
-        *(dest++) = *(src++);
+        while (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')
+        {
+            ++pos;
+        }
+        if (*pos == '\0')
+        {
+            return true;
+        }
+        if (*field_count == LG_MAX_FIELDS)
+        {
+            return false;
+        }
+
+        const char* field_end = pos;
+        while (*field_end != '\0' && *field_end != ' ' && *field_end != '\t'
+               && *field_end != '\n' && *field_end != '\r')
+        {
+            ++field_end;
+        }
+
+        fm_field_t* field = &fields[*field_count];
+        const char* equals = memchr(pos, '=', field_end - pos);
+        bool is_first = *field_count == 0;
+        if (equals && equals > pos)
+        {
+            if (!_formatter_encode_key(field, pos, equals - pos, emode, is_first))
+            {
+                return false;
+            }
+            field->value_pos = equals + 1 - format;
+            field->value_len = field_end - equals - 1;
+        }
+        else
+        {
+            char key[LG_MAX_FM_S_LEN];
+            fm_info_t fm = _formatter_recognize_fm(formatter, pos);
+            if (fm.id == LG_FM_NO_MACRO || pos + fm.len != field_end)
+            {
+                return false;
+            }
+            _formatter_fm_as_str(formatter, key, pos);
+            LG_str_to_lower(key);
+            if (!_formatter_encode_key(field, key, strlen(key), emode, is_first))
+            {
+                return false;
+            }
+            field->value_pos = pos - format;
+            field->value_len = fm.len;
+        }
+        ++*field_count;
+        pos = field_end;
     }
-    *dest = *src;
-    return orig_dest;
 }
 
 size_t _formatter_expand_fm(const formatter_t* formatter,
                             char* dest,
                             LG_FM_ID fm,
-                            const char* msg,
-                            LG_LEVEL lvl)
+                            const fm_entry_t* entry)
 {
+    LG_LEVEL lvl = entry->lvl;
     assert(fm != LG_FM_NO_MACRO);
 
+    const char* name;
+    size_t name_len;
+    switch (fm)
+    {
+        case LG_FM_THREAD_NAME:
+            name = LG_thread_name(&name_len);
+            if (name_len > 0)
+            {
+                memcpy(dest, name, name_len);
+                return name_len;
+            }
+            /* An unnamed thread is shown by its ID. */
+            /* Falls through. */
+        case LG_FM_TID:
+            if (LG_fm_tid_len == 0)
+            {
+                LG_fm_tid_len = _formatter_u64(LG_fm_tid, LG_thread_id());
+            }
+            memcpy(dest, LG_fm_tid, LG_fm_tid_len);
+            return LG_fm_tid_len;
+        case LG_FM_PID:
+            memcpy(dest, LG_fm_pid, LG_fm_pid_len);
+            return LG_fm_pid_len;
+        case LG_FM_HOST:
+            memcpy(dest, LG_fm_host, LG_fm_host_len);
+            return LG_fm_host_len;
+        case LG_FM_SEQ:
+            return _formatter_u64(dest, entry->meta ? entry->meta->seq : 0);
+        default:
+            break;
+    }
+
+    /* The source location expands to nothing if it is not known. */
+    const fm_src_t* src = entry->meta ? entry->meta->src : NULL;
+    switch (fm)
+    {
+        case LG_FM_FILE:
+            return src ? _formatter_basename(dest, src->file, src->file_len) : 0;
+        case LG_FM_LINE:
+            return src ? _formatter_u64(dest, src->line) : 0;
+        case LG_FM_FUNC:
+            if (!src)
+            {
+                return 0;
+            }
+            name_len = src->func_len < LG_FM_FUNC_MAX_LEN
+                       ? src->func_len : LG_FM_FUNC_MAX_LEN;
+            memcpy(dest, src->func, name_len);
+            return name_len;
+        default:
+            break;
+    }
+
     char format[8] = "%0*d";
 
     switch (fm)
     {
         case LG_FM_YEAR:
-            return sprintf(dest, format, 4, formatter->time.tm_year + 1900);
+            return sprintf(dest, format, 4, entry->time->tm_year + 1900);
         case LG_FM_MONTH:
-            return sprintf(dest, format, 2, formatter->time.tm_mon + 1);
+            return sprintf(dest, format, 2, entry->time->tm_mon + 1);
         case LG_FM_MDAY:
-            return sprintf(dest, format, 2, formatter->time.tm_mday);
+            return sprintf(dest, format, 2, entry->time->tm_mday);
         case LG_FM_HOUR:
-            return sprintf(dest, format, 2, formatter->time.tm_hour);
+            return sprintf(dest, format, 2, entry->time->tm_hour);
         case LG_FM_MIN:
-            return sprintf(dest, format, 2, formatter->time.tm_min);
+            return sprintf(dest, format, 2, entry->time->tm_min);
         case LG_FM_SEC:
-            return sprintf(dest, format, 2, formatter->time.tm_sec);
+            return sprintf(dest, format, 2, entry->time->tm_sec);
+        default:
+            break;
     }
 
     strcpy(format, "%.*s");
@@ -249,35 +615,35 @@ size_t _formatter_expand_fm(const formatter_t* formatter,
     switch (fm)
     {
         case LG_FM_MNAME_S_F:
-            _formatter_get_mname(formatter, source, source + 1);
+            _formatter_get_mname(entry->time, source, source + 1);
             copy_amount = LG_FM_MNAME_S_EXP_SIZE;
             break;
         case LG_FM_MNAME_S_A:
-            _formatter_get_mname(formatter, source, NULL);
+            _formatter_get_mname(entry->time, source, NULL);
             copy_amount = LG_FM_MNAME_S_EXP_SIZE;
             break;
         case LG_FM_MNAME_L_F:
-            _formatter_get_mname(formatter, source, source + 1);
+            _formatter_get_mname(entry->time, source, source + 1);
             copy_amount = LG_MAX_FM_MNAME_L_EXP_SIZE;
             break;
         case LG_FM_MNAME_L_A:
-            _formatter_get_mname(formatter, source, NULL);
+            _formatter_get_mname(entry->time, source, NULL);
             copy_amount = LG_MAX_FM_MNAME_L_EXP_SIZE;
             break;
         case LG_FM_WDAY_S_F:
-            _formatter_get_wday(formatter, source, source + 1);
+            _formatter_get_wday(entry->time, source, source + 1);
             copy_amount = LG_FM_WDAY_S_EXP_SIZE;
             break;
         case LG_FM_WDAY_S_A:
-            _formatter_get_wday(formatter, source, NULL);
+            _formatter_get_wday(entry->time, source, NULL);
             copy_amount = LG_FM_WDAY_S_EXP_SIZE;
             break;
         case LG_FM_WDAY_L_F:
-            _formatter_get_wday(formatter, source, source + 1);
+            _formatter_get_wday(entry->time, source, source + 1);
             copy_amount = LG_MAX_FM_WDAY_L_EXP_SIZE;
             break;
         case LG_FM_WDAY_L_A:
-            _formatter_get_wday(formatter, source, NULL);
+            _formatter_get_wday(entry->time, source, NULL);
             copy_amount = LG_MAX_FM_WDAY_L_EXP_SIZE;
             break;
         case LG_FM_LVL_N:
@@ -293,7 +659,28 @@ size_t _formatter_expand_fm(const formatter_t* formatter,
             copy_amount = LG_FM_LVL_MAX_LEN;
             break;
         case LG_FM_MSG:
-            return sprintf(dest, format, LG_MAX_MSG_SIZE, msg);
+            copy_amount = sprintf(dest, format,
+                                  (int)(entry->msg_len < LG_MAX_MSG_SIZE
+                                        ? entry->msg_len : LG_MAX_MSG_SIZE),
+                                  entry->msg);
+            if (formatter->emode == LG_EMODE_TEXT)
+            {
+                /* The key-value pairs follow the message in logfmt. */
+                for (size_t i = 0; i < entry->kv_count; ++i)
+                {
+                    size_t kv_len = kv_encode(dest + copy_amount,
+                                              LG_MAX_MSG_SIZE - copy_amount,
+                                              &entry->kvs[i],
+                                              LG_EMODE_LOGFMT,
+                                              copy_amount == 0);
+                    if (kv_len == 0)
+                    {
+                        break;
+                    }
+                    copy_amount += kv_len;
+                }
+            }
+            return copy_amount;
         default:
             assert(0);
     }
@@ -301,9 +688,9 @@ size_t _formatter_expand_fm(const formatter_t* formatter,
     return copy_amount;
 }
 
-char* _formatter_get_mname(const formatter_t* formatter, char* dest, char* decapitalize_from)
+char* _formatter_get_mname(const struct tm* time, char* dest, char* decapitalize_from)
 {
-    strcpy(dest, MONTHS[formatter->time.tm_mon]);
+    strcpy(dest, MONTHS[time->tm_mon]);
     if (decapitalize_from)
     {
         LG_str_to_lower(decapitalize_from);
@@ -311,9 +698,9 @@ char* _formatter_get_mname(const formatter_t* formatter, char* dest, char* decap
     return dest;
 }
 
-char* _formatter_get_wday(const formatter_t* formatter, char* dest, char* decapitalize_from)
+char* _formatter_get_wday(const struct tm* time, char* dest, char* decapitalize_from)
 {
-    strcpy(dest, WEEKDAYS[formatter->time.tm_wday]);
+    strcpy(dest, WEEKDAYS[time->tm_wday]);
     if (decapitalize_from)
     {
         LG_str_to_lower(decapitalize_from);
@@ -344,7 +731,7 @@ bool _formatter_is_valid_format(const formatter_t* formatter, const char* format
             fm_info_t fm = _formatter_recognize_fm(formatter, format);
             if (fm.id != LG_FM_NO_MACRO)
             {
-                exp_macro_len = _FM_TABLE[fm.id].len;
+                exp_macro_len = _FM_TABLE[fm.id - 1].len;
             }
             if (formatter->flags & LG_FORMAT_PATHS)
             {
@@ -354,6 +741,12 @@ bool _formatter_is_valid_format(const formatter_t* formatter, const char* format
                     case LG_FM_LVL_N:
                     case LG_FM_LVL_F:
                     case LG_FM_LVL_A:
+                    case LG_FM_TID:
+                    case LG_FM_SEQ:
+                    case LG_FM_THREAD_NAME:
+                    case LG_FM_FILE:
+                    case LG_FM_LINE:
+                    case LG_FM_FUNC:
                         return false;
                     default:
                         break;
@@ -379,3 +772,91 @@ bool _formatter_is_valid_format(const formatter_t* formatter, const char* format
 
     return false;
 }
+
+/* Returns the macros that occur in format as a mask of 1 << id. */
+uint64_t _formatter_scan_macros(const formatter_t* formatter, const char* format)
+{
+    uint64_t macros = 0;
+    const char* pos = format;
+    while ((pos = strchr(pos, LG_FM_BEGIN_INDIC)))
+    {
+        fm_info_t fm = _formatter_recognize_fm(formatter, pos);
+        if (fm.id != LG_FM_NO_MACRO)
+        {
+            macros |= (uint64_t)1 << fm.id;
+            pos += fm.len;
+        }
+        else
+        {
+            ++pos;
+        }
+    }
+    return macros;
+}
+
+void _formatter_render_process(void)
+{
+    if (LG_ATOMIC_LOAD(&LG_fm_process_state) == 2)
+    {
+        return;
+    }
+    if (!LG_ATOMIC_CAS(&LG_fm_process_state, 0, 1))
+    {
+        while (LG_ATOMIC_LOAD(&LG_fm_process_state) != 2)
+        {
+            LG_thread_yield();
+        }
+        return;
+    }
+
+    _formatter_render_pid();
+    _host_name(LG_fm_host, LG_MAX_HOST_SIZE);
+    LG_fm_host_len = strlen(LG_fm_host);
+#ifndef LG_USE_WINAPI
+    pthread_atfork(NULL, NULL, _formatter_render_pid);
+#endif
+    LG_ATOMIC_STORE(&LG_fm_process_state, 2);
+}
+
+/* Also run in the child after a fork, where the calling thread is the
+only one. */
+void _formatter_render_pid(void)
+{
+    LG_fm_pid_len = _formatter_u64(LG_fm_pid, _process_id());
+}
+
+/* Writes value in decimal in dest without a null terminator and returns
+its length. */
+size_t _formatter_u64(char* dest, uint64_t value)
+{
+    char digits[LG_FM_SEQ_MAX_LEN];
+    size_t len = 0;
+    do
+    {
+        digits[len++] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value > 0);
+    for (size_t i = 0; i < len; ++i)
+    {
+        dest[i] = digits[len - 1 - i];
+    }
+    return len;
+}
+
+/* Writes the last component of path in dest without a null terminator
+and returns its length. */
+size_t _formatter_basename(char* dest, const char* path, size_t len)
+{
+    const char* name = path + len;
+    while (name > path && name[-1] != '/' && name[-1] != '\\')
+    {
+        --name;
+    }
+    len = path + len - name;
+    if (len > LG_FM_FILE_MAX_LEN)
+    {
+        len = LG_FM_FILE_MAX_LEN;
+    }
+    memcpy(dest, name, len);
+    return len;
+}
@@ -36,8 +36,11 @@
 #ifndef LG_FORMATTER_H
 #define LG_FORMATTER_H
 
+#include "fmacro.h"
+#include "kv.h"
 #include "log_level.h"
 #include "macros.h"
+#include "policy.h"
 #include <stdbool.h>
 #include <stdint.h>
 #include <time.h>
@@ -45,26 +48,140 @@
 #define LG_FORMAT_PATHS (1 << 0)
 #define LG_FORMAT_ENTRIES (1 << 1)
 
+/* A field of a structured entry format. */
 typedef struct {
-    char      format[LG_MAX_ENTRY_SIZE];
-    struct tm time;
-    uint16_t  flags;
-    bool      is_dynamic;
+    /* The key encoded for the entry mode, preceded by the separator
+    from the previous field. */
+    char       key[LG_MAX_FIELD_KEY_SIZE];
+    size_t     key_len;
+
+    /* The position and the length of the value in the format. */
+    size_t     value_pos;
+    size_t     value_len;
+} fm_field_t;
+
+/* The name of the source file being compiled, without directories if
+the compiler can strip them. */
+#ifdef __FILE_NAME__
+#define LG_FILE_NAME __FILE_NAME__
+#else
+#define LG_FILE_NAME __FILE__
+#endif
+
+/* The source location of an entry. The strings are not copied, so
+they must outlive the entry, like the literals that LG_SRC refers
+to. The directories of file are stripped when it is expanded. */
+typedef struct {
+    const char* file;
+    size_t      file_len;
+    unsigned    line;
+    const char* func;
+    size_t      func_len;
+} fm_src_t;
+
+/* The source location of the call site. The lengths of the strings
+are known at compile time. */
+#define LG_SRC (&(const fm_src_t){ LG_FILE_NAME, sizeof(LG_FILE_NAME) - 1, \
+                                   __LINE__, __func__, sizeof(__func__) - 1 })
+
+/* The properties of an entry that are not given by the caller. */
+typedef struct {
+    /* The sequence number of the entry in its log. */
+    uint64_t        seq;
+
+    /* The source location of the entry, or NULL if not known. */
+    const fm_src_t* src;
+} fm_meta_t;
+
+typedef struct {
+    char       format[LG_MAX_ENTRY_SIZE];
+
+    /* Bit 1 << id is set for every macro that occurs in the format. */
+    uint64_t   macros;
+
+    /* Entry mode. One of: TEXT, JSON, LOGFMT. */
+    LG_EMODE   emode;
+
+    /* Time mode. One of: LOCAL, UTC, FIXED. */
+    LG_TMODE   tmode;
+
+    /* In LG_TMODE_FIXED mode, the offset from UTC in seconds. */
+    int32_t    utc_offset_s;
+
+    /* In JSON and LOGFMT modes, the format split into fields. */
+    fm_field_t fields[LG_MAX_FIELDS];
+    size_t     field_count;
+
+    uint16_t   flags;
+    bool       is_dynamic;
 } formatter_t;
 
 formatter_t* formatter_init(formatter_t* buffer, const char* format, uint16_t flags);
 
 bool formatter_set(formatter_t* formatter, const char* format);
 
-char* formatter_get(formatter_t* formatter, char* dest);
+char* formatter_get(const formatter_t* formatter, char* dest);
+
+/* Sets the syntax of the entries. In LG_EMODE_JSON and LG_EMODE_LOGFMT
+modes the entry format is a list of fields separated by whitespace,
+each either key=value, where the value may contain macros, or a single
+macro that is keyed by its name in lowercase, e.g. "%(LVL)" is the same
+as "lvl=%(LVL)". The keys are encoded when the format is set. Returns
+false if the format is not a valid list of fields. */
+bool formatter_set_emode(formatter_t* formatter, LG_EMODE mode);
+
+LG_EMODE formatter_emode(const formatter_t* formatter);
+
+/* Sets the time zone of the time macros. In LG_TMODE_FIXED mode the
+time is offset_s seconds east of UTC, or the offset of local time at
+the moment of the call if offset_s is LG_TZ_CURRENT. offset_s is
+ignored in other modes. */
+bool formatter_set_tmode(formatter_t* formatter, LG_TMODE mode, int32_t offset_s);
 
-char* formatter_path(formatter_t* formatter, char* dest);
+LG_TMODE formatter_tmode(const formatter_t* formatter);
 
-char* formatter_entry(formatter_t* formatter,
+/* Returns true if the macro occurs in the format, so that the values
+only it needs can be left uncomputed otherwise. */
+bool formatter_uses(const formatter_t* formatter, LG_FM_ID fm);
+
+char* formatter_path(const formatter_t* formatter, char* dest);
+
+char* formatter_entry(const formatter_t* formatter,
                       char* dest,
                       const char* msg,
                       LG_LEVEL level);
 
+/* Like formatter_entry, but the message is at most msg_len characters
+long and the time macros are expanded with time instead of the current
+time. Lets many entries be formatted with one reading of the clock. */
+char* formatter_entry_at(const formatter_t* formatter,
+                         char* dest,
+                         const char* msg,
+                         size_t msg_len,
+                         LG_LEVEL level,
+                         const struct tm* time);
+
+/* Like formatter_entry_at, but with key-value pairs and the metadata
+of the entry. In LG_EMODE_TEXT mode the pairs are appended to the
+message in logfmt, otherwise they follow the fields of the format.
+time and meta may be NULL. */
+char* formatter_entry_kv(const formatter_t* formatter,
+                         char* dest,
+                         const char* msg,
+                         size_t msg_len,
+                         LG_LEVEL level,
+                         const struct tm* time,
+                         const kv_t* kvs,
+                         size_t kv_count,
+                         const fm_meta_t* meta);
+
+/* Writes the calendar time of t in the time zone of the formatter in
+dest. */
+struct tm* formatter_time(const formatter_t* formatter, time_t t, struct tm* dest);
+
+/* Writes the current time in the time zone of the formatter in dest. */
+struct tm* formatter_now(const formatter_t* formatter, struct tm* dest);
+
 void formatter_free(formatter_t* formatter);
 
 #endif /* LG_FORMATTER_H */
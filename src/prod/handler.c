@@ -7,24 +7,66 @@
  */
 
 #include "alloc.h"
+#include "compress.h"
+#include "crash.h"
 #include "flags.h"
 #include "handler.h"
 #include "macros.h"
 #include "os.h"
 #include "string_util.h"
+#include "syncer.h"
+#include "tbuf.h"
 #include <assert.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
 
-static bool   _handler_stdout_write(handler_t* handler, const char* data_out);
-static bool   _handler_stderr_write(handler_t* handler, const char* data_out);
-static bool   _handler_file_write  (handler_t* handler, const char* data_out);
+static void   _handler_output      (handler_t* handler,
+                                    const char* data,
+                                    size_t size);
+static void   _handler_unlock      (handler_t* handler);
+static bool   _handler_stdout_write(handler_t* handler,
+                                    const char* data,
+                                    size_t size);
+static bool   _handler_stderr_write(handler_t* handler,
+                                    const char* data,
+                                    size_t size);
+static bool   _handler_file_write  (handler_t* handler,
+                                    const char* data,
+                                    size_t size);
 static void   _handler_refresh_path(handler_t* handler);
-static bool   _rotate_files        (const char* abs_filepath);
+static bool   _rotate_files        (const char* abs_filepath, LG_CMODE cmode);
 static void   _handler_deploy_file (handler_t* handler);
 static void   _handler_close_file  (handler_t* handler);
 static fpos_t _handler_file_size   (handler_t* handler);
+static bool   _handler_shared_write(handler_t* handler,
+                                    const char* data,
+                                    size_t size);
+static bool   _handler_shared_flush(handler_t* handler);
+static bool   _handler_shared_commit(handler_t* handler,
+                                     const char* data,
+                                     size_t size);
+static bool   _handler_shared_open (handler_t* handler, bool truncate);
+static void   _handler_shared_close(handler_t* handler);
+static int    _handler_flush_file  (handler_t* handler);
+static bool   _handler_sync_file   (handler_t* handler);
+static void   _handler_preallocate (handler_t* handler, int fd);
+static void   _handler_trim_file   (handler_t* handler, int fd);
+static bool   _handler_stream_write(handler_t* handler,
+                                    const char* data,
+                                    size_t size);
+static bool   _handler_uring_write (handler_t* handler,
+                                    const char* data,
+                                    size_t size);
+static void   _handler_uring_submit(handler_t* handler);
+static bool   _handler_uring_open  (handler_t* handler);
+static void   _handler_uring_close (handler_t* handler);
+static bool   _handler_tbuf_write  (handler_t* handler,
+                                    const char* data,
+                                    size_t size);
+static void   _handler_tbuf_drain  (handler_t* handler, tbuf_t* buf);
+static bool   _handler_update_syncer(handler_t* handler);
+static bool   _handler_sinks_submit(handler_t* handler, bool flush);
 
 /* Allocates and initializes a new handler_t object and returns
 a pointer to it. */
@@ -47,13 +89,37 @@ handler_t* handler_init(handler_t* buffer, LG_LEVEL level)
     }
 
     /* Finish initialization. */
+    LG_mutex_init(&handler->lock);
     formatter_init(&handler->dname_formatter, "", LG_FORMAT_PATHS);
     formatter_init(&handler->fname_formatter, "", LG_FORMAT_PATHS);
 
     handler->bmode = _IOFBF;
     handler->fstream = NULL;
+    handler->gzstream = NULL;
+    handler->fd = -1;
+    handler->lock_fd = -1;
+    handler->batch_size = 0;
+    handler->uring = NULL;
+    handler->uring_data = NULL;
+    handler->uring_buf = -1;
+    handler->uring_len = 0;
     handler->bsize = LG_DEF_BSIZE;
     handler->fmode = LG_FMODE_NONE;
+    handler->cmode = LG_DEF_CMODE;
+    handler->dmode = LG_DEF_DMODE;
+    handler->sync_interval_ms = LG_DEF_SYNC_INTERVAL_MS;
+    handler->sync_interval_size = LG_DEF_SYNC_INTERVAL_SIZE;
+    handler->unsynced_size = 0;
+    handler->has_requested_sync = false;
+    handler->tbufs = NULL;
+    handler->tbuf_timeout_ms = LG_DEF_TBUF_TIMEOUT_MS;
+    handler->is_tbuf_merge_enabled = false;
+    stats_init(&handler->stats);
+    handler->ring = NULL;
+    handler->sink_count = 0;
+    handler->dgram = NULL;
+    handler->net = NULL;
+    handler->is_crash_flush_enabled = false;
     handler->has_file_changed = false;
     handler->is_file_creator = false;
     handler->is_dir_creator = false;
@@ -61,12 +127,21 @@ handler_t* handler_init(handler_t* buffer, LG_LEVEL level)
     handler->max_fsize = LG_DEF_MAX_FSIZE;
     handler->curr_fsize = 0;
     handler->flags = 0;
+    handler->level = level;
     handler->is_enabled = true;
     handler->is_strict_time_enabled = false;
     handler->is_flock_enabled = false;
+    handler->is_prealloc_enabled = false;
+    handler->is_file_preallocated = false;
     handler->is_file_enabled = false;
     handler->is_stdout_enabled = false;
     handler->is_stderr_enabled = false;
+    handler->is_user_output_enabled = false;
+    handler->user_output = NULL;
+    handler->user_batch_vtable.write = NULL;
+    handler->user_batch_vtable.flush = NULL;
+    handler->user_batch_vtable.close = NULL;
+    sink_init(&handler->user_batch, NULL, NULL);
     handler->curr_fname[0] = '\0';
     handler->curr_dname[0] = '\0';
     handler->curr_fpath[0] = '\0';
@@ -79,9 +154,38 @@ handler_t* handler_init(handler_t* buffer, LG_LEVEL level)
 /* Frees the memory reserved for handler and its sub-objects. */
 void handler_free(handler_t* handler)
 {
+    LG_syncer_unregister(handler);
+    LG_crash_unregister(handler);
+    if (handler->tbufs)
+    {
+        _handler_tbuf_drain(handler, NULL);
+        tbuf_pool_free(handler->tbufs);
+    }
+    if (handler->ring)
+    {
+        ring_free(handler->ring);
+    }
+    for (size_t i = 0; i < handler->sink_count; ++i)
+    {
+        sink_free(handler->sinks[i]);
+    }
+    if (handler->user_batch.vtable)
+    {
+        sink_free(&handler->user_batch);
+    }
     formatter_free(&handler->dname_formatter);
     formatter_free(&handler->fname_formatter);
-    if (handler->fstream) { fclose(handler->fstream); }
+    if (handler->fstream)
+    {
+        fflush(handler->fstream);
+        _handler_trim_file(handler, _stream_fd(handler->fstream));
+        fclose(handler->fstream);
+    }
+    if (handler->gzstream) { LG_gz_close(handler->gzstream); }
+    if (handler->is_flock_enabled) { _handler_shared_flush(handler); }
+    else if (handler->uring) { _handler_uring_close(handler); }
+    _handler_shared_close(handler);
+    LG_mutex_free(&handler->lock);
 
     if (handler->is_dynamic)
     {
@@ -104,6 +208,127 @@ bool handler_enabled(handler_t* handler)
     return handler->is_enabled;
 }
 
+sink_t* handler_sink_attach(handler_t* handler,
+                            const sink_vtable_t* vtable,
+                            void* ctx)
+{
+    sink_t* sink = sink_init(NULL, vtable, ctx);
+    if (!sink)
+    {
+        return NULL;
+    }
+
+    LG_mutex_lock(&handler->lock);
+    bool is_full = handler->sink_count == LG_MAX_SINKS;
+    if (!is_full)
+    {
+        handler->sinks[handler->sink_count++] = sink;
+    }
+    LG_mutex_unlock(&handler->lock);
+
+    if (is_full)
+    {
+        /* Not sink_free: ctx still belongs to the caller and must not
+        be closed. */
+        LG_dealloc(sink);
+        return NULL;
+    }
+    return sink;
+}
+
+bool handler_sink_detach(handler_t* handler,
+                         const sink_vtable_t* vtable,
+                         void* ctx)
+{
+    sink_t* sink = NULL;
+    LG_mutex_lock(&handler->lock);
+    for (size_t i = 0; i < handler->sink_count; ++i)
+    {
+        if (handler->sinks[i]->vtable == vtable && handler->sinks[i]->ctx == ctx)
+        {
+            sink = handler->sinks[i];
+            handler->sinks[i] = handler->sinks[--handler->sink_count];
+            break;
+        }
+    }
+    if (sink)
+    {
+        sink_free(sink);
+    }
+    LG_mutex_unlock(&handler->lock);
+    return sink != NULL;
+}
+
+size_t handler_sink_count(handler_t* handler)
+{
+    return handler->sink_count;
+}
+
+bool handler_dgram_enable(handler_t* handler,
+                          LG_DGRAM_PROTO proto,
+                          const char* path,
+                          const char* ident)
+{
+    handler_dgram_disable(handler);
+    dgram_t* dgram = dgram_init(NULL, proto, path, handler->level, ident);
+    if (!dgram)
+    {
+        return false;
+    }
+    if (!handler_sink_attach(handler, &LG_DGRAM_SINK, dgram))
+    {
+        dgram_free(dgram);
+        return false;
+    }
+    handler->dgram = dgram;
+    return true;
+}
+
+bool handler_dgram_disable(handler_t* handler)
+{
+    if (!handler->dgram)
+    {
+        return true;
+    }
+    bool success = handler_sink_detach(handler, &LG_DGRAM_SINK, handler->dgram);
+    handler->dgram = NULL;
+    return success;
+}
+
+bool handler_dgram_enabled(handler_t* handler)
+{
+    return handler->dgram != NULL;
+}
+
+bool handler_net_enable(handler_t* handler, net_t* net)
+{
+    handler_net_disable(handler);
+    net_retain(net);
+    if (!handler_sink_attach(handler, &LG_NET_SINK, net))
+    {
+        net_release(net);
+        return false;
+    }
+    handler->net = net;
+    return true;
+}
+
+bool handler_net_disable(handler_t* handler)
+{
+    if (!handler->net)
+    {
+        return true;
+    }
+    bool success = handler_sink_detach(handler, &LG_NET_SINK, handler->net);
+    handler->net = NULL;
+    return success;
+}
+
+bool handler_net_enabled(handler_t* handler)
+{
+    return handler->net != NULL;
+}
+
 bool handler_user_output_register(handler_t* handler,
                                   bool (*user_output)(const char*))
 {
@@ -111,6 +336,26 @@ bool handler_user_output_register(handler_t* handler,
     return true;
 }
 
+bool handler_user_batch_register(handler_t* handler,
+                                 bool (*user_output)(void* ctx,
+                                                     const sink_entry_t* entries,
+                                                     size_t count),
+                                 void* ctx)
+{
+    bool success = true;
+    LG_mutex_lock(&handler->lock);
+    if (handler->user_batch.vtable)
+    {
+        success = sink_submit(&handler->user_batch);
+    }
+    handler->user_batch_vtable.write = user_output;
+    sink_init(&handler->user_batch,
+              user_output ? &handler->user_batch_vtable : NULL,
+              ctx);
+    LG_mutex_unlock(&handler->lock);
+    return success;
+}
+
 void handler_user_output_enable(handler_t* handler)
 {
     handler->is_user_output_enabled = true;
@@ -158,12 +403,20 @@ bool handler_strict_time_enabled(handler_t* handler)
 
 void handler_flock_enable(handler_t* handler)
 {
+    if (!handler->is_flock_enabled && (handler->fstream || handler->gzstream))
+    {
+        _handler_close_file(handler);
+    }
     handler->is_flock_enabled = true;
 }
 
 void handler_flock_disable(handler_t* handler)
 {
-    handler->is_flock_enabled = true;
+    if (handler->is_flock_enabled)
+    {
+        _handler_close_file(handler);
+    }
+    handler->is_flock_enabled = false;
 }
 
 bool handler_flock_enabled(handler_t* handler)
@@ -171,6 +424,58 @@ bool handler_flock_enabled(handler_t* handler)
     return handler->is_flock_enabled;
 }
 
+void handler_prealloc_enable(handler_t* handler)
+{
+    handler->is_prealloc_enabled = true;
+}
+
+void handler_prealloc_disable(handler_t* handler)
+{
+    handler->is_prealloc_enabled = false;
+}
+
+bool handler_prealloc_enabled(handler_t* handler)
+{
+    return handler->is_prealloc_enabled;
+}
+
+bool handler_uring_enable(handler_t* handler, uring_t* uring)
+{
+    if (handler->uring == uring)
+    {
+        return true;
+    }
+    if (handler->fstream || handler->gzstream || handler->fd >= 0)
+    {
+        _handler_close_file(handler);
+    }
+    if (handler->uring)
+    {
+        _handler_uring_close(handler);
+    }
+    handler->uring = uring;
+    return true;
+}
+
+void handler_uring_disable(handler_t* handler)
+{
+    if (!handler->uring)
+    {
+        return;
+    }
+    if (handler->fd >= 0)
+    {
+        _handler_close_file(handler);
+    }
+    _handler_uring_close(handler);
+    handler->uring = NULL;
+}
+
+bool handler_uring_enabled(handler_t* handler)
+{
+    return handler->uring != NULL;
+}
+
 void handler_file_enable(handler_t* handler)
 {
     handler->is_file_enabled = true;
@@ -293,230 +598,835 @@ LG_FMODE handler_fmode(const handler_t* handler)
     return handler->fmode;
 }
 
-bool handler_set_fname_format(handler_t* handler, const char* format)
+bool handler_set_cmode(handler_t* handler, LG_CMODE mode)
 {
-    if (!formatter_set(&handler->fname_formatter, format))
+    assert(mode == LG_CMODE_NONE
+           || mode == LG_CMODE_ROTATED
+           || mode == LG_CMODE_INLINE);
+    if (mode != LG_CMODE_NONE && !LG_compression_supported())
     {
         return false;
     }
-    _handler_refresh_path(handler);
+    handler->cmode = mode;
     return true;
 }
 
-char* handler_fname_format(handler_t* handler, char* dest)
+LG_CMODE handler_cmode(const handler_t* handler)
 {
-    formatter_get(&handler->fname_formatter, dest);
-    return dest;
+    return handler->cmode;
 }
 
-char* handler_curr_fname(const handler_t* handler, char* dest)
+bool handler_set_dmode(handler_t* handler, LG_DMODE mode)
 {
-    strcpy(dest, handler->curr_fname);
-    return dest;
-}
+    assert(mode == LG_DMODE_NONE
+           || mode == LG_DMODE_PERIODIC
+           || mode == LG_DMODE_SYNC);
+    if (handler->dmode == mode)
+    {
+        return true;
+    }
 
-char* handler_curr_dname(const handler_t* handler, char* dest)
-{
-    strcpy(dest, handler->curr_dname);
-    return dest;
+    LG_DMODE old_mode = handler->dmode;
+    handler->dmode = mode;
+    if (!_handler_update_syncer(handler))
+    {
+        handler->dmode = old_mode;
+        return false;
+    }
+    return true;
 }
 
-char* handler_curr_fpath(const handler_t* handler, char* dest)
+LG_DMODE handler_dmode(const handler_t* handler)
 {
-    strcpy(dest, handler->curr_fpath);
-    return dest;
+    return handler->dmode;
 }
 
-bool handler_set_dname_format(handler_t* handler, const char* format)
+bool handler_set_sync_interval(handler_t* handler,
+                               uint32_t interval_ms,
+                               size_t interval_size)
 {
-    if (!formatter_set(&handler->dname_formatter, format))
+    if (interval_ms == 0)
     {
         return false;
     }
-    _handler_refresh_path(handler);
+
+    LG_mutex_lock(&handler->lock);
+    handler->sync_interval_size = interval_size;
+    LG_mutex_unlock(&handler->lock);
+    LG_syncer_set_interval(handler, interval_ms);
     return true;
 }
 
-char* handler_dname_format(handler_t* handler, char* dest)
+bool handler_sync(handler_t* handler)
 {
-    formatter_get(&handler->dname_formatter, dest);
-    return dest;
-}
+    LG_mutex_lock(&handler->lock);
+    if (handler->tbufs)
+    {
+        _handler_tbuf_drain(handler, NULL);
+    }
+    _handler_sinks_submit(handler, true);
+    if (handler->uring)
+    {
+        bool success = _handler_sync_file(handler);
+        LG_mutex_unlock(&handler->lock);
+        return success;
+    }
 
-bool handler_set_max_fsize(handler_t* handler, size_t size)
-{
-    handler->max_fsize = size;
-    return true;
-}
+    /* The descriptor is duplicated so that the slow sync can be done
+    without blocking writers, even if they close the file meanwhile. */
+    int fd = _handler_flush_file(handler);
+    if (fd >= 0)
+    {
+        fd = _dup_fd(fd);
+    }
+    handler->unsynced_size = 0;
+    handler->has_requested_sync = false;
+    LG_mutex_unlock(&handler->lock);
 
-size_t handler_max_fsize(const handler_t* handler)
-{
-    return handler->max_fsize;
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool success = _sync_file(fd);
+    _close_shared_file(fd);
+    return success;
 }
 
-size_t handler_current_fsize(const handler_t* handler)
+bool handler_flush(handler_t* handler)
 {
-    return handler->curr_fsize;
+    LG_mutex_lock(&handler->lock);
+    if (handler->tbufs)
+    {
+        _handler_tbuf_drain(handler, NULL);
+    }
+    _handler_flush_file(handler);
+    if (handler->is_stdout_enabled)
+    {
+        fflush(stdout);
+    }
+    bool success = _handler_sinks_submit(handler, true);
+    _handler_unlock(handler);
+    return success;
 }
 
-bool handler_send(handler_t* handler, const char* data_out)
+bool handler_tbuf_enable(handler_t* handler)
 {
-    if (!handler->is_enabled)
+    if (handler->tbufs)
     {
-        return false;
+        return true;
     }
 
-    if (handler->is_file_enabled)
+    handler->tbufs = tbuf_pool_init(NULL, LG_TBUF_SIZE);
+    if (!handler->tbufs)
     {
-        _handler_file_write(handler, data_out);
+        return false;
     }
-    if (handler->is_stdout_enabled)
+    if (!_handler_update_syncer(handler))
     {
-        _handler_stdout_write(handler, data_out);
+        tbuf_pool_free(handler->tbufs);
+        handler->tbufs = NULL;
+        return false;
     }
-    if (handler->is_stderr_enabled)
+    return true;
+}
+
+void handler_tbuf_disable(handler_t* handler)
+{
+    if (!handler->tbufs)
     {
-        _handler_stderr_write(handler, data_out);
+        return;
     }
-    if (handler->is_user_output_enabled)
+
+    LG_mutex_lock(&handler->lock);
+    tbuf_pool_t* pool = handler->tbufs;
+    _handler_tbuf_drain(handler, NULL);
+    handler->tbufs = NULL;
+    LG_mutex_unlock(&handler->lock);
+
+    /* Waits for the syncer to let go of the handler. */
+    _handler_update_syncer(handler);
+    tbuf_pool_free(pool);
+}
+
+bool handler_tbuf_enabled(handler_t* handler)
+{
+    return handler->tbufs != NULL;
+}
+
+bool handler_set_tbuf_timeout(handler_t* handler, uint32_t timeout_ms)
+{
+    if (timeout_ms == 0)
     {
-        handler->user_output(data_out);
+        return false;
     }
-
+    LG_syncer_set_tbuf_timeout(handler, timeout_ms);
     return true;
 }
 
-bool _handler_stdout_write(handler_t* handler, const char* data_out)
+void handler_tbuf_merge_enable(handler_t* handler)
 {
-    return fputs(data_out, stdout);
+    handler->is_tbuf_merge_enabled = true;
 }
 
-bool _handler_stderr_write(handler_t* handler, const char* data_out)
+void handler_tbuf_merge_disable(handler_t* handler)
 {
-    return fputs(data_out, stderr);
+    handler->is_tbuf_merge_enabled = false;
 }
 
-bool _handler_file_write(handler_t* handler, const char* data_out)
+bool handler_tbuf_merge_enabled(handler_t* handler)
 {
-    if (!handler->is_file_enabled)
+    return handler->is_tbuf_merge_enabled;
+}
+
+bool handler_ring_enable(handler_t* handler, size_t size)
+{
+    if (handler->ring && handler->ring->capacity == size)
+    {
+        return true;
+    }
+
+    ring_t* ring = ring_init(NULL, size);
+    if (!ring)
     {
         return false;
     }
+    handler_ring_disable(handler);
+    LG_mutex_lock(&handler->lock);
+    handler->ring = ring;
+    LG_mutex_unlock(&handler->lock);
+    return true;
+}
 
-    if (!handler->fstream)
+void handler_ring_disable(handler_t* handler)
+{
+    if (!handler->ring)
     {
-        _handler_deploy_file(handler);
+        return;
     }
 
-    fpos_t data_size = 0;
-    if (handler->is_strict_fsize_enabled)
+    handler_ring_dump(handler);
+    LG_mutex_lock(&handler->lock);
+    ring_free(handler->ring);
+    handler->ring = NULL;
+    LG_mutex_unlock(&handler->lock);
+}
+
+bool handler_ring_enabled(handler_t* handler)
+{
+    return handler->ring != NULL;
+}
+
+/* Writes a part of the flight recorder in the file. */
+static void _handler_ring_output(void* arg, const char* data, size_t size)
+{
+    handler_t* handler = arg;
+    if (_handler_file_write(handler, data, size))
     {
-        data_size = strlen(data_out);
-        if (strlen(data_out) + handler->curr_fsize >= handler->max_fsize)
-        {
-            _handler_close_file(handler);
-            _handler_deploy_file(handler);
-        }
+        LG_STATS_ADD(&handler->stats, file_bytes, size);
     }
     else
     {
-        if (_handler_file_size(handler) >= handler->max_fsize)
-        {
-            _handler_close_file(handler);
-            _handler_deploy_file(handler);
-        }
+        LG_STATS_ADD(&handler->stats, write_errors, 1);
     }
+}
 
-    if (!handler->fstream) { return false; }
-
-    /* Write. */
-    if (fputs(data_out, handler->fstream) == EOF)
+bool handler_ring_dump(handler_t* handler)
+{
+    LG_mutex_lock(&handler->lock);
+    if (!handler->ring)
     {
-        fclose(handler->fstream);
-        handler->fstream = NULL;
+        LG_mutex_unlock(&handler->lock);
         return false;
     }
-
-    handler->has_file_changed = true;
-    handler->has_dir_changed = true;
-    if (handler->is_strict_fsize_enabled)
+    if (handler->tbufs)
     {
-        handler->curr_fsize += data_size;
+        _handler_tbuf_drain(handler, NULL);
     }
-
+    ring_drain(handler->ring, _handler_ring_output, handler);
+    _handler_unlock(handler);
     return true;
 }
 
-/* Updates the active filepath. The handlerandler will attempt to write in
-that file. */
-void _handler_refresh_path(handler_t* handler)
+bool handler_crash_flush_enable(handler_t* handler)
 {
-    handler->curr_dname[0] = '\0';
-    handler->curr_fname[0] = '\0';
-    handler->curr_fpath[0] = '\0';
-    formatter_path(&handler->dname_formatter, handler->curr_dname);
-    formatter_path(&handler->fname_formatter, handler->curr_fname);
-    strcpy(handler->curr_fpath, handler->curr_dname);
-    strcat(handler->curr_fpath, LG_PATH_DELIM_STR);
-    strcat(handler->curr_fpath, handler->curr_fname);
+    handler->is_crash_flush_enabled = LG_crash_register(handler);
+    return handler->is_crash_flush_enabled;
 }
 
-bool _rotate_files(const char* abs_path)
+void handler_crash_flush_disable(handler_t* handler)
 {
-    char file_to_rename[LG_MAX_FNAME_SIZE];
-    char new_filename[LG_MAX_FNAME_SIZE];
-    size_t i = 0;
+    LG_crash_unregister(handler);
+    handler->is_crash_flush_enabled = false;
+}
 
-    /* Rename old file to old_filename.0 to simplify logic
-    below. */
-    if (_does_file_exist(abs_path))
-    {
-        sprintf(new_filename, "%s.0", abs_path);
-        rename(abs_path, new_filename);
-    }
-    else { return true; }
+bool handler_crash_flush_enabled(handler_t* handler)
+{
+    return handler->is_crash_flush_enabled;
+}
 
-    do
-    {
-        sprintf(file_to_rename, "%s.%u", abs_path, i);
-        ++i;
-    } while (_does_file_exist(file_to_rename));
-    
-    for (i; i >= 1; --i)
-    {
-        sprintf(file_to_rename, "%s.%u", abs_path, i - 1);
-        sprintf(new_filename, "%s.%u", abs_path, i);
-        rename(file_to_rename, new_filename);
-    }
-    return true;
+/* Writes salvaged data in the descriptor passed as arg. */
+static void _handler_crash_output(void* arg, const char* data, size_t size)
+{
+    _write_shared_file(*(int*)arg, data, size);
 }
 
-void _handler_deploy_file(handler_t* handler)
+void handler_crash_flush(handler_t* handler)
 {
-    /* Create directory and open file. */
-    _handler_refresh_path(handler);
-    if (!_does_dir_exist(handler->curr_dname))
+    int fd = 2;
+    if (handler->is_flock_enabled)
     {
-        _create_dir(handler->curr_dname);
+        fd = handler->fd >= 0 ? handler->fd : fd;
+        _write_shared_file(fd, handler->file_buf, handler->batch_size);
+        handler->batch_size = 0;
     }
-    if (_does_file_exist(handler->curr_fpath))
+    else if (handler->uring && handler->fd >= 0)
+    {
+        /* The buffer being filled goes after the submitted writes. */
+        fd = handler->fd;
+        if (handler->uring_data)
+        {
+            _write_file_at(fd, handler->uring_data, handler->uring_len,
+                           handler->curr_fsize);
+            handler->uring_len = 0;
+        }
+    }
+    else if (handler->fstream)
+    {
+        size_t size = 0;
+        const char* pending = _stream_pending(handler->fstream, &size);
+        fd = _stream_fd(handler->fstream);
+        if (pending)
+        {
+            _write_shared_file(fd, pending, size);
+        }
+    }
+
+    if (handler->ring)
+    {
+        ring_drain(handler->ring, _handler_crash_output, &fd);
+    }
+    if (handler->tbufs)
+    {
+        tbuf_peek(handler->tbufs,
+                  handler->is_tbuf_merge_enabled,
+                  _handler_crash_output,
+                  &fd);
+    }
+}
+
+bool handler_set_tmode(handler_t* handler, LG_TMODE mode, int32_t offset_s)
+{
+    LG_mutex_lock(&handler->lock);
+    bool success = formatter_set_tmode(&handler->fname_formatter, mode, offset_s)
+                   && formatter_set_tmode(&handler->dname_formatter, mode, offset_s);
+    if (success)
+    {
+        _handler_refresh_path(handler);
+    }
+    LG_mutex_unlock(&handler->lock);
+    return success;
+}
+
+bool handler_set_fname_format(handler_t* handler, const char* format)
+{
+    LG_mutex_lock(&handler->lock);
+    bool success = formatter_set(&handler->fname_formatter, format);
+    if (success)
+    {
+        _handler_refresh_path(handler);
+    }
+    LG_mutex_unlock(&handler->lock);
+    return success;
+}
+
+char* handler_fname_format(handler_t* handler, char* dest)
+{
+    formatter_get(&handler->fname_formatter, dest);
+    return dest;
+}
+
+char* handler_curr_fname(const handler_t* handler, char* dest)
+{
+    strcpy(dest, handler->curr_fname);
+    return dest;
+}
+
+char* handler_curr_dname(const handler_t* handler, char* dest)
+{
+    strcpy(dest, handler->curr_dname);
+    return dest;
+}
+
+char* handler_curr_fpath(const handler_t* handler, char* dest)
+{
+    strcpy(dest, handler->curr_fpath);
+    return dest;
+}
+
+bool handler_set_dname_format(handler_t* handler, const char* format)
+{
+    LG_mutex_lock(&handler->lock);
+    bool success = formatter_set(&handler->dname_formatter, format);
+    if (success)
+    {
+        _handler_refresh_path(handler);
+    }
+    LG_mutex_unlock(&handler->lock);
+    return success;
+}
+
+char* handler_dname_format(handler_t* handler, char* dest)
+{
+    formatter_get(&handler->dname_formatter, dest);
+    return dest;
+}
+
+bool handler_set_max_fsize(handler_t* handler, size_t size)
+{
+    handler->max_fsize = size;
+    return true;
+}
+
+size_t handler_max_fsize(const handler_t* handler)
+{
+    return handler->max_fsize;
+}
+
+size_t handler_current_fsize(const handler_t* handler)
+{
+    return handler->curr_fsize;
+}
+
+bool handler_send(handler_t* handler, const char* data_out)
+{
+    if (!handler->is_enabled)
+    {
+        LG_STATS_ADD(&handler->stats, entries_dropped, 1);
+        return false;
+    }
+    LG_STATS_ADD(&handler->stats, entries_accepted, 1);
+
+    size_t data_size = strlen(data_out);
+    if (handler->tbufs && _handler_tbuf_write(handler, data_out, data_size))
+    {
+        return true;
+    }
+
+    LG_mutex_lock(&handler->lock);
+    if (handler->tbufs && handler->is_tbuf_merge_enabled)
+    {
+        /* Keep the entry behind the ones other threads have buffered. */
+        _handler_tbuf_drain(handler, NULL);
+    }
+    _handler_output(handler, data_out, data_size);
+    if (handler->bmode != _IOFBF)
+    {
+        _handler_sinks_submit(handler, false);
+    }
+    _handler_unlock(handler);
+    return true;
+}
+
+bool handler_send_batch(handler_t* handler,
+                        const char* data,
+                        const size_t* sizes,
+                        size_t count)
+{
+    if (!handler->is_enabled)
+    {
+        LG_STATS_ADD(&handler->stats, entries_dropped, count);
+        return false;
+    }
+    LG_STATS_ADD(&handler->stats, entries_accepted, count);
+
+    LG_mutex_lock(&handler->lock);
+    if (handler->tbufs)
+    {
+        /* Keep the batch behind the entries buffered before it. */
+        _handler_tbuf_drain(handler, NULL);
+    }
+    for (size_t i = 0; i < count; ++i)
+    {
+        _handler_output(handler, data, sizes[i]);
+        data += sizes[i] + 1;
+    }
+    _handler_sinks_submit(handler, false);
+    _handler_unlock(handler);
+    return true;
+}
+
+void handler_stats(handler_t* handler, stats_t* dest)
+{
+    stats_add(dest, &handler->stats);
+}
+
+/* Sends an entry to all enabled outputs. data must be null-terminated.
+The caller must hold the handler's lock. */
+void _handler_output(handler_t* handler, const char* data, size_t size)
+{
+    stats_t* stats = &handler->stats;
+    if (handler->is_file_enabled && handler->ring)
+    {
+        ring_write(handler->ring, data, size);
+    }
+    else if (handler->is_file_enabled)
+    {
+        if (_handler_file_write(handler, data, size))
+        {
+            LG_STATS_ADD(stats, file_bytes, size);
+        }
+        else
+        {
+            LG_STATS_ADD(stats, write_errors, 1);
+        }
+    }
+    if (handler->is_stdout_enabled)
+    {
+        if (_handler_stdout_write(handler, data, size))
+        {
+            LG_STATS_ADD(stats, stdout_bytes, size);
+        }
+        else
+        {
+            LG_STATS_ADD(stats, write_errors, 1);
+        }
+    }
+    if (handler->is_stderr_enabled)
+    {
+        if (_handler_stderr_write(handler, data, size))
+        {
+            LG_STATS_ADD(stats, stderr_bytes, size);
+        }
+        else
+        {
+            LG_STATS_ADD(stats, write_errors, 1);
+        }
+    }
+    if (handler->is_user_output_enabled && handler->user_output)
+    {
+        if (handler->user_output(data))
+        {
+            LG_STATS_ADD(stats, user_bytes, size);
+        }
+        else
+        {
+            LG_STATS_ADD(stats, write_errors, 1);
+        }
+    }
+    if (handler->is_user_output_enabled && handler->user_batch.vtable)
+    {
+        if (sink_write(&handler->user_batch, data, size))
+        {
+            LG_STATS_ADD(stats, user_bytes, size);
+        }
+        else
+        {
+            LG_STATS_ADD(stats, write_errors, 1);
+        }
+    }
+    for (size_t i = 0; i < handler->sink_count; ++i)
+    {
+        if (sink_write(handler->sinks[i], data, size))
+        {
+            LG_STATS_ADD(stats, sink_bytes, size);
+        }
+        else
+        {
+            LG_STATS_ADD(stats, write_errors, 1);
+        }
+    }
+}
+
+/* Hands the entries gathered by the sinks over, and flushes the sinks
+too if flush is true. The caller must hold the handler's lock. */
+static bool _handler_sinks_submit(handler_t* handler, bool flush)
+{
+    bool failed = false;
+    for (size_t i = 0; i < handler->sink_count; ++i)
+    {
+        sink_t* sink = handler->sinks[i];
+        if (!(flush ? sink_flush(sink) : sink_submit(sink)))
+        {
+            LG_STATS_ADD(&handler->stats, write_errors, 1);
+            failed = true;
+        }
+    }
+    if (handler->user_batch.vtable && !sink_submit(&handler->user_batch))
+    {
+        LG_STATS_ADD(&handler->stats, write_errors, 1);
+        failed = true;
+    }
+    return !failed;
+}
+
+/* Unlocks the handler and wakes up the syncer if enough data has been
+written since the last sync. The syncer is woken up only after the
+handler has been unlocked, because it will need the lock itself. */
+void _handler_unlock(handler_t* handler)
+{
+    bool needs_sync = handler->dmode == LG_DMODE_PERIODIC
+                      && handler->sync_interval_size > 0
+                      && handler->unsynced_size >= handler->sync_interval_size
+                      && !handler->has_requested_sync;
+    if (needs_sync)
+    {
+        handler->has_requested_sync = true;
+    }
+    LG_mutex_unlock(&handler->lock);
+
+    if (needs_sync)
+    {
+        LG_syncer_request(handler);
+    }
+}
+
+bool _handler_stdout_write(handler_t* handler, const char* data, size_t size)
+{
+    return fwrite(data, 1, size, stdout) == size;
+}
+
+bool _handler_stderr_write(handler_t* handler, const char* data, size_t size)
+{
+    return fwrite(data, 1, size, stderr) == size;
+}
+
+bool _handler_file_write(handler_t* handler, const char* data, size_t size)
+{
+    if (!handler->is_file_enabled)
+    {
+        return false;
+    }
+
+    bool success = false;
+    if (handler->is_flock_enabled)
+    {
+        success = _handler_shared_write(handler, data, size);
+    }
+    else if (handler->uring)
+    {
+        success = _handler_uring_write(handler, data, size);
+    }
+    else
+    {
+        success = _handler_stream_write(handler, data, size);
+    }
+    if (!success)
+    {
+        return false;
+    }
+
+    handler->unsynced_size += size;
+    if (handler->dmode == LG_DMODE_SYNC)
+    {
+        _handler_sync_file(handler);
+    }
+    return true;
+}
+
+/* Writes data in the file through stdio or the gzip stream. */
+bool _handler_stream_write(handler_t* handler, const char* data, size_t size)
+{
+    if (!handler->fstream && !handler->gzstream)
+    {
+        _handler_deploy_file(handler);
+    }
+
+    if (handler->is_strict_fsize_enabled)
+    {
+        if (size + handler->curr_fsize >= handler->max_fsize)
+        {
+            _handler_close_file(handler);
+            _handler_deploy_file(handler);
+        }
+    }
+    else
+    {
+        if (_handler_file_size(handler) >= handler->max_fsize)
+        {
+            _handler_close_file(handler);
+            _handler_deploy_file(handler);
+        }
+    }
+
+    /* Write. */
+    if (handler->gzstream)
+    {
+        if (!LG_gz_write(handler->gzstream, data, size))
+        {
+            LG_gz_close(handler->gzstream);
+            handler->gzstream = NULL;
+            return false;
+        }
+    }
+    else if (!handler->fstream)
+    {
+        return false;
+    }
+    else if (fwrite(data, 1, size, handler->fstream) != size)
+    {
+        fclose(handler->fstream);
+        handler->fstream = NULL;
+        return false;
+    }
+
+    handler->has_file_changed = true;
+    handler->has_dir_changed = true;
+    if (handler->is_strict_fsize_enabled)
+    {
+        handler->curr_fsize += size;
+    }
+
+    return true;
+}
+
+/* Updates the active filepath. The handlerandler will attempt to write in
+that file. */
+void _handler_refresh_path(handler_t* handler)
+{
+    handler->curr_dname[0] = '\0';
+    handler->curr_fname[0] = '\0';
+    handler->curr_fpath[0] = '\0';
+    formatter_path(&handler->dname_formatter, handler->curr_dname);
+    formatter_path(&handler->fname_formatter, handler->curr_fname);
+    strcpy(handler->curr_fpath, handler->curr_dname);
+    strcat(handler->curr_fpath, LG_PATH_DELIM_STR);
+    strcat(handler->curr_fpath, handler->curr_fname);
+    if (handler->cmode == LG_CMODE_INLINE
+        && !handler->is_flock_enabled
+        && !handler->uring)
+    {
+        strcat(handler->curr_fname, LG_COMPRESSED_EXT);
+        strcat(handler->curr_fpath, LG_COMPRESSED_EXT);
+    }
+}
+
+/* Writes the path of the file with the given rotation index in dest,
+which must hold LG_MAX_FPATH_SIZE + 32 characters. If compressed is
+true, the path has the compressed extension. */
+static char* _rotated_fpath(const char* base_path,
+                            size_t index,
+                            bool compressed,
+                            char* dest)
+{
+    snprintf(dest, LG_MAX_FPATH_SIZE + 32, "%s.%u%s", base_path,
+             (unsigned)index, compressed ? LG_COMPRESSED_EXT : "");
+    return dest;
+}
+
+/* Returns true if a file, compressed or not, exists with the given
+rotation index. */
+static bool _does_rotated_file_exist(const char* base_path, size_t index)
+{
+    char path[LG_MAX_FPATH_SIZE + 32];
+    return _does_file_exist(_rotated_fpath(base_path, index, false, path))
+        || _does_file_exist(_rotated_fpath(base_path, index, true, path));
+}
+
+/* Renames the rotated file(s) with index from_index to to_index.
+Both the compressed and the uncompressed file are renamed, since
+a file can exist in both forms while it is being compressed. */
+static void _rename_rotated_file(const char* base_path,
+                                 size_t from_index,
+                                 size_t to_index)
+{
+    char old_path[LG_MAX_FPATH_SIZE + 32];
+    char new_path[LG_MAX_FPATH_SIZE + 32];
+    for (int compressed = 0; compressed <= 1; ++compressed)
+    {
+        _rotated_fpath(base_path, from_index, compressed, old_path);
+        _rotated_fpath(base_path, to_index, compressed, new_path);
+        rename(old_path, new_path);
+    }
+}
+
+/* Renames abs_path to <abs_path>.1, shifting the older rotated files
+up by one. Returns false if there was no file to rotate. */
+bool _rotate_files(const char* abs_path, LG_CMODE cmode)
+{
+    char base_path[LG_MAX_FPATH_SIZE];
+    char new_path[LG_MAX_FPATH_SIZE + 32];
+    size_t i = 1;
+
+    if (!_does_file_exist(abs_path))
+    {
+        return false;
+    }
+
+    /* Rotated files are named after the path without the compressed
+    extension so that they all look alike regardless of the mode. */
+    snprintf(base_path, sizeof(base_path), "%s", abs_path);
+    if (cmode == LG_CMODE_INLINE)
+    {
+        LG_terminate_str(base_path,
+                         strlen(base_path) - strlen(LG_COMPRESSED_EXT));
+    }
+
+    if (cmode == LG_CMODE_ROTATED)
+    {
+        LG_compressor_lock();
+    }
+
+    while (_does_rotated_file_exist(base_path, i))
+    {
+        ++i;
+    }
+    for (i; i > 1; --i)
+    {
+        _rename_rotated_file(base_path, i - 1, i);
+    }
+    _rotated_fpath(base_path, 1, cmode == LG_CMODE_INLINE, new_path);
+    rename(abs_path, new_path);
+
+    if (cmode == LG_CMODE_ROTATED)
+    {
+        LG_compressor_shift(base_path);
+        LG_compressor_submit(base_path, 1);
+        LG_compressor_unlock();
+    }
+    return true;
+}
+
+void _handler_deploy_file(handler_t* handler)
+{
+    /* Create directory and open file. */
+    _handler_refresh_path(handler);
+    if (!_does_dir_exist(handler->curr_dname))
+    {
+        _create_dir(handler->curr_dname);
+    }
+    const char* open_mode = "w";
+    if (_does_file_exist(handler->curr_fpath))
     {
         switch (handler->fmode)
         {
         case LG_FMODE_MANUAL:
-            handler->fstream = fopen(handler->curr_fpath, "a"); break;
+            open_mode = "a"; break;
         case LG_FMODE_REWRITE:
-            handler->fstream = fopen(handler->curr_fpath, "w"); break;
+            open_mode = "w"; break;
         case LG_FMODE_ROTATE:
-            _rotate_files(handler->curr_fpath);
-            handler->fstream = fopen(handler->curr_fpath, "w"); break;
+            if (_rotate_files(handler->curr_fpath, handler->cmode))
+            {
+                LG_STATS_ADD(&handler->stats, rotations, 1);
+            }
+            open_mode = "w"; break;
         }
     }
-    else
+
+    if (handler->cmode == LG_CMODE_INLINE)
     {
-        handler->fstream = fopen(handler->curr_fpath, "w");
+        /* The gzip stream does its own buffering. */
+        handler->gzstream = LG_gz_open(handler->curr_fpath,
+                                       open_mode,
+                                       handler->bsize);
+        if (handler->gzstream)
+        {
+            handler->curr_fsize = _handler_file_size(handler);
+        }
+        return;
     }
 
+    handler->fstream = fopen(handler->curr_fpath, open_mode);
+
     /* Set output buffer. */
     if (handler->fstream)
     {
@@ -524,13 +1434,32 @@ void _handler_deploy_file(handler_t* handler)
                 handler->file_buf,
                 handler->bmode,
                 handler->bsize);
+        _handler_preallocate(handler, _stream_fd(handler->fstream));
         handler->curr_fsize = _handler_file_size(handler);
     }
 }
 
 void _handler_close_file(handler_t* handler)
 {
-    fclose(handler->fstream);
+    if (handler->gzstream)
+    {
+        LG_gz_close(handler->gzstream);
+    }
+    if (handler->fstream)
+    {
+        fflush(handler->fstream);
+        _handler_trim_file(handler, _stream_fd(handler->fstream));
+        fclose(handler->fstream);
+    }
+    if (handler->is_flock_enabled)
+    {
+        _handler_shared_flush(handler);
+    }
+    else if (handler->uring)
+    {
+        _handler_uring_close(handler);
+    }
+    _handler_shared_close(handler);
     if (!handler->has_file_changed && handler->is_file_creator)
     {
         _remove_file(handler->curr_fname);
@@ -541,6 +1470,7 @@ void _handler_close_file(handler_t* handler)
          _remove_dir(handler->curr_dname);
     }
     handler->fstream = NULL;
+    handler->gzstream = NULL;
     handler->is_dir_creator = false;
     handler->has_dir_changed = false;
     handler->has_file_changed = false;
@@ -550,6 +1480,11 @@ void _handler_close_file(handler_t* handler)
 
 fpos_t _handler_file_size(handler_t* handler)
 {
+    if (handler->gzstream)
+    {
+        return LG_gz_size(handler->gzstream);
+    }
+
     /* TODO: Error checks */
     fpos_t size = 0;
     fpos_t orig_pos = 0;
@@ -560,3 +1495,446 @@ fpos_t _handler_file_size(handler_t* handler)
 
     return size;
 }
+
+/* Collects data in the batch and appends the batch to the file
+when the buffering mode requires it. */
+bool _handler_shared_write(handler_t* handler, const char* data, size_t size)
+{
+    size_t capacity = handler->bmode == _IONBF ? 0 : handler->bsize;
+    if (capacity > sizeof(handler->file_buf))
+    {
+        capacity = sizeof(handler->file_buf);
+    }
+
+    if (handler->batch_size + size > capacity)
+    {
+        if (!_handler_shared_flush(handler))
+        {
+            return false;
+        }
+        if (size > capacity)
+        {
+            return _handler_shared_commit(handler, data, size);
+        }
+    }
+
+    memcpy(handler->file_buf + handler->batch_size, data, size);
+    handler->batch_size += size;
+    if (handler->bmode == _IOLBF && size > 0
+        && data[size - 1] == '\n')
+    {
+        return _handler_shared_flush(handler);
+    }
+    return true;
+}
+
+/* Appends the batch to the file. */
+bool _handler_shared_flush(handler_t* handler)
+{
+    if (handler->batch_size == 0)
+    {
+        return true;
+    }
+    bool success = _handler_shared_commit(handler,
+                                          handler->file_buf,
+                                          handler->batch_size);
+    handler->batch_size = 0;
+    return success;
+}
+
+/* Returns true if appending size bytes requires a new log file. */
+static bool _handler_shared_is_full(handler_t* handler, size_t size)
+{
+    size_t fsize = _shared_file_size(handler->fd);
+    if (handler->is_strict_fsize_enabled)
+    {
+        return fsize > 0 && fsize + size >= handler->max_fsize;
+    }
+    return fsize >= handler->max_fsize;
+}
+
+/* Appends size bytes from data to the file, rotating the file first
+if it is full. */
+bool _handler_shared_commit(handler_t* handler, const char* data, size_t size)
+{
+    bool is_locked = false;
+
+    /* Another process may have rotated the file since the last write. */
+    if (handler->fd < 0 || !_is_same_file(handler->fd, handler->curr_fpath))
+    {
+        _handler_shared_close(handler);
+        if (!_handler_shared_open(handler, false))
+        {
+            return false;
+        }
+    }
+
+    if (_handler_shared_is_full(handler, size))
+    {
+        _lock_shared_file(handler->lock_fd);
+        is_locked = true;
+
+        /* Whoever gets the lock first rotates, the rest only reopen. */
+        if (!_is_same_file(handler->fd, handler->curr_fpath))
+        {
+            _handler_shared_close(handler);
+            is_locked = false;
+            if (!_handler_shared_open(handler, false))
+            {
+                return false;
+            }
+            _lock_shared_file(handler->lock_fd);
+            is_locked = true;
+        }
+        if (_handler_shared_is_full(handler, size))
+        {
+            _close_shared_file(handler->fd);
+            if (handler->fmode == LG_FMODE_ROTATE
+                && _rotate_files(handler->curr_fpath,
+                                 handler->cmode == LG_CMODE_INLINE
+                                 ? LG_CMODE_NONE : handler->cmode))
+            {
+                LG_STATS_ADD(&handler->stats, rotations, 1);
+            }
+            handler->fd = _open_shared_file(handler->curr_fpath,
+                                            handler->fmode == LG_FMODE_REWRITE);
+        }
+    }
+    else if (size > LG_ATOMIC_WRITE_SIZE)
+    {
+        _lock_shared_file(handler->lock_fd);
+        is_locked = true;
+    }
+
+    bool success = handler->fd >= 0
+                   && _write_shared_file(handler->fd, data, size);
+    if (is_locked)
+    {
+        _unlock_shared_file(handler->lock_fd);
+    }
+
+    if (success)
+    {
+        handler->has_file_changed = true;
+        handler->has_dir_changed = true;
+        handler->curr_fsize = _shared_file_size(handler->fd);
+    }
+    return success;
+}
+
+/* Opens the current log file and its lock file for shared writing. */
+bool _handler_shared_open(handler_t* handler, bool truncate)
+{
+    char lock_path[LG_MAX_FPATH_SIZE + 8];
+
+    _handler_refresh_path(handler);
+    if (!_does_dir_exist(handler->curr_dname))
+    {
+        _create_dir(handler->curr_dname);
+    }
+
+    snprintf(lock_path, sizeof(lock_path), "%s.lock", handler->curr_fpath);
+    handler->lock_fd = _open_shared_file(lock_path, false);
+    handler->fd = _open_shared_file(handler->curr_fpath, truncate);
+    if (handler->fd < 0 || handler->lock_fd < 0)
+    {
+        _handler_shared_close(handler);
+        return false;
+    }
+    handler->curr_fsize = _shared_file_size(handler->fd);
+    return true;
+}
+
+/* Closes the shared file. Data still in the batch is kept. */
+void _handler_shared_close(handler_t* handler)
+{
+    if (handler->fd >= 0)
+    {
+        _close_shared_file(handler->fd);
+        handler->fd = -1;
+    }
+    if (handler->lock_fd >= 0)
+    {
+        _close_shared_file(handler->lock_fd);
+        handler->lock_fd = -1;
+    }
+}
+
+/* Flushes the buffered file output to the operating system and
+returns the descriptor of the current log file, or -1 if no file
+is open. */
+int _handler_flush_file(handler_t* handler)
+{
+    int fd = -1;
+    if (handler->is_flock_enabled)
+    {
+        _handler_shared_flush(handler);
+        fd = handler->fd;
+    }
+    else if (handler->uring)
+    {
+        _handler_uring_submit(handler);
+        uring_wait(handler->uring);
+        fd = handler->fd;
+    }
+    else if (handler->gzstream)
+    {
+        LG_gz_flush(handler->gzstream);
+        fd = LG_gz_fd(handler->gzstream);
+    }
+    else if (handler->fstream)
+    {
+        fflush(handler->fstream);
+        fd = _stream_fd(handler->fstream);
+    }
+    if (fd >= 0)
+    {
+        LG_STATS_ADD(&handler->stats, flushes, 1);
+    }
+    return fd;
+}
+
+/* Forces the data of the current log file to disk. */
+bool _handler_sync_file(handler_t* handler)
+{
+    handler->unsynced_size = 0;
+    handler->has_requested_sync = false;
+    if (handler->uring && !handler->is_flock_enabled)
+    {
+        _handler_uring_submit(handler);
+        return handler->fd >= 0 && uring_sync(handler->uring, handler->fd);
+    }
+    return _sync_file(_handler_flush_file(handler));
+}
+
+/* Copies data in the handler's uring buffer and submits the buffer
+when it is full or the buffering mode requires it. */
+bool _handler_uring_write(handler_t* handler, const char* data, size_t size)
+{
+    const char* data_end = data + size;
+    size_t capacity = uring_buf_size(handler->uring);
+    if (handler->bsize > 0 && handler->bsize < capacity)
+    {
+        capacity = handler->bsize;
+    }
+
+    if (handler->fd < 0 && !_handler_uring_open(handler))
+    {
+        return false;
+    }
+
+    size_t fsize = handler->curr_fsize + handler->uring_len;
+    bool is_full = handler->is_strict_fsize_enabled
+                   ? fsize > 0 && fsize + size >= handler->max_fsize
+                   : fsize >= handler->max_fsize;
+    if (is_full)
+    {
+        _handler_uring_close(handler);
+        if (!_handler_uring_open(handler))
+        {
+            return false;
+        }
+    }
+
+    while (size > 0)
+    {
+        if (!handler->uring_data)
+        {
+            handler->uring_data = uring_acquire(handler->uring,
+                                                &handler->uring_buf);
+        }
+        if (!handler->uring_data)
+        {
+            /* No buffer to spare: write directly. */
+            if (!_write_file_at(handler->fd, data, size,
+                                handler->curr_fsize))
+            {
+                return false;
+            }
+            handler->curr_fsize += size;
+            break;
+        }
+
+        size_t chunk_size = capacity - handler->uring_len;
+        if (chunk_size > size)
+        {
+            chunk_size = size;
+        }
+        memcpy(handler->uring_data + handler->uring_len, data, chunk_size);
+        handler->uring_len += chunk_size;
+        data += chunk_size;
+        size -= chunk_size;
+        if (handler->uring_len == capacity)
+        {
+            _handler_uring_submit(handler);
+        }
+    }
+
+    if (handler->bmode == _IONBF
+        || (handler->bmode == _IOLBF && data_end[-1] == '\n'))
+    {
+        _handler_uring_submit(handler);
+    }
+
+    handler->has_file_changed = true;
+    handler->has_dir_changed = true;
+    return true;
+}
+
+/* Submits the data in the handler's uring buffer as a write at the end
+of the file. */
+void _handler_uring_submit(handler_t* handler)
+{
+    if (handler->uring_len == 0)
+    {
+        return;
+    }
+    uring_write(handler->uring,
+                handler->fd,
+                handler->uring_buf,
+                handler->uring_len,
+                handler->curr_fsize);
+    handler->curr_fsize += handler->uring_len;
+    handler->uring_data = NULL;
+    handler->uring_len = 0;
+}
+
+/* Opens the current log file for the uring backend. */
+bool _handler_uring_open(handler_t* handler)
+{
+    bool truncate = true;
+    _handler_refresh_path(handler);
+    if (!_does_dir_exist(handler->curr_dname))
+    {
+        _create_dir(handler->curr_dname);
+    }
+    if (_does_file_exist(handler->curr_fpath))
+    {
+        switch (handler->fmode)
+        {
+        case LG_FMODE_MANUAL:
+            truncate = false; break;
+        case LG_FMODE_ROTATE:
+            if (_rotate_files(handler->curr_fpath,
+                              handler->cmode == LG_CMODE_INLINE
+                              ? LG_CMODE_NONE : handler->cmode))
+            {
+                LG_STATS_ADD(&handler->stats, rotations, 1);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    handler->fd = _open_file(handler->curr_fpath, truncate);
+    if (handler->fd < 0)
+    {
+        return false;
+    }
+    _handler_preallocate(handler, handler->fd);
+    handler->curr_fsize = _shared_file_size(handler->fd);
+    return true;
+}
+
+/* Writes out the pending data and closes the file. Waits for the writes
+in flight, so that a rotated file is complete when it is renamed or
+compressed. */
+void _handler_uring_close(handler_t* handler)
+{
+    _handler_uring_submit(handler);
+    uring_wait(handler->uring);
+    if (handler->uring_data)
+    {
+        uring_release(handler->uring, handler->uring_buf);
+        handler->uring_data = NULL;
+    }
+    if (handler->fd >= 0)
+    {
+        _handler_trim_file(handler, handler->fd);
+        _close_shared_file(handler->fd);
+        handler->fd = -1;
+    }
+}
+
+/* Reserves disk space for a full log file if preallocation is enabled. */
+void _handler_preallocate(handler_t* handler, int fd)
+{
+    handler->is_file_preallocated = handler->is_prealloc_enabled
+                                    && _preallocate_file(fd, handler->max_fsize);
+}
+
+/* Releases the disk space preallocated beyond the end of the file. */
+void _handler_trim_file(handler_t* handler, int fd)
+{
+    if (handler->is_file_preallocated)
+    {
+        _truncate_file(fd, _shared_file_size(fd));
+        handler->is_file_preallocated = false;
+    }
+}
+
+/* Appends an entry to the calling thread's buffer. A full buffer is
+handed to the outputs first: only the thread's own buffer, or all
+buffers if they are merged. Returns false if the entry must be
+written directly. */
+bool _handler_tbuf_write(handler_t* handler, const char* data, size_t size)
+{
+    tbuf_pool_t* pool = handler->tbufs;
+    tbuf_t* buf = tbuf_acquire(pool);
+    if (!buf)
+    {
+        return false;
+    }
+    bool success = tbuf_append(pool, buf, data, size);
+    tbuf_release(buf);
+    if (success)
+    {
+        return true;
+    }
+
+    /* The buffer lock must not be held here: the handler's lock is
+    always taken before the buffer locks. */
+    LG_mutex_lock(&handler->lock);
+    _handler_tbuf_drain(handler, handler->is_tbuf_merge_enabled ? NULL : buf);
+    LG_STATS_ADD(&handler->stats, flushes, 1);
+    _handler_unlock(handler);
+
+    buf = tbuf_acquire(pool);
+    if (!buf)
+    {
+        return false;
+    }
+    success = tbuf_append(pool, buf, data, size);
+    tbuf_release(buf);
+    return success;
+}
+
+static void _handler_tbuf_output(void* handler, const char* data, size_t size)
+{
+    _handler_output(handler, data, size);
+}
+
+/* Hands the entries in buf, or in all buffers if buf is NULL, to the
+outputs. The caller must hold the handler's lock. */
+void _handler_tbuf_drain(handler_t* handler, tbuf_t* buf)
+{
+    tbuf_drain(handler->tbufs,
+               buf,
+               handler->is_tbuf_merge_enabled,
+               _handler_tbuf_output,
+               handler);
+    _handler_sinks_submit(handler, false);
+}
+
+/* Registers the handler with the syncer if it needs periodic syncs or
+thread buffer flushes, and unregisters it otherwise. */
+bool _handler_update_syncer(handler_t* handler)
+{
+    if (handler->dmode == LG_DMODE_PERIODIC || handler->tbufs)
+    {
+        return LG_syncer_register(handler);
+    }
+    LG_syncer_unregister(handler);
+    return true;
+}
@@ -26,6 +26,62 @@
  * be wiped completely clean, after which the log will continue writing
  * in that file.
  *
+ * Log files can optionally be compressed with gzip (see
+ * handler_set_cmode). In LG_CMODE_ROTATED mode files rotated out
+ * in ROTATE mode are compressed by a background worker and named
+ * <filename>.1.gz, <filename>.2.gz and so on. In LG_CMODE_INLINE
+ * mode the log file itself is a gzip stream named <filename>.gz,
+ * and its rotated copies are named like above. The stream is
+ * flushed in blocks of bsize uncompressed bytes, and the file
+ * size is measured in the compressed bytes flushed so far.
+ *
+ * When file locks are enabled (see handler_flock_enable), several
+ * processes can safely write in the same log file. Entries are then
+ * collected in the handler's buffer and appended to the file in
+ * whole batches: a batch no larger than LG_ATOMIC_WRITE_SIZE is
+ * appended with a single atomic write, a larger one while holding an
+ * advisory lock on <filename>.lock. The same lock ensures that only
+ * one of the processes rotates a full file; the others notice the
+ * rotation and reopen the path. LG_CMODE_INLINE is not available in
+ * this mode and files are written uncompressed instead.
+ *
+ * Instead of stdio the handler can write through an asynchronous
+ * uring backend (see uring.h and handler_uring_enable), which may be
+ * shared by many handlers. The handler fills a buffer of the backend
+ * and submits it as a write at the end of the file whenever the
+ * buffering mode requires. LG_CMODE_INLINE is not available with the
+ * backend. File locks, if enabled, take precedence over the backend.
+ *
+ * With preallocation enabled (see handler_prealloc_enable), disk
+ * space for max_fsize bytes is reserved when a log file is opened,
+ * so that appending does not have to allocate blocks and update the
+ * inode on every write. The space left unused is released when the
+ * file is closed. Not available when file locks are enabled.
+ *
+ * With thread buffers enabled (see handler_tbuf_enable), each thread
+ * appends its entries to a buffer of its own instead of taking the
+ * handler's lock for every entry. The buffered entries are handed to
+ * the outputs in blocks: when the thread's buffer is full, when the
+ * background thread finds them older than the buffer timeout, and on
+ * handler_flush. By default every block keeps the order of one
+ * thread only; with merging enabled all buffers are handed over at
+ * once and their entries interleaved in the order they were logged.
+ *
+ * With the flight recorder enabled (see handler_ring_enable), the file
+ * output is kept in a ring buffer in memory that holds the most recent
+ * entries, and written in the file only when handler_ring_dump is
+ * called. The log dumps the rings of all levels when an entry at or
+ * above its ring dump level is written.
+ *
+ * With crash flushing enabled (see handler_crash_flush_enable), the
+ * data still buffered in the handler is written out if the process
+ * dies of a fatal signal, see crash.h.
+ *
+ * The durability mode (see handler_set_dmode) controls when written
+ * data is forced to disk: never explicitly (LG_DMODE_NONE), by a
+ * background thread every sync interval or after enough unsynced
+ * data (LG_DMODE_PERIODIC), or after every entry (LG_DMODE_SYNC).
+ *
  * The file handler has three possible buffering modes: _IONBF
  * (no buffering), _IOLBF (line buffering) and _IOFBF (full buffering).
  * These are defined in stdio.h and work precisely as described
@@ -37,18 +93,55 @@
 #ifndef LG_FILE_HANDLER_H
 #define LG_FILE_HANDLER_H
 
+#include "dgram.h"
 #include "error.h"
 #include "formatter.h"
 #include "macros.h"
+#include "net.h"
 #include "policy.h"
+#include "ring.h"
+#include "sink.h"
+#include "stats.h"
+#include "tbuf.h"
+#include "thread.h"
+#include "uring.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 
 /* Log output handler. */
 typedef struct {
+    /* Serializes writes and syncs. */
+    LG_mutex_t   lock;
+
     /* The file stream used to write in files. */
     FILE*        fstream;
+
+    /* The gzip stream used instead of fstream in
+    LG_CMODE_INLINE mode. */
+    void*        gzstream;
+
+    /* The file descriptor used instead of fstream when file locks or
+    the uring backend are enabled, or -1. */
+    int          fd;
+
+    /* The descriptor of the lock file shared by all processes that
+    write in the same log file, or -1. */
+    int          lock_fd;
+
+    /* The amount of data waiting in file_buf when file locks are
+    enabled. */
+    size_t       batch_size;
+
+    /* The asynchronous output backend, or NULL if not in use. Not
+    owned by the handler. */
+    uring_t*     uring;
+
+    /* The uring buffer currently being filled, its index and the
+    amount of data in it. */
+    char*        uring_data;
+    int          uring_buf;
+    size_t       uring_len;
     
     /* File name formatter: required to support user macros
     in file names. */
@@ -66,7 +159,7 @@ typedef struct {
     char         curr_dname[LG_MAX_FNAME_SIZE];
 
     /* The absolute filepath of the currently active log file. */
-    char         curr_fpath[LG_MAX_FNAME_SIZE];
+    char         curr_fpath[LG_MAX_FPATH_SIZE];
 
     /* The capacity of the buffer in bytes. */
     size_t       bsize;
@@ -77,6 +170,64 @@ typedef struct {
     /* File mode. One of: MANUAL, REWRITE, ROTATE. */
     LG_FMODE     fmode;
 
+    /* Compression mode. One of: NONE, ROTATED, INLINE. */
+    LG_CMODE     cmode;
+
+    /* Durability mode. One of: NONE, PERIODIC, SYNC. */
+    LG_DMODE     dmode;
+
+    /* In PERIODIC mode, the interval between syncs in milliseconds. */
+    uint32_t     sync_interval_ms;
+
+    /* In PERIODIC mode, the amount of unsynced data in bytes that
+    causes a sync before the interval has passed. Zero if unlimited. */
+    size_t       sync_interval_size;
+
+    /* The amount of data written since the last sync. */
+    size_t       unsynced_size;
+
+    /* Indicates whether the handler has asked the background thread
+    for a sync that has not happened yet. */
+    bool         has_requested_sync;
+
+    /* Owned by the syncer: the time of the next periodic sync and
+    whether a sync has been requested. */
+    uint64_t     next_sync_time;
+    bool         is_sync_requested;
+
+    /* The per-thread entry buffers, or NULL if not in use. */
+    tbuf_pool_t* tbufs;
+
+    /* The longest time in milliseconds an entry may wait in a thread's
+    buffer before the syncer hands it to the outputs. */
+    uint32_t     tbuf_timeout_ms;
+
+    /* Owned by the syncer: the time of the next thread buffer flush. */
+    uint64_t     next_flush_time;
+
+    /* Indicates whether entries from different thread buffers are
+    written in the order they were logged in. */
+    bool         is_tbuf_merge_enabled;
+
+    /* Write path counters. */
+    stats_t      stats;
+
+    /* The flight recorder that keeps the file output in memory until
+    it is dumped, or NULL if not in use. */
+    ring_t*      ring;
+
+    /* The attached sinks, see sink.h. */
+    sink_t*      sinks[LG_MAX_SINKS];
+    size_t       sink_count;
+
+    /* The socket of the syslog or journald output, or NULL if not in
+    use. It is attached as one of the sinks. */
+    dgram_t*     dgram;
+
+    /* The network output, or NULL if not in use. It is attached as one
+    of the sinks and may be shared with other handlers. */
+    net_t*       net;
+
     /* The maximum size of a log file in bytes. Log files are
     guaranteed to be smaller than this. */
     fpos_t       max_fsize;
@@ -116,6 +267,17 @@ typedef struct {
     /* Indicates whether file locks are enabled. */
     bool         is_flock_enabled;
 
+    /* Indicates whether log files are preallocated to max_fsize. */
+    bool         is_prealloc_enabled;
+
+    /* Indicates whether disk space was preallocated for the current
+    log file and must be trimmed when it is closed. */
+    bool         is_file_preallocated;
+
+    /* Indicates whether the buffered data is written out if the process
+    dies. */
+    bool         is_crash_flush_enabled;
+
     /* Indicates whether writing to files is enabled. */
     bool         is_file_enabled;
 
@@ -141,6 +303,11 @@ typedef struct {
     bool         is_dynamic;
 
     bool         (*user_output)(const char*);
+
+    /* The batched user output, see handler_user_batch_register. The
+    vtable of user_batch is NULL if none is registered. */
+    sink_vtable_t user_batch_vtable;
+    sink_t       user_batch;
 } handler_t;
 
 handler_t* handler_init(handler_t* buffer, LG_LEVEL level);
@@ -155,12 +322,58 @@ bool handler_enabled(handler_t* handler);
 
 bool handler_user_output_register(handler_t* handler, bool (*user_output)(const char*));
 
+/* Registers a user output that receives the entries in batches along
+with ctx, instead of one call per entry. The batches are handed over
+like those of sinks, see sink.h. Enabling and disabling the user output
+applies to both kinds of callbacks. Passing NULL unregisters the
+callback after the gathered entries have been handed over. */
+bool handler_user_batch_register(handler_t* handler,
+                                 bool (*user_output)(void* ctx,
+                                                     const sink_entry_t* entries,
+                                                     size_t count),
+                                 void* ctx);
+
 void handler_user_output_enable(handler_t* handler);
 
 void handler_user_output_disable(handler_t* handler);
 
 bool handler_user_output_enabled(handler_t* handler);
 
+/* Attaches a sink made of vtable and ctx that receives the entries of
+the handler in batches. Returns NULL if LG_MAX_SINKS sinks are attached
+already. */
+sink_t* handler_sink_attach(handler_t* handler,
+                            const sink_vtable_t* vtable,
+                            void* ctx);
+
+/* Writes out, detaches and closes the sink made of vtable and ctx.
+Returns false if no such sink is attached. */
+bool handler_sink_detach(handler_t* handler,
+                         const sink_vtable_t* vtable,
+                         void* ctx);
+
+size_t handler_sink_count(handler_t* handler);
+
+/* Sends the entries to the local syslog daemon or journald in addition
+to the other outputs, see dgram.h. A NULL path uses the protocol's
+default socket. */
+bool handler_dgram_enable(handler_t* handler,
+                          LG_DGRAM_PROTO proto,
+                          const char* path,
+                          const char* ident);
+
+bool handler_dgram_disable(handler_t* handler);
+
+bool handler_dgram_enabled(handler_t* handler);
+
+/* Sends the entries to a collector through net in addition to the
+other outputs, see net.h. */
+bool handler_net_enable(handler_t* handler, net_t* net);
+
+bool handler_net_disable(handler_t* handler);
+
+bool handler_net_enabled(handler_t* handler);
+
 /* TODO */
 void handler_strict_fsize_enable(handler_t* handler);
 
@@ -179,15 +392,30 @@ void handler_strict_time_disable(handler_t* handler);
 /* TODO */
 bool handler_strict_time_enabled(handler_t* handler);
 
-/* TODO */
+/* Enables safe writing in the same file from several processes.
+The currently open log file is closed. */
 void handler_flock_enable(handler_t* handler);
 
-/* TODO */
 void handler_flock_disable(handler_t* handler);
 
-/* TODO */
 bool handler_flock_enabled(handler_t* handler);
 
+/* Enables preallocating log files. Takes effect when the next log
+file is opened. */
+void handler_prealloc_enable(handler_t* handler);
+
+void handler_prealloc_disable(handler_t* handler);
+
+bool handler_prealloc_enabled(handler_t* handler);
+
+/* Makes the handler write in files through the uring backend.
+The currently open log file is closed. */
+bool handler_uring_enable(handler_t* handler, uring_t* uring);
+
+void handler_uring_disable(handler_t* handler);
+
+bool handler_uring_enabled(handler_t* handler);
+
 void handler_file_enable(handler_t* handler);
 
 void handler_file_disable(handler_t* handler);
@@ -226,6 +454,84 @@ bool handler_set_fmode(handler_t* handler, LG_FMODE mode);
 
 LG_FMODE handler_fmode(const handler_t* handler);
 
+/* Returns false if the library was built without compression support.
+The mode takes effect when the next log file is opened. */
+bool handler_set_cmode(handler_t* handler, LG_CMODE mode);
+
+LG_CMODE handler_cmode(const handler_t* handler);
+
+bool handler_set_dmode(handler_t* handler, LG_DMODE mode);
+
+LG_DMODE handler_dmode(const handler_t* handler);
+
+/* Sets the sync interval of LG_DMODE_PERIODIC mode: the handler is
+synced every interval_ms milliseconds, and whenever interval_size
+bytes have been written since the last sync (unless zero). Returns
+false if interval_ms is zero. */
+bool handler_set_sync_interval(handler_t* handler,
+                               uint32_t interval_ms,
+                               size_t interval_size);
+
+/* Flushes the buffered output and forces the written data to disk. */
+bool handler_sync(handler_t* handler);
+
+/* Hands the thread buffers to the outputs and flushes the buffered
+output to the operating system. */
+bool handler_flush(handler_t* handler);
+
+/* Enables per-thread buffering of entries. Like the other settings,
+thread buffers must not be enabled or disabled while other threads
+are writing through the handler. */
+bool handler_tbuf_enable(handler_t* handler);
+
+/* Hands the buffered entries to the outputs and stops buffering. */
+void handler_tbuf_disable(handler_t* handler);
+
+bool handler_tbuf_enabled(handler_t* handler);
+
+/* Sets the longest time an entry may wait in a thread buffer. Returns
+false if timeout_ms is zero. */
+bool handler_set_tbuf_timeout(handler_t* handler, uint32_t timeout_ms);
+
+void handler_tbuf_merge_enable(handler_t* handler);
+
+void handler_tbuf_merge_disable(handler_t* handler);
+
+bool handler_tbuf_merge_enabled(handler_t* handler);
+
+/* Makes the handler keep its file output in a flight recorder of
+size bytes instead of writing it in the file. Data already in the
+recorder is written in the file first if the size changes. */
+bool handler_ring_enable(handler_t* handler, size_t size);
+
+/* Dumps the flight recorder and stops using it. */
+void handler_ring_disable(handler_t* handler);
+
+bool handler_ring_enabled(handler_t* handler);
+
+/* Writes the contents of the flight recorder in the file. */
+bool handler_ring_dump(handler_t* handler);
+
+/* Makes the handler write out its buffered data if the process dies
+of a fatal signal or exits. */
+bool handler_crash_flush_enable(handler_t* handler);
+
+void handler_crash_flush_disable(handler_t* handler);
+
+bool handler_crash_flush_enabled(handler_t* handler);
+
+/* Writes the data buffered in the file stream, the flight recorder and
+the thread buffers in the log file, or on stderr if no log file is open.
+Uses only async-signal-safe calls and takes no locks, so that it can be
+called from a signal handler; the handler must not be used afterwards.
+Data waiting in a gzip stream or in writes already submitted to the
+uring backend is not salvaged. */
+void handler_crash_flush(handler_t* handler);
+
+/* Sets the time zone of the file and directory names, see
+formatter_set_tmode. */
+bool handler_set_tmode(handler_t* handler, LG_TMODE mode, int32_t offset_s);
+
 bool handler_set_fname_format(handler_t* handler, const char* format);
 
 char* handler_fname_format(handler_t* handler, char* dest);
@@ -248,4 +554,15 @@ size_t handler_current_fsize(const handler_t* handler);
 
 bool handler_send(handler_t* handler, const char* data_out);
 
+/* Sends count entries while holding the handler's lock only once. data
+holds the entries back to back, each followed by a null character, and
+sizes their lengths without it. */
+bool handler_send_batch(handler_t* handler,
+                        const char* data,
+                        const size_t* sizes,
+                        size_t count);
+
+/* Adds the handler's counters to dest. */
+void handler_stats(handler_t* handler, stats_t* dest);
+
 #endif /* LG_FILE_HANDLER_H */
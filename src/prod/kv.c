@@ -0,0 +1,217 @@
+/*
+ * File: kv.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "kv.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* For each byte, the character that follows the backslash in its
+escape sequence, 'u' for the \u00XX form, or 0 if the byte needs no
+escaping. The null character ends the input. */
+static const char LG_KV_ESCAPES[256] = {
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    'b', 't', 'n', 'u', 'f', 'r', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    'u', 'u', 'u', 'u', 'u', 'u', 'u', 'u',
+    ['"'] = '"',
+    ['\\'] = '\\'
+};
+
+/* Returns true if a logfmt value must be quoted. */
+static bool _kv_needs_quotes(const char* value, size_t value_len)
+{
+    if (value_len == 0 || value[0] == '\0')
+    {
+        return true;
+    }
+    for (size_t i = 0; i < value_len && value[i] != '\0'; ++i)
+    {
+        unsigned char c = (unsigned char)value[i];
+        if (LG_KV_ESCAPES[c] || c == ' ' || c == '=')
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t kv_escape(char* dest, size_t capacity, const char* src, size_t src_len)
+{
+    static const char hex[] = "0123456789abcdef";
+    size_t len = 0;
+    size_t i = 0;
+    while (i < src_len)
+    {
+        /* Copy the characters up to the next one that needs escaping
+        at once. */
+        size_t run_end = i;
+        while (run_end < src_len
+               && !LG_KV_ESCAPES[(unsigned char)src[run_end]])
+        {
+            ++run_end;
+        }
+        size_t run_len = run_end - i;
+        if (run_len > capacity - len)
+        {
+            run_len = capacity - len;
+        }
+        memcpy(dest + len, src + i, run_len);
+        len += run_len;
+        i += run_len;
+        if (i == src_len || i < run_end || src[i] == '\0')
+        {
+            break;
+        }
+
+        unsigned char c = (unsigned char)src[i];
+        char escape = LG_KV_ESCAPES[c];
+        size_t escape_len = escape == 'u' ? 6 : 2;
+        if (capacity - len < escape_len)
+        {
+            break;
+        }
+        dest[len] = '\\';
+        dest[len + 1] = escape;
+        if (escape == 'u')
+        {
+            dest[len + 2] = '0';
+            dest[len + 3] = '0';
+            dest[len + 4] = hex[c >> 4];
+            dest[len + 5] = hex[c & 0xf];
+        }
+        len += escape_len;
+        ++i;
+    }
+    return len;
+}
+
+size_t kv_encode_key(char* dest,
+                     size_t capacity,
+                     const char* key,
+                     size_t key_len,
+                     LG_EMODE mode,
+                     bool is_first)
+{
+    /* The separator, the quotes and the colon or equals sign. */
+    size_t len = 0;
+    if (key_len + 4 > capacity)
+    {
+        return 0;
+    }
+
+    if (mode == LG_EMODE_JSON)
+    {
+        if (!is_first)
+        {
+            dest[len++] = ',';
+        }
+        dest[len++] = '"';
+        len += kv_escape(dest + len, capacity - len - 2, key, key_len);
+        dest[len++] = '"';
+        dest[len++] = ':';
+        return len;
+    }
+
+    if (!is_first)
+    {
+        dest[len++] = ' ';
+    }
+    for (size_t i = 0; i < key_len && key[i] != '\0'; ++i)
+    {
+        /* A logfmt key cannot be quoted. */
+        unsigned char c = (unsigned char)key[i];
+        dest[len++] = LG_KV_ESCAPES[c] || c == ' ' || c == '=' ? '_' : c;
+    }
+    dest[len++] = '=';
+    return len;
+}
+
+size_t kv_encode_str(char* dest,
+                     size_t capacity,
+                     const char* value,
+                     size_t value_len,
+                     LG_EMODE mode)
+{
+    if (mode != LG_EMODE_JSON && !_kv_needs_quotes(value, value_len))
+    {
+        size_t len = 0;
+        while (len < value_len && len < capacity && value[len] != '\0')
+        {
+            dest[len] = value[len];
+            ++len;
+        }
+        return len;
+    }
+
+    if (capacity < 2)
+    {
+        return 0;
+    }
+    size_t len = 0;
+    dest[len++] = '"';
+    len += kv_escape(dest + len, capacity - 2, value, value_len);
+    dest[len++] = '"';
+    return len;
+}
+
+size_t kv_encode_value(char* dest, size_t capacity, const kv_t* kv, LG_EMODE mode)
+{
+    int len = 0;
+    switch (kv->type)
+    {
+        case LG_KVTYPE_STRING:
+            if (!kv->value.s)
+            {
+                len = snprintf(dest, capacity, mode == LG_EMODE_JSON
+                                               ? "null" : "\"\"");
+                break;
+            }
+            return kv_encode_str(dest, capacity, kv->value.s,
+                                 strlen(kv->value.s), mode);
+        case LG_KVTYPE_INT:
+            len = snprintf(dest, capacity, "%lld", (long long)kv->value.i);
+            break;
+        case LG_KVTYPE_UINT:
+            len = snprintf(dest, capacity, "%llu",
+                           (unsigned long long)kv->value.u);
+            break;
+        case LG_KVTYPE_DOUBLE:
+            /* JSON has no representation for infinities and NaN. */
+            if (mode == LG_EMODE_JSON && !isfinite(kv->value.d))
+            {
+                len = snprintf(dest, capacity, "null");
+            }
+            else
+            {
+                len = snprintf(dest, capacity, "%.17g", kv->value.d);
+            }
+            break;
+        case LG_KVTYPE_BOOL:
+            len = snprintf(dest, capacity, kv->value.b ? "true" : "false");
+            break;
+    }
+    return len > 0 && (size_t)len < capacity ? (size_t)len : 0;
+}
+
+size_t kv_encode(char* dest,
+                 size_t capacity,
+                 const kv_t* kv,
+                 LG_EMODE mode,
+                 bool is_first)
+{
+    size_t key_len = kv_encode_key(dest, capacity, kv->key,
+                                   strlen(kv->key), mode, is_first);
+    if (key_len == 0)
+    {
+        return 0;
+    }
+    size_t value_len = kv_encode_value(dest + key_len, capacity - key_len,
+                                       kv, mode);
+    return value_len > 0 ? key_len + value_len : 0;
+}
@@ -0,0 +1,97 @@
+/*
+ * File: kv.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains the typed key-value pairs of structured
+ * log entries and the routines that encode them as JSON or
+ * logfmt.
+ *
+ * Example: Writing an entry with fields.
+ *
+ *   kv_t fields[] = {
+ *       LG_KV_STR("user", "anton"),
+ *       LG_KV_INT("attempt", 3),
+ *       LG_KV_BOOL("locked", true)
+ *   };
+ *   log_writekv(log, LG_WARNING, "Login failed", fields, 3);
+ *   // In LG_EMODE_JSON mode the fields are written as
+ *   // "user":"anton","attempt":3,"locked":true
+ *   // and in LG_EMODE_TEXT and LG_EMODE_LOGFMT modes as
+ *   // user=anton attempt=3 locked=true
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_KV_H
+#define LG_KV_H
+
+#include "policy.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    LG_KVTYPE_STRING = 0,
+    LG_KVTYPE_INT,
+    LG_KVTYPE_UINT,
+    LG_KVTYPE_DOUBLE,
+    LG_KVTYPE_BOOL
+} LG_KVTYPE;
+
+/* A key-value pair. The key and a string value must stay valid until
+the entry has been formatted. */
+typedef struct {
+    const char* key;
+    LG_KVTYPE   type;
+    union {
+        const char* s;
+        int64_t     i;
+        uint64_t    u;
+        double      d;
+        bool        b;
+    } value;
+} kv_t;
+
+#define LG_KV_STR(key, v)    { (key), LG_KVTYPE_STRING, { .s = (v) } }
+#define LG_KV_INT(key, v)    { (key), LG_KVTYPE_INT,    { .i = (v) } }
+#define LG_KV_UINT(key, v)   { (key), LG_KVTYPE_UINT,   { .u = (v) } }
+#define LG_KV_DOUBLE(key, v) { (key), LG_KVTYPE_DOUBLE, { .d = (v) } }
+#define LG_KV_BOOL(key, v)   { (key), LG_KVTYPE_BOOL,   { .b = (v) } }
+
+/* Writes src with the characters that JSON does not allow in strings
+escaped. Writes at most capacity bytes and never splits an escape
+sequence. Returns the number of bytes written. */
+size_t kv_escape(char* dest, size_t capacity, const char* src, size_t src_len);
+
+/* Writes the key of a field in mode, preceded by the separator from
+the previous field unless the field is the first one. Returns the number
+of bytes written, or 0 if there was not enough room. */
+size_t kv_encode_key(char* dest,
+                     size_t capacity,
+                     const char* key,
+                     size_t key_len,
+                     LG_EMODE mode,
+                     bool is_first);
+
+/* Writes a string value in mode: quoted in JSON, and quoted in logfmt
+if it contains characters that would break the line apart. Returns the
+number of bytes written. A value that does not fit is truncated. */
+size_t kv_encode_str(char* dest,
+                     size_t capacity,
+                     const char* value,
+                     size_t value_len,
+                     LG_EMODE mode);
+
+/* Writes the value of kv in mode. Returns the number of bytes written,
+or 0 if there was not enough room. */
+size_t kv_encode_value(char* dest, size_t capacity, const kv_t* kv, LG_EMODE mode);
+
+/* Writes the key and the value of kv. */
+size_t kv_encode(char* dest,
+                 size_t capacity,
+                 const kv_t* kv,
+                 LG_EMODE mode,
+                 bool is_first);
+
+#endif /* LG_KV_H */
@@ -0,0 +1,128 @@
+/*
+ * File: limiter.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "alloc.h"
+#include "limiter.h"
+#include "os.h"
+#include "thread.h"
+
+limiter_t* limiter_init(limiter_t* buffer)
+{
+    limiter_t* limiter = buffer;
+    if (!limiter)
+    {
+        limiter = LG_alloc(sizeof(limiter_t));
+        if (!limiter)
+        {
+            return NULL;
+        }
+        limiter->is_dynamic = true;
+    }
+    else
+    {
+        limiter->is_dynamic = false;
+    }
+
+    limiter->rate = 0;
+    limiter->burst = 1;
+    limiter->sample_n = 0;
+    limiter->interval_ns = 0;
+    limiter->full_time = 0;
+    limiter->sample_count = 0;
+    limiter->suppressed = 0;
+    limiter->next_summary_time = 0;
+    limiter->site = NULL;
+
+    return limiter;
+}
+
+void limiter_free(limiter_t* limiter)
+{
+    if (limiter->is_dynamic)
+    {
+        LG_dealloc(limiter);
+    }
+}
+
+void limiter_set_rate(limiter_t* limiter, uint32_t rate, uint32_t burst)
+{
+    limiter->interval_ns = rate ? 1000000000ULL / rate : 0;
+    limiter->burst = burst ? burst : 1;
+    LG_ATOMIC_STORE(&limiter->full_time, 0);
+    limiter->rate = rate;
+}
+
+void limiter_set_sampling(limiter_t* limiter, uint32_t n)
+{
+    limiter->sample_n = n;
+}
+
+/* Takes a token from the bucket if there is one. The bucket is
+represented by the time at which it would be full again, which allows
+taking a token with a single compare-and-swap. */
+static bool _limiter_take(limiter_t* limiter, uint64_t now)
+{
+    uint64_t tolerance = limiter->interval_ns * (limiter->burst - 1);
+    for (;;)
+    {
+        uint64_t full_time = LG_ATOMIC_LOAD(&limiter->full_time);
+        uint64_t start_time = full_time > now ? full_time : now;
+        if (start_time - now > tolerance)
+        {
+            return false;
+        }
+        if (LG_ATOMIC_CAS(&limiter->full_time,
+                          full_time,
+                          start_time + limiter->interval_ns))
+        {
+            return true;
+        }
+    }
+}
+
+bool limiter_allow(limiter_t* limiter, uint64_t* suppressed)
+{
+    return limiter_allow_at(limiter, 0, suppressed);
+}
+
+bool limiter_allow_at(limiter_t* limiter, uint64_t now, uint64_t* suppressed)
+{
+    *suppressed = 0;
+    if (limiter->rate == 0 && limiter->sample_n <= 1)
+    {
+        return true;
+    }
+
+    bool is_allowed = limiter->sample_n <= 1
+                      || LG_ATOMIC_ADD(&limiter->sample_count, 1)
+                         % limiter->sample_n == 0;
+    if (is_allowed && limiter->rate > 0)
+    {
+        now = now ? now : _monotonic_time_ns();
+        is_allowed = _limiter_take(limiter, now);
+    }
+    if (!is_allowed)
+    {
+        LG_ATOMIC_ADD(&limiter->suppressed, 1);
+        return false;
+    }
+
+    if (LG_ATOMIC_LOAD(&limiter->suppressed) > 0)
+    {
+        now = now ? now : _monotonic_time_ns();
+        uint64_t summary_time = LG_ATOMIC_LOAD(&limiter->next_summary_time);
+        if (now >= summary_time
+            && LG_ATOMIC_CAS(&limiter->next_summary_time,
+                             summary_time,
+                             now + LG_LIMIT_SUMMARY_MS * 1000000ULL))
+        {
+            *suppressed = LG_ATOMIC_EXCHANGE(&limiter->suppressed, 0);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,98 @@
+/*
+ * File: limiter.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains the rate limiter that the log uses to
+ * keep a hot code path from flooding the outputs. A limiter
+ * combines two independent checks:
+ * -a token bucket that lets through at most rate entries per
+ *  second on average, and up to burst entries at once after a
+ *  quiet period
+ * -sampling that lets through only 1 of every sample_n entries
+ *
+ * The checks are lock-free and read the clock only when the rate
+ * is limited, so that a suppressed entry costs a few atomic
+ * operations. The limiter counts the entries it suppresses and
+ * reports the count at most once every LG_LIMIT_SUMMARY_MS
+ * milliseconds, along with the next entry it lets through.
+ *
+ * A log has a limiter for each level. A limiter for a single call
+ * site can be declared statically with LG_LIMITER_INIT, see
+ * LG_WRITE_LIMITED in log.h.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_LIMITER_H
+#define LG_LIMITER_H
+
+#include "macros.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+    /* The number of entries let through per second on average, or 0
+    if the rate is unlimited. */
+    uint32_t    rate;
+
+    /* The number of entries that can be let through at once. */
+    uint32_t    burst;
+
+    /* Lets through 1 of every sample_n entries. 0 and 1 let through
+    every entry. */
+    uint32_t    sample_n;
+
+    /* The time between entries at the limited rate in nanoseconds. */
+    uint64_t    interval_ns;
+
+    /* The time at which the bucket would be full again if nothing
+    else were let through. */
+    uint64_t    full_time;
+
+    /* The number of entries seen by sampling. */
+    uint64_t    sample_count;
+
+    /* The number of entries suppressed since the last summary. */
+    uint64_t    suppressed;
+
+    /* The earliest time of the next summary. */
+    uint64_t    next_summary_time;
+
+    /* A description of the call site that uses the limiter, or NULL
+    if the limiter is not specific to a call site. */
+    const char* site;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool        is_dynamic;
+} limiter_t;
+
+/* Initializes a statically allocated limiter. */
+#define LG_LIMITER_INIT(rate, burst, sample_n, site) \
+    { (rate), (burst) ? (burst) : 1, (sample_n), \
+      (rate) ? 1000000000ULL / (rate) : 0, 0, 0, 0, 0, (site), false }
+
+/* Creates a limiter that lets everything through. */
+limiter_t* limiter_init(limiter_t* buffer);
+
+void limiter_free(limiter_t* limiter);
+
+/* Limits the rate to rate entries per second with bursts of up to
+burst entries. A rate of 0 removes the limit. */
+void limiter_set_rate(limiter_t* limiter, uint32_t rate, uint32_t burst);
+
+/* Makes the limiter let through 1 of every n entries. */
+void limiter_set_sampling(limiter_t* limiter, uint32_t n);
+
+/* Returns true if the next entry may be written. If so and the entries
+suppressed before it should be reported, stores their number in
+suppressed and starts counting from zero; otherwise stores zero. */
+bool limiter_allow(limiter_t* limiter, uint64_t* suppressed);
+
+/* Like limiter_allow, but takes the current monotonic time in
+nanoseconds instead of reading the clock. A now of 0 reads the clock
+if it is needed. */
+bool limiter_allow_at(limiter_t* limiter, uint64_t now, uint64_t* suppressed);
+
+#endif /* LG_LIMITER_H */
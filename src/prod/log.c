@@ -7,19 +7,57 @@
  */
 
 #include "alloc.h"
+#include "category.h"
+#include "config.h"
 #include "log.h"
+#include "os.h"
+#include "string_util.h"
+#include "tz.h"
 #include <assert.h>
 #include <string.h>
 
+static void _log_report_repeats(log_t* log, LG_LEVEL level);
+
+/* Returns a copy of the current configuration for a setter to change
+and publish with _log_config_publish, or NULL if there is no memory.
+The configuration stays locked until the copy is published. */
+static log_config_t* _log_config_copy(log_t* log)
+{
+    LG_mutex_lock(&log->config_lock);
+    log_config_t* config = LG_alloc(sizeof(log_config_t));
+    if (!config)
+    {
+        LG_mutex_unlock(&log->config_lock);
+        return NULL;
+    }
+    *config = *(const log_config_t*)snapshot_current(&log->config);
+    return config;
+}
+
+/* Replaces the current configuration with config and frees the previous
+one once no writer uses it. */
+static void _log_config_publish(log_t* log, log_config_t* config)
+{
+    LG_dealloc(snapshot_publish(&log->config, config));
+    category_resolve_all(log);
+    LG_mutex_unlock(&log->config_lock);
+}
+
 log_t * log_init(log_t* buffer)
 {
     log_t* log = buffer;
+    log_config_t* config = LG_alloc(sizeof(log_config_t));
+    if (!config)
+    {
+        return NULL;
+    }
 
     if (!log)
     {
         log = LG_alloc(sizeof(log_t));
         if (!log)
         {
+            LG_dealloc(config);
             return NULL;
         }
         log->is_dynamic = true;
@@ -32,11 +70,20 @@ log_t * log_init(log_t* buffer)
     for (size_t level = 0; level < LG_VALID_LVL_COUNT; ++level)
     {
         handler_init(&log->handlers[level], level);
-        formatter_init(&log->formatters[level], LG_DEF_ENTRY_FORMAT, LG_FORMAT_ENTRIES);
-        log->is_enabled[level] = true;
+        formatter_init(&config->formatters[level], LG_DEF_ENTRY_FORMAT, LG_FORMAT_ENTRIES);
+        limiter_init(&log->limiters[level]);
+        dedup_init(&log->dedups[level]);
+        config->is_enabled[level] = true;
+        config->is_timed[level] = false;
     }
-
-    log->threshold = LG_DEF_THRESHOLD;
+    config->threshold = LG_DEF_THRESHOLD;
+    config->ring_dump_level = LG_DEF_RING_DUMP_LEVEL;
+
+    log->uring = NULL;
+    snapshot_init(&log->config, config);
+    log->categories = NULL;
+    log->seq = 0;
+    LG_mutex_init(&log->config_lock);
     log->flags = 0;
     log->last_error = LG_E_NO_ERROR;
     log->error_msg[0] = '\0';
@@ -46,11 +93,24 @@ log_t * log_init(log_t* buffer)
 
 bool log_free(log_t* log)
 {
+    LG_config_unwatch(log);
     for (size_t level = 0; level < LG_VALID_LVL_COUNT; ++level)
     {
+        _log_report_repeats(log, level);
+    }
+    for (size_t level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        dedup_free(&log->dedups[level]);
         handler_free(&log->handlers[level]);
-        formatter_free(&log->formatters[level]);
+        limiter_free(&log->limiters[level]);
+    }
+    if (log->uring)
+    {
+        uring_free(log->uring);
     }
+    LG_dealloc(snapshot_current(&log->config));
+    snapshot_free(&log->config);
+    LG_mutex_free(&log->config_lock);
 
     if (log->is_dynamic)
     {
@@ -62,53 +122,71 @@ bool log_free(log_t* log)
 
 bool log_enable(log_t* log, LG_LEVEL level)
 {
+    log_config_t* config = _log_config_copy(log);
+    if (!config)
+    {
+        return false;
+    }
+
     if (level == LG_ALL_LEVELS)
     {
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            log->is_enabled[level] = true;
+            config->is_enabled[level] = true;
         }
     }
     else
     {
-        log->is_enabled[level] = true;
+        config->is_enabled[level] = true;
     }
+    _log_config_publish(log, config);
     return true;
 }
 
 bool log_disable(log_t* log, LG_LEVEL level)
 {
+    log_config_t* config = _log_config_copy(log);
+    if (!config)
+    {
+        return false;
+    }
+
     if (level == LG_ALL_LEVELS)
     {
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            log->is_enabled[level] = false;
+            config->is_enabled[level] = false;
         }
     }
     else
     {
-        log->is_enabled[level] = false;
+        config->is_enabled[level] = false;
     }
+    _log_config_publish(log, config);
     return true;
 }
 
 bool log_enabled(log_t* log, LG_LEVEL level)
 {
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+    bool enabled = true;
     if (level == LG_ALL_LEVELS)
     {
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            if (!log->is_enabled[level])
+            if (!config->is_enabled[level])
             {
-                return false;
+                enabled = false;
             }
         }
     }
     else
     {
-        return log->is_enabled[level];
+        enabled = config->is_enabled[level];
     }
-    return true;
+    snapshot_release(&log->config, token);
+    return enabled;
 }
 
 bool log_set_user_output(log_t* log, LG_LEVEL level, bool(*user_output)(const char*))
@@ -131,102 +209,164 @@ bool log_set_user_output(log_t* log, LG_LEVEL level, bool(*user_output)(const ch
     return true;
 }
 
-bool log_user_output_enable(log_t* log, LG_LEVEL level)
+bool log_dgram_enable(log_t* log,
+                      LG_LEVEL level,
+                      LG_DGRAM_PROTO proto,
+                      const char* path,
+                      const char* ident)
 {
-    bool success = false;
     bool failed = false;
     if (level == LG_ALL_LEVELS)
     {
-        success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            handler_user_output_enable(&log->handlers[level]);
+            failed = !handler_dgram_enable(&log->handlers[level],
+                                           proto,
+                                           path,
+                                           ident)
+                     || failed;
         }
     }
     else
     {
-        handler_user_output_enable(&log->handlers[level]);
+        failed = !handler_dgram_enable(&log->handlers[level], proto, path, ident);
     }
-
-    return true;
+    return !failed;
 }
 
-bool log_user_output_disable(log_t* log, LG_LEVEL level)
+bool log_dgram_disable(log_t* log, LG_LEVEL level)
 {
-    bool success = false;
     bool failed = false;
     if (level == LG_ALL_LEVELS)
     {
-        success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            handler_user_output_disable(&log->handlers[level]);
+            failed = !handler_dgram_disable(&log->handlers[level]) || failed;
         }
     }
     else
     {
-        handler_user_output_disable(&log->handlers[level]);
+        failed = !handler_dgram_disable(&log->handlers[level]);
     }
-
-    return true;
+    return !failed;
 }
 
-bool log_user_output_enabled(log_t* log, LG_LEVEL level)
+bool log_dgram_enabled(log_t* log, LG_LEVEL level)
 {
     if (level == LG_ALL_LEVELS)
     {
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            if (!handler_user_output_enabled(&log->handlers[level]))
+            if (!handler_dgram_enabled(&log->handlers[level]))
             {
                 return false;
             }
         }
+        return true;
+    }
+    return handler_dgram_enabled(&log->handlers[level]);
+}
+
+bool log_net_enable(log_t* log,
+                    LG_LEVEL level,
+                    LG_NET_PROTO proto,
+                    const char* host,
+                    const char* port,
+                    size_t queue_size,
+                    const char* spill_path)
+{
+    net_t* net = net_init(NULL, proto, host, port, queue_size, spill_path);
+    if (!net)
+    {
+        return false;
+    }
+
+    /* Held until every level has been attached, so that a failure does
+    not free the object in between. */
+    net_retain(net);
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            failed = !handler_net_enable(&log->handlers[level], net) || failed;
+        }
     }
     else
     {
-        return handler_user_output_enabled(&log->handlers[level]);
+        failed = !handler_net_enable(&log->handlers[level], net);
     }
-    return true;
+    net_release(net);
+    return !failed;
 }
 
-bool log_strict_fsize_enable(log_t* log, LG_LEVEL level)
+bool log_net_disable(log_t* log, LG_LEVEL level)
 {
-    handler_strict_fsize_enable(&log->handlers[level]);
-    return true;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            failed = !handler_net_disable(&log->handlers[level]) || failed;
+        }
+    }
+    else
+    {
+        failed = !handler_net_disable(&log->handlers[level]);
+    }
+    return !failed;
 }
 
-bool log_strict_fsize_disable(log_t* log, LG_LEVEL level)
+bool log_net_enabled(log_t* log, LG_LEVEL level)
 {
-    handler_strict_fsize_disable(&log->handlers[level]);
-    return true;
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            if (!handler_net_enabled(&log->handlers[level]))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+    return handler_net_enabled(&log->handlers[level]);
 }
 
-bool log_strict_fsize_enabled(log_t* log, LG_LEVEL level)
+bool log_set_thread_name(const char* name)
 {
-    return handler_strict_fsize_enabled(&log->handlers[level]);;
+    LG_thread_set_name(name);
+    return true;
 }
 
-bool log_stdout_enable(log_t* log, LG_LEVEL level)
+bool log_set_user_batch_output(log_t* log,
+                               LG_LEVEL level,
+                               bool (*user_output)(void* ctx,
+                                                   const sink_entry_t* entries,
+                                                   size_t count),
+                               void* ctx)
 {
-    bool success = false;
     bool failed = false;
     if (level == LG_ALL_LEVELS)
     {
-        success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            handler_stdout_enable(&log->handlers[level]);
+            failed = !handler_user_batch_register(&log->handlers[level],
+                                                  user_output,
+                                                  ctx)
+                     || failed;
         }
     }
     else
     {
-        handler_stdout_enable(&log->handlers[level]);
+        failed = !handler_user_batch_register(&log->handlers[level],
+                                              user_output,
+                                              ctx);
     }
-    return true;
+    return !failed;
 }
 
-bool log_stdout_disable(log_t* log, LG_LEVEL level)
+bool log_user_output_enable(log_t* log, LG_LEVEL level)
 {
     bool success = false;
     bool failed = false;
@@ -235,22 +375,18 @@ bool log_stdout_disable(log_t* log, LG_LEVEL level)
         success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            handler_stdout_disable(&log->handlers[level]);
+            handler_user_output_enable(&log->handlers[level]);
         }
     }
     else
     {
-        handler_stdout_disable(&log->handlers[level]);
+        handler_user_output_enable(&log->handlers[level]);
     }
-    return true;
-}
 
-bool log_stdout_enabled(log_t* log, LG_LEVEL level)
-{
-    return handler_stdout_enabled(&log->handlers[level]);
+    return true;
 }
 
-bool log_stderr_enable(log_t* log, LG_LEVEL level)
+bool log_user_output_disable(log_t* log, LG_LEVEL level)
 {
     bool success = false;
     bool failed = false;
@@ -259,139 +395,153 @@ bool log_stderr_enable(log_t* log, LG_LEVEL level)
         success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            handler_stderr_enable(&log->handlers[level]);
+            handler_user_output_disable(&log->handlers[level]);
         }
     }
     else
     {
-        handler_stderr_enable(&log->handlers[level]);
+        handler_user_output_disable(&log->handlers[level]);
     }
+
     return true;
 }
 
-bool log_stderr_disable(log_t* log, LG_LEVEL level)
+bool log_user_output_enabled(log_t* log, LG_LEVEL level)
 {
-    bool success = false;
-    bool failed = false;
     if (level == LG_ALL_LEVELS)
     {
-        success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            handler_stderr_disable(&log->handlers[level]);
+            if (!handler_user_output_enabled(&log->handlers[level]))
+            {
+                return false;
+            }
         }
-        return true;
     }
     else
     {
-        handler_stderr_disable(&log->handlers[level]);
-        return true;
+        return handler_user_output_enabled(&log->handlers[level]);
     }
+    return true;
 }
 
-bool log_stderr_enabled(log_t* log, LG_LEVEL level)
-{
-    return handler_stderr_enabled(&log->handlers[level]);
-}
-
-bool log_file_enable(log_t* log, LG_LEVEL level)
+bool log_sink_attach(log_t* log,
+                     LG_LEVEL level,
+                     const sink_vtable_t* vtable,
+                     void* ctx)
 {
-    bool success = false;
     bool failed = false;
     if (level == LG_ALL_LEVELS)
     {
-        success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            handler_file_enable(&log->handlers[level]);
+            failed = !handler_sink_attach(&log->handlers[level], vtable, ctx)
+                     || failed;
         }
     }
     else
     {
-        handler_file_enable(&log->handlers[level]);
+        failed = !handler_sink_attach(&log->handlers[level], vtable, ctx);
     }
-    return true;
+    return !failed;
 }
 
-bool log_file_disable(log_t* log, LG_LEVEL level)
+bool log_sink_detach(log_t* log,
+                     LG_LEVEL level,
+                     const sink_vtable_t* vtable,
+                     void* ctx)
 {
-    bool success = false;
     bool failed = false;
     if (level == LG_ALL_LEVELS)
     {
-        success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            handler_file_disable(&log->handlers[level]);
+            failed = !handler_sink_detach(&log->handlers[level], vtable, ctx)
+                     || failed;
         }
-        return true;
     }
     else
     {
-        handler_file_disable(&log->handlers[level]);
-        return true;
+        failed = !handler_sink_detach(&log->handlers[level], vtable, ctx);
     }
-
     return !failed;
 }
 
-bool log_file_enabled(log_t* log, LG_LEVEL level)
+bool log_strict_fsize_enable(log_t* log, LG_LEVEL level)
 {
-    bool success = false;
-    bool failed = false;
     if (level == LG_ALL_LEVELS)
     {
-        success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            success = handler_file_enabled(&log->handlers[level]);
-            if (!failed)
-            {
-                failed = !success;
-            }
+            handler_strict_fsize_enable(&log->handlers[level]);
         }
     }
     else
     {
-        return handler_file_enabled(&log->handlers[level]);
+        handler_strict_fsize_enable(&log->handlers[level]);
     }
-
-    return !failed;
-}
-
-bool log_set_error(log_t* log, LG_ERRNO error, const char* message)
-{
-    log->last_error = error;
-    strcpy(log->error_msg, message);
+    return true;
 }
 
-LG_ERRNO log_get_error(log_t* log)
+bool log_strict_fsize_disable(log_t* log, LG_LEVEL level)
 {
-    return log->last_error;
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_strict_fsize_disable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_strict_fsize_disable(&log->handlers[level]);
+    }
+    return true;
 }
 
-bool log_clear_error(log_t* log)
+bool log_strict_fsize_enabled(log_t* log, LG_LEVEL level)
 {
-    log->last_error = LG_E_NO_ERROR;
+    return handler_strict_fsize_enabled(&log->handlers[level]);;
 }
 
-bool log_has_error(log_t* log)
+bool log_flock_enable(log_t* log, LG_LEVEL level)
 {
-    return log->last_error != LG_E_NO_ERROR;
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_flock_enable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_flock_enable(&log->handlers[level]);
+    }
+    return true;
 }
 
-bool log_set_threshold(log_t* log, LG_LEVEL threshold)
+bool log_flock_disable(log_t* log, LG_LEVEL level)
 {
-    log->threshold = threshold;
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_flock_disable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_flock_disable(&log->handlers[level]);
+    }
     return true;
 }
 
-LG_LEVEL log_threshold(log_t* log)
+bool log_flock_enabled(log_t* log, LG_LEVEL level)
 {
-    return log->threshold;
+    return handler_flock_enabled(&log->handlers[level]);
 }
 
-bool log_set_bmode(log_t* log, LG_LEVEL level, int mode)
+bool log_stdout_enable(log_t* log, LG_LEVEL level)
 {
     bool success = false;
     bool failed = false;
@@ -400,27 +550,17 @@ bool log_set_bmode(log_t* log, LG_LEVEL level, int mode)
         success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            success = handler_set_bmode(&log->handlers[level], mode);
-            if (!failed)
-            {
-                failed = !success;
-            }
+            handler_stdout_enable(&log->handlers[level]);
         }
     }
     else
     {
-        return handler_set_bmode(&log->handlers[level], mode);
+        handler_stdout_enable(&log->handlers[level]);
     }
-
-    return !failed;
-}
-
-int log_bmode(log_t* log, LG_LEVEL level)
-{
-    return handler_bmode(&log->handlers[level]);
+    return true;
 }
 
-bool log_set_bsize(log_t* log, LG_LEVEL level, size_t buf_size)
+bool log_stdout_disable(log_t* log, LG_LEVEL level)
 {
     bool success = false;
     bool failed = false;
@@ -429,27 +569,22 @@ bool log_set_bsize(log_t* log, LG_LEVEL level, size_t buf_size)
         success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            success = handler_set_bsize(&log->handlers[level], buf_size);
-            if (!failed)
-            {
-                failed = !success;
-            }
+            handler_stdout_disable(&log->handlers[level]);
         }
     }
     else
     {
-        return success = handler_set_bsize(&log->handlers[level], buf_size);
+        handler_stdout_disable(&log->handlers[level]);
     }
-
-    return !failed;
+    return true;
 }
 
-size_t log_bsize(log_t* log, LG_LEVEL level)
+bool log_stdout_enabled(log_t* log, LG_LEVEL level)
 {
-    return handler_bsize(&log->handlers[level]);
+    return handler_stdout_enabled(&log->handlers[level]);
 }
 
-bool log_set_fmode(log_t* log, LG_LEVEL level, LG_FMODE mode)
+bool log_stderr_enable(log_t* log, LG_LEVEL level)
 {
     bool success = false;
     bool failed = false;
@@ -458,24 +593,844 @@ bool log_set_fmode(log_t* log, LG_LEVEL level, LG_FMODE mode)
         success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            success = handler_set_fmode(&log->handlers[level], mode);
-            if (!failed)
-            {
-                failed = !success;
-            }
+            handler_stderr_enable(&log->handlers[level]);
         }
     }
     else
     {
-        return handler_set_fmode(&log->handlers[level], mode);
+        handler_stderr_enable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_stderr_disable(log_t* log, LG_LEVEL level)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_stderr_disable(&log->handlers[level]);
+        }
+        return true;
+    }
+    else
+    {
+        handler_stderr_disable(&log->handlers[level]);
+        return true;
+    }
+}
+
+bool log_stderr_enabled(log_t* log, LG_LEVEL level)
+{
+    return handler_stderr_enabled(&log->handlers[level]);
+}
+
+bool log_prealloc_enable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_prealloc_enable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_prealloc_enable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_prealloc_disable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_prealloc_disable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_prealloc_disable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_prealloc_enabled(log_t* log, LG_LEVEL level)
+{
+    return handler_prealloc_enabled(&log->handlers[level]);
+}
+
+bool log_uring_enable(log_t* log, LG_LEVEL level)
+{
+    if (!log->uring)
+    {
+        /* Two buffers per level so that each level can fill one
+        while the other is being written. */
+        log->uring = uring_init(NULL, 2 * LG_VALID_LVL_COUNT, LG_MAX_BSIZE);
+        if (!log->uring)
+        {
+            return false;
+        }
+    }
+
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_uring_enable(&log->handlers[level], log->uring);
+        }
+    }
+    else
+    {
+        handler_uring_enable(&log->handlers[level], log->uring);
+    }
+    return true;
+}
+
+bool log_uring_disable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_uring_disable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_uring_disable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_uring_enabled(log_t* log, LG_LEVEL level)
+{
+    return handler_uring_enabled(&log->handlers[level]);
+}
+
+bool log_tbuf_enable(log_t* log, LG_LEVEL level)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_tbuf_enable(&log->handlers[level]);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_tbuf_enable(&log->handlers[level]);
+    }
+
+    return !failed;
+}
+
+bool log_tbuf_disable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_tbuf_disable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_tbuf_disable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_tbuf_enabled(log_t* log, LG_LEVEL level)
+{
+    return handler_tbuf_enabled(&log->handlers[level]);
+}
+
+bool log_set_tbuf_timeout(log_t* log, LG_LEVEL level, uint32_t timeout_ms)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_set_tbuf_timeout(&log->handlers[level],
+                                               timeout_ms);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_set_tbuf_timeout(&log->handlers[level], timeout_ms);
+    }
+
+    return !failed;
+}
+
+bool log_tbuf_merge_enable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_tbuf_merge_enable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_tbuf_merge_enable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_tbuf_merge_disable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_tbuf_merge_disable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_tbuf_merge_disable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_tbuf_merge_enabled(log_t* log, LG_LEVEL level)
+{
+    return handler_tbuf_merge_enabled(&log->handlers[level]);
+}
+
+bool log_stats(log_t* log, log_stats_t* dest)
+{
+    stats_init(&dest->total);
+    for (size_t level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        stats_init(&dest->levels[level]);
+        handler_stats(&log->handlers[level], &dest->levels[level]);
+        stats_add(&dest->total, &dest->levels[level]);
+    }
+    return true;
+}
+
+bool log_timing_enable(log_t* log, LG_LEVEL level)
+{
+    log_config_t* config = _log_config_copy(log);
+    if (!config)
+    {
+        return false;
+    }
+
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            config->is_timed[level] = true;
+        }
+    }
+    else
+    {
+        config->is_timed[level] = true;
+    }
+    _log_config_publish(log, config);
+    return true;
+}
+
+bool log_timing_disable(log_t* log, LG_LEVEL level)
+{
+    log_config_t* config = _log_config_copy(log);
+    if (!config)
+    {
+        return false;
+    }
+
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            config->is_timed[level] = false;
+        }
+    }
+    else
+    {
+        config->is_timed[level] = false;
+    }
+    _log_config_publish(log, config);
+    return true;
+}
+
+bool log_timing_enabled(log_t* log, LG_LEVEL level)
+{
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+    bool enabled = config->is_timed[level];
+    snapshot_release(&log->config, token);
+    return enabled;
+}
+
+bool log_crash_flush_enable(log_t* log, LG_LEVEL level)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_crash_flush_enable(&log->handlers[level]);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_crash_flush_enable(&log->handlers[level]);
+    }
+
+    return !failed;
+}
+
+bool log_crash_flush_disable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_crash_flush_disable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_crash_flush_disable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_crash_flush_enabled(log_t* log, LG_LEVEL level)
+{
+    return handler_crash_flush_enabled(&log->handlers[level]);
+}
+
+bool log_set_rate_limit(log_t* log,
+                        LG_LEVEL level,
+                        uint32_t rate,
+                        uint32_t burst)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            limiter_set_rate(&log->limiters[level], rate, burst);
+        }
+    }
+    else
+    {
+        limiter_set_rate(&log->limiters[level], rate, burst);
+    }
+    return true;
+}
+
+bool log_set_sampling(log_t* log, LG_LEVEL level, uint32_t n)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            limiter_set_sampling(&log->limiters[level], n);
+        }
+    }
+    else
+    {
+        limiter_set_sampling(&log->limiters[level], n);
+    }
+    return true;
+}
+
+bool log_dedup_enable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            dedup_enable(&log->dedups[level]);
+        }
+    }
+    else
+    {
+        dedup_enable(&log->dedups[level]);
+    }
+    return true;
+}
+
+bool log_dedup_disable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            dedup_disable(&log->dedups[level]);
+            _log_report_repeats(log, level);
+        }
+    }
+    else
+    {
+        dedup_disable(&log->dedups[level]);
+        _log_report_repeats(log, level);
+    }
+    return true;
+}
+
+bool log_dedup_enabled(log_t* log, LG_LEVEL level)
+{
+    return dedup_enabled(&log->dedups[level]);
+}
+
+bool log_set_dedup_timeout(log_t* log, LG_LEVEL level, uint32_t timeout_ms)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            dedup_set_timeout(&log->dedups[level], timeout_ms);
+        }
+    }
+    else
+    {
+        dedup_set_timeout(&log->dedups[level], timeout_ms);
+    }
+    return true;
+}
+
+bool log_ring_enable(log_t* log, LG_LEVEL level, size_t size)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_ring_enable(&log->handlers[level], size);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_ring_enable(&log->handlers[level], size);
+    }
+
+    return !failed;
+}
+
+bool log_ring_disable(log_t* log, LG_LEVEL level)
+{
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_ring_disable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_ring_disable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_ring_enabled(log_t* log, LG_LEVEL level)
+{
+    return handler_ring_enabled(&log->handlers[level]);
+}
+
+bool log_set_ring_dump_level(log_t* log, LG_LEVEL level)
+{
+    log_config_t* config = _log_config_copy(log);
+    if (!config)
+    {
+        return false;
+    }
+    config->ring_dump_level = level;
+    _log_config_publish(log, config);
+    return true;
+}
+
+LG_LEVEL log_ring_dump_level(log_t* log)
+{
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+    LG_LEVEL level = config->ring_dump_level;
+    snapshot_release(&log->config, token);
+    return level;
+}
+
+bool log_ring_dump(log_t* log)
+{
+    for (size_t level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        if (handler_ring_enabled(&log->handlers[level]))
+        {
+            handler_ring_dump(&log->handlers[level]);
+        }
+    }
+    return true;
+}
+
+bool log_flush(log_t* log)
+{
+    bool failed = false;
+    for (size_t level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        _log_report_repeats(log, level);
+        failed = !handler_flush(&log->handlers[level]) || failed;
+    }
+    return !failed;
+}
+
+bool log_file_enable(log_t* log, LG_LEVEL level)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_file_enable(&log->handlers[level]);
+        }
+    }
+    else
+    {
+        handler_file_enable(&log->handlers[level]);
+    }
+    return true;
+}
+
+bool log_file_disable(log_t* log, LG_LEVEL level)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            handler_file_disable(&log->handlers[level]);
+        }
+        return true;
+    }
+    else
+    {
+        handler_file_disable(&log->handlers[level]);
+        return true;
+    }
+
+    return !failed;
+}
+
+bool log_file_enabled(log_t* log, LG_LEVEL level)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_file_enabled(&log->handlers[level]);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_file_enabled(&log->handlers[level]);
+    }
+
+    return !failed;
+}
+
+bool log_set_error(log_t* log, LG_ERRNO error, const char* message)
+{
+    log->last_error = error;
+    strcpy(log->error_msg, message);
+    return true;
+}
+
+log_config_t* log_config(log_t* log, log_config_t* dest)
+{
+    uint64_t token;
+    *dest = *(const log_config_t*)snapshot_acquire(&log->config, &token);
+    snapshot_release(&log->config, token);
+    return dest;
+}
+
+bool log_set_config(log_t* log, const log_config_t* config)
+{
+    log_config_t* copy = _log_config_copy(log);
+    if (!copy)
+    {
+        return false;
+    }
+    *copy = *config;
+    _log_config_publish(log, copy);
+    return true;
+}
+
+LG_ERRNO log_get_error(log_t* log)
+{
+    return log->last_error;
+}
+
+bool log_clear_error(log_t* log)
+{
+    log->last_error = LG_E_NO_ERROR;
+}
+
+bool log_has_error(log_t* log)
+{
+    return log->last_error != LG_E_NO_ERROR;
+}
+
+bool log_set_threshold(log_t* log, LG_LEVEL threshold)
+{
+    log_config_t* config = _log_config_copy(log);
+    if (!config)
+    {
+        return false;
+    }
+    config->threshold = threshold;
+    _log_config_publish(log, config);
+    return true;
+}
+
+LG_LEVEL log_threshold(log_t* log)
+{
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+    LG_LEVEL threshold = config->threshold;
+    snapshot_release(&log->config, token);
+    return threshold;
+}
+
+bool log_set_bmode(log_t* log, LG_LEVEL level, int mode)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_set_bmode(&log->handlers[level], mode);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_set_bmode(&log->handlers[level], mode);
+    }
+
+    return !failed;
+}
+
+int log_bmode(log_t* log, LG_LEVEL level)
+{
+    return handler_bmode(&log->handlers[level]);
+}
+
+bool log_set_bsize(log_t* log, LG_LEVEL level, size_t buf_size)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_set_bsize(&log->handlers[level], buf_size);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return success = handler_set_bsize(&log->handlers[level], buf_size);
+    }
+
+    return !failed;
+}
+
+size_t log_bsize(log_t* log, LG_LEVEL level)
+{
+    return handler_bsize(&log->handlers[level]);
+}
+
+bool log_set_fmode(log_t* log, LG_LEVEL level, LG_FMODE mode)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_set_fmode(&log->handlers[level], mode);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_set_fmode(&log->handlers[level], mode);
+    }
+
+    return !failed;
+}
+
+LG_FMODE log_fmode(log_t* log, LG_LEVEL level)
+{
+    return handler_fmode(&log->handlers[level]);
+}
+
+bool log_set_cmode(log_t* log, LG_LEVEL level, LG_CMODE mode)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_set_cmode(&log->handlers[level], mode);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_set_cmode(&log->handlers[level], mode);
     }
 
     return !failed;
 }
 
-LG_FMODE log_fmode(log_t* log, LG_LEVEL level)
+LG_CMODE log_cmode(log_t* log, LG_LEVEL level)
 {
-    return handler_fmode(&log->handlers[level]);
+    return handler_cmode(&log->handlers[level]);
+}
+
+bool log_set_dmode(log_t* log, LG_LEVEL level, LG_DMODE mode)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_set_dmode(&log->handlers[level], mode);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_set_dmode(&log->handlers[level], mode);
+    }
+
+    return !failed;
+}
+
+LG_DMODE log_dmode(log_t* log, LG_LEVEL level)
+{
+    return handler_dmode(&log->handlers[level]);
+}
+
+bool log_set_sync_interval(log_t* log,
+                           LG_LEVEL level,
+                           uint32_t interval_ms,
+                           size_t interval_size)
+{
+    bool success = false;
+    bool failed = false;
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = handler_set_sync_interval(&log->handlers[level],
+                                                interval_ms,
+                                                interval_size);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        return handler_set_sync_interval(&log->handlers[level],
+                                         interval_ms,
+                                         interval_size);
+    }
+
+    return !failed;
+}
+
+bool log_set_sync_threshold(log_t* log, LG_LEVEL threshold)
+{
+    bool failed = false;
+    for (LG_LEVEL level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        handler_t* handler = &log->handlers[level];
+        if (level >= threshold)
+        {
+            failed = !handler_set_dmode(handler, LG_DMODE_SYNC) || failed;
+        }
+        else if (handler_dmode(handler) == LG_DMODE_SYNC)
+        {
+            failed = !handler_set_dmode(handler, LG_DMODE_NONE) || failed;
+        }
+    }
+    return !failed;
 }
 
 bool log_set_dname_format(log_t* log, LG_LEVEL level, const char* format)
@@ -601,12 +1556,18 @@ bool log_set_entry_format(log_t* log, LG_LEVEL level, const char* format)
 {
     bool success = false;
     bool failed = false;
+    log_config_t* config = _log_config_copy(log);
+    if (!config)
+    {
+        return false;
+    }
+
     if (level == LG_ALL_LEVELS)
     {
         success = true;
         for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
         {
-            success = formatter_set(&log->formatters[level], format);
+            success = formatter_set(&config->formatters[level], format);
             if (!failed)
             {
                 failed = !success;
@@ -615,33 +1576,529 @@ bool log_set_entry_format(log_t* log, LG_LEVEL level, const char* format)
     }
     else
     {
-        failed = !formatter_set(&log->formatters[level], format);
+        failed = !formatter_set(&config->formatters[level], format);
     }
+    _log_config_publish(log, config);
 
     return !failed;
 }
 
 char* log_entry_format(log_t* log, LG_LEVEL level, const char* dest)
 {
-    return formatter_get(&log->formatters[level], dest);
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+    char* format = formatter_get(&config->formatters[level], dest);
+    snapshot_release(&log->config, token);
+    return format;
 }
 
-bool log_write(log_t* log, LG_LEVEL level, const char* message)
+bool log_set_emode(log_t* log, LG_LEVEL level, LG_EMODE mode)
+{
+    bool success = false;
+    bool failed = false;
+    log_config_t* config = _log_config_copy(log);
+    if (!config)
+    {
+        return false;
+    }
+
+    if (level == LG_ALL_LEVELS)
+    {
+        success = true;
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            success = formatter_set_emode(&config->formatters[level], mode);
+            if (!failed)
+            {
+                failed = !success;
+            }
+        }
+    }
+    else
+    {
+        failed = !formatter_set_emode(&config->formatters[level], mode);
+    }
+    _log_config_publish(log, config);
+
+    return !failed;
+}
+
+bool log_set_tmode(log_t* log, LG_LEVEL level, LG_TMODE mode, int32_t offset_s)
+{
+    bool failed = false;
+    log_config_t* config = _log_config_copy(log);
+    if (!config)
+    {
+        return false;
+    }
+
+    /* The current local offset is computed once for every level. */
+    if (mode == LG_TMODE_FIXED && offset_s == LG_TZ_CURRENT)
+    {
+        offset_s = tz_local_offset((int64_t)time(NULL));
+    }
+    if (level == LG_ALL_LEVELS)
+    {
+        for (level = 0; level < LG_VALID_LVL_COUNT; ++level)
+        {
+            failed = !formatter_set_tmode(&config->formatters[level], mode, offset_s)
+                     || failed;
+            failed = !handler_set_tmode(&log->handlers[level], mode, offset_s)
+                     || failed;
+        }
+    }
+    else
+    {
+        failed = !formatter_set_tmode(&config->formatters[level], mode, offset_s);
+        failed = !handler_set_tmode(&log->handlers[level], mode, offset_s) || failed;
+    }
+    _log_config_publish(log, config);
+
+    return !failed;
+}
+
+LG_TMODE log_tmode(log_t* log, LG_LEVEL level)
+{
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+    LG_TMODE mode = formatter_tmode(&config->formatters[level]);
+    snapshot_release(&log->config, token);
+    return mode;
+}
+
+LG_EMODE log_emode(log_t* log, LG_LEVEL level)
+{
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+    LG_EMODE mode = formatter_emode(&config->formatters[level]);
+    snapshot_release(&log->config, token);
+    return mode;
+}
+
+/* Returns true if limiter lets an entry of level through. If the
+entries suppressed before it should be reported, a message that reports
+them is stored in summary; otherwise summary is left empty. */
+static bool _log_limit(log_t* log,
+                       LG_LEVEL level,
+                       limiter_t* limiter,
+                       char* summary)
+{
+    uint64_t suppressed = 0;
+    summary[0] = '\0';
+    if (!limiter_allow(limiter, &suppressed))
+    {
+        LG_STATS_ADD(&log->handlers[level].stats, entries_suppressed, 1);
+        return false;
+    }
+
+    if (suppressed > 0 && limiter->site)
+    {
+        snprintf(summary, LG_MAX_MSG_SIZE, "%llu messages suppressed at %s",
+                 (unsigned long long)suppressed, limiter->site);
+    }
+    else if (suppressed > 0)
+    {
+        snprintf(summary, LG_MAX_MSG_SIZE, "%llu messages suppressed",
+                 (unsigned long long)suppressed);
+    }
+    return true;
+}
+
+/* Stores a message that reports repeats repetitions in summary. */
+static void _log_format_repeats(char* summary, uint64_t repeats)
+{
+    snprintf(summary, LG_MAX_MSG_SIZE, "Last message repeated %llu times",
+             (unsigned long long)repeats);
+}
+
+/* Returns true if msg does not repeat the last message of level. If the
+repetitions of the last message should be reported, a message that
+reports them is stored in summary; otherwise summary is left empty. */
+static bool _log_dedup(log_t* log,
+                       LG_LEVEL level,
+                       const char* msg,
+                       size_t msg_len,
+                       const kv_t* kvs,
+                       size_t kv_count,
+                       char* summary)
+{
+    dedup_t* dedup = &log->dedups[level];
+    uint64_t repeats = 0;
+    summary[0] = '\0';
+    if (!dedup_enabled(dedup))
+    {
+        return true;
+    }
+
+    /* The key-value pairs are part of the message. */
+    uint64_t hash = LG_str_hash(msg, msg_len);
+    for (size_t i = 0; i < kv_count; ++i)
+    {
+        char value[LG_MAX_MSG_SIZE];
+        size_t value_len = kv_encode_value(value, sizeof(value), &kvs[i],
+                                           LG_EMODE_JSON);
+        hash = hash * 31 + LG_str_hash(kvs[i].key, LG_MAX_FIELD_KEY_SIZE);
+        hash = hash * 31 + LG_str_hash(value, value_len);
+    }
+    bool is_new = dedup_check(dedup, hash, &repeats);
+    if (!is_new)
+    {
+        LG_STATS_ADD(&log->handlers[level].stats, entries_collapsed, 1);
+    }
+    if (repeats > 0)
+    {
+        _log_format_repeats(summary, repeats);
+    }
+    return is_new;
+}
+
+/* Writes the report of the repetitions of the last message of level if
+there are any. */
+static void _log_report_repeats(log_t* log, LG_LEVEL level)
+{
+    char summary[LG_MAX_MSG_SIZE];
+    uint64_t repeats = dedup_take(&log->dedups[level]);
+    if (repeats > 0)
+    {
+        _log_format_repeats(summary, repeats);
+        log_fwrite(log, level, summary);
+    }
+}
+
+static bool _log_fwrite(log_t* log,
+                        const log_config_t* config,
+                        LG_LEVEL level,
+                        const fm_src_t* src,
+                        const char* message,
+                        const kv_t* kvs,
+                        size_t kv_count);
+
+/* Writes message with kv_count key-value pairs with config if it passes
+threshold, the deduplication, limiter and the limiter of the level. */
+static bool _log_write_config(log_t* log,
+                              const log_config_t* config,
+                              LG_LEVEL level,
+                              LG_LEVEL threshold,
+                              limiter_t* limiter,
+                              const fm_src_t* src,
+                              const char* message,
+                              const kv_t* kvs,
+                              size_t kv_count)
+{
+    char summary[LG_MAX_MSG_SIZE];
+    if (level < threshold || !config->is_enabled[level])
+    {
+        LG_STATS_ADD(&log->handlers[level].stats, entries_filtered, 1);
+        return false;
+    }
+
+    bool is_new = _log_dedup(log, level, message, LG_MAX_MSG_SIZE,
+                             kvs, kv_count, summary);
+    if (summary[0])
+    {
+        _log_fwrite(log, config, level, NULL, summary, NULL, 0);
+    }
+    if (!is_new)
+    {
+        return true;
+    }
+
+    if (limiter)
+    {
+        if (!_log_limit(log, level, limiter, summary))
+        {
+            return false;
+        }
+        if (summary[0])
+        {
+            _log_fwrite(log, config, level, NULL, summary, NULL, 0);
+        }
+    }
+    if (!_log_limit(log, level, &log->limiters[level], summary))
+    {
+        return false;
+    }
+    if (summary[0])
+    {
+        _log_fwrite(log, config, level, NULL, summary, NULL, 0);
+    }
+    return _log_fwrite(log, config, level, src, message, kvs, kv_count);
+}
+
+/* Like _log_write_config with the current configuration. A threshold
+of LG_NO_LEVEL stands for the threshold of the log. */
+static bool _log_write(log_t* log,
+                       LG_LEVEL level,
+                       LG_LEVEL threshold,
+                       limiter_t* limiter,
+                       const fm_src_t* src,
+                       const char* message,
+                       const kv_t* kvs,
+                       size_t kv_count)
 {
-    if (level >= log->threshold && log->is_enabled[level])
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+    if (threshold == LG_NO_LEVEL)
     {
-        return log_fwrite(log, level, message);
+        threshold = config->threshold;
     }
+    bool success = _log_write_config(log, config, level, threshold, limiter,
+                                     src, message, kvs, kv_count);
+    snapshot_release(&log->config, token);
+    return success;
+}
+
+bool log_write(log_t* log, LG_LEVEL level, const char* message)
+{
+    return _log_write(log, level, LG_NO_LEVEL, NULL, NULL, message, NULL, 0);
+}
+
+bool log_write_src(log_t* log,
+                   LG_LEVEL level,
+                   const fm_src_t* src,
+                   const char* message)
+{
+    return _log_write(log, level, LG_NO_LEVEL, NULL, src, message, NULL, 0);
+}
+
+bool log_write_limited(log_t* log,
+                       LG_LEVEL level,
+                       limiter_t* limiter,
+                       const char* message)
+{
+    return _log_write(log, level, LG_NO_LEVEL, limiter, NULL, message, NULL, 0);
+}
+
+bool log_writekv(log_t* log,
+                 LG_LEVEL level,
+                 const char* message,
+                 const kv_t* kvs,
+                 size_t kv_count)
+{
+    return _log_write(log, level, LG_NO_LEVEL, NULL, NULL, message, kvs, kv_count);
+}
+
+bool log_writekv_src(log_t* log,
+                     LG_LEVEL level,
+                     const fm_src_t* src,
+                     const char* message,
+                     const kv_t* kvs,
+                     size_t kv_count)
+{
+    return _log_write(log, level, LG_NO_LEVEL, NULL, src, message, kvs, kv_count);
+}
 
-    return false;
+bool log_write_threshold(log_t* log,
+                         LG_LEVEL level,
+                         LG_LEVEL threshold,
+                         const fm_src_t* src,
+                         const char* message,
+                         const kv_t* kvs,
+                         size_t kv_count)
+{
+    return _log_write(log, level, threshold, NULL, src, message, kvs, kv_count);
 }
 
 bool log_fwrite(log_t* log, LG_LEVEL level, const char* message)
 {
-    char formatted_message[LG_MAX_MSG_SIZE];
-    formatter_entry(&log->formatters[level], formatted_message, message, level);
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+    bool success = _log_fwrite(log, config, level, NULL, message, NULL, 0);
+    snapshot_release(&log->config, token);
+    return success;
+}
+
+static bool _log_fwrite(log_t* log,
+                        const log_config_t* config,
+                        LG_LEVEL level,
+                        const fm_src_t* src,
+                        const char* message,
+                        const kv_t* kvs,
+                        size_t kv_count)
+{
+    char formatted_message[LG_MAX_ENTRY_SIZE + LG_MAX_MSG_SIZE];
+    handler_t* handler = &log->handlers[level];
+    bool is_timed = config->is_timed[level];
+    uint64_t start_time = is_timed ? _monotonic_time_ns() : 0;
+    const formatter_t* formatter = &config->formatters[level];
+    fm_meta_t meta = { 0, src };
+    if (formatter_uses(formatter, LG_FM_SEQ))
+    {
+        meta.seq = LG_ATOMIC_ADD(&log->seq, 1);
+    }
+    formatter_entry_kv(formatter, formatted_message, message,
+                       LG_MAX_MSG_SIZE, level, NULL, kvs, kv_count, &meta);
+    uint64_t format_time = is_timed ? _monotonic_time_ns() : 0;
     
-    return handler_send(&log->handlers[level], formatted_message);
+    bool success = handler_send(handler, formatted_message);
+    if (level >= config->ring_dump_level)
+    {
+        log_ring_dump(log);
+    }
+    if (is_timed)
+    {
+        LG_STATS_ADD(&handler->stats, format_ns, format_time - start_time);
+        LG_STATS_ADD(&handler->stats, io_ns, _monotonic_time_ns() - format_time);
+    }
+    return success;
+}
+
+/* Sends a block of formatted entries to handler and updates its
+counters. If time is not NULL, the formatting of the block began at
+*time, and *time is set to when the block was sent, which is also when
+the formatting of the next block begins. */
+static bool _log_send_block(handler_t* handler,
+                            const char* block,
+                            const size_t* sizes,
+                            size_t count,
+                            uint64_t* time)
+{
+    if (!time)
+    {
+        return handler_send_batch(handler, block, sizes, count);
+    }
+    uint64_t send_time = _monotonic_time_ns();
+    bool success = handler_send_batch(handler, block, sizes, count);
+    uint64_t end_time = _monotonic_time_ns();
+    LG_STATS_ADD(&handler->stats, format_ns, send_time - *time);
+    LG_STATS_ADD(&handler->stats, io_ns, end_time - send_time);
+    *time = end_time;
+    return success;
+}
+
+bool log_write_batch(log_t* log, const log_entry_t* entries, size_t count)
+{
+    char block[LG_BATCH_BSIZE];
+    size_t sizes[LG_MAX_BATCH_ENTRIES];
+    size_t pending[LG_VALID_LVL_COUNT] = { 0 };
+    char summary[LG_MAX_MSG_SIZE];
+    char repeats_summary[LG_MAX_MSG_SIZE];
+    bool dump = false;
+    struct tm now;
+    bool failed = false;
+    uint64_t token;
+    const log_config_t* config = snapshot_acquire(&log->config, &token);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        LG_LEVEL level = entries[i].level;
+        if (level >= config->threshold && config->is_enabled[level])
+        {
+            ++pending[level];
+            dump = dump || level >= config->ring_dump_level;
+        }
+        else
+        {
+            LG_STATS_ADD(&log->handlers[level].stats, entries_filtered, 1);
+        }
+    }
+
+    /* The clock is read once, but the time is converted for each level
+because the levels may be in different time zones. */
+    time_t raw_time = time(NULL);
+    for (LG_LEVEL level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        handler_t* handler = &log->handlers[level];
+        size_t block_len = 0;
+        size_t block_count = 0;
+        uint64_t format_time = 0;
+        uint64_t* time_ptr = config->is_timed[level] ? &format_time : NULL;
+        bool uses_seq = formatter_uses(&config->formatters[level], LG_FM_SEQ);
+        fm_meta_t meta = { 0 };
+        if (pending[level] > 0)
+        {
+            formatter_time(&config->formatters[level], raw_time, &now);
+            if (time_ptr)
+            {
+                format_time = _monotonic_time_ns();
+            }
+        }
+
+        for (size_t i = 0; i < count && pending[level] > 0; ++i)
+        {
+            if (entries[i].level != level)
+            {
+                continue;
+            }
+            --pending[level];
+
+            /* The reports of collapsed and suppressed entries, if any,
+            go before the entry. */
+            const char* msgs[3];
+            size_t msg_lens[3];
+            const kv_t* msg_kvs[3] = { NULL, NULL, NULL };
+            size_t msg_kv_counts[3] = { 0, 0, 0 };
+            const fm_src_t* msg_srcs[3] = { NULL, NULL, NULL };
+            size_t msg_count = 0;
+            size_t msg_len = entries[i].msg_len ? entries[i].msg_len
+                                                : LG_MAX_MSG_SIZE;
+            bool is_new = _log_dedup(log, level, entries[i].msg, msg_len,
+                                     entries[i].kvs, entries[i].kv_count,
+                                     repeats_summary);
+            if (repeats_summary[0])
+            {
+                msgs[msg_count] = repeats_summary;
+                msg_lens[msg_count++] = LG_MAX_MSG_SIZE;
+            }
+            if (is_new && _log_limit(log, level, &log->limiters[level], summary))
+            {
+                if (summary[0])
+                {
+                    msgs[msg_count] = summary;
+                    msg_lens[msg_count++] = LG_MAX_MSG_SIZE;
+                }
+                msgs[msg_count] = entries[i].msg;
+                msg_kvs[msg_count] = entries[i].kvs;
+                msg_kv_counts[msg_count] = entries[i].kv_count;
+                msg_srcs[msg_count] = entries[i].src;
+                msg_lens[msg_count++] = msg_len;
+            }
+
+            for (size_t k = 0; k < msg_count; ++k)
+            {
+                /* Leave room for the longest possible entry. */
+                if (block_len + LG_MAX_ENTRY_SIZE + LG_MAX_MSG_SIZE > LG_BATCH_BSIZE
+                    || block_count == LG_MAX_BATCH_ENTRIES)
+                {
+                    failed = !_log_send_block(handler, block, sizes,
+                                              block_count, time_ptr) || failed;
+                    block_len = 0;
+                    block_count = 0;
+                }
+                if (uses_seq)
+                {
+                    meta.seq = LG_ATOMIC_ADD(&log->seq, 1);
+                }
+                meta.src = msg_srcs[k];
+
+                formatter_entry_kv(&config->formatters[level],
+                                   block + block_len,
+                                   msgs[k],
+                                   msg_lens[k],
+                                   level,
+                                   &now,
+                                   msg_kvs[k],
+                                   msg_kv_counts[k],
+                                   &meta);
+                sizes[block_count] = strlen(block + block_len);
+                block_len += sizes[block_count++] + 1;
+            }
+        }
+
+        if (block_count > 0)
+        {
+            failed = !_log_send_block(handler, block, sizes,
+                                      block_count, time_ptr) || failed;
+        }
+    }
+
+    snapshot_release(&log->config, token);
+
+    if (dump)
+    {
+        log_ring_dump(log);
+    }
+    return !failed;
 }
 
 bool log_trace(log_t* log, const char* message)
@@ -691,5 +2148,16 @@ bool log_emergency(log_t* log, const char* message)
 
 bool log_fatal(log_t* log, const char* message)
 {
-    return log_write(log, LG_FATAL, message);
+    bool success = log_write(log, LG_FATAL, message);
+
+    /* The process is likely about to die: get everything to disk. */
+    log_flush(log);
+    for (size_t level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        if (handler_file_enabled(&log->handlers[level]))
+        {
+            handler_sync(&log->handlers[level]);
+        }
+    }
+    return success;
 }
@@ -12,20 +12,58 @@
 #define LG_LOG_H
 
 #include "flags.h"
+#include "dedup.h"
 #include "handler.h"
+#include "limiter.h"
 #include "log_level.h"
+#include "snapshot.h"
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdio.h>
 
-/* Log. */
+struct category_s;
+
+/* The part of the configuration of a log that the write path reads.
+It is never changed in place: setters publish a changed copy, see
+snapshot.h, so that writers need no locks. */
 typedef struct
 {
-    handler_t   handlers[LG_VALID_LVL_COUNT];
     formatter_t formatters[LG_VALID_LVL_COUNT];
-
     bool        is_enabled[LG_VALID_LVL_COUNT];
+
+    /* Indicates whether the write path measures its time, see
+    log_timing_enable. */
+    bool        is_timed[LG_VALID_LVL_COUNT];
     LG_LEVEL    threshold;
+
+    /* Writing an entry at or above this level dumps the flight
+    recorders of all levels. */
+    LG_LEVEL    ring_dump_level;
+} log_config_t;
+
+/* Log. */
+typedef struct
+{
+    handler_t   handlers[LG_VALID_LVL_COUNT];
+    limiter_t   limiters[LG_VALID_LVL_COUNT];
+    dedup_t     dedups[LG_VALID_LVL_COUNT];
+
+    /* The asynchronous output backend shared by the handlers,
+    created on demand. */
+    uring_t*    uring;
+
+    /* The current log_config_t. */
+    snapshot_t  config;
+
+    /* The categories of the log, see category.h. */
+    struct category_s* categories;
+
+    /* Serializes changes to the configuration and the categories. */
+    LG_mutex_t  config_lock;
+
+    /* The sequence number of the next entry, see %(seq). */
+    uint64_t    seq;
+
     uint64_t    flags;
     LG_ERRNO    last_error;
     char        error_msg[LG_MAX_ERR_MSG_SIZE];
@@ -33,6 +71,32 @@ typedef struct
     bool        is_dynamic;
 } log_t;
 
+/* An entry of log_write_batch. */
+typedef struct
+{
+    LG_LEVEL    level;
+    const char* msg;
+
+    /* The length of msg, or 0 if msg is null-terminated. */
+    size_t      msg_len;
+
+    /* The key-value pairs of the entry, see log_writekv. */
+    const kv_t* kvs;
+    size_t      kv_count;
+
+    /* The source location of the entry, e.g. LG_SRC, or NULL. */
+    const fm_src_t* src;
+} log_entry_t;
+
+/* A snapshot of the write path counters of a log. */
+typedef struct
+{
+    stats_t     levels[LG_VALID_LVL_COUNT];
+
+    /* The sum of all levels. */
+    stats_t     total;
+} log_stats_t;
+
 log_t* log_init(log_t* buffer);
 
 bool log_free(log_t* log);
@@ -45,12 +109,64 @@ bool log_enabled(log_t* log, LG_LEVEL level);
 
 bool log_set_user_output(log_t* log, LG_LEVEL level, bool(*user_output)(const char*));
 
+/* Names the calling thread for the %(thread_name) format macro. */
+bool log_set_thread_name(const char* name);
+
+/* Registers a user output that receives the entries in batches, see
+handler_user_batch_register. */
+bool log_set_user_batch_output(log_t* log,
+                               LG_LEVEL level,
+                               bool (*user_output)(void* ctx,
+                                                   const sink_entry_t* entries,
+                                                   size_t count),
+                               void* ctx);
+
 bool log_user_output_enable(log_t* log, LG_LEVEL level);
 
 bool log_user_output_disable(log_t* log, LG_LEVEL level);
 
 bool log_user_output_enabled(log_t* log, LG_LEVEL level);
 
+/* Attaches a sink to the level, see sink.h. With LG_ALL_LEVELS the sink
+is attached to every level separately, and its close function is called
+once for each of them. */
+bool log_sink_attach(log_t* log,
+                     LG_LEVEL level,
+                     const sink_vtable_t* vtable,
+                     void* ctx);
+
+bool log_sink_detach(log_t* log,
+                     LG_LEVEL level,
+                     const sink_vtable_t* vtable,
+                     void* ctx);
+
+/* Sends the entries of the level to the local syslog daemon or journald
+with the severity of the level, see dgram.h. */
+bool log_dgram_enable(log_t* log,
+                      LG_LEVEL level,
+                      LG_DGRAM_PROTO proto,
+                      const char* path,
+                      const char* ident);
+
+bool log_dgram_disable(log_t* log, LG_LEVEL level);
+
+bool log_dgram_enabled(log_t* log, LG_LEVEL level);
+
+/* Sends the entries of the level to a collector at host:port, see
+net.h. With LG_ALL_LEVELS, every level shares one queue and
+connection. */
+bool log_net_enable(log_t* log,
+                    LG_LEVEL level,
+                    LG_NET_PROTO proto,
+                    const char* host,
+                    const char* port,
+                    size_t queue_size,
+                    const char* spill_path);
+
+bool log_net_disable(log_t* log, LG_LEVEL level);
+
+bool log_net_enabled(log_t* log, LG_LEVEL level);
+
 /* TODO */
 bool log_fclose_enable(log_t* log, LG_LEVEL level);
 
@@ -75,13 +191,12 @@ bool log_strict_fsize_disable(log_t* log, LG_LEVEL level);
 
 bool log_strict_fsize_enabled(log_t* log, LG_LEVEL level);
 
-/* TODO */
+/* Enables safe writing in the same log files from several
+processes, see handler_flock_enable. */
 bool log_flock_enable(log_t* log, LG_LEVEL level);
 
-/* TODO */
 bool log_flock_disable(log_t* log, LG_LEVEL level);
 
-/* TODO */
 bool log_flock_enabled(log_t* log, LG_LEVEL level);
 
 bool log_stdout_enable(log_t* log, LG_LEVEL level);
@@ -96,12 +211,122 @@ bool log_stderr_disable(log_t* log, LG_LEVEL level);
 
 bool log_stderr_enabled(log_t* log, LG_LEVEL level);
 
+/* Enables preallocating the log files of the level to their maximum
+size, see handler_prealloc_enable. */
+bool log_prealloc_enable(log_t* log, LG_LEVEL level);
+
+bool log_prealloc_disable(log_t* log, LG_LEVEL level);
+
+bool log_prealloc_enabled(log_t* log, LG_LEVEL level);
+
+/* Makes the level write in files through the uring backend,
+so that the files of all levels can be written concurrently. */
+bool log_uring_enable(log_t* log, LG_LEVEL level);
+
+bool log_uring_disable(log_t* log, LG_LEVEL level);
+
+bool log_uring_enabled(log_t* log, LG_LEVEL level);
+
+/* Makes each thread buffer the entries of the level and hand them
+over in blocks, see handler_tbuf_enable. */
+bool log_tbuf_enable(log_t* log, LG_LEVEL level);
+
+bool log_tbuf_disable(log_t* log, LG_LEVEL level);
+
+bool log_tbuf_enabled(log_t* log, LG_LEVEL level);
+
+bool log_set_tbuf_timeout(log_t* log, LG_LEVEL level, uint32_t timeout_ms);
+
+/* Makes the level write buffered entries in the order they were
+logged in, regardless of the thread. */
+bool log_tbuf_merge_enable(log_t* log, LG_LEVEL level);
+
+bool log_tbuf_merge_disable(log_t* log, LG_LEVEL level);
+
+bool log_tbuf_merge_enabled(log_t* log, LG_LEVEL level);
+
+/* Makes the level write out its buffered data if the process dies of a
+fatal signal or exits, see crash.h. */
+bool log_crash_flush_enable(log_t* log, LG_LEVEL level);
+
+bool log_crash_flush_disable(log_t* log, LG_LEVEL level);
+
+bool log_crash_flush_enabled(log_t* log, LG_LEVEL level);
+
+/* Lets through at most rate entries of the level per second on average,
+and up to burst entries at once. A rate of 0 removes the limit. The
+number of suppressed entries is reported in an entry of the level at
+most once every LG_LIMIT_SUMMARY_MS milliseconds. */
+bool log_set_rate_limit(log_t* log,
+                        LG_LEVEL level,
+                        uint32_t rate,
+                        uint32_t burst);
+
+/* Lets through only 1 of every n entries of the level. An n of 0 or 1
+lets through every entry. */
+bool log_set_sampling(log_t* log, LG_LEVEL level, uint32_t n);
+
+/* Collapses runs of identical messages of the level into the first
+message and a report of the number of repetitions, see dedup.h. A run
+is reported when a different message is written, every timeout while
+it lasts, and on log_flush. */
+bool log_dedup_enable(log_t* log, LG_LEVEL level);
+
+bool log_dedup_disable(log_t* log, LG_LEVEL level);
+
+bool log_dedup_enabled(log_t* log, LG_LEVEL level);
+
+bool log_set_dedup_timeout(log_t* log, LG_LEVEL level, uint32_t timeout_ms);
+
+/* Makes the level keep its file output in a flight recorder of size
+bytes, see handler_ring_enable. */
+bool log_ring_enable(log_t* log, LG_LEVEL level, size_t size);
+
+bool log_ring_disable(log_t* log, LG_LEVEL level);
+
+bool log_ring_enabled(log_t* log, LG_LEVEL level);
+
+/* Sets the level at or above which writing an entry dumps the flight
+recorders. */
+bool log_set_ring_dump_level(log_t* log, LG_LEVEL level);
+
+LG_LEVEL log_ring_dump_level(log_t* log);
+
+/* Writes the contents of the flight recorders of all levels in their
+files. */
+bool log_ring_dump(log_t* log);
+
+/* Writes out the entries buffered by all levels. */
+bool log_flush(log_t* log);
+
+/* Takes a snapshot of the counters of all levels. The counters keep
+running while the snapshot is taken, so they are consistent with each
+other only approximately. */
+bool log_stats(log_t* log, log_stats_t* dest);
+
+/* Makes the write path of the level measure the time it spends
+formatting and sending entries, see format_ns and io_ns in stats.h.
+This costs three reads of the monotonic clock per entry, or two per
+block of log_write_batch, so it is disabled by default. */
+bool log_timing_enable(log_t* log, LG_LEVEL level);
+
+bool log_timing_disable(log_t* log, LG_LEVEL level);
+
+bool log_timing_enabled(log_t* log, LG_LEVEL level);
+
 bool log_file_enable(log_t* log, LG_LEVEL level);
 
 bool log_file_disable(log_t* log, LG_LEVEL level);
 
 bool log_file_enabled(log_t* log, LG_LEVEL level);
 
+/* Copies the configuration that the write path reads in dest. */
+log_config_t* log_config(log_t* log, log_config_t* dest);
+
+/* Replaces the configuration that the write path reads with a copy of
+config in one step. */
+bool log_set_config(log_t* log, const log_config_t* config);
+
 bool log_set_error(log_t* log, LG_ERRNO error, const char* message);
 
 LG_ERRNO log_get_error(log_t* log);
@@ -126,6 +351,24 @@ bool log_set_fmode(log_t* log, LG_LEVEL level, LG_FMODE mode);
 
 LG_FMODE log_fmode(log_t* log, LG_LEVEL level);
 
+bool log_set_cmode(log_t* log, LG_LEVEL level, LG_CMODE mode);
+
+LG_CMODE log_cmode(log_t* log, LG_LEVEL level);
+
+bool log_set_dmode(log_t* log, LG_LEVEL level, LG_DMODE mode);
+
+LG_DMODE log_dmode(log_t* log, LG_LEVEL level);
+
+bool log_set_sync_interval(log_t* log,
+                           LG_LEVEL level,
+                           uint32_t interval_ms,
+                           size_t interval_size);
+
+/* Puts the levels at or above threshold in LG_DMODE_SYNC mode, so that
+their entries survive a crash. Levels below threshold that were in
+LG_DMODE_SYNC mode are put in LG_DMODE_NONE mode. */
+bool log_set_sync_threshold(log_t* log, LG_LEVEL threshold);
+
 bool log_set_dname_format(log_t* log, LG_LEVEL level, const char* dname_format);
 
 /* TODO */
@@ -173,10 +416,93 @@ bool log_set_static_entry_format(log_t* log, LG_LEVEL level, const char* format)
 
 char* log_entry_format(log_t* log, LG_LEVEL level, const char* dest);
 
+/* Sets the syntax of the entries of the level. In LG_EMODE_JSON and
+LG_EMODE_LOGFMT the entry format is a whitespace-separated list of
+fields, see formatter_set_emode. */
+bool log_set_emode(log_t* log, LG_LEVEL level, LG_EMODE mode);
+
+LG_EMODE log_emode(log_t* log, LG_LEVEL level);
+
+/* Sets the time zone of the time macros in the entries and the file
+and directory names of the level, see formatter_set_tmode. */
+bool log_set_tmode(log_t* log, LG_LEVEL level, LG_TMODE mode, int32_t offset_s);
+
+LG_TMODE log_tmode(log_t* log, LG_LEVEL level);
+
 bool log_write(log_t* log, LG_LEVEL level, const char* message);
 
 bool log_fwrite(log_t* log, LG_LEVEL level, const char* message);
 
+/* Like log_write, but the entry also carries kv_count key-value pairs.
+They are written as fields of the entry in LG_EMODE_JSON and
+LG_EMODE_LOGFMT, and as logfmt after the message in LG_EMODE_TEXT. */
+bool log_writekv(log_t* log,
+                 LG_LEVEL level,
+                 const char* message,
+                 const kv_t* kvs,
+                 size_t kv_count);
+
+/* Like log_writekv_src, but filters the entry by threshold instead of
+the threshold of the log, or by the threshold of the log if threshold
+is LG_NO_LEVEL. Used by categories. */
+bool log_write_threshold(log_t* log,
+                         LG_LEVEL level,
+                         LG_LEVEL threshold,
+                         const fm_src_t* src,
+                         const char* message,
+                         const kv_t* kvs,
+                         size_t kv_count);
+
+/* Like log_write, but the entry must also pass limiter, which may be
+NULL. Used by LG_WRITE_LIMITED. */
+bool log_write_limited(log_t* log,
+                       LG_LEVEL level,
+                       limiter_t* limiter,
+                       const char* message);
+
+/* Like log_write, with the source location of the entry for the
+%(file), %(line) and %(func) format macros. Used by LG_WRITE. */
+bool log_write_src(log_t* log,
+                   LG_LEVEL level,
+                   const fm_src_t* src,
+                   const char* message);
+
+/* Like log_writekv, with the source location of the entry. Used by
+LG_WRITEKV. */
+bool log_writekv_src(log_t* log,
+                     LG_LEVEL level,
+                     const fm_src_t* src,
+                     const char* message,
+                     const kv_t* kvs,
+                     size_t kv_count);
+
+/* Write an entry with the location of the call site. */
+#define LG_WRITE(log, level, message) \
+    log_write_src((log), (level), LG_SRC, (message))
+#define LG_WRITEKV(log, level, message, kvs, kv_count) \
+    log_writekv_src((log), (level), LG_SRC, (message), (kvs), (kv_count))
+
+#define LG_STRINGIFY(x) #x
+#define LG_LINE_STR(line) LG_STRINGIFY(line)
+
+/* Writes an entry through a limiter of its own for the call site, so
+that a hot call site can be limited without affecting the rest of the
+level. */
+#define LG_WRITE_LIMITED(log, level, rate, burst, message) \
+    do \
+    { \
+        static limiter_t LG_site_limiter = LG_LIMITER_INIT( \
+            rate, burst, 0, __FILE__ ":" LG_LINE_STR(__LINE__)); \
+        log_write_limited((log), (level), &LG_site_limiter, (message)); \
+    } while (0)
+
+/* Writes count entries in one call. The clock is read once for all of
+them, and the entries of each level are formatted in a block that is
+sent to the level's handler at once. The entries of a level are written
+in the order they appear in. Returns false if an entry that passed the
+threshold could not be sent. */
+bool log_write_batch(log_t* log, const log_entry_t* entries, size_t count);
+
 bool log_trace(log_t* log, const char* message);
 
 bool log_debug(log_t* log, const char* message);
@@ -195,6 +521,8 @@ bool log_alert(log_t* log, const char* message);
 
 bool log_emergency(log_t* log, const char* message);
 
+/* Writes the entry, then flushes all levels and forces the data of their
+log files to disk before returning. */
 bool log_fatal(log_t* log, const char* message);
 
 #endif /* LG_LOG_H */
@@ -31,7 +31,7 @@ typedef enum {
 } LG_LEVEL;
 #define LG_VALID_LVL_COUNT (LG_FATAL + 1)
 
-const LG_LEVEL LG_VALID_LEVELS[LG_VALID_LVL_COUNT];
-const char* const LG_LEVEL_STRS[LG_VALID_LVL_COUNT];
+extern const LG_LEVEL LG_VALID_LEVELS[LG_VALID_LVL_COUNT];
+extern const char* const LG_LEVEL_STRS[LG_VALID_LVL_COUNT];
 
 #endif /* LOG_LEVEL_H */
@@ -16,6 +16,7 @@
 
 #define LG_DEF_MAX_FSIZE 1048576 /* 1 MiB */
 #define LG_DEF_THRESHOLD LG_TRACE
+#define LG_DEF_RING_DUMP_LEVEL LG_ERROR
 #define LG_DEF_ENTRY_FORMAT "%(MSG)\n"
 
 #define LG_MAX_BSIZE 8192
@@ -28,6 +29,44 @@
 #define LG_MAX_E_FORMAT_SIZE 256
 #define LG_MAX_ENTRY_SIZE 1024
 #define LG_MAX_ERR_MSG_SIZE 256
+#define LG_DEF_SYNC_INTERVAL_MS 1000
+#define LG_DEF_SYNC_INTERVAL_SIZE 0 /* No size limit. */
+#define LG_TBUF_SIZE 65536
+#define LG_MAX_TBUFS 64
+#define LG_DEF_TBUF_TIMEOUT_MS 100
+#define LG_BATCH_BSIZE 16384
+#define LG_MAX_BATCH_ENTRIES 256
+#define LG_MAX_CRASH_HANDLERS 256
+#define LG_LIMIT_SUMMARY_MS 1000
+#define LG_DEF_DEDUP_TIMEOUT_MS 10000
+#define LG_MAX_FIELDS 16
+#define LG_MAX_FIELD_KEY_SIZE 64
+#define LG_MAX_CATEGORY_NAME_SIZE 128
+#define LG_CONFIG_ENV "LG_CONFIG"
+#define LG_MAX_CONFIG_SIZE 65536
+#define LG_MAX_CONFIG_WATCHES 16
+#define LG_MAX_SINKS 8
+#define LG_SINK_BSIZE 16384
+#define LG_MAX_SINK_ENTRIES 256
+#define LG_SYSLOG_PATH "/dev/log"
+#define LG_JOURNALD_PATH "/run/systemd/journal/socket"
+#define LG_DEF_DGRAM_IDENT "logger"
+#define LG_DGRAM_FACILITY 1 /* user */
+#define LG_MAX_DGRAM_HEADER_SIZE 256
+#define LG_MAX_DGRAM_BATCH 64
+#define LG_MAX_NET_HOST_SIZE 256
+#define LG_MAX_NET_PORT_SIZE 32
+#define LG_DEF_NET_QUEUE_SIZE 1048576 /* 1 MiB */
+#define LG_NET_SEND_BSIZE 65536
+#define LG_NET_MIN_BACKOFF_MS 100
+#define LG_NET_MAX_BACKOFF_MS 30000
+#define LG_NET_CONNECT_TIMEOUT_MS 5000
+#define LG_NET_SEND_TIMEOUT_MS 5000
+#define LG_MAX_NET_IOVECS 64
+#define LG_MAX_HOST_SIZE 65
+#define LG_MAX_THREAD_NAME_SIZE 32
+#define LG_MAX_THREAD_EXIT_HOOKS 4
+#define LG_CACHE_LINE_SIZE 64
 
 /* The sizes of expanded format macros. */
 #define LG_FM_YEAR_EXP_SIZE 5
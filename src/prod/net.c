@@ -0,0 +1,602 @@
+/*
+ * File: net.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+/* Exposes getaddrinfo. */
+#define _GNU_SOURCE
+
+#include "alloc.h"
+#include "net.h"
+#include "os.h"
+#include <errno.h>
+#include <string.h>
+#ifndef LG_USE_WINAPI
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static bool _net_sink_write(void* ctx, const sink_entry_t* entries, size_t count);
+static bool _net_sink_flush(void* ctx);
+static void _net_sink_close(void* ctx);
+
+const sink_vtable_t LG_NET_SINK = { _net_sink_write, _net_sink_flush, _net_sink_close };
+
+#ifdef LG_USE_WINAPI
+
+net_t* net_init(net_t* buffer,
+                LG_NET_PROTO proto,
+                const char* host,
+                const char* port,
+                size_t queue_size,
+                const char* spill_path)
+{
+    return NULL;
+}
+
+void net_free(net_t* net)
+{
+}
+
+bool net_write(net_t* net, const sink_entry_t* entries, size_t count)
+{
+    return false;
+}
+
+bool net_flush(net_t* net)
+{
+    return false;
+}
+
+#else
+
+static void   _net_run       (void* arg);
+static bool   _net_connect   (net_t* net);
+static void   _net_disconnect(net_t* net);
+static bool   _net_send_out  (net_t* net, uint64_t* dropped);
+static void   _net_take      (net_t* net);
+static bool   _net_spill     (net_t* net, const char* data, size_t size);
+static void   _net_spill_rest(net_t* net);
+static void   _net_queue_put (net_t* net, const void* data, size_t size);
+static void   _net_queue_get (net_t* net, void* dest, size_t size);
+
+net_t* net_init(net_t* buffer,
+                LG_NET_PROTO proto,
+                const char* host,
+                const char* port,
+                size_t queue_size,
+                const char* spill_path)
+{
+    if (strlen(host) >= LG_MAX_NET_HOST_SIZE
+        || strlen(port) >= LG_MAX_NET_PORT_SIZE
+        || (spill_path && strlen(spill_path) >= LG_MAX_FPATH_SIZE))
+    {
+        return NULL;
+    }
+    if (queue_size == 0)
+    {
+        queue_size = LG_DEF_NET_QUEUE_SIZE;
+    }
+
+    net_t* net = buffer;
+    if (!net)
+    {
+        net = LG_alloc(sizeof(net_t));
+        if (!net)
+        {
+            return NULL;
+        }
+        net->is_dynamic = true;
+    }
+    else
+    {
+        net->is_dynamic = false;
+    }
+
+    net->queue = LG_alloc(queue_size);
+    if (!net->queue)
+    {
+        if (net->is_dynamic)
+        {
+            LG_dealloc(net);
+        }
+        return NULL;
+    }
+
+    net->proto = proto;
+    strcpy(net->host, host);
+    strcpy(net->port, port);
+    net->queue_size = queue_size;
+    net->queue_head = 0;
+    net->queue_len = 0;
+    net->out_len = 0;
+    net->out_pos = 0;
+    net->out_part = 0;
+    net->out_count = 0;
+    strcpy(net->spill_path, spill_path ? spill_path : "");
+    net->spill_file = NULL;
+    net->fd = -1;
+    net->dropped = 0;
+    net->spilled = 0;
+    net->sent = 0;
+    net->is_connected = false;
+    net->is_waiting = false;
+    net->is_stopping = false;
+    net->refs = 0;
+    LG_mutex_init(&net->lock);
+    LG_cond_init(&net->cond);
+
+    if (!LG_thread_create(&net->thread, _net_run, net))
+    {
+        LG_cond_free(&net->cond);
+        LG_mutex_free(&net->lock);
+        LG_dealloc(net->queue);
+        if (net->is_dynamic)
+        {
+            LG_dealloc(net);
+        }
+        return NULL;
+    }
+    return net;
+}
+
+void net_free(net_t* net)
+{
+    LG_mutex_lock(&net->lock);
+    net->is_stopping = true;
+    LG_cond_broadcast(&net->cond);
+    LG_mutex_unlock(&net->lock);
+    LG_thread_join(&net->thread);
+
+    _net_disconnect(net);
+    if (net->spill_file)
+    {
+        fclose(net->spill_file);
+    }
+    LG_cond_free(&net->cond);
+    LG_mutex_free(&net->lock);
+    LG_dealloc(net->queue);
+    if (net->is_dynamic)
+    {
+        LG_dealloc(net);
+    }
+}
+
+bool net_write(net_t* net, const sink_entry_t* entries, size_t count)
+{
+    bool failed = false;
+    LG_mutex_lock(&net->lock);
+    for (size_t i = 0; i < count; ++i)
+    {
+        uint32_t size = (uint32_t)entries[i].size;
+        size_t record_size = sizeof(size) + size;
+        if (record_size > LG_NET_SEND_BSIZE)
+        {
+            ++net->dropped;
+            failed = true;
+        }
+        else if (record_size <= net->queue_size - net->queue_len)
+        {
+            _net_queue_put(net, &size, sizeof(size));
+            _net_queue_put(net, entries[i].data, size);
+        }
+        else if (net->spill_path[0] != '\0'
+                 && _net_spill(net, entries[i].data, size))
+        {
+            ++net->spilled;
+        }
+        else
+        {
+            ++net->dropped;
+            failed = true;
+        }
+    }
+    if (net->is_waiting && net->queue_len > 0)
+    {
+        LG_cond_signal(&net->cond);
+    }
+    LG_mutex_unlock(&net->lock);
+    return !failed;
+}
+
+bool net_flush(net_t* net)
+{
+    LG_mutex_lock(&net->lock);
+    if (net->is_waiting && net->queue_len > 0)
+    {
+        LG_cond_signal(&net->cond);
+    }
+    if (net->spill_file)
+    {
+        fflush(net->spill_file);
+    }
+    LG_mutex_unlock(&net->lock);
+    return true;
+}
+
+/* The background thread. It takes entries off the queue, and sends
+them without holding the lock, so that writers only ever wait for
+the entries to be copied. */
+void _net_run(void* arg)
+{
+    net_t* net = arg;
+    uint32_t backoff_ms = LG_NET_MIN_BACKOFF_MS;
+
+    LG_mutex_lock(&net->lock);
+    while (true)
+    {
+        if (net->out_pos == net->out_len)
+        {
+            _net_take(net);
+        }
+        if (net->out_len == 0)
+        {
+            if (net->is_stopping)
+            {
+                break;
+            }
+            net->is_waiting = true;
+            LG_cond_wait(&net->cond, &net->lock);
+            net->is_waiting = false;
+            continue;
+        }
+
+        if (net->fd < 0)
+        {
+            if (net->is_stopping)
+            {
+                break;
+            }
+            LG_mutex_unlock(&net->lock);
+            bool is_connected = _net_connect(net);
+            LG_mutex_lock(&net->lock);
+            net->is_connected = is_connected;
+            if (!is_connected)
+            {
+                /* Writers do not wake the thread up here, only
+                stopping does. */
+                if (!net->is_stopping)
+                {
+                    LG_cond_timedwait(&net->cond, &net->lock, backoff_ms);
+                }
+                backoff_ms = backoff_ms * 2 > LG_NET_MAX_BACKOFF_MS
+                             ? LG_NET_MAX_BACKOFF_MS
+                             : backoff_ms * 2;
+                continue;
+            }
+            backoff_ms = LG_NET_MIN_BACKOFF_MS;
+        }
+
+        LG_mutex_unlock(&net->lock);
+        uint64_t dropped = 0;
+        bool success = _net_send_out(net, &dropped);
+        if (!success)
+        {
+            _net_disconnect(net);
+        }
+        LG_mutex_lock(&net->lock);
+        net->dropped += dropped;
+        if (!success)
+        {
+            net->is_connected = false;
+        }
+    }
+    _net_spill_rest(net);
+    LG_mutex_unlock(&net->lock);
+}
+
+bool _net_connect(net_t* net)
+{
+    struct addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = net->proto == LG_NET_UDP ? SOCK_DGRAM : SOCK_STREAM;
+    struct addrinfo* addrs;
+    if (getaddrinfo(net->host, net->port, &hints, &addrs) != 0)
+    {
+        return false;
+    }
+
+    for (struct addrinfo* addr = addrs; addr && net->fd < 0; addr = addr->ai_next)
+    {
+        int fd = socket(addr->ai_family, addr->ai_socktype | SOCK_CLOEXEC, addr->ai_protocol);
+        if (fd < 0)
+        {
+            continue;
+        }
+
+        /* Connects without blocking so that the attempt can time out. */
+        int flags = fcntl(fd, F_GETFL);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        bool success = connect(fd, addr->ai_addr, addr->ai_addrlen) == 0;
+        if (!success && errno == EINPROGRESS)
+        {
+            struct pollfd pfd = { fd, POLLOUT, 0 };
+            int error = 0;
+            socklen_t len = sizeof(error);
+            success = poll(&pfd, 1, LG_NET_CONNECT_TIMEOUT_MS) == 1
+                      && getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len) == 0
+                      && error == 0;
+        }
+        if (!success)
+        {
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFL, flags);
+
+        /* A collector that stops reading must not hold the thread
+        forever. */
+        struct timeval timeout = {
+            LG_NET_SEND_TIMEOUT_MS / 1000,
+            (LG_NET_SEND_TIMEOUT_MS % 1000) * 1000
+        };
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        net->fd = fd;
+    }
+    freeaddrinfo(addrs);
+    return net->fd >= 0;
+}
+
+void _net_disconnect(net_t* net)
+{
+    if (net->fd >= 0)
+    {
+        close(net->fd);
+        net->fd = -1;
+    }
+}
+
+/* Sends the rest of the out buffer. A datagram that cannot be sent is
+dropped and counted in dropped, but a failed stream is connected again
+and the rest is sent then. */
+bool _net_send_out(net_t* net, uint64_t* dropped)
+{
+    if (net->proto == LG_NET_UDP)
+    {
+        while (net->out_pos < net->out_len)
+        {
+            uint32_t size;
+            memcpy(&size, net->out + net->out_pos, sizeof(size));
+            const char* data = net->out + net->out_pos + sizeof(size);
+            ssize_t result;
+            do
+            {
+                result = send(net->fd, data, size, MSG_NOSIGNAL);
+            } while (result < 0 && errno == EINTR);
+            *dropped += result < 0 ? 1 : 0;
+            net->out_pos += sizeof(size) + size;
+        }
+        LG_ATOMIC_ADD(&net->sent, net->out_count - *dropped);
+        return true;
+    }
+
+    /* A stream is sent with as few calls as possible, but out_pos only
+    moves past whole entries. If the connection fails in the middle of
+    an entry, the entry is sent again from its start on the next
+    connection, so that the collector never receives the tail of an
+    entry without its head. */
+    while (net->out_pos < net->out_len)
+    {
+        struct iovec iovecs[LG_MAX_NET_IOVECS];
+        struct msghdr msg;
+        size_t total = 0;
+        size_t part = net->out_part;
+        memset(&msg, 0x00, sizeof(msg));
+        msg.msg_iov = iovecs;
+        for (size_t pos = net->out_pos;
+             pos < net->out_len && msg.msg_iovlen < LG_MAX_NET_IOVECS;)
+        {
+            uint32_t size;
+            memcpy(&size, net->out + pos, sizeof(size));
+            iovecs[msg.msg_iovlen].iov_base = net->out + pos + sizeof(size) + part;
+            iovecs[msg.msg_iovlen].iov_len = size - part;
+            total += size - part;
+            ++msg.msg_iovlen;
+            part = 0;
+            pos += sizeof(size) + size;
+        }
+
+        ssize_t result;
+        do
+        {
+            result = sendmsg(net->fd, &msg, MSG_NOSIGNAL);
+        } while (result < 0 && errno == EINTR);
+        if (result < 0 || (result == 0 && total > 0))
+        {
+            net->out_part = 0;
+            return false;
+        }
+
+        size_t sent = (size_t)result;
+        while (net->out_pos < net->out_len)
+        {
+            uint32_t size;
+            memcpy(&size, net->out + net->out_pos, sizeof(size));
+            size_t left = size - net->out_part;
+            if (sent < left)
+            {
+                net->out_part += sent;
+                break;
+            }
+            sent -= left;
+            net->out_part = 0;
+            net->out_pos += sizeof(size) + size;
+        }
+    }
+    LG_ATOMIC_ADD(&net->sent, net->out_count);
+    return true;
+}
+
+/* Moves whole records from the queue to the out buffer. */
+void _net_take(net_t* net)
+{
+    net->out_len = 0;
+    net->out_pos = 0;
+    net->out_part = 0;
+    net->out_count = 0;
+    while (net->queue_len > 0)
+    {
+        uint32_t size;
+        size_t head = net->queue_head;
+        size_t len = net->queue_len;
+        _net_queue_get(net, &size, sizeof(size));
+        if (net->out_len + sizeof(size) + size > LG_NET_SEND_BSIZE)
+        {
+            net->queue_head = head;
+            net->queue_len = len;
+            break;
+        }
+        memcpy(net->out + net->out_len, &size, sizeof(size));
+        net->out_len += sizeof(size);
+        _net_queue_get(net, net->out + net->out_len, size);
+        net->out_len += size;
+        ++net->out_count;
+    }
+}
+
+/* Appends data to the spill file, opening it first if needed. */
+bool _net_spill(net_t* net, const char* data, size_t size)
+{
+    if (!net->spill_file)
+    {
+        net->spill_file = fopen(net->spill_path, "ab");
+    }
+    return net->spill_file && fwrite(data, 1, size, net->spill_file) == size;
+}
+
+/* Spills or drops what is left when the thread stops. */
+void _net_spill_rest(net_t* net)
+{
+    bool can_spill = net->spill_path[0] != '\0';
+    /* The entries that were not sent in whole, including one that a
+    stream sent in part. */
+    for (size_t pos = net->out_pos; pos < net->out_len;)
+    {
+        uint32_t size;
+        memcpy(&size, net->out + pos, sizeof(size));
+        if (can_spill && _net_spill(net, net->out + pos + sizeof(size), size))
+        {
+            ++net->spilled;
+        }
+        else
+        {
+            ++net->dropped;
+        }
+        pos += sizeof(size) + size;
+    }
+    net->out_len = 0;
+    net->out_pos = 0;
+    net->out_part = 0;
+
+    /* The out buffer holds the largest entry. */
+    while (net->queue_len > 0)
+    {
+        uint32_t size;
+        _net_queue_get(net, &size, sizeof(size));
+        _net_queue_get(net, net->out, size);
+        if (can_spill && _net_spill(net, net->out, size))
+        {
+            ++net->spilled;
+        }
+        else
+        {
+            ++net->dropped;
+        }
+    }
+}
+
+void _net_queue_put(net_t* net, const void* data, size_t size)
+{
+    size_t tail = (net->queue_head + net->queue_len) % net->queue_size;
+    size_t first = net->queue_size - tail < size ? net->queue_size - tail : size;
+    memcpy(net->queue + tail, data, first);
+    memcpy(net->queue, (const char*)data + first, size - first);
+    net->queue_len += size;
+}
+
+void _net_queue_get(net_t* net, void* dest, size_t size)
+{
+    size_t head = net->queue_head;
+    size_t first = net->queue_size - head < size ? net->queue_size - head : size;
+    memcpy(dest, net->queue + head, first);
+    memcpy((char*)dest + first, net->queue, size - first);
+    net->queue_head = (head + size) % net->queue_size;
+    net->queue_len -= size;
+}
+
+#endif /* LG_USE_WINAPI */
+
+void net_retain(net_t* net)
+{
+    LG_mutex_lock(&net->lock);
+    ++net->refs;
+    LG_mutex_unlock(&net->lock);
+}
+
+void net_release(net_t* net)
+{
+    LG_mutex_lock(&net->lock);
+    bool is_last = --net->refs == 0;
+    LG_mutex_unlock(&net->lock);
+    if (is_last)
+    {
+        net_free(net);
+    }
+}
+
+bool net_connected(net_t* net)
+{
+    LG_mutex_lock(&net->lock);
+    bool is_connected = net->is_connected;
+    LG_mutex_unlock(&net->lock);
+    return is_connected;
+}
+
+uint64_t net_dropped(net_t* net)
+{
+    LG_mutex_lock(&net->lock);
+    uint64_t dropped = net->dropped;
+    LG_mutex_unlock(&net->lock);
+    return dropped;
+}
+
+uint64_t net_spilled(net_t* net)
+{
+    LG_mutex_lock(&net->lock);
+    uint64_t spilled = net->spilled;
+    LG_mutex_unlock(&net->lock);
+    return spilled;
+}
+
+uint64_t net_sent(net_t* net)
+{
+    return LG_ATOMIC_LOAD(&net->sent);
+}
+
+bool _net_sink_write(void* ctx, const sink_entry_t* entries, size_t count)
+{
+    return net_write((net_t*)ctx, entries, count);
+}
+
+bool _net_sink_flush(void* ctx)
+{
+    return net_flush((net_t*)ctx);
+}
+
+void _net_sink_close(void* ctx)
+{
+    net_release((net_t*)ctx);
+}
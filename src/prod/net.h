@@ -0,0 +1,133 @@
+/*
+ * File: net.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains a sink that streams entries to a remote
+ * collector over TCP, or sends each entry as a UDP datagram. The
+ * entries are copied in a bounded queue and a background thread of
+ * the sink sends them, so the thread writing the entries never waits
+ * for the network. The background thread resolves the address,
+ * connects and, if the collector is unavailable, connects again with
+ * an exponentially growing delay.
+ *
+ * If the queue is full, entries are appended to a spill file instead
+ * when one is given, and dropped otherwise. Entries still queued when
+ * the sink is closed are spilled as well. The spill file is not sent
+ * to the collector afterwards.
+ *
+ * The module is only available on POSIX systems. A net_t can be
+ * attached to several handlers, all of which then share the queue
+ * and the connection.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_NET_H
+#define LG_NET_H
+
+#include "macros.h"
+#include "sink.h"
+#include "thread.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+typedef enum {
+    /* The entries are streamed as is over one connection. */
+    LG_NET_TCP = 0,
+    /* Every entry is sent as a datagram of its own. */
+    LG_NET_UDP
+} LG_NET_PROTO;
+
+typedef struct {
+    LG_NET_PROTO proto;
+    char         host[LG_MAX_NET_HOST_SIZE];
+    char         port[LG_MAX_NET_PORT_SIZE];
+
+    /* The queue of entries, each stored as its size in a uint32_t
+    followed by its data. */
+    char*        queue;
+    size_t       queue_size;
+    size_t       queue_head;
+    size_t       queue_len;
+
+    /* The entries taken off the queue by the background thread but
+    not sent yet, each preceded by its size as a uint32_t. out_pos is
+    the offset of the first entry not sent in whole, and out_part the
+    number of its bytes sent on the current connection. */
+    char         out[LG_NET_SEND_BSIZE];
+    size_t       out_len;
+    size_t       out_pos;
+    size_t       out_part;
+    size_t       out_count;
+
+    char         spill_path[LG_MAX_FPATH_SIZE];
+    FILE*        spill_file;
+
+    /* The socket, or -1 if not connected. Only used by the background
+    thread. */
+    int          fd;
+
+    uint64_t     dropped;
+    uint64_t     spilled;
+    uint64_t     sent;
+    bool         is_connected;
+
+    LG_mutex_t   lock;
+    LG_cond_t    cond;
+    LG_thread_t  thread;
+    bool         is_waiting;
+    bool         is_stopping;
+
+    /* The number of handlers the sink is attached to. */
+    size_t       refs;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool         is_dynamic;
+} net_t;
+
+/* A sink that writes in the net_t given as the context and releases it
+when closed. */
+extern const sink_vtable_t LG_NET_SINK;
+
+/* Starts sending to host:port. The port may be a service name. A
+queue_size of 0 means LG_DEF_NET_QUEUE_SIZE. spill_path may be NULL.
+The collector does not need to be available yet. */
+net_t* net_init(net_t* buffer,
+                LG_NET_PROTO proto,
+                const char* host,
+                const char* port,
+                size_t queue_size,
+                const char* spill_path);
+
+/* Stops the background thread after a last attempt to send the queued
+entries, and spills the rest. */
+void net_free(net_t* net);
+
+/* Queues the entries. Returns false if any of them had to be dropped. */
+bool net_write(net_t* net, const sink_entry_t* entries, size_t count);
+
+/* Wakes the background thread up to send the queued entries. Does not
+wait for them to be sent. */
+bool net_flush(net_t* net);
+
+/* Counts an attachment to a handler. */
+void net_retain(net_t* net);
+
+/* Uncounts an attachment, and frees the object when none are left. */
+void net_release(net_t* net);
+
+bool net_connected(net_t* net);
+
+/* The number of entries dropped because the queue was full. */
+uint64_t net_dropped(net_t* net);
+
+/* The number of entries appended to the spill file. */
+uint64_t net_spilled(net_t* net);
+
+/* The number of entries sent to the collector. */
+uint64_t net_sent(net_t* net);
+
+#endif /* LG_NET_H */
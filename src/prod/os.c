@@ -0,0 +1,328 @@
+/*
+ * File: os.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+/* Exposes the POSIX and Linux extensions used below. */
+#define _GNU_SOURCE
+
+#include "os.h"
+
+#ifdef LG_USE_WINAPI
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <linux/falloc.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+bool _does_dir_exist(const char* abs_path)
+{
+#ifdef LG_USE_WINAPI
+    DWORD ftyp = GetFileAttributesA(abs_path);
+    if (ftyp == INVALID_FILE_ATTRIBUTES)
+    {
+        return false;
+    }
+    else if (ftyp & FILE_ATTRIBUTE_DIRECTORY)
+    {
+        return true;
+    }
+    return false;
+#else
+    struct stat st;
+    return stat(abs_path, &st) == 0 && S_ISDIR(st.st_mode);
+#endif
+}
+
+bool _create_dir(const char* abs_path)
+{
+#ifdef LG_USE_WINAPI
+    /* TODO: Recursive folder creation, i.e. create parent folder(s) */
+    return CreateDirectoryA(abs_path, NULL) != 0;
+#else
+    return mkdir(abs_path, 0755) == 0;
+#endif
+}
+
+bool _remove_dir(const char* abs_path)
+{
+#ifdef LG_USE_WINAPI
+    return RemoveDirectoryA(abs_path) == 0;
+#else
+    return rmdir(abs_path) == 0;
+#endif
+}
+
+bool _remove_file(const char* abs_path)
+{
+    return remove(abs_path) == 0;
+}
+
+bool _does_file_exist(const char* abs_path)
+{
+    FILE* f = fopen(abs_path, "r");
+    if (f)
+    {
+        fclose(f);
+        return true;
+    }
+    return false;
+}
+
+int _open_shared_file(const char* abs_path, bool truncate)
+{
+#ifdef LG_USE_WINAPI
+    int flags = _O_WRONLY | _O_APPEND | _O_CREAT | _O_BINARY;
+    return _open(abs_path, truncate ? flags | _O_TRUNC : flags,
+                 _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC;
+    return open(abs_path, truncate ? flags | O_TRUNC : flags, 0644);
+#endif
+}
+
+int _open_file(const char* abs_path, bool truncate)
+{
+#ifdef LG_USE_WINAPI
+    int flags = _O_WRONLY | _O_CREAT | _O_BINARY;
+    return _open(abs_path, truncate ? flags | _O_TRUNC : flags,
+                 _S_IREAD | _S_IWRITE);
+#else
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC;
+    return open(abs_path, truncate ? flags | O_TRUNC : flags, 0644);
+#endif
+}
+
+bool _write_file_at(int fd, const char* data, size_t size, uint64_t offset)
+{
+#ifdef LG_USE_WINAPI
+    if (_lseeki64(fd, (__int64)offset, SEEK_SET) < 0)
+    {
+        return false;
+    }
+    return _write_shared_file(fd, data, size);
+#else
+    while (size > 0)
+    {
+        ssize_t written = pwrite(fd, data, size, (off_t)offset);
+        if (written < 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+        offset += written;
+    }
+    return true;
+#endif
+}
+
+void _close_shared_file(int fd)
+{
+#ifdef LG_USE_WINAPI
+    _close(fd);
+#else
+    close(fd);
+#endif
+}
+
+bool _write_shared_file(int fd, const char* data, size_t size)
+{
+    while (size > 0)
+    {
+#ifdef LG_USE_WINAPI
+        int written = _write(fd, data, (unsigned)size);
+#else
+        ssize_t written = write(fd, data, size);
+#endif
+        if (written < 0)
+        {
+            return false;
+        }
+        data += written;
+        size -= written;
+    }
+    return true;
+}
+
+bool _lock_shared_file(int fd)
+{
+#ifdef LG_USE_WINAPI
+    OVERLAPPED overlapped = { 0 };
+    return LockFileEx((HANDLE)_get_osfhandle(fd), LOCKFILE_EXCLUSIVE_LOCK,
+                      0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+#else
+    return flock(fd, LOCK_EX) == 0;
+#endif
+}
+
+bool _unlock_shared_file(int fd)
+{
+#ifdef LG_USE_WINAPI
+    OVERLAPPED overlapped = { 0 };
+    return UnlockFileEx((HANDLE)_get_osfhandle(fd),
+                        0, MAXDWORD, MAXDWORD, &overlapped) != 0;
+#else
+    return flock(fd, LOCK_UN) == 0;
+#endif
+}
+
+size_t _shared_file_size(int fd)
+{
+#ifdef LG_USE_WINAPI
+    __int64 size = _filelengthi64(fd);
+    return size < 0 ? 0 : (size_t)size;
+#else
+    struct stat st;
+    return fstat(fd, &st) == 0 ? (size_t)st.st_size : 0;
+#endif
+}
+
+bool _is_same_file(int fd, const char* abs_path)
+{
+#ifdef LG_USE_WINAPI
+    BY_HANDLE_FILE_INFORMATION fd_info;
+    BY_HANDLE_FILE_INFORMATION path_info;
+    HANDLE path_handle = CreateFileA(abs_path, 0,
+                                     FILE_SHARE_READ | FILE_SHARE_WRITE
+                                     | FILE_SHARE_DELETE,
+                                     NULL, OPEN_EXISTING, 0, NULL);
+    if (path_handle == INVALID_HANDLE_VALUE)
+    {
+        return false;
+    }
+    bool is_same =
+        GetFileInformationByHandle((HANDLE)_get_osfhandle(fd), &fd_info)
+        && GetFileInformationByHandle(path_handle, &path_info)
+        && fd_info.dwVolumeSerialNumber == path_info.dwVolumeSerialNumber
+        && fd_info.nFileIndexHigh == path_info.nFileIndexHigh
+        && fd_info.nFileIndexLow == path_info.nFileIndexLow;
+    CloseHandle(path_handle);
+    return is_same;
+#else
+    struct stat fd_st;
+    struct stat path_st;
+    return fstat(fd, &fd_st) == 0
+        && stat(abs_path, &path_st) == 0
+        && fd_st.st_dev == path_st.st_dev
+        && fd_st.st_ino == path_st.st_ino;
+#endif
+}
+
+bool _preallocate_file(int fd, size_t size)
+{
+#ifdef LG_USE_WINAPI
+    FILE_ALLOCATION_INFO info;
+    info.AllocationSize.QuadPart = (LONGLONG)size;
+    return SetFileInformationByHandle((HANDLE)_get_osfhandle(fd),
+                                      FileAllocationInfo,
+                                      &info, sizeof(info)) != 0;
+#else
+    /* posix_fallocate would change the file size, which would break
+    appending, so only the Linux call is usable. */
+    return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) == 0;
+#endif
+}
+
+bool _truncate_file(int fd, size_t size)
+{
+#ifdef LG_USE_WINAPI
+    return _chsize_s(fd, (__int64)size) == 0;
+#else
+    return ftruncate(fd, (off_t)size) == 0;
+#endif
+}
+
+int _stream_fd(FILE* stream)
+{
+#ifdef LG_USE_WINAPI
+    return _fileno(stream);
+#else
+    return fileno(stream);
+#endif
+}
+
+const char* _stream_pending(FILE* stream, size_t* size)
+{
+#ifdef __GLIBC__
+    *size = (size_t)(stream->_IO_write_ptr - stream->_IO_write_base);
+    return stream->_IO_write_base;
+#else
+    /* The layout of FILE is private elsewhere. */
+    (void)stream;
+    *size = 0;
+    return NULL;
+#endif
+}
+
+int _dup_fd(int fd)
+{
+#ifdef LG_USE_WINAPI
+    return _dup(fd);
+#else
+    return fcntl(fd, F_DUPFD_CLOEXEC, 0);
+#endif
+}
+
+bool _sync_file(int fd)
+{
+#ifdef LG_USE_WINAPI
+    return FlushFileBuffers((HANDLE)_get_osfhandle(fd)) != 0;
+#else
+    return fdatasync(fd) == 0;
+#endif
+}
+
+uint64_t _monotonic_time_ns(void)
+{
+#ifdef LG_USE_WINAPI
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ULL
+        + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ULL
+          / frequency.QuadPart;
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000ULL + (uint64_t)now.tv_nsec;
+#endif
+}
+
+unsigned long _process_id(void)
+{
+#ifdef LG_USE_WINAPI
+    return (unsigned long)GetCurrentProcessId();
+#else
+    return (unsigned long)getpid();
+#endif
+}
+
+void _host_name(char* dest, size_t size)
+{
+#ifdef LG_USE_WINAPI
+    DWORD len = (DWORD)size;
+    if (!GetComputerNameA(dest, &len))
+    {
+        dest[0] = '\0';
+    }
+#else
+    if (gethostname(dest, size) != 0)
+    {
+        dest[0] = '\0';
+    }
+    /* The name is not terminated if it was truncated. */
+    dest[size - 1] = '\0';
+#endif
+}
@@ -3,6 +3,9 @@
  * Project: logger
  * Author: Anton Ihonen, anton@ihonen.net
  *
+ * This module contains wrappers for the file system
+ * operations that differ between operating systems.
+ *
  * Copyright (C) 2019. Anton Ihonen
  */
 
@@ -11,68 +14,103 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #if defined(WIN32) || defined(_WIN32) || defined(_WIN32) && !defined(_CYGWIN_)
 #define LG_USE_WINAPI
 #include <windows.h>
 #define LG_PATH_DELIM_CHAR '\\'
 #define LG_PATH_DELIM_STR "\\"
+/* The largest write that is appended to a file atomically. */
+#define LG_ATOMIC_WRITE_SIZE 512
 #else
 #define LG_USE_LINUX_API
 #define LG_PATH_DELIM_CHAR '/'
 #define LG_PATH_DELIM_STR "/"
+#define LG_ATOMIC_WRITE_SIZE 4096 /* PIPE_BUF */
 #endif
 
- /* Returns true if dir_path points to an existing directory. */
-bool _does_dir_exist(const char* abs_path)
-{
-#ifdef LG_USE_WINAPI
-    DWORD ftyp = GetFileAttributesA(abs_path);
-    if (ftyp == INVALID_FILE_ATTRIBUTES)
-    {
-        return false;
-    }
-    else if (ftyp & FILE_ATTRIBUTE_DIRECTORY)
-    {
-        return true;
-    }
-    return false;
-#endif
-}
+/* Returns true if dir_path points to an existing directory. */
+bool _does_dir_exist(const char* abs_path);
 
 /* Creates the directory in dir_path and returns true if successful. */
-bool _create_dir(const char* abs_path)
-{
-#ifdef LG_USE_WINAPI
-    /* TODO: Recursive folder creation, i.e. create parent folder(s) */
-    return CreateDirectoryA(abs_path, NULL) != 0;
-#endif
-}
+bool _create_dir(const char* abs_path);
 
-bool _remove_dir(const char* abs_path)
-{
-#ifdef LG_USE_WINAPI
-    return RemoveDirectoryA(abs_path) == 0;
-#endif
-    return false;
-}
+bool _remove_dir(const char* abs_path);
 
-/* TODO */
-bool _remove_file(const char* abs_path)
-{
-    return true;
-}
+/* Removes the file in abs_path and returns true if successful. */
+bool _remove_file(const char* abs_path);
 
 /* Returns true if filepath points to an existing file. */
-bool _does_file_exist(const char* abs_path)
-{
-    FILE* f = fopen(abs_path, "r");
-    if (f)
-    {
-        fclose(f);
-        return true;
-    }
-    return false;
-}
+bool _does_file_exist(const char* abs_path);
+
+/* Opens the file in abs_path for appending, creating it if needed,
+and returns its file descriptor or -1 on failure. Every write through
+the descriptor is appended at the current end of the file, even if
+other processes have appended since. If truncate is true, the file
+is emptied first. */
+int _open_shared_file(const char* abs_path, bool truncate);
+
+void _close_shared_file(int fd);
+
+/* Opens the file in abs_path for writing at explicit offsets, creating
+it if needed, and returns its file descriptor or -1 on failure. If
+truncate is true, the file is emptied first. Close with
+_close_shared_file. */
+int _open_file(const char* abs_path, bool truncate);
+
+/* Writes size bytes from data in the file at offset. */
+bool _write_file_at(int fd, const char* data, size_t size, uint64_t offset);
+
+/* Writes size bytes from data in the file. */
+bool _write_shared_file(int fd, const char* data, size_t size);
+
+/* Blocks until this process holds an exclusive advisory lock
+on the file. */
+bool _lock_shared_file(int fd);
+
+bool _unlock_shared_file(int fd);
+
+/* Returns the current size of the file in bytes. */
+size_t _shared_file_size(int fd);
+
+/* Returns true if abs_path still refers to the file open in fd,
+i.e. the file has not been renamed or replaced. */
+bool _is_same_file(int fd, const char* abs_path);
+
+/* Reserves disk space for the file up to size bytes without changing
+the size of the file, so that appending up to size bytes requires no
+further block allocation. Returns false if the file system does not
+support this. */
+bool _preallocate_file(int fd, size_t size);
+
+/* Sets the size of the file to size bytes, releasing any disk space
+reserved beyond it. */
+bool _truncate_file(int fd, size_t size);
+
+/* Returns the file descriptor of stream. */
+int _stream_fd(FILE* stream);
+
+/* Returns the data written in stream that is still waiting in its
+buffer and stores its size in size, or returns NULL if the buffer
+cannot be inspected on this platform. Async-signal-safe. */
+const char* _stream_pending(FILE* stream, size_t* size);
+
+/* Returns a new descriptor for the file open in fd, or -1. */
+int _dup_fd(int fd);
+
+/* Blocks until the data written in the file has reached the disk. */
+bool _sync_file(int fd);
+
+/* Returns the time in nanoseconds from an arbitrary fixed point. The
+time is monotonic, i.e. unaffected by changes of the system clock. */
+uint64_t _monotonic_time_ns(void);
+
+/* Returns the ID of the calling process. */
+unsigned long _process_id(void);
+
+/* Writes the name of the host in dest, truncated to size - 1
+characters, or an empty string if it is not known. */
+void _host_name(char* dest, size_t size);
 
 #endif /* LG_OS_H */
@@ -8,11 +8,16 @@
  * File policy determines what happens when
  * the current log file reaches its maximum size.
  * Buffering policy determines how log output is
- * buffered.
+ * buffered. Compression policy determines whether
+ * log files are compressed. Durability policy
+ * determines when written data is forced to disk.
+ * Entry policy determines the syntax of log entries.
+ * Time policy determines the time zone of the time macros.
  *
  * Copyright (C) 2019. Anton Ihonen
  */
 
+#include <stdint.h>
 #include <stdio.h>
 
 #ifndef LG_POLICY_H
@@ -28,6 +33,52 @@ typedef enum {
 #define LG_VALID_FMODE_COUNT LG_FMODE_ROTATE
 const LG_FMODE LG_VALID_FMODES[LG_VALID_FMODE_COUNT];
 
+typedef enum {
+    /* Log files are not compressed. */
+    LG_CMODE_NONE = 0,
+    /* Files are compressed in the background when they are
+    rotated out. */
+    LG_CMODE_ROTATED,
+    /* Entries are compressed in blocks as they are written. */
+    LG_CMODE_INLINE
+} LG_CMODE;
+#define LG_DEF_CMODE LG_CMODE_NONE
+
+typedef enum {
+    /* Data reaches the disk whenever the operating system
+    decides. */
+    LG_DMODE_NONE = 0,
+    /* Data is flushed and synced to disk by a background thread
+    every sync interval. */
+    LG_DMODE_PERIODIC,
+    /* Every entry is flushed and synced to disk before the write
+    returns. */
+    LG_DMODE_SYNC
+} LG_DMODE;
+#define LG_DEF_DMODE LG_DMODE_NONE
+
+typedef enum {
+    /* Entries are expanded from the entry format as is. */
+    LG_EMODE_TEXT = 0,
+    /* Entries are JSON objects, one per line. */
+    LG_EMODE_JSON,
+    /* Entries are lines of space-separated key=value pairs. */
+    LG_EMODE_LOGFMT
+} LG_EMODE;
+#define LG_DEF_EMODE LG_EMODE_TEXT
+
+typedef enum {
+    /* Local time, following daylight saving time. */
+    LG_TMODE_LOCAL = 0,
+    /* Coordinated universal time. */
+    LG_TMODE_UTC,
+    /* A fixed offset from UTC that never changes. */
+    LG_TMODE_FIXED
+} LG_TMODE;
+#define LG_DEF_TMODE LG_TMODE_LOCAL
+/* Stands for the current offset of local time in LG_TMODE_FIXED. */
+#define LG_TZ_CURRENT INT32_MIN
+
 /*
 typedef enum {
     LG_NBF = 1,
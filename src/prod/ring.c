@@ -0,0 +1,122 @@
+/*
+ * File: ring.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "alloc.h"
+#include "ring.h"
+#include <string.h>
+
+ring_t* ring_init(ring_t* buffer, size_t capacity)
+{
+    ring_t* ring = buffer;
+    if (!ring)
+    {
+        ring = LG_alloc(sizeof(ring_t));
+        if (!ring)
+        {
+            return NULL;
+        }
+        ring->is_dynamic = true;
+    }
+    else
+    {
+        ring->is_dynamic = false;
+    }
+
+    ring->data = LG_alloc(capacity);
+    if (!ring->data)
+    {
+        if (ring->is_dynamic)
+        {
+            LG_dealloc(ring);
+        }
+        return NULL;
+    }
+    ring->capacity = capacity;
+    ring->head = 0;
+    ring->len = 0;
+    ring->has_wrapped = false;
+
+    return ring;
+}
+
+void ring_free(ring_t* ring)
+{
+    LG_dealloc(ring->data);
+    if (ring->is_dynamic)
+    {
+        LG_dealloc(ring);
+    }
+}
+
+void ring_write(ring_t* ring, const char* data, size_t size)
+{
+    if (size >= ring->capacity)
+    {
+        /* Only the end of the data fits. */
+        data += size - ring->capacity;
+        size = ring->capacity;
+        ring->head = 0;
+        ring->len = 0;
+        ring->has_wrapped = true;
+    }
+
+    size_t tail_room = ring->capacity - ring->head;
+    size_t first = size < tail_room ? size : tail_room;
+    memcpy(ring->data + ring->head, data, first);
+    memcpy(ring->data, data + first, size - first);
+    ring->head = (ring->head + size) % ring->capacity;
+
+    if (ring->len + size > ring->capacity)
+    {
+        ring->len = ring->capacity;
+        ring->has_wrapped = true;
+    }
+    else
+    {
+        ring->len += size;
+    }
+}
+
+void ring_drain(ring_t* ring, ring_output_t output, void* arg)
+{
+    size_t begin = (ring->head + ring->capacity - ring->len) % ring->capacity;
+    size_t len = ring->len;
+
+    if (ring->has_wrapped)
+    {
+        /* Skip to the beginning of the first complete entry. */
+        while (len > 0 && ring->data[begin] != '\n')
+        {
+            begin = (begin + 1) % ring->capacity;
+            --len;
+        }
+        if (len > 0)
+        {
+            begin = (begin + 1) % ring->capacity;
+            --len;
+        }
+    }
+
+    size_t first = ring->capacity - begin;
+    if (first > len)
+    {
+        first = len;
+    }
+    if (first > 0)
+    {
+        output(arg, ring->data + begin, first);
+    }
+    if (len > first)
+    {
+        output(arg, ring->data, len - first);
+    }
+
+    ring->head = 0;
+    ring->len = 0;
+    ring->has_wrapped = false;
+}
@@ -0,0 +1,57 @@
+/*
+ * File: ring.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains the ring buffer of the flight recorder.
+ * The ring keeps the last capacity bytes written in it in memory
+ * that is allocated once, overwriting the oldest data when it
+ * is full. A handler with a ring keeps its file output in the
+ * ring instead of writing it in the file, and dumps the ring in
+ * the file only when asked to, so that detailed context is
+ * available after an error without paying for the I/O otherwise.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_RING_H
+#define LG_RING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct {
+    char*  data;
+    size_t capacity;
+
+    /* The position of the next write. */
+    size_t head;
+
+    /* The amount of data in the ring. */
+    size_t len;
+
+    /* Indicates whether data has been overwritten since the last
+    drain, so that the oldest entry may be incomplete. */
+    bool   has_wrapped;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool   is_dynamic;
+} ring_t;
+
+/* Receives the contents of a ring. */
+typedef void (*ring_output_t)(void* arg, const char* data, size_t size);
+
+ring_t* ring_init(ring_t* buffer, size_t capacity);
+
+void ring_free(ring_t* ring);
+
+/* Appends size bytes from data, overwriting the oldest data if there
+is not enough room. */
+void ring_write(ring_t* ring, const char* data, size_t size);
+
+/* Passes the contents of the ring to output, oldest first, and empties
+the ring. If data has been overwritten, the incomplete entry at the
+beginning is skipped. Does not allocate memory or take locks. */
+void ring_drain(ring_t* ring, ring_output_t output, void* arg);
+
+#endif /* LG_RING_H */
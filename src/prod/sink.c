@@ -0,0 +1,114 @@
+/*
+ * File: sink.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "alloc.h"
+#include "sink.h"
+#include <stdio.h>
+#include <string.h>
+
+static bool _stream_sink_write(void* ctx, const sink_entry_t* entries, size_t count)
+{
+    bool failed = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        failed = fwrite(entries[i].data, 1, entries[i].size, (FILE*)ctx)
+                 != entries[i].size || failed;
+    }
+    return !failed;
+}
+
+static bool _stream_sink_flush(void* ctx)
+{
+    return fflush((FILE*)ctx) == 0;
+}
+
+const sink_vtable_t LG_STREAM_SINK = { _stream_sink_write, _stream_sink_flush, NULL };
+
+sink_t* sink_init(sink_t* buffer, const sink_vtable_t* vtable, void* ctx)
+{
+    sink_t* sink = buffer;
+    if (!sink)
+    {
+        sink = LG_alloc(sizeof(sink_t));
+        if (!sink)
+        {
+            return NULL;
+        }
+        sink->is_dynamic = true;
+    }
+    else
+    {
+        sink->is_dynamic = false;
+    }
+
+    sink->vtable = vtable;
+    sink->ctx = ctx;
+    sink->count = 0;
+    sink->data_len = 0;
+
+    return sink;
+}
+
+void sink_free(sink_t* sink)
+{
+    sink_flush(sink);
+    if (sink->vtable->close)
+    {
+        sink->vtable->close(sink->ctx);
+    }
+    if (sink->is_dynamic)
+    {
+        LG_dealloc(sink);
+    }
+}
+
+bool sink_write(sink_t* sink, const char* data, size_t size)
+{
+    bool success = true;
+    if (sink->count == LG_MAX_SINK_ENTRIES
+        || sink->data_len + size > LG_SINK_BSIZE)
+    {
+        success = sink_submit(sink);
+    }
+    if (size > LG_SINK_BSIZE)
+    {
+        /* Too large to gather: hand it over on its own. */
+        sink_entry_t entry = { data, size };
+        return sink->vtable->write(sink->ctx, &entry, 1) && success;
+    }
+
+    char* copy = sink->data + sink->data_len;
+    memcpy(copy, data, size);
+    sink->entries[sink->count].data = copy;
+    sink->entries[sink->count].size = size;
+    ++sink->count;
+    sink->data_len += size;
+    return success;
+}
+
+bool sink_submit(sink_t* sink)
+{
+    if (sink->count == 0)
+    {
+        return true;
+    }
+    bool success = sink->vtable->write(sink->ctx, sink->entries, sink->count);
+    sink->count = 0;
+    sink->data_len = 0;
+    return success;
+}
+
+bool sink_flush(sink_t* sink)
+{
+    bool success = sink_submit(sink);
+    if (sink->vtable->flush)
+    {
+        success = sink->vtable->flush(sink->ctx) && success;
+    }
+    return success;
+}
@@ -0,0 +1,80 @@
+/*
+ * File: sink.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains sinks, pluggable outputs that a handler fans
+ * its entries out to in addition to its built-in outputs. A sink is
+ * implemented with a table of functions and a context pointer that is
+ * passed to them. The sink gathers copies of the entries in a buffer
+ * of its own and hands them to the write function in batches, so that
+ * an implementation can send many entries with one system call.
+ *
+ * A batch is handed over when the buffer fills up, and otherwise when
+ * the handler submits it: after every entry unless the handler is in
+ * fully buffered mode, after every batch of entries, and when the
+ * handler is flushed.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_SINK_H
+#define LG_SINK_H
+
+#include "macros.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+/* An entry handed to a sink. The data is not null-terminated. */
+typedef struct {
+    const char* data;
+    size_t      size;
+} sink_entry_t;
+
+typedef struct {
+    /* Writes count entries. Returns false if they could not be
+    written. */
+    bool (*write)(void* ctx, const sink_entry_t* entries, size_t count);
+
+    /* Forces the written entries out, or NULL if there is nothing to
+    do. */
+    bool (*flush)(void* ctx);
+
+    /* Releases the context when the sink is detached, or NULL. */
+    void (*close)(void* ctx);
+} sink_vtable_t;
+
+typedef struct {
+    const sink_vtable_t* vtable;
+    void*                ctx;
+
+    /* The entries gathered but not written yet. Their data is in
+    data. */
+    sink_entry_t         entries[LG_MAX_SINK_ENTRIES];
+    size_t               count;
+    char                 data[LG_SINK_BSIZE];
+    size_t               data_len;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool                 is_dynamic;
+} sink_t;
+
+/* A sink that writes in the FILE* given as the context. */
+extern const sink_vtable_t LG_STREAM_SINK;
+
+sink_t* sink_init(sink_t* buffer, const sink_vtable_t* vtable, void* ctx);
+
+/* Writes out the gathered entries and closes the context. */
+void sink_free(sink_t* sink);
+
+/* Gathers a copy of an entry. Returns false if a batch had to be
+handed over to make room and could not be written. */
+bool sink_write(sink_t* sink, const char* data, size_t size);
+
+/* Hands the gathered entries over as a batch. */
+bool sink_submit(sink_t* sink);
+
+/* Hands the gathered entries over and flushes the sink. */
+bool sink_flush(sink_t* sink);
+
+#endif /* LG_SINK_H */
@@ -0,0 +1,206 @@
+/*
+ * File: snapshot.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "alloc.h"
+#include "snapshot.h"
+
+/* The reader slot of a thread. Each slot fills a cache line of its
+own, so that readers never write to memory that other threads use. */
+typedef struct snapshot_slot_s
+{
+    /* Odd while the thread reads. Every read changes the value, so a
+    writer can tell a new read from the one it waits for. */
+    uint64_t                state;
+
+    /* Indicates whether a thread owns the slot, accessed atomically. */
+    uint64_t                is_used;
+
+    /* The next slot in the registry. Slots are never removed. */
+    struct snapshot_slot_s* next;
+
+    char                    padding[LG_CACHE_LINE_SIZE
+                                    - 2 * sizeof(uint64_t)
+                                    - sizeof(void*)];
+} snapshot_slot_t;
+
+/* The slots of all threads, accessed atomically. */
+static uint64_t                          LG_snapshot_slots = 0;
+
+/* The slot of the calling thread and the number of snapshots it
+currently reads. */
+static LG_THREAD_LOCAL snapshot_slot_t*  LG_snapshot_slot = NULL;
+static LG_THREAD_LOCAL size_t            LG_snapshot_depth = 0;
+static LG_THREAD_LOCAL bool              LG_snapshot_is_shared = false;
+static LG_THREAD_LOCAL bool              LG_snapshot_is_exit_hooked = false;
+
+/* The slot of the threads whose slot could not be allocated. Its
+state counts those of them that read, which is slower but still
+correct. */
+static snapshot_slot_t                   LG_snapshot_shared_slot;
+
+snapshot_t* snapshot_init(snapshot_t* buffer, void* initial)
+{
+    snapshot_t* snapshot = buffer;
+    if (!snapshot)
+    {
+        snapshot = LG_alloc(sizeof(snapshot_t));
+        if (!snapshot)
+        {
+            return NULL;
+        }
+        snapshot->is_dynamic = true;
+    }
+    else
+    {
+        snapshot->is_dynamic = false;
+    }
+
+    snapshot->current = (uint64_t)(uintptr_t)initial;
+
+    return snapshot;
+}
+
+void snapshot_free(snapshot_t* snapshot)
+{
+    if (snapshot->is_dynamic)
+    {
+        LG_dealloc(snapshot);
+    }
+}
+
+/* Gives the slot of the exiting thread to the next new thread. */
+static void _snapshot_thread_exit(void)
+{
+    if (LG_snapshot_slot && LG_snapshot_slot != &LG_snapshot_shared_slot)
+    {
+        LG_ATOMIC_STORE(&LG_snapshot_slot->is_used, 0);
+    }
+    LG_snapshot_slot = NULL;
+    LG_snapshot_is_exit_hooked = false;
+}
+
+/* Returns the slot of the calling thread, claiming an unused slot or
+adding a new one on the first call. */
+static snapshot_slot_t* _snapshot_slot(void)
+{
+    if (LG_snapshot_slot)
+    {
+        return LG_snapshot_slot;
+    }
+
+    snapshot_slot_t* slot = (snapshot_slot_t*)(uintptr_t)
+                            LG_ATOMIC_LOAD(&LG_snapshot_slots);
+    for (; slot; slot = slot->next)
+    {
+        if (LG_ATOMIC_LOAD(&slot->is_used) == 0
+            && LG_ATOMIC_CAS(&slot->is_used, 0, 1))
+        {
+            break;
+        }
+    }
+
+    if (!slot)
+    {
+        /* Aligned to a cache line by hand. Slots are never freed. */
+        char* memory = LG_alloc(sizeof(snapshot_slot_t) + LG_CACHE_LINE_SIZE - 1);
+        if (!memory)
+        {
+            /* Not remembered, so that the next read tries again. */
+            return &LG_snapshot_shared_slot;
+        }
+        slot = (snapshot_slot_t*)(((uintptr_t)memory + LG_CACHE_LINE_SIZE - 1)
+                                  & ~(uintptr_t)(LG_CACHE_LINE_SIZE - 1));
+        slot->state = 0;
+        slot->is_used = 1;
+        uint64_t head;
+        do
+        {
+            head = LG_ATOMIC_LOAD(&LG_snapshot_slots);
+            slot->next = (snapshot_slot_t*)(uintptr_t)head;
+        } while (!LG_ATOMIC_CAS(&LG_snapshot_slots, head,
+                                (uint64_t)(uintptr_t)slot));
+    }
+
+    LG_snapshot_slot = slot;
+    if (!LG_snapshot_is_exit_hooked)
+    {
+        /* Without the hook the slot is just never reused. */
+        LG_snapshot_is_exit_hooked = LG_thread_at_exit(_snapshot_thread_exit);
+    }
+    return slot;
+}
+
+const void* snapshot_acquire(snapshot_t* snapshot, uint64_t* token)
+{
+    *token = 0;
+    if (LG_snapshot_depth++ == 0)
+    {
+        snapshot_slot_t* slot = _snapshot_slot();
+        LG_snapshot_is_shared = slot == &LG_snapshot_shared_slot;
+        if (LG_snapshot_is_shared)
+        {
+            LG_ATOMIC_ADD(&slot->state, 1);
+            LG_ATOMIC_FENCE();
+        }
+        else
+        {
+            /* The exchange is a full barrier: the slot must be marked
+            before the pointer is read, or a writer could miss the
+            reader. */
+            LG_ATOMIC_EXCHANGE(&slot->state, slot->state + 1);
+        }
+    }
+    return (const void*)(uintptr_t)LG_ATOMIC_LOAD(&snapshot->current);
+}
+
+void snapshot_release(snapshot_t* snapshot, uint64_t token)
+{
+    (void)snapshot;
+    (void)token;
+    if (--LG_snapshot_depth > 0)
+    {
+        return;
+    }
+    if (LG_snapshot_is_shared)
+    {
+        LG_ATOMIC_FENCE();
+        LG_ATOMIC_ADD(&LG_snapshot_shared_slot.state, (uint64_t)-1);
+        return;
+    }
+    LG_ATOMIC_STORE(&LG_snapshot_slot->state, LG_snapshot_slot->state + 1);
+}
+
+void* snapshot_current(snapshot_t* snapshot)
+{
+    return (void*)(uintptr_t)LG_ATOMIC_LOAD(&snapshot->current);
+}
+
+void* snapshot_publish(snapshot_t* snapshot, void* next)
+{
+    void* prev = (void*)(uintptr_t)LG_ATOMIC_EXCHANGE(&snapshot->current,
+                                                      (uint64_t)(uintptr_t)next);
+
+    /* Every thread that reads now may have read prev. Each of them is
+    waited for until it finishes that read; reads that begin later see
+    next. */
+    snapshot_slot_t* slot = (snapshot_slot_t*)(uintptr_t)
+                            LG_ATOMIC_LOAD(&LG_snapshot_slots);
+    for (; slot; slot = slot->next)
+    {
+        uint64_t state = LG_ATOMIC_LOAD(&slot->state);
+        while (state & 1 && LG_ATOMIC_LOAD(&slot->state) == state)
+        {
+            LG_thread_yield();
+        }
+    }
+    while (LG_ATOMIC_LOAD(&LG_snapshot_shared_slot.state) != 0)
+    {
+        LG_thread_yield();
+    }
+    return prev;
+}
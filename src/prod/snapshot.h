@@ -0,0 +1,59 @@
+/*
+ * File: snapshot.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains a read-copy-update cell: a pointer to an
+ * immutable object that readers use without locks while a writer
+ * replaces it wholesale. A reader brackets its use of the object with
+ * snapshot_acquire and snapshot_release, which only mark the reader in
+ * a slot of its own thread. A writer publishes a new object with
+ * snapshot_publish, which swaps the pointer and then waits until every
+ * thread that was reading has finished that read, after which the
+ * previous object may be freed.
+ *
+ * The slots are shared by all cells and each fills a cache line of
+ * its own, so readers write nothing that other threads use, and a
+ * writer is never starved by new readers. A thread gets its slot on
+ * its first read and gives it to the next new thread when it exits.
+ * Reads may nest. Writers must be serialized by the caller and must
+ * not be reading themselves.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_SNAPSHOT_H
+#define LG_SNAPSHOT_H
+
+#include "thread.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+    /* The current object, accessed atomically. */
+    uint64_t current;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool     is_dynamic;
+} snapshot_t;
+
+snapshot_t* snapshot_init(snapshot_t* buffer, void* initial);
+
+/* The current object is not freed. */
+void snapshot_free(snapshot_t* snapshot);
+
+/* Returns the current object, which stays valid until the token stored
+in token is passed to snapshot_release. Never fails. */
+const void* snapshot_acquire(snapshot_t* snapshot, uint64_t* token);
+
+void snapshot_release(snapshot_t* snapshot, uint64_t token);
+
+/* Returns the current object. Only for writers, which keep it from
+being replaced while they use it. */
+void* snapshot_current(snapshot_t* snapshot);
+
+/* Replaces the current object with next and returns the previous one
+once no reader can see it anymore. */
+void* snapshot_publish(snapshot_t* snapshot, void* next);
+
+#endif /* LG_SNAPSHOT_H */
@@ -0,0 +1,34 @@
+/*
+ * File: stats.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "stats.h"
+#include <string.h>
+
+void stats_init(stats_t* stats)
+{
+    memset(stats, 0, sizeof(stats_t));
+}
+
+void stats_add(stats_t* dest, stats_t* src)
+{
+    dest->entries_accepted   += LG_ATOMIC_LOAD(&src->entries_accepted);
+    dest->entries_filtered   += LG_ATOMIC_LOAD(&src->entries_filtered);
+    dest->entries_dropped    += LG_ATOMIC_LOAD(&src->entries_dropped);
+    dest->entries_suppressed += LG_ATOMIC_LOAD(&src->entries_suppressed);
+    dest->entries_collapsed  += LG_ATOMIC_LOAD(&src->entries_collapsed);
+    dest->file_bytes         += LG_ATOMIC_LOAD(&src->file_bytes);
+    dest->stdout_bytes       += LG_ATOMIC_LOAD(&src->stdout_bytes);
+    dest->stderr_bytes       += LG_ATOMIC_LOAD(&src->stderr_bytes);
+    dest->user_bytes         += LG_ATOMIC_LOAD(&src->user_bytes);
+    dest->sink_bytes         += LG_ATOMIC_LOAD(&src->sink_bytes);
+    dest->rotations          += LG_ATOMIC_LOAD(&src->rotations);
+    dest->flushes            += LG_ATOMIC_LOAD(&src->flushes);
+    dest->write_errors       += LG_ATOMIC_LOAD(&src->write_errors);
+    dest->format_ns          += LG_ATOMIC_LOAD(&src->format_ns);
+    dest->io_ns              += LG_ATOMIC_LOAD(&src->io_ns);
+}
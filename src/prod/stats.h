@@ -0,0 +1,70 @@
+/*
+ * File: stats.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains the counters that describe what the
+ * write path has done. Every handler keeps its own counters
+ * and updates them with relaxed atomic additions, so they are
+ * cheap enough to be left on. A snapshot of the counters is
+ * available through log_stats.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_STATS_H
+#define LG_STATS_H
+
+#include "thread.h"
+#include <stdint.h>
+
+typedef struct {
+    /* Entries that passed the threshold and were sent to the handler. */
+    uint64_t entries_accepted;
+
+    /* Entries discarded because of the threshold or a disabled level. */
+    uint64_t entries_filtered;
+
+    /* Accepted entries discarded because the handler was disabled. */
+    uint64_t entries_dropped;
+
+    /* Entries discarded by rate limiting or sampling. */
+    uint64_t entries_suppressed;
+
+    /* Entries collapsed into the identical entry before them. */
+    uint64_t entries_collapsed;
+
+    /* Bytes successfully written to each output. */
+    uint64_t file_bytes;
+    uint64_t stdout_bytes;
+    uint64_t stderr_bytes;
+    uint64_t user_bytes;
+    uint64_t sink_bytes;
+
+    /* Log files rotated out. */
+    uint64_t rotations;
+
+    /* Explicit flushes of buffered output, including thread buffer
+    hand-offs. */
+    uint64_t flushes;
+
+    /* Failed writes to any output. */
+    uint64_t write_errors;
+
+    /* Time in nanoseconds spent formatting entries and sending them
+    to the handler, as seen by the logging threads. Only counted while
+    log_timing_enable is in effect. */
+    uint64_t format_ns;
+    uint64_t io_ns;
+} stats_t;
+
+/* Increments a counter of a stats_t. */
+#define LG_STATS_ADD(stats, counter, value) \
+    LG_ATOMIC_ADD(&(stats)->counter, (uint64_t)(value))
+
+void stats_init(stats_t* stats);
+
+/* Adds the counters of src to dest. src may be updated concurrently. */
+void stats_add(stats_t* dest, stats_t* src);
+
+#endif /* LG_STATS_H */
@@ -49,3 +49,14 @@ void LG_str_to_lower(char* str)
         ++str;
     }
 }
+
+uint64_t LG_str_hash(const char* str, size_t max_len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < max_len && str[i] != '\0'; ++i)
+    {
+        hash ^= (unsigned char)str[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
@@ -14,6 +14,7 @@
 
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 /* Writes '\0' at pos. */
 void LG_terminate_str(char* str, size_t pos);
@@ -27,4 +28,8 @@ bool LG_is_empty_str(char* str);
 /* Converts alphabetical characters in str to lowercase. */
 void LG_str_to_lower(char* str);
 
+/* Returns a 64-bit FNV-1a hash of the first max_len characters of str,
+or of all of them if str is shorter. */
+uint64_t LG_str_hash(const char* str, size_t max_len);
+
 #endif /* LG_STRING_UTIL_H */
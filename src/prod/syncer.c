@@ -0,0 +1,254 @@
+/*
+ * File: syncer.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "alloc.h"
+#include "os.h"
+#include "syncer.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* The longest time the worker sleeps without checking its handlers. */
+#define LG_SYNCER_MAX_SLEEP_MS 1000
+
+/* The state of the background worker. */
+static LG_mutex_t   LG_sync_mutex;
+static LG_cond_t    LG_sync_cond;
+static LG_thread_t  LG_sync_thread;
+static handler_t**  LG_sync_handlers = NULL;
+static size_t       LG_sync_count = 0;
+static size_t       LG_sync_capacity = 0;
+static handler_t*   LG_sync_active = NULL;
+static bool         LG_sync_is_initialized = false;
+static bool         LG_sync_is_running = false;
+
+static uint64_t LG_syncer_now_ms(void)
+{
+    return _monotonic_time_ns() / 1000000;
+}
+
+/* Returns true if the handler's data should be synced now. */
+static bool LG_syncer_is_sync_due(handler_t* handler, uint64_t now)
+{
+    return handler->dmode == LG_DMODE_PERIODIC
+           && (handler->is_sync_requested || now >= handler->next_sync_time);
+}
+
+/* Returns true if the handler's thread buffers should be flushed now. */
+static bool LG_syncer_is_flush_due(handler_t* handler, uint64_t now)
+{
+    return handler->tbufs && now >= handler->next_flush_time;
+}
+
+static void LG_syncer_routine(void* arg)
+{
+    (void)arg;
+    LG_mutex_lock(&LG_sync_mutex);
+    while (LG_sync_is_running)
+    {
+        uint64_t now = LG_syncer_now_ms();
+        uint64_t wake_time = now + LG_SYNCER_MAX_SLEEP_MS;
+        handler_t* due = NULL;
+
+        for (size_t i = 0; i < LG_sync_count && !due; ++i)
+        {
+            handler_t* handler = LG_sync_handlers[i];
+            if (LG_syncer_is_sync_due(handler, now)
+                || LG_syncer_is_flush_due(handler, now))
+            {
+                due = handler;
+                continue;
+            }
+            if (handler->dmode == LG_DMODE_PERIODIC
+                && handler->next_sync_time < wake_time)
+            {
+                wake_time = handler->next_sync_time;
+            }
+            if (handler->tbufs && handler->next_flush_time < wake_time)
+            {
+                wake_time = handler->next_flush_time;
+            }
+        }
+
+        if (!due)
+        {
+            LG_cond_timedwait(&LG_sync_cond, &LG_sync_mutex,
+                              (uint32_t)(wake_time - now));
+            continue;
+        }
+
+        bool is_sync_due = LG_syncer_is_sync_due(due, now);
+        if (is_sync_due)
+        {
+            due->is_sync_requested = false;
+            due->next_sync_time = now + due->sync_interval_ms;
+        }
+        /* A sync hands over the thread buffers as well. */
+        due->next_flush_time = now + due->tbuf_timeout_ms;
+        LG_sync_active = due;
+        LG_mutex_unlock(&LG_sync_mutex);
+
+        if (is_sync_due)
+        {
+            handler_sync(due);
+        }
+        else
+        {
+            handler_flush(due);
+        }
+
+        LG_mutex_lock(&LG_sync_mutex);
+        LG_sync_active = NULL;
+        LG_cond_broadcast(&LG_sync_cond);
+    }
+    LG_mutex_unlock(&LG_sync_mutex);
+}
+
+bool LG_syncer_register(handler_t* handler)
+{
+    if (!LG_sync_is_initialized)
+    {
+        LG_mutex_init(&LG_sync_mutex);
+        LG_cond_init(&LG_sync_cond);
+        LG_sync_is_initialized = true;
+    }
+
+    LG_mutex_lock(&LG_sync_mutex);
+    bool success = true;
+    for (size_t i = 0; i < LG_sync_count; ++i)
+    {
+        if (LG_sync_handlers[i] == handler)
+        {
+            LG_mutex_unlock(&LG_sync_mutex);
+            return true;
+        }
+    }
+
+    if (LG_sync_count == LG_sync_capacity)
+    {
+        size_t capacity = LG_sync_capacity ? 2 * LG_sync_capacity : 16;
+        handler_t** handlers = LG_alloc(capacity * sizeof(handler_t*));
+        success = handlers != NULL;
+        if (success)
+        {
+            if (LG_sync_handlers)
+            {
+                memcpy(handlers, LG_sync_handlers,
+                       LG_sync_count * sizeof(handler_t*));
+                LG_dealloc(LG_sync_handlers);
+            }
+            LG_sync_handlers = handlers;
+            LG_sync_capacity = capacity;
+        }
+    }
+
+    if (success && !LG_sync_is_running)
+    {
+        LG_sync_is_running = LG_thread_create(&LG_sync_thread,
+                                              LG_syncer_routine,
+                                              NULL);
+        success = LG_sync_is_running;
+        if (success)
+        {
+            atexit(LG_syncer_stop);
+        }
+    }
+
+    if (success)
+    {
+        handler->is_sync_requested = false;
+        handler->next_sync_time = LG_syncer_now_ms() + handler->sync_interval_ms;
+        handler->next_flush_time = LG_syncer_now_ms() + handler->tbuf_timeout_ms;
+        LG_sync_handlers[LG_sync_count++] = handler;
+        LG_cond_broadcast(&LG_sync_cond);
+    }
+    LG_mutex_unlock(&LG_sync_mutex);
+    return success;
+}
+
+void LG_syncer_unregister(handler_t* handler)
+{
+    if (!LG_sync_is_initialized)
+    {
+        return;
+    }
+
+    LG_mutex_lock(&LG_sync_mutex);
+    for (size_t i = 0; i < LG_sync_count; ++i)
+    {
+        if (LG_sync_handlers[i] == handler)
+        {
+            LG_sync_handlers[i] = LG_sync_handlers[--LG_sync_count];
+            break;
+        }
+    }
+    while (LG_sync_active == handler)
+    {
+        LG_cond_wait(&LG_sync_cond, &LG_sync_mutex);
+    }
+    LG_mutex_unlock(&LG_sync_mutex);
+}
+
+void LG_syncer_set_interval(handler_t* handler, uint32_t interval_ms)
+{
+    if (!LG_sync_is_initialized)
+    {
+        /* There is no worker to race with; registering schedules
+        the first sync. */
+        handler->sync_interval_ms = interval_ms;
+        return;
+    }
+
+    LG_mutex_lock(&LG_sync_mutex);
+    handler->sync_interval_ms = interval_ms;
+    handler->next_sync_time = LG_syncer_now_ms() + interval_ms;
+    LG_cond_broadcast(&LG_sync_cond);
+    LG_mutex_unlock(&LG_sync_mutex);
+}
+
+void LG_syncer_set_tbuf_timeout(handler_t* handler, uint32_t timeout_ms)
+{
+    if (!LG_sync_is_initialized)
+    {
+        handler->tbuf_timeout_ms = timeout_ms;
+        return;
+    }
+
+    LG_mutex_lock(&LG_sync_mutex);
+    handler->tbuf_timeout_ms = timeout_ms;
+    handler->next_flush_time = LG_syncer_now_ms() + timeout_ms;
+    LG_cond_broadcast(&LG_sync_cond);
+    LG_mutex_unlock(&LG_sync_mutex);
+}
+
+void LG_syncer_request(handler_t* handler)
+{
+    LG_mutex_lock(&LG_sync_mutex);
+    handler->is_sync_requested = true;
+    LG_cond_broadcast(&LG_sync_cond);
+    LG_mutex_unlock(&LG_sync_mutex);
+}
+
+void LG_syncer_stop(void)
+{
+    if (!LG_sync_is_initialized)
+    {
+        return;
+    }
+
+    LG_mutex_lock(&LG_sync_mutex);
+    bool was_running = LG_sync_is_running;
+    LG_sync_is_running = false;
+    LG_cond_broadcast(&LG_sync_cond);
+    LG_mutex_unlock(&LG_sync_mutex);
+
+    if (was_running)
+    {
+        LG_thread_join(&LG_sync_thread);
+    }
+}
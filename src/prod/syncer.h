@@ -0,0 +1,46 @@
+/*
+ * File: syncer.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains the background worker that forces
+ * the data of handlers in LG_DMODE_PERIODIC mode to disk.
+ * A registered handler is synced once every sync interval,
+ * or sooner if it requests a sync because enough unsynced
+ * data has accumulated. The same worker hands the thread
+ * buffers of handlers that use them to the outputs once
+ * every buffer timeout.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_SYNCER_H
+#define LG_SYNCER_H
+
+#include "handler.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Starts syncing or flushing handler periodically. */
+bool LG_syncer_register(handler_t* handler);
+
+/* Stops syncing handler. Returns after any sync of handler that is
+in progress has finished. */
+void LG_syncer_unregister(handler_t* handler);
+
+/* Sets the sync interval of handler and reschedules its next sync
+from now, waking the worker so that the change takes effect at once
+rather than after the old deadline. */
+void LG_syncer_set_interval(handler_t* handler, uint32_t interval_ms);
+
+/* Sets the thread buffer timeout of handler like
+LG_syncer_set_interval. */
+void LG_syncer_set_tbuf_timeout(handler_t* handler, uint32_t timeout_ms);
+
+/* Asks the worker to sync handler as soon as possible. */
+void LG_syncer_request(handler_t* handler);
+
+/* Stops the background worker. */
+void LG_syncer_stop(void);
+
+#endif /* LG_SYNCER_H */
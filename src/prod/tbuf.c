@@ -0,0 +1,389 @@
+/*
+ * File: tbuf.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#include "alloc.h"
+#include "tbuf.h"
+#include <string.h>
+
+/* The header that precedes every buffered entry. The entry itself
+follows the header null-terminated, padded to a multiple of 8 bytes. */
+typedef struct {
+    uint64_t seq;
+    uint64_t size;
+} tbuf_entry_t;
+
+/* The space an entry of size bytes takes in a buffer. */
+#define LG_TBUF_ENTRY_SIZE(size) \
+    ((sizeof(tbuf_entry_t) + (size) + 1 + 7) & ~(size_t)7)
+
+/* The number of pools each thread remembers its buffer in. */
+#define LG_TBUF_CACHE_SIZE 4
+
+/* What a thread last found in a pool: its buffer, or NULL if there was
+none to reserve when releases of the pool had the given value. */
+typedef struct {
+    uint64_t pool_id;
+    uint64_t releases;
+    tbuf_t*  buf;
+} tbuf_cache_t;
+
+static LG_THREAD_LOCAL tbuf_cache_t LG_tbuf_cache[LG_TBUF_CACHE_SIZE];
+static LG_THREAD_LOCAL bool         LG_tbuf_is_exit_hooked = false;
+
+/* The live pools, so that an exiting thread can release its buffers. */
+static tbuf_pool_t* LG_tbuf_pools = NULL;
+static LG_mutex_t   LG_tbuf_pools_lock;
+static LG_once_t    LG_tbuf_once = LG_ONCE_INIT;
+static uint64_t     LG_tbuf_next_pool_id = 1;
+
+static void _tbuf_thread_exit(void);
+
+static void _tbuf_init_pools(void)
+{
+    LG_mutex_init(&LG_tbuf_pools_lock);
+}
+
+tbuf_pool_t* tbuf_pool_init(tbuf_pool_t* buffer, size_t capacity)
+{
+    tbuf_pool_t* pool = buffer;
+    if (!pool)
+    {
+        pool = LG_alloc(sizeof(tbuf_pool_t));
+        if (!pool)
+        {
+            return NULL;
+        }
+        pool->is_dynamic = true;
+    }
+    else
+    {
+        pool->is_dynamic = false;
+    }
+
+    for (size_t i = 0; i < LG_MAX_TBUFS; ++i)
+    {
+        LG_mutex_init(&pool->bufs[i].lock);
+        pool->bufs[i].owner = 0;
+        pool->bufs[i].data = NULL;
+        pool->bufs[i].len = 0;
+        pool->bufs[i].has_exited = false;
+    }
+    LG_mutex_init(&pool->claim_lock);
+    pool->capacity = capacity;
+    pool->seq = 0;
+    pool->id = LG_ATOMIC_ADD(&LG_tbuf_next_pool_id, 1);
+    pool->releases = 0;
+
+    LG_once(&LG_tbuf_once, _tbuf_init_pools);
+    LG_mutex_lock(&LG_tbuf_pools_lock);
+    pool->next = LG_tbuf_pools;
+    LG_tbuf_pools = pool;
+    LG_mutex_unlock(&LG_tbuf_pools_lock);
+
+    return pool;
+}
+
+void tbuf_pool_free(tbuf_pool_t* pool)
+{
+    LG_mutex_lock(&LG_tbuf_pools_lock);
+    tbuf_pool_t** link = &LG_tbuf_pools;
+    while (*link != pool)
+    {
+        link = &(*link)->next;
+    }
+    *link = pool->next;
+    LG_mutex_unlock(&LG_tbuf_pools_lock);
+
+    for (size_t i = 0; i < LG_MAX_TBUFS; ++i)
+    {
+        if (pool->bufs[i].data)
+        {
+            LG_dealloc(pool->bufs[i].data);
+        }
+        LG_mutex_free(&pool->bufs[i].lock);
+    }
+    LG_mutex_free(&pool->claim_lock);
+
+    if (pool->is_dynamic)
+    {
+        LG_dealloc(pool);
+    }
+}
+
+/* Returns the buffer owned by thread_id, or NULL. Buffers are reserved
+by linear probing from the thread's home slot, so the search usually
+ends at once. Since buffers are freed in any order, a miss has to
+look at every slot, which is why the result is cached. */
+static tbuf_t* _tbuf_find(tbuf_pool_t* pool, uint64_t thread_id)
+{
+    size_t home = (size_t)(thread_id % LG_MAX_TBUFS);
+    for (size_t i = 0; i < LG_MAX_TBUFS; ++i)
+    {
+        tbuf_t* buf = &pool->bufs[(home + i) % LG_MAX_TBUFS];
+        if (LG_ATOMIC_LOAD(&buf->owner) == thread_id)
+        {
+            return buf;
+        }
+    }
+    return NULL;
+}
+
+/* Reserves a free buffer for thread_id. */
+static tbuf_t* _tbuf_claim(tbuf_pool_t* pool, uint64_t thread_id)
+{
+    tbuf_t* claimed = NULL;
+    size_t home = (size_t)(thread_id % LG_MAX_TBUFS);
+
+    LG_mutex_lock(&pool->claim_lock);
+    for (size_t i = 0; i < LG_MAX_TBUFS && !claimed; ++i)
+    {
+        tbuf_t* buf = &pool->bufs[(home + i) % LG_MAX_TBUFS];
+        if (LG_ATOMIC_LOAD(&buf->owner) == 0)
+        {
+            /* A drain may still hold the buffer it just freed. */
+            LG_mutex_lock(&buf->lock);
+            buf->data = LG_alloc(pool->capacity);
+            if (buf->data)
+            {
+                LG_ATOMIC_STORE(&buf->owner, thread_id);
+                claimed = buf;
+            }
+            LG_mutex_unlock(&buf->lock);
+            break;
+        }
+    }
+    LG_mutex_unlock(&pool->claim_lock);
+
+    if (claimed && !LG_tbuf_is_exit_hooked)
+    {
+        LG_tbuf_is_exit_hooked = LG_thread_at_exit(_tbuf_thread_exit);
+    }
+    return claimed;
+}
+
+/* Frees buf so that another thread can reserve it. The caller must hold
+the lock of buf. */
+static void _tbuf_free_slot(tbuf_pool_t* pool, tbuf_t* buf)
+{
+    LG_dealloc(buf->data);
+    buf->data = NULL;
+    buf->len = 0;
+    buf->has_exited = false;
+    LG_ATOMIC_STORE(&buf->owner, 0);
+    LG_ATOMIC_ADD(&pool->releases, 1);
+}
+
+/* Releases the buffers of the exiting thread. A buffer with entries in
+it is left for the next drain to free. */
+static void _tbuf_thread_exit(void)
+{
+    uint64_t thread_id = LG_thread_id();
+    LG_mutex_lock(&LG_tbuf_pools_lock);
+    for (tbuf_pool_t* pool = LG_tbuf_pools; pool; pool = pool->next)
+    {
+        tbuf_t* buf = _tbuf_find(pool, thread_id);
+        if (!buf)
+        {
+            continue;
+        }
+        LG_mutex_lock(&buf->lock);
+        if (buf->len == 0)
+        {
+            _tbuf_free_slot(pool, buf);
+        }
+        else
+        {
+            buf->has_exited = true;
+        }
+        LG_mutex_unlock(&buf->lock);
+    }
+    LG_mutex_unlock(&LG_tbuf_pools_lock);
+    memset(LG_tbuf_cache, 0x00, sizeof(LG_tbuf_cache));
+}
+
+tbuf_t* tbuf_acquire(tbuf_pool_t* pool)
+{
+    tbuf_cache_t* cached = &LG_tbuf_cache[pool->id % LG_TBUF_CACHE_SIZE];
+    tbuf_t* buf = NULL;
+    if (cached->pool_id == pool->id)
+    {
+        if (!cached->buf
+            && cached->releases == LG_ATOMIC_LOAD(&pool->releases))
+        {
+            /* The pool was full and nothing has been freed since. */
+            return NULL;
+        }
+        buf = cached->buf;
+    }
+
+    if (!buf)
+    {
+        uint64_t thread_id = LG_thread_id();
+        uint64_t releases = LG_ATOMIC_LOAD(&pool->releases);
+        buf = _tbuf_find(pool, thread_id);
+        if (!buf)
+        {
+            buf = _tbuf_claim(pool, thread_id);
+        }
+        cached->pool_id = pool->id;
+        cached->releases = releases;
+        cached->buf = buf;
+    }
+
+    if (buf)
+    {
+        LG_mutex_lock(&buf->lock);
+    }
+    return buf;
+}
+
+void tbuf_release(tbuf_t* buf)
+{
+    LG_mutex_unlock(&buf->lock);
+}
+
+bool tbuf_append(tbuf_pool_t* pool, tbuf_t* buf, const char* data, size_t size)
+{
+    size_t entry_size = LG_TBUF_ENTRY_SIZE(size);
+    if (buf->len + entry_size > pool->capacity)
+    {
+        return false;
+    }
+
+    tbuf_entry_t* entry = (tbuf_entry_t*)(buf->data + buf->len);
+    entry->seq = LG_ATOMIC_ADD(&pool->seq, 1);
+    entry->size = size;
+    memcpy(entry + 1, data, size);
+    ((char*)(entry + 1))[size] = '\0';
+    buf->len += entry_size;
+    return true;
+}
+
+/* Passes the entry at offset pos of buf to output and returns the
+offset of the next entry. */
+static size_t _tbuf_emit(tbuf_t* buf,
+                         size_t pos,
+                         tbuf_output_t output,
+                         void* arg)
+{
+    tbuf_entry_t* entry = (tbuf_entry_t*)(buf->data + pos);
+    output(arg, (const char*)(entry + 1), (size_t)entry->size);
+    return pos + LG_TBUF_ENTRY_SIZE((size_t)entry->size);
+}
+
+/* Passes the entries of count buffers, from offsets pos onwards, to
+output. */
+static void _tbuf_emit_all(tbuf_t** bufs,
+                           size_t* pos,
+                           size_t count,
+                           bool merge,
+                           tbuf_output_t output,
+                           void* arg)
+{
+    if (merge && count > 1)
+    {
+        /* Repeatedly emit the entry with the lowest sequence number.
+        The entries of each buffer are already in order. */
+        for (;;)
+        {
+            size_t next = count;
+            uint64_t next_seq = 0;
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (pos[i] < bufs[i]->len)
+                {
+                    tbuf_entry_t* entry = (tbuf_entry_t*)(bufs[i]->data + pos[i]);
+                    if (next == count || entry->seq < next_seq)
+                    {
+                        next = i;
+                        next_seq = entry->seq;
+                    }
+                }
+            }
+            if (next == count)
+            {
+                break;
+            }
+            pos[next] = _tbuf_emit(bufs[next], pos[next], output, arg);
+        }
+    }
+    else
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            while (pos[i] < bufs[i]->len)
+            {
+                pos[i] = _tbuf_emit(bufs[i], pos[i], output, arg);
+            }
+        }
+    }
+}
+
+void tbuf_drain(tbuf_pool_t* pool,
+                tbuf_t* buf,
+                bool merge,
+                tbuf_output_t output,
+                void* arg)
+{
+    tbuf_t* bufs[LG_MAX_TBUFS];
+    size_t  pos[LG_MAX_TBUFS];
+    size_t  count = 0;
+
+    /* Lock every buffer that has something in it. */
+    for (size_t i = 0; i < LG_MAX_TBUFS; ++i)
+    {
+        tbuf_t* candidate = buf ? buf : &pool->bufs[i];
+        if (LG_ATOMIC_LOAD(&candidate->owner) != 0)
+        {
+            LG_mutex_lock(&candidate->lock);
+            if (candidate->len > 0)
+            {
+                pos[count] = 0;
+                bufs[count++] = candidate;
+            }
+            else
+            {
+                LG_mutex_unlock(&candidate->lock);
+            }
+        }
+        if (buf)
+        {
+            break;
+        }
+    }
+
+    _tbuf_emit_all(bufs, pos, count, merge, output, arg);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        bufs[i]->len = 0;
+        if (bufs[i]->has_exited)
+        {
+            _tbuf_free_slot(pool, bufs[i]);
+        }
+        LG_mutex_unlock(&bufs[i]->lock);
+    }
+}
+
+void tbuf_peek(tbuf_pool_t* pool, bool merge, tbuf_output_t output, void* arg)
+{
+    tbuf_t* bufs[LG_MAX_TBUFS];
+    size_t  pos[LG_MAX_TBUFS];
+    size_t  count = 0;
+
+    for (size_t i = 0; i < LG_MAX_TBUFS; ++i)
+    {
+        tbuf_t* candidate = &pool->bufs[i];
+        if (LG_ATOMIC_LOAD(&candidate->owner) != 0 && candidate->len > 0)
+        {
+            pos[count] = 0;
+            bufs[count++] = candidate;
+        }
+    }
+    _tbuf_emit_all(bufs, pos, count, merge, output, arg);
+}
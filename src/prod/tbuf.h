@@ -0,0 +1,115 @@
+/*
+ * File: tbuf.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains per-thread entry buffers. A tbuf_pool_t
+ * holds up to LG_MAX_TBUFS buffers, one for each thread that writes
+ * through it. A thread appends entries to its own buffer, so that
+ * threads only contend for a buffer when its contents are being
+ * drained, and the buffered entries are handed to the outputs in
+ * large blocks.
+ *
+ * Every entry is stamped with a sequence number taken from a counter
+ * shared by the pool. When all buffers are drained at once, the
+ * entries can optionally be merged back into the order in which
+ * they were appended.
+ *
+ * A buffer stays reserved for its thread until the thread exits.
+ * An empty buffer is then freed at once, and one with entries left
+ * in it once they have been drained. When all buffers are reserved,
+ * tbuf_acquire returns NULL and the caller is expected to write
+ * directly; each thread remembers that until a buffer is freed, so
+ * it does not search the pool again for every entry.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_TBUF_H
+#define LG_TBUF_H
+
+#include "macros.h"
+#include "thread.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A buffer owned by a single thread. */
+typedef struct {
+    /* Held by the owner while appending and by whoever drains. */
+    LG_mutex_t lock;
+
+    /* The LG_thread_id of the owner, or 0 if the buffer is free. */
+    uint64_t   owner;
+
+    /* The buffered entries, allocated on first use. */
+    char*      data;
+    size_t     len;
+
+    /* Indicates whether the owner has exited, so that the buffer is
+    freed once it has been drained. */
+    bool       has_exited;
+} tbuf_t;
+
+typedef struct tbuf_pool_s {
+    tbuf_t     bufs[LG_MAX_TBUFS];
+
+    /* Identifies the pool in the threads' caches. Unlike the address,
+    it is never reused. */
+    uint64_t   id;
+
+    /* The number of buffers freed so far. */
+    uint64_t   releases;
+
+    /* The next pool in the list of live pools that exiting threads
+    release their buffers in. */
+    struct tbuf_pool_s* next;
+
+    /* Serializes reserving buffers for new threads. */
+    LG_mutex_t claim_lock;
+
+    /* The capacity of each buffer in bytes. */
+    size_t     capacity;
+
+    /* The sequence number of the next entry. */
+    uint64_t   seq;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool       is_dynamic;
+} tbuf_pool_t;
+
+/* Receives a drained entry. data is null-terminated. */
+typedef void (*tbuf_output_t)(void* arg, const char* data, size_t size);
+
+tbuf_pool_t* tbuf_pool_init(tbuf_pool_t* buffer, size_t capacity);
+
+void tbuf_pool_free(tbuf_pool_t* pool);
+
+/* Returns the calling thread's buffer locked, reserving one first if
+the thread has none. Returns NULL if no buffer is available. */
+tbuf_t* tbuf_acquire(tbuf_pool_t* pool);
+
+/* Unlocks a buffer returned by tbuf_acquire. */
+void tbuf_release(tbuf_t* buf);
+
+/* Appends an entry to a buffer returned by tbuf_acquire. Returns false
+if the buffer does not have room for it. */
+bool tbuf_append(tbuf_pool_t* pool, tbuf_t* buf, const char* data, size_t size);
+
+/* Passes the entries of buf, or of all buffers if buf is NULL, to
+output and empties the buffers. If merge is true, entries of different
+buffers are passed in the order they were appended in. The caller must
+not hold the lock of any of the buffers. */
+void tbuf_drain(tbuf_pool_t* pool,
+                tbuf_t* buf,
+                bool merge,
+                tbuf_output_t output,
+                void* arg);
+
+/* Passes the entries of all buffers to output like tbuf_drain, but
+without taking any locks or emptying the buffers. Only meant for
+salvaging the entries when the process is about to die: an entry that
+is being appended meanwhile may be passed incomplete. */
+void tbuf_peek(tbuf_pool_t* pool, bool merge, tbuf_output_t output, void* arg);
+
+#endif /* LG_TBUF_H */
@@ -0,0 +1,309 @@
+/*
+ * File: thread.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+/* Exposes the POSIX and Linux extensions used below. */
+#define _GNU_SOURCE
+
+#include "alloc.h"
+#include "thread.h"
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#ifndef LG_USE_WINAPI
+#include <sched.h>
+#endif
+
+/* The next thread ID to hand out and the ID of the calling thread. */
+static uint64_t                 LG_next_thread_id = 1;
+static LG_THREAD_LOCAL uint64_t LG_curr_thread_id = 0;
+
+/* The name of the calling thread, see LG_thread_name. */
+static LG_THREAD_LOCAL char     LG_curr_thread_name[LG_MAX_THREAD_NAME_SIZE];
+static LG_THREAD_LOCAL size_t   LG_curr_thread_name_len = 0;
+static LG_THREAD_LOCAL bool     LG_is_thread_named = false;
+
+/* The hooks to run when the calling thread exits, see
+LG_thread_at_exit. They are run by the destructor of a thread-specific
+value that is set once a thread registers its first hook. */
+static LG_THREAD_LOCAL void   (*LG_exit_hooks[LG_MAX_THREAD_EXIT_HOOKS])(void);
+static LG_THREAD_LOCAL size_t   LG_exit_hook_count = 0;
+static LG_once_t                LG_exit_key_once = LG_ONCE_INIT;
+static bool                     LG_is_exit_key_created = false;
+#ifdef LG_USE_WINAPI
+static DWORD                    LG_exit_key;
+#else
+static pthread_key_t            LG_exit_key;
+#endif
+
+/* The routine and argument of a thread that is being started. */
+typedef struct
+{
+    void (*routine)(void*);
+    void* arg;
+} LG_thread_start_t;
+
+#ifdef LG_USE_WINAPI
+static DWORD WINAPI LG_thread_trampoline(LPVOID param)
+#else
+static void* LG_thread_trampoline(void* param)
+#endif
+{
+    LG_thread_start_t start = *(LG_thread_start_t*)param;
+    LG_dealloc(param);
+    start.routine(start.arg);
+    return 0;
+}
+
+bool LG_thread_create(LG_thread_t* thread, void (*routine)(void*), void* arg)
+{
+    LG_thread_start_t* start = LG_alloc(sizeof(LG_thread_start_t));
+    if (!start)
+    {
+        return false;
+    }
+    start->routine = routine;
+    start->arg = arg;
+
+#ifdef LG_USE_WINAPI
+    *thread = CreateThread(NULL, 0, LG_thread_trampoline, start, 0, NULL);
+    if (*thread == NULL)
+#else
+    if (pthread_create(thread, NULL, LG_thread_trampoline, start) != 0)
+#endif
+    {
+        LG_dealloc(start);
+        return false;
+    }
+    return true;
+}
+
+void LG_thread_join(LG_thread_t* thread)
+{
+#ifdef LG_USE_WINAPI
+    WaitForSingleObject(*thread, INFINITE);
+    CloseHandle(*thread);
+#else
+    pthread_join(*thread, NULL);
+#endif
+}
+
+void LG_thread_yield(void)
+{
+#ifdef LG_USE_WINAPI
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+uint64_t LG_thread_id(void)
+{
+    if (LG_curr_thread_id == 0)
+    {
+        LG_curr_thread_id = LG_ATOMIC_ADD(&LG_next_thread_id, 1);
+    }
+    return LG_curr_thread_id;
+}
+
+void LG_thread_set_name(const char* name)
+{
+    size_t len = strlen(name);
+    if (len >= LG_MAX_THREAD_NAME_SIZE)
+    {
+        len = LG_MAX_THREAD_NAME_SIZE - 1;
+    }
+    memcpy(LG_curr_thread_name, name, len);
+    LG_curr_thread_name[len] = '\0';
+    LG_curr_thread_name_len = len;
+    LG_is_thread_named = true;
+}
+
+const char* LG_thread_name(size_t* len)
+{
+    if (!LG_is_thread_named)
+    {
+        LG_curr_thread_name[0] = '\0';
+#if defined(__linux__) && !defined(LG_USE_WINAPI)
+        pthread_getname_np(pthread_self(),
+                           LG_curr_thread_name,
+                           LG_MAX_THREAD_NAME_SIZE);
+#endif
+        LG_curr_thread_name_len = strlen(LG_curr_thread_name);
+        LG_is_thread_named = true;
+    }
+    *len = LG_curr_thread_name_len;
+    return LG_curr_thread_name;
+}
+
+#ifdef LG_USE_WINAPI
+static VOID NTAPI LG_thread_run_exit_hooks(PVOID value)
+#else
+static void LG_thread_run_exit_hooks(void* value)
+#endif
+{
+    (void)value;
+    while (LG_exit_hook_count > 0)
+    {
+        LG_exit_hooks[--LG_exit_hook_count]();
+    }
+}
+
+static void LG_thread_create_exit_key(void)
+{
+#ifdef LG_USE_WINAPI
+    LG_exit_key = FlsAlloc(LG_thread_run_exit_hooks);
+    LG_is_exit_key_created = LG_exit_key != FLS_OUT_OF_INDEXES;
+#else
+    LG_is_exit_key_created =
+        pthread_key_create(&LG_exit_key, LG_thread_run_exit_hooks) == 0;
+#endif
+}
+
+bool LG_thread_at_exit(void (*hook)(void))
+{
+    LG_once(&LG_exit_key_once, LG_thread_create_exit_key);
+    if (!LG_is_exit_key_created
+        || LG_exit_hook_count == LG_MAX_THREAD_EXIT_HOOKS)
+    {
+        return false;
+    }
+
+    if (LG_exit_hook_count == 0)
+    {
+        /* The destructor only runs for threads whose value is set. */
+#ifdef LG_USE_WINAPI
+        if (!FlsSetValue(LG_exit_key, (PVOID)1))
+#else
+        if (pthread_setspecific(LG_exit_key, (void*)1) != 0)
+#endif
+        {
+            return false;
+        }
+    }
+    LG_exit_hooks[LG_exit_hook_count++] = hook;
+    return true;
+}
+
+void LG_once(LG_once_t* once, void (*routine)(void))
+{
+    /* 0: not run, 1: running, 2: done. */
+    if (LG_ATOMIC_LOAD(once) == 2)
+    {
+        return;
+    }
+    if (LG_ATOMIC_CAS(once, 0, 1))
+    {
+        routine();
+        LG_ATOMIC_STORE(once, 2);
+        return;
+    }
+    while (LG_ATOMIC_LOAD(once) != 2)
+    {
+        LG_thread_yield();
+    }
+}
+
+void LG_mutex_init(LG_mutex_t* mutex)
+{
+#ifdef LG_USE_WINAPI
+    InitializeCriticalSection(mutex);
+#else
+    pthread_mutex_init(mutex, NULL);
+#endif
+}
+
+void LG_mutex_free(LG_mutex_t* mutex)
+{
+#ifdef LG_USE_WINAPI
+    DeleteCriticalSection(mutex);
+#else
+    pthread_mutex_destroy(mutex);
+#endif
+}
+
+void LG_mutex_lock(LG_mutex_t* mutex)
+{
+#ifdef LG_USE_WINAPI
+    EnterCriticalSection(mutex);
+#else
+    pthread_mutex_lock(mutex);
+#endif
+}
+
+void LG_mutex_unlock(LG_mutex_t* mutex)
+{
+#ifdef LG_USE_WINAPI
+    LeaveCriticalSection(mutex);
+#else
+    pthread_mutex_unlock(mutex);
+#endif
+}
+
+void LG_cond_init(LG_cond_t* cond)
+{
+#ifdef LG_USE_WINAPI
+    InitializeConditionVariable(cond);
+#else
+    pthread_cond_init(cond, NULL);
+#endif
+}
+
+void LG_cond_free(LG_cond_t* cond)
+{
+#ifdef LG_USE_WINAPI
+    /* Windows condition variables need no cleanup. */
+    (void)cond;
+#else
+    pthread_cond_destroy(cond);
+#endif
+}
+
+void LG_cond_wait(LG_cond_t* cond, LG_mutex_t* mutex)
+{
+#ifdef LG_USE_WINAPI
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+#else
+    pthread_cond_wait(cond, mutex);
+#endif
+}
+
+bool LG_cond_timedwait(LG_cond_t* cond, LG_mutex_t* mutex, uint32_t timeout_ms)
+{
+#ifdef LG_USE_WINAPI
+    return SleepConditionVariableCS(cond, mutex, timeout_ms) != 0;
+#else
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec += 1;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    return pthread_cond_timedwait(cond, mutex, &deadline) != ETIMEDOUT;
+#endif
+}
+
+void LG_cond_signal(LG_cond_t* cond)
+{
+#ifdef LG_USE_WINAPI
+    WakeConditionVariable(cond);
+#else
+    pthread_cond_signal(cond);
+#endif
+}
+
+void LG_cond_broadcast(LG_cond_t* cond)
+{
+#ifdef LG_USE_WINAPI
+    WakeAllConditionVariable(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
@@ -0,0 +1,136 @@
+/*
+ * File: thread.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains a thin portability layer over
+ * threads, mutexes, condition variables, thread-local
+ * storage and atomic counters. It is used by the library's
+ * background workers and per-thread buffers.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_THREAD_H
+#define LG_THREAD_H
+
+#include "macros.h"
+#include "os.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef LG_USE_WINAPI
+typedef HANDLE             LG_thread_t;
+typedef CRITICAL_SECTION   LG_mutex_t;
+typedef CONDITION_VARIABLE LG_cond_t;
+#else
+#include <pthread.h>
+typedef pthread_t          LG_thread_t;
+typedef pthread_mutex_t    LG_mutex_t;
+typedef pthread_cond_t     LG_cond_t;
+#endif
+
+/* A flag for LG_once, initialized with LG_ONCE_INIT. */
+typedef uint64_t           LG_once_t;
+#define LG_ONCE_INIT 0
+
+/* Declares a variable that every thread has its own copy of. */
+#ifdef _MSC_VER
+#define LG_THREAD_LOCAL __declspec(thread)
+#else
+#define LG_THREAD_LOCAL __thread
+#endif
+
+/* Atomic operations on uint64_t variables. LG_ATOMIC_ADD returns the
+previous value and imposes no ordering: it is meant for counters.
+LG_ATOMIC_LOAD and LG_ATOMIC_STORE acquire and release, respectively.
+LG_ATOMIC_EXCHANGE returns the previous value, and LG_ATOMIC_CAS stores
+desired and returns true if target equals expected; both are full
+barriers. LG_ATOMIC_FENCE orders all loads and stores around it. */
+#ifdef _MSC_VER
+#define LG_ATOMIC_ADD(target, value) \
+    ((uint64_t)InterlockedExchangeAdd64((volatile LONG64*)(target), \
+                                        (LONG64)(value)))
+#define LG_ATOMIC_LOAD(target) \
+    ((uint64_t)InterlockedCompareExchange64((volatile LONG64*)(target), 0, 0))
+#define LG_ATOMIC_STORE(target, value) \
+    ((void)InterlockedExchange64((volatile LONG64*)(target), (LONG64)(value)))
+#define LG_ATOMIC_EXCHANGE(target, value) \
+    ((uint64_t)InterlockedExchange64((volatile LONG64*)(target), (LONG64)(value)))
+#define LG_ATOMIC_CAS(target, expected, desired) \
+    ((uint64_t)InterlockedCompareExchange64((volatile LONG64*)(target), \
+                                            (LONG64)(desired), \
+                                            (LONG64)(expected)) \
+     == (uint64_t)(expected))
+#define LG_ATOMIC_FENCE() MemoryBarrier()
+#else
+#define LG_ATOMIC_ADD(target, value) \
+    __atomic_fetch_add((target), (value), __ATOMIC_RELAXED)
+#define LG_ATOMIC_LOAD(target) \
+    __atomic_load_n((target), __ATOMIC_ACQUIRE)
+#define LG_ATOMIC_STORE(target, value) \
+    __atomic_store_n((target), (value), __ATOMIC_RELEASE)
+#define LG_ATOMIC_EXCHANGE(target, value) \
+    __atomic_exchange_n((target), (value), __ATOMIC_SEQ_CST)
+#define LG_ATOMIC_CAS(target, expected, desired) \
+    __sync_bool_compare_and_swap((target), (expected), (desired))
+#define LG_ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#endif
+
+/* Starts a new thread that runs routine(arg). */
+bool LG_thread_create(LG_thread_t* thread, void (*routine)(void*), void* arg);
+
+/* Blocks until thread has finished. */
+void LG_thread_join(LG_thread_t* thread);
+
+/* Lets other threads run before the calling thread continues. */
+void LG_thread_yield(void);
+
+/* Returns a non-zero number that identifies the calling thread. Unlike
+system thread IDs, the numbers are never reused within a process. */
+uint64_t LG_thread_id(void);
+
+/* Names the calling thread for the %(thread_name) format macro. The
+name is truncated to LG_MAX_THREAD_NAME_SIZE - 1 characters. */
+void LG_thread_set_name(const char* name);
+
+/* Returns the name of the calling thread and stores its length in
+len. Unless it has been set, the name is the one the system knows
+the thread by, or empty if there is none. */
+const char* LG_thread_name(size_t* len);
+
+/* Makes hook run on the calling thread when it exits, while its
+thread-local variables are still in place. Up to
+LG_MAX_THREAD_EXIT_HOOKS hooks can be registered per thread; returns
+false if there is no room. Hooks do not run for the thread that
+ends the process. */
+bool LG_thread_at_exit(void (*hook)(void));
+
+/* Runs routine once per flag, however many threads call this at the
+same time. None of the callers returns before routine has. */
+void LG_once(LG_once_t* once, void (*routine)(void));
+
+void LG_mutex_init(LG_mutex_t* mutex);
+
+void LG_mutex_free(LG_mutex_t* mutex);
+
+void LG_mutex_lock(LG_mutex_t* mutex);
+
+void LG_mutex_unlock(LG_mutex_t* mutex);
+
+void LG_cond_init(LG_cond_t* cond);
+
+void LG_cond_free(LG_cond_t* cond);
+
+void LG_cond_wait(LG_cond_t* cond, LG_mutex_t* mutex);
+
+/* Like LG_cond_wait but gives up after timeout_ms milliseconds.
+Returns false if the wait timed out. */
+bool LG_cond_timedwait(LG_cond_t* cond, LG_mutex_t* mutex, uint32_t timeout_ms);
+
+void LG_cond_signal(LG_cond_t* cond);
+
+void LG_cond_broadcast(LG_cond_t* cond);
+
+#endif /* LG_THREAD_H */
@@ -0,0 +1,192 @@
+/*
+ * File: tz.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+/* Exposes localtime_r and tzset. */
+#define _GNU_SOURCE
+
+#include "thread.h"
+#include "tz.h"
+#include <stdbool.h>
+
+#define LG_TZ_DAY_S 86400
+#define LG_TZ_WEEK_S (7 * LG_TZ_DAY_S)
+/* How many weeks ahead the next transition is looked for. */
+#define LG_TZ_MAX_WEEKS 53
+
+/* The cached local offset, valid for start <= t < end. The fields are
+guarded by a sequence lock: version is odd while they are written, and
+readers retry if it changed while they read. */
+static uint64_t LG_tz_version = 0;
+static uint64_t LG_tz_start = 0;
+static uint64_t LG_tz_end = 0;
+static uint64_t LG_tz_offset = 0;
+static uint64_t LG_tz_isdst = 0;
+
+static int64_t _tz_days_from_civil(int64_t y, int m, int d);
+static void    _tz_local_info(int64_t t, int32_t* offset_s, int* isdst);
+static void    _tz_reload(void);
+
+/* Converts days since 1970-01-01 to a date in the proleptic Gregorian
+calendar. */
+struct tm* tz_utc(int64_t t, struct tm* dest)
+{
+    int64_t days = t / LG_TZ_DAY_S;
+    int64_t secs = t % LG_TZ_DAY_S;
+    if (secs < 0)
+    {
+        secs += LG_TZ_DAY_S;
+        --days;
+    }
+
+    int64_t z = days + 719468;
+    int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int64_t doe = z - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    int mday = (int)(doy - (153 * mp + 2) / 5 + 1);
+    int mon = (int)(mp < 10 ? mp + 3 : mp - 9);
+    int64_t year = yoe + era * 400 + (mon <= 2);
+
+    dest->tm_year = (int)(year - 1900);
+    dest->tm_mon = mon - 1;
+    dest->tm_mday = mday;
+    dest->tm_hour = (int)(secs / 3600);
+    dest->tm_min = (int)(secs / 60 % 60);
+    dest->tm_sec = (int)(secs % 60);
+    dest->tm_wday = (int)(days >= -4 ? (days + 4) % 7 : (days + 5) % 7 + 6);
+    dest->tm_yday = (int)(days - _tz_days_from_civil(year, 1, 1));
+    dest->tm_isdst = 0;
+    return dest;
+}
+
+struct tm* tz_fixed(int64_t t, int32_t offset_s, struct tm* dest)
+{
+    return tz_utc(t + offset_s, dest);
+}
+
+struct tm* tz_local(int64_t t, struct tm* dest)
+{
+    uint64_t version = LG_ATOMIC_LOAD(&LG_tz_version);
+    if (!(version & 1))
+    {
+        int64_t start = (int64_t)LG_ATOMIC_LOAD(&LG_tz_start);
+        int64_t end = (int64_t)LG_ATOMIC_LOAD(&LG_tz_end);
+        int32_t offset_s = (int32_t)(int64_t)LG_ATOMIC_LOAD(&LG_tz_offset);
+        int isdst = (int)LG_ATOMIC_LOAD(&LG_tz_isdst);
+        if (LG_ATOMIC_LOAD(&LG_tz_version) == version && t >= start && t < end)
+        {
+            tz_fixed(t, offset_s, dest);
+            dest->tm_isdst = isdst;
+            return dest;
+        }
+    }
+
+    /* Finds the next transition a week at a time, and then the exact
+    second by halving. */
+    int32_t offset_s;
+    int isdst;
+    _tz_reload();
+    _tz_local_info(t, &offset_s, &isdst);
+    int64_t end = t + (int64_t)LG_TZ_MAX_WEEKS * LG_TZ_WEEK_S;
+    for (int64_t probe = t + LG_TZ_WEEK_S; probe <= end; probe += LG_TZ_WEEK_S)
+    {
+        int32_t probe_offset_s;
+        int probe_isdst;
+        _tz_local_info(probe, &probe_offset_s, &probe_isdst);
+        if (probe_offset_s != offset_s || probe_isdst != isdst)
+        {
+            int64_t low = probe - LG_TZ_WEEK_S;
+            int64_t high = probe;
+            while (high - low > 1)
+            {
+                int64_t mid = low + (high - low) / 2;
+                _tz_local_info(mid, &probe_offset_s, &probe_isdst);
+                if (probe_offset_s == offset_s && probe_isdst == isdst)
+                {
+                    low = mid;
+                }
+                else
+                {
+                    high = mid;
+                }
+            }
+            end = high;
+            break;
+        }
+    }
+
+    /* If another thread is refreshing the cache, this one leaves it
+    alone. */
+    if (!(version & 1) && LG_ATOMIC_CAS(&LG_tz_version, version, version + 1))
+    {
+        LG_ATOMIC_STORE(&LG_tz_start, (uint64_t)t);
+        LG_ATOMIC_STORE(&LG_tz_end, (uint64_t)end);
+        LG_ATOMIC_STORE(&LG_tz_offset, (uint64_t)(int64_t)offset_s);
+        LG_ATOMIC_STORE(&LG_tz_isdst, (uint64_t)isdst);
+        LG_ATOMIC_STORE(&LG_tz_version, version + 2);
+    }
+
+    tz_fixed(t, offset_s, dest);
+    dest->tm_isdst = isdst;
+    return dest;
+}
+
+int32_t tz_local_offset(int64_t t)
+{
+    int32_t offset_s;
+    int isdst;
+    _tz_reload();
+    _tz_local_info(t, &offset_s, &isdst);
+    return offset_s;
+}
+
+/* Returns the number of days from 1970-01-01 to the date. */
+int64_t _tz_days_from_civil(int64_t y, int m, int d)
+{
+    y -= m <= 2;
+    int64_t era = (y >= 0 ? y : y - 399) / 400;
+    int64_t yoe = y - era * 400;
+    int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+    int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    return era * 146097 + doe - 719468;
+}
+
+/* Reads the time zone of the system. */
+void _tz_reload(void)
+{
+#ifdef LG_USE_WINAPI
+    _tzset();
+#else
+    tzset();
+#endif
+}
+
+/* Asks the system for the local offset at t. */
+void _tz_local_info(int64_t t, int32_t* offset_s, int* isdst)
+{
+    time_t raw_time = (time_t)t;
+    struct tm local;
+#ifdef LG_USE_WINAPI
+    bool success = localtime_s(&local, &raw_time) == 0;
+#else
+    bool success = localtime_r(&raw_time, &local) != NULL;
+#endif
+    if (!success)
+    {
+        *offset_s = 0;
+        *isdst = 0;
+        return;
+    }
+    int64_t local_t = _tz_days_from_civil(local.tm_year + 1900LL,
+                                          local.tm_mon + 1,
+                                          local.tm_mday) * LG_TZ_DAY_S
+                      + local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+    *offset_s = (int32_t)(local_t - t);
+    *isdst = local.tm_isdst > 0;
+}
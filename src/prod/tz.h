@@ -0,0 +1,39 @@
+/*
+ * File: tz.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module converts times to calendar time without localtime(),
+ * which reads the time zone and takes a global lock on every call and
+ * is not thread-safe. UTC and fixed offsets are converted with
+ * arithmetic alone. For local time, the offset from UTC is cached
+ * together with the range of time it holds for, which reaches to the
+ * next daylight saving time transition, so the system is consulted
+ * only when the range has been left.
+ *
+ * The cache does not notice changes of the system time zone while the
+ * process runs.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_TZ_H
+#define LG_TZ_H
+
+#include <stdint.h>
+#include <time.h>
+
+/* Writes the UTC calendar time of t in dest. */
+struct tm* tz_utc(int64_t t, struct tm* dest);
+
+/* Writes the calendar time of t at offset_s seconds east of UTC in
+dest. */
+struct tm* tz_fixed(int64_t t, int32_t offset_s, struct tm* dest);
+
+/* Writes the local calendar time of t in dest. */
+struct tm* tz_local(int64_t t, struct tm* dest);
+
+/* Returns the offset of local time from UTC at t in seconds. */
+int32_t tz_local_offset(int64_t t);
+
+#endif /* LG_TZ_H */
@@ -0,0 +1,401 @@
+/*
+ * File: uring.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+/* Exposes the POSIX and Linux extensions used below. */
+#define _GNU_SOURCE
+
+#include "alloc.h"
+#include "os.h"
+#include "uring.h"
+#include <errno.h>
+#include <string.h>
+
+#if defined(LG_USE_IO_URING) && defined(LG_USE_LINUX_API)
+#define LG_HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+/* The user data of requests that do not own a buffer. */
+#define LG_URING_NO_BUF ((uint64_t)-1)
+
+#ifdef LG_HAVE_IO_URING
+static bool   _uring_setup(uring_t* uring, unsigned entries);
+static void   _uring_teardown(uring_t* uring);
+static struct io_uring_sqe* _uring_next_sqe(uring_t* uring);
+static bool   _uring_submit(uring_t* uring);
+static void   _uring_reap(uring_t* uring);
+static bool   _uring_wait_one(uring_t* uring);
+#endif
+
+uring_t* uring_init(uring_t* buffer, size_t buf_count, size_t buf_size)
+{
+    uring_t* uring = buffer;
+    if (!uring)
+    {
+        uring = LG_alloc(sizeof(uring_t));
+        if (!uring)
+        {
+            return NULL;
+        }
+        uring->is_dynamic = true;
+    }
+    else
+    {
+        uring->is_dynamic = false;
+    }
+
+    uring->ring_fd = -1;
+    uring->are_buffers_registered = false;
+    uring->buf_size = buf_size;
+    uring->buf_count = buf_count;
+    uring->free_count = buf_count;
+    uring->in_flight = 0;
+    uring->has_failed = false;
+    uring->buffers = LG_alloc(buf_count * buf_size);
+    uring->free_bufs = LG_alloc(buf_count * sizeof(int));
+    uring->reqs = LG_alloc(buf_count * sizeof(uring_req_t));
+    if (!uring->buffers || !uring->free_bufs || !uring->reqs)
+    {
+        if (uring->buffers) { LG_dealloc(uring->buffers); }
+        if (uring->free_bufs) { LG_dealloc(uring->free_bufs); }
+        if (uring->reqs) { LG_dealloc(uring->reqs); }
+        if (uring->is_dynamic) { LG_dealloc(uring); }
+        return NULL;
+    }
+    for (size_t i = 0; i < buf_count; ++i)
+    {
+        uring->free_bufs[i] = (int)i;
+    }
+    LG_mutex_init(&uring->lock);
+
+#ifdef LG_HAVE_IO_URING
+    /* Failing here is not an error: plain writes are used instead. */
+    _uring_setup(uring, (unsigned)buf_count + 1);
+#endif
+
+    return uring;
+}
+
+void uring_free(uring_t* uring)
+{
+    uring_wait(uring);
+#ifdef LG_HAVE_IO_URING
+    _uring_teardown(uring);
+#endif
+    LG_mutex_free(&uring->lock);
+    LG_dealloc(uring->buffers);
+    LG_dealloc(uring->free_bufs);
+    LG_dealloc(uring->reqs);
+    if (uring->is_dynamic)
+    {
+        LG_dealloc(uring);
+    }
+}
+
+bool uring_enabled(const uring_t* uring)
+{
+    return uring->ring_fd >= 0;
+}
+
+size_t uring_buf_size(const uring_t* uring)
+{
+    return uring->buf_size;
+}
+
+char* uring_acquire(uring_t* uring, int* buf_index)
+{
+    LG_mutex_lock(&uring->lock);
+#ifdef LG_HAVE_IO_URING
+    while (uring->free_count == 0 && uring->in_flight > 0)
+    {
+        _uring_wait_one(uring);
+    }
+#endif
+    if (uring->free_count == 0)
+    {
+        /* Every buffer is held by some handler. */
+        LG_mutex_unlock(&uring->lock);
+        return NULL;
+    }
+    *buf_index = uring->free_bufs[--uring->free_count];
+    LG_mutex_unlock(&uring->lock);
+    return uring->buffers + (size_t)*buf_index * uring->buf_size;
+}
+
+void uring_release(uring_t* uring, int buf_index)
+{
+    LG_mutex_lock(&uring->lock);
+    uring->free_bufs[uring->free_count++] = buf_index;
+    LG_mutex_unlock(&uring->lock);
+}
+
+bool uring_write(uring_t* uring,
+                 int fd,
+                 int buf_index,
+                 size_t size,
+                 uint64_t offset)
+{
+    char* data = uring->buffers + (size_t)buf_index * uring->buf_size;
+    bool success = true;
+
+    LG_mutex_lock(&uring->lock);
+#ifdef LG_HAVE_IO_URING
+    if (uring->ring_fd >= 0)
+    {
+        struct io_uring_sqe* sqe = _uring_next_sqe(uring);
+        sqe->opcode = uring->are_buffers_registered
+                      ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+        sqe->fd = fd;
+        sqe->addr = (uint64_t)(uintptr_t)data;
+        sqe->len = (uint32_t)size;
+        sqe->off = offset;
+        sqe->buf_index = (uint16_t)buf_index;
+        sqe->user_data = (uint64_t)buf_index;
+        uring->reqs[buf_index].fd = fd;
+        uring->reqs[buf_index].size = size;
+        uring->reqs[buf_index].offset = offset;
+        success = _uring_submit(uring);
+        if (success)
+        {
+            LG_mutex_unlock(&uring->lock);
+            return true;
+        }
+    }
+#endif
+    /* Plain write. */
+    success = _write_file_at(fd, data, size, offset);
+    uring->free_bufs[uring->free_count++] = buf_index;
+    LG_mutex_unlock(&uring->lock);
+    return success;
+}
+
+bool uring_sync(uring_t* uring, int fd)
+{
+#ifdef LG_HAVE_IO_URING
+    if (uring->ring_fd >= 0)
+    {
+        /* The drain flag holds the sync back until every earlier
+        request has completed. */
+        LG_mutex_lock(&uring->lock);
+        struct io_uring_sqe* sqe = _uring_next_sqe(uring);
+        sqe->opcode = IORING_OP_FSYNC;
+        sqe->fd = fd;
+        sqe->fsync_flags = IORING_FSYNC_DATASYNC;
+        sqe->flags = IOSQE_IO_DRAIN;
+        sqe->user_data = LG_URING_NO_BUF;
+        bool success = _uring_submit(uring);
+        LG_mutex_unlock(&uring->lock);
+        return uring_wait(uring) && success;
+    }
+#else
+    (void)uring;
+#endif
+    return _sync_file(fd);
+}
+
+bool uring_wait(uring_t* uring)
+{
+    LG_mutex_lock(&uring->lock);
+#ifdef LG_HAVE_IO_URING
+    while (uring->in_flight > 0)
+    {
+        if (!_uring_wait_one(uring))
+        {
+            break;
+        }
+    }
+#endif
+    bool success = !uring->has_failed;
+    uring->has_failed = false;
+    LG_mutex_unlock(&uring->lock);
+    return success;
+}
+
+#ifdef LG_HAVE_IO_URING
+bool _uring_setup(uring_t* uring, unsigned entries)
+{
+    struct io_uring_params params;
+    memset(&params, 0x00, sizeof(params));
+    int ring_fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring_fd < 0)
+    {
+        return false;
+    }
+
+    uring->sq_ring_size = params.sq_off.array
+                          + params.sq_entries * sizeof(unsigned);
+    uring->cq_ring_size = params.cq_off.cqes
+                          + params.cq_entries * sizeof(struct io_uring_cqe);
+    uring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    uring->sq_ring = mmap(NULL, uring->sq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd,
+                          IORING_OFF_SQ_RING);
+    uring->cq_ring = mmap(NULL, uring->cq_ring_size, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_POPULATE, ring_fd,
+                          IORING_OFF_CQ_RING);
+    uring->sqes = mmap(NULL, uring->sqes_size, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring_fd,
+                       IORING_OFF_SQES);
+    if (uring->sq_ring == MAP_FAILED
+        || uring->cq_ring == MAP_FAILED
+        || uring->sqes == MAP_FAILED)
+    {
+        uring->ring_fd = ring_fd;
+        _uring_teardown(uring);
+        return false;
+    }
+
+    char* sq = uring->sq_ring;
+    char* cq = uring->cq_ring;
+    uring->sq_head = (unsigned*)(sq + params.sq_off.head);
+    uring->sq_tail = (unsigned*)(sq + params.sq_off.tail);
+    uring->sq_mask = (unsigned*)(sq + params.sq_off.ring_mask);
+    uring->sq_array = (unsigned*)(sq + params.sq_off.array);
+    uring->cq_head = (unsigned*)(cq + params.cq_off.head);
+    uring->cq_tail = (unsigned*)(cq + params.cq_off.tail);
+    uring->cq_mask = (unsigned*)(cq + params.cq_off.ring_mask);
+    uring->cqes = cq + params.cq_off.cqes;
+    uring->ring_fd = ring_fd;
+
+    /* Registered buffers save the kernel from mapping the buffer on
+    every write. If registration is not allowed (e.g. because of the
+    locked memory limit), unregistered writes are used. */
+    struct iovec* iovecs = LG_alloc(uring->buf_count * sizeof(struct iovec));
+    if (iovecs)
+    {
+        for (size_t i = 0; i < uring->buf_count; ++i)
+        {
+            iovecs[i].iov_base = uring->buffers + i * uring->buf_size;
+            iovecs[i].iov_len = uring->buf_size;
+        }
+        uring->are_buffers_registered =
+            syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_BUFFERS,
+                    iovecs, (unsigned)uring->buf_count) == 0;
+        LG_dealloc(iovecs);
+    }
+    return true;
+}
+
+void _uring_teardown(uring_t* uring)
+{
+    if (uring->ring_fd < 0)
+    {
+        return;
+    }
+    if (uring->sq_ring != MAP_FAILED)
+    {
+        munmap(uring->sq_ring, uring->sq_ring_size);
+    }
+    if (uring->cq_ring != MAP_FAILED)
+    {
+        munmap(uring->cq_ring, uring->cq_ring_size);
+    }
+    if (uring->sqes != MAP_FAILED)
+    {
+        munmap(uring->sqes, uring->sqes_size);
+    }
+    close(uring->ring_fd);
+    uring->ring_fd = -1;
+}
+
+/* Returns the next free submission queue entry. Every entry is
+submitted right after it has been filled, so there always is one. */
+struct io_uring_sqe* _uring_next_sqe(uring_t* uring)
+{
+    unsigned index = *uring->sq_tail & *uring->sq_mask;
+    struct io_uring_sqe* sqe = (struct io_uring_sqe*)uring->sqes + index;
+    memset(sqe, 0x00, sizeof(struct io_uring_sqe));
+    uring->sq_array[index] = index;
+    return sqe;
+}
+
+/* Submits the entry filled last. */
+bool _uring_submit(uring_t* uring)
+{
+    __atomic_store_n(uring->sq_tail, *uring->sq_tail + 1, __ATOMIC_RELEASE);
+    int submitted;
+    do
+    {
+        submitted = (int)syscall(__NR_io_uring_enter, uring->ring_fd,
+                                 1, 0, 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+
+    if (submitted != 1)
+    {
+        /* Take the entry back so that the caller can fall back. */
+        __atomic_store_n(uring->sq_tail, *uring->sq_tail - 1,
+                         __ATOMIC_RELEASE);
+        return false;
+    }
+    ++uring->in_flight;
+    return true;
+}
+
+/* Handles the completed requests. */
+void _uring_reap(uring_t* uring)
+{
+    unsigned head = *uring->cq_head;
+    while (head != __atomic_load_n(uring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        struct io_uring_cqe* cqe =
+            (struct io_uring_cqe*)uring->cqes + (head & *uring->cq_mask);
+        if (cqe->res < 0)
+        {
+            uring->has_failed = true;
+        }
+        if (cqe->user_data != LG_URING_NO_BUF)
+        {
+            int buf_index = (int)cqe->user_data;
+            const uring_req_t* req = &uring->reqs[buf_index];
+            size_t written = cqe->res < 0 ? 0 : (size_t)cqe->res;
+            if (cqe->res >= 0 && written < req->size)
+            {
+                /* A short write, e.g. because the disk is nearly
+                full. The rest is written here so that the file has
+                no hole where the tail of the buffer should be. */
+                const char* data = uring->buffers
+                                   + (size_t)buf_index * uring->buf_size;
+                if (written == 0
+                    || !_write_file_at(req->fd,
+                                       data + written,
+                                       req->size - written,
+                                       req->offset + written))
+                {
+                    uring->has_failed = true;
+                }
+            }
+            uring->free_bufs[uring->free_count++] = buf_index;
+        }
+        --uring->in_flight;
+        ++head;
+    }
+    __atomic_store_n(uring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* Blocks until at least one request has completed. */
+bool _uring_wait_one(uring_t* uring)
+{
+    _uring_reap(uring);
+    if (uring->in_flight == 0)
+    {
+        return true;
+    }
+    int result = (int)syscall(__NR_io_uring_enter, uring->ring_fd,
+                              0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if (result < 0 && errno != EINTR)
+    {
+        return false;
+    }
+    _uring_reap(uring);
+    return true;
+}
+#endif
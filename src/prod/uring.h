@@ -0,0 +1,131 @@
+/*
+ * File: uring.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This module contains an asynchronous file output backend
+ * built on Linux io_uring. A single uring_t owns a pool of
+ * output buffers that are registered with the kernel. Handlers
+ * fill the buffers and submit them as writes; the writes of many
+ * files can then be in flight at the same time while the writing
+ * thread carries on, and the buffers return to the pool when the
+ * writes complete.
+ *
+ * io_uring is used only if the library was built with
+ * LG_USE_IO_URING (see flags.h) and the running kernel supports
+ * it. Otherwise every submitted buffer is written immediately
+ * with a plain write, so the backend can always be used.
+ *
+ * Example:
+ *
+ *   uring_t* uring = uring_init(NULL, 16, LG_MAX_BSIZE);
+ *   int buf_index;
+ *   char* buf = uring_acquire(uring, &buf_index);
+ *   memcpy(buf, "entry\n", 6);
+ *   uring_write(uring, fd, buf_index, 6, offset);
+ *   uring_sync(uring, fd);
+ *   uring_free(uring);
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LG_URING_H
+#define LG_URING_H
+
+#include "flags.h"
+#include "thread.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/* A write submitted from a buffer of the pool. */
+typedef struct {
+    int        fd;
+    size_t     size;
+    uint64_t   offset;
+} uring_req_t;
+
+typedef struct {
+    /* Serializes the use of the rings and the buffer pool. */
+    LG_mutex_t lock;
+
+    /* The io_uring file descriptor, or -1 if plain writes are used. */
+    int        ring_fd;
+
+    /* The submission and completion rings shared with the kernel. */
+    void*      sq_ring;
+    size_t     sq_ring_size;
+    void*      cq_ring;
+    size_t     cq_ring_size;
+    void*      sqes;
+    size_t     sqes_size;
+    unsigned*  sq_head;
+    unsigned*  sq_tail;
+    unsigned*  sq_mask;
+    unsigned*  sq_array;
+    unsigned*  cq_head;
+    unsigned*  cq_tail;
+    unsigned*  cq_mask;
+    void*      cqes;
+
+    /* Indicates whether the buffers are registered with the kernel. */
+    bool       are_buffers_registered;
+
+    /* The buffer pool. */
+    char*      buffers;
+    size_t     buf_size;
+    size_t     buf_count;
+
+    /* The write in flight from each buffer, so that the rest of a
+    short write can be written. */
+    uring_req_t* reqs;
+
+    /* The indices of the buffers that are not in use. */
+    int*       free_bufs;
+    size_t     free_count;
+
+    /* The number of submitted requests that have not completed. */
+    size_t     in_flight;
+
+    /* Indicates whether a request has failed since the last wait. */
+    bool       has_failed;
+
+    /* Indicates whether the object dynamically reserved its own memory. */
+    bool       is_dynamic;
+} uring_t;
+
+uring_t* uring_init(uring_t* buffer, size_t buf_count, size_t buf_size);
+
+/* Waits for the requests in flight and frees the backend. */
+void uring_free(uring_t* uring);
+
+/* Returns true if io_uring is in use, false if the backend
+has fallen back to plain writes. */
+bool uring_enabled(const uring_t* uring);
+
+size_t uring_buf_size(const uring_t* uring);
+
+/* Returns a free buffer from the pool and writes its index in
+buf_index. Blocks until a buffer is free. */
+char* uring_acquire(uring_t* uring, int* buf_index);
+
+/* Returns an unused buffer to the pool. */
+void uring_release(uring_t* uring, int buf_index);
+
+/* Submits a write of size bytes from the buffer in the file at offset.
+The buffer returns to the pool when the write completes. */
+bool uring_write(uring_t* uring,
+                 int fd,
+                 int buf_index,
+                 size_t size,
+                 uint64_t offset);
+
+/* Forces the data of the file to disk once every write submitted
+before has completed, and waits for it. */
+bool uring_sync(uring_t* uring, int fd);
+
+/* Waits for every request in flight. Returns false if any of the
+requests completed since the last wait has failed. */
+bool uring_wait(uring_t* uring);
+
+#endif /* LG_URING_H */
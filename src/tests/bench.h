@@ -0,0 +1,440 @@
+/*
+ * File: bench.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This file contains the benchmark harness of the project. A
+ * benchmark runs one configuration of the log for a fixed time in
+ * any number of threads, timing every call of log_write with the
+ * monotonic clock. The latencies are collected in a histogram with
+ * about 6 % resolution, from which throughput and the latency
+ * percentiles p50, p99, p99.9 and the maximum are reported.
+ *
+ * bench_run_matrix runs a baseline configuration and then varies one
+ * parameter at a time: entry format, message size, buffering mode and
+ * size, file mode, strict file size, thread count and output sink.
+ * Log files are written in a temporary directory that is emptied
+ * after every run.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "../prod/log.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef LG_USE_WINAPI
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <unistd.h>
+#endif
+
+/* Histogram buckets: 16 linear sub-buckets for every power of two. */
+#define BENCH_SUB_BITS 4
+#define BENCH_SUB_COUNT (1 << BENCH_SUB_BITS)
+#define BENCH_BUCKET_COUNT (64 * BENCH_SUB_COUNT)
+
+#define BENCH_MAX_THREADS 64
+#define BENCH_MAX_MSG_SIZE 256
+
+/* Where the benchmarked entries go. */
+typedef enum
+{
+    BENCH_SINK_FILE,   /* stdio file output. */
+    BENCH_SINK_URING,  /* File output through the uring backend. */
+    BENCH_SINK_FLOCK,  /* File output with file locks. */
+    BENCH_SINK_TBUF,   /* File output through per-thread buffers. */
+    BENCH_SINK_USER    /* A user output that discards the entries. */
+} BENCH_SINK;
+
+static const char* const BENCH_SINK_STRS[] = {
+    "file", "uring", "flock", "tbuf", "user"
+};
+
+typedef struct
+{
+    const char* e_format;
+    size_t      msg_size;
+    int         bmode;
+    size_t      bsize;
+    LG_FMODE    fmode;
+    bool        is_strict_fsize_enabled;
+    size_t      thread_count;
+    BENCH_SINK  sink;
+    uint32_t    duration_ms;
+} bench_config_t;
+
+typedef struct
+{
+    uint64_t counts[BENCH_BUCKET_COUNT];
+    uint64_t total;
+    uint64_t max;
+} bench_hist_t;
+
+/* The state of one benchmark thread. */
+typedef struct
+{
+    log_t*        log;
+    const char*   msg;
+    uint64_t      end_time;
+    volatile int* is_started;
+    bench_hist_t  hist;
+} bench_worker_t;
+
+static bool bench_discard(const char* data)
+{
+    (void)data;
+    return true;
+}
+
+static size_t bench_bucket(uint64_t ns)
+{
+    if (ns < BENCH_SUB_COUNT)
+    {
+        return (size_t)ns;
+    }
+    size_t msb = 0;
+    while ((ns >> msb) > 1)
+    {
+        ++msb;
+    }
+    size_t shift = msb - BENCH_SUB_BITS;
+    return ((shift + 1) << BENCH_SUB_BITS)
+           + (size_t)((ns >> shift) & (BENCH_SUB_COUNT - 1));
+}
+
+/* Returns the largest latency that falls in bucket. */
+static uint64_t bench_bucket_max(size_t bucket)
+{
+    if (bucket < BENCH_SUB_COUNT)
+    {
+        return bucket;
+    }
+    size_t shift = (bucket >> BENCH_SUB_BITS) - 1;
+    uint64_t sub = bucket & (BENCH_SUB_COUNT - 1);
+    return ((BENCH_SUB_COUNT + sub) << shift) + ((uint64_t)1 << shift) - 1;
+}
+
+static void bench_hist_record(bench_hist_t* hist, uint64_t ns)
+{
+    ++hist->counts[bench_bucket(ns)];
+    ++hist->total;
+    if (ns > hist->max)
+    {
+        hist->max = ns;
+    }
+}
+
+static void bench_hist_merge(bench_hist_t* dest, const bench_hist_t* src)
+{
+    for (size_t i = 0; i < BENCH_BUCKET_COUNT; ++i)
+    {
+        dest->counts[i] += src->counts[i];
+    }
+    dest->total += src->total;
+    if (src->max > dest->max)
+    {
+        dest->max = src->max;
+    }
+}
+
+/* Returns the latency below which the given fraction of calls fell. */
+static uint64_t bench_hist_percentile(const bench_hist_t* hist, double fraction)
+{
+    uint64_t rank = (uint64_t)(fraction * (double)hist->total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BENCH_BUCKET_COUNT; ++i)
+    {
+        seen += hist->counts[i];
+        if (seen > rank)
+        {
+            uint64_t value = bench_bucket_max(i);
+            return value < hist->max ? value : hist->max;
+        }
+    }
+    return hist->max;
+}
+
+static void bench_worker(void* arg)
+{
+    bench_worker_t* worker = arg;
+    while (!*worker->is_started)
+    {
+        /* Start all threads at once. */
+    }
+
+    uint64_t prev_time = _monotonic_time_ns();
+    size_t level = 0;
+    while (prev_time < worker->end_time)
+    {
+        log_write(worker->log, (LG_LEVEL)level, worker->msg);
+        uint64_t curr_time = _monotonic_time_ns();
+        bench_hist_record(&worker->hist, curr_time - prev_time);
+        prev_time = curr_time;
+        level = (level + 1) % LG_VALID_LVL_COUNT;
+    }
+}
+
+/* Creates a fresh directory for the log files and writes its path
+in dest. */
+static bool bench_make_dir(char* dest)
+{
+#ifdef LG_USE_WINAPI
+    char tmp_path[MAX_PATH];
+    GetTempPathA(MAX_PATH, tmp_path);
+    snprintf(dest, LG_MAX_FPATH_SIZE, "%slog_bench_%u",
+             tmp_path, (unsigned)GetCurrentProcessId());
+    return _create_dir(dest) || _does_dir_exist(dest);
+#else
+    strcpy(dest, "/tmp/log_bench_XXXXXX");
+    return mkdtemp(dest) != NULL;
+#endif
+}
+
+/* Removes the files in the directory, but not the directory. */
+static void bench_clear_dir(const char* path)
+{
+    char fpath[LG_MAX_FPATH_SIZE];
+#ifdef LG_USE_WINAPI
+    WIN32_FIND_DATAA data;
+    snprintf(fpath, sizeof fpath, "%s\\*", path);
+    HANDLE find = FindFirstFileA(fpath, &data);
+    if (find == INVALID_HANDLE_VALUE)
+    {
+        return;
+    }
+    do
+    {
+        snprintf(fpath, sizeof fpath, "%s\\%s", path, data.cFileName);
+        DeleteFileA(fpath);
+    } while (FindNextFileA(find, &data));
+    FindClose(find);
+#else
+    DIR* dir = opendir(path);
+    if (!dir)
+    {
+        return;
+    }
+    struct dirent* entry;
+    while ((entry = readdir(dir)))
+    {
+        if (entry->d_name[0] != '.')
+        {
+            snprintf(fpath, sizeof fpath, "%s/%s", path, entry->d_name);
+            remove(fpath);
+        }
+    }
+    closedir(dir);
+#endif
+}
+
+static bool bench_setup_log(log_t* log, const bench_config_t* config, const char* dir)
+{
+    log_init(log);
+    log_set_fmode(log, LG_ALL_LEVELS, config->fmode);
+    log_set_bmode(log, LG_ALL_LEVELS, config->bmode);
+    log_set_bsize(log, LG_ALL_LEVELS, config->bsize);
+    log_set_entry_format(log, LG_ALL_LEVELS, config->e_format);
+    log_set_max_fsize(log, LG_ALL_LEVELS, LG_DEF_MAX_FSIZE);
+    log_set_dname_format(log, LG_ALL_LEVELS, dir);
+    for (size_t level = 0; level < LG_VALID_LVL_COUNT; ++level)
+    {
+        char fname[32];
+        snprintf(fname, sizeof fname, "%s.log", LG_LEVEL_STRS[level]);
+        log_set_fname_format(log, level, fname);
+    }
+    if (config->is_strict_fsize_enabled)
+    {
+        log_strict_fsize_enable(log, LG_ALL_LEVELS);
+    }
+
+    switch (config->sink)
+    {
+    case BENCH_SINK_USER:
+        log_set_user_output(log, LG_ALL_LEVELS, bench_discard);
+        return log_user_output_enable(log, LG_ALL_LEVELS);
+    case BENCH_SINK_URING:
+        log_file_enable(log, LG_ALL_LEVELS);
+        return log_uring_enable(log, LG_ALL_LEVELS);
+    case BENCH_SINK_FLOCK:
+        log_file_enable(log, LG_ALL_LEVELS);
+        return log_flock_enable(log, LG_ALL_LEVELS);
+    case BENCH_SINK_TBUF:
+        log_file_enable(log, LG_ALL_LEVELS);
+        return log_tbuf_enable(log, LG_ALL_LEVELS);
+    default:
+        return log_file_enable(log, LG_ALL_LEVELS);
+    }
+}
+
+/* Writes the entry format in dest with newlines escaped. */
+static char* bench_format_label(const char* e_format, char* dest)
+{
+    char* out = dest;
+    for (; *e_format; ++e_format)
+    {
+        if (*e_format == '\n')
+        {
+            *out++ = '\\';
+            *out++ = 'n';
+        }
+        else
+        {
+            *out++ = *e_format;
+        }
+    }
+    *out = '\0';
+    return dest;
+}
+
+static void bench_print_header(void)
+{
+    printf("%-26s %5s %5s %7s %4s %4s %5s %3s %11s %8s %8s %8s %8s %9s\n",
+           "format", "msg", "bmode", "bsize", "fm", "sfs", "sink", "thr",
+           "entries/s", "MiB/s", "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+}
+
+static bool bench_run(const bench_config_t* config, const char* dir)
+{
+    static bench_worker_t workers[BENCH_MAX_THREADS];
+    static LG_thread_t threads[BENCH_MAX_THREADS];
+    char msg[BENCH_MAX_MSG_SIZE + 1];
+    char label[2 * LG_MAX_E_FORMAT_SIZE];
+    volatile int is_started = 0;
+    log_t log;
+
+    size_t thread_count = config->thread_count;
+    if (thread_count < 1 || thread_count > BENCH_MAX_THREADS)
+    {
+        return false;
+    }
+    size_t msg_size = config->msg_size < BENCH_MAX_MSG_SIZE
+                      ? config->msg_size : BENCH_MAX_MSG_SIZE;
+    memset(msg, 'x', msg_size);
+    msg[msg_size] = '\0';
+
+    if (!bench_setup_log(&log, config, dir))
+    {
+        log_free(&log);
+        return false;
+    }
+
+    uint64_t begin_time = _monotonic_time_ns();
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        memset(&workers[i].hist, 0, sizeof(bench_hist_t));
+        workers[i].log = &log;
+        workers[i].msg = msg;
+        workers[i].is_started = &is_started;
+        workers[i].end_time = begin_time + (uint64_t)config->duration_ms * 1000000;
+        if (i > 0 && !LG_thread_create(&threads[i], bench_worker, &workers[i]))
+        {
+            thread_count = i;
+            break;
+        }
+    }
+    is_started = 1;
+    bench_worker(&workers[0]);
+    for (size_t i = 1; i < thread_count; ++i)
+    {
+        LG_thread_join(&threads[i]);
+    }
+    log_flush(&log);
+    uint64_t elapsed = _monotonic_time_ns() - begin_time;
+
+    static bench_hist_t hist;
+    memset(&hist, 0, sizeof(bench_hist_t));
+    for (size_t i = 0; i < thread_count; ++i)
+    {
+        bench_hist_merge(&hist, &workers[i].hist);
+    }
+    log_stats_t stats;
+    log_stats(&log, &stats);
+    uint64_t bytes = stats.total.file_bytes + stats.total.user_bytes;
+    log_free(&log);
+    bench_clear_dir(dir);
+
+    double seconds = (double)elapsed / 1e9;
+    printf("%-26.26s %5u %5s %7u %4s %4s %5s %3u %11.0f %8.1f %8llu %8llu %8llu %9llu\n",
+           bench_format_label(config->e_format, label),
+           (unsigned)msg_size,
+           config->bmode == _IONBF ? "none" : config->bmode == _IOLBF ? "line" : "full",
+           (unsigned)config->bsize,
+           config->fmode == LG_FMODE_ROTATE ? "rot" : "rew",
+           config->is_strict_fsize_enabled ? "yes" : "no",
+           BENCH_SINK_STRS[config->sink],
+           (unsigned)thread_count,
+           (double)hist.total / seconds,
+           (double)bytes / seconds / (1024.0 * 1024.0),
+           (unsigned long long)bench_hist_percentile(&hist, 0.5),
+           (unsigned long long)bench_hist_percentile(&hist, 0.99),
+           (unsigned long long)bench_hist_percentile(&hist, 0.999),
+           (unsigned long long)hist.max);
+    fflush(stdout);
+    return true;
+}
+
+/* Runs the baseline and every variation of it for duration_ms each. */
+static bool bench_run_matrix(uint32_t duration_ms)
+{
+    static const char* const formats[] = {
+        "%(MSG)\n",
+        "%(LVL) %(MSG)\n",
+        "%(year)-%(month)-%(mday) %(hour):%(min):%(sec) %(LVL) %(MSG)\n"
+    };
+    static const size_t msg_sizes[] = { 16, 64, 256 };
+    static const int bmodes[] = { _IONBF, _IOLBF, _IOFBF };
+    static const size_t bsizes[] = { 512, BUFSIZ, LG_MAX_BSIZE };
+    static const LG_FMODE fmodes[] = { LG_FMODE_ROTATE, LG_FMODE_REWRITE };
+    static const bool strict_fsizes[] = { false, true };
+    static const size_t thread_counts[] = { 1, 2, 4, 8 };
+    static const BENCH_SINK sinks[] = {
+        BENCH_SINK_FILE, BENCH_SINK_URING, BENCH_SINK_FLOCK,
+        BENCH_SINK_TBUF, BENCH_SINK_USER
+    };
+    const bench_config_t baseline = {
+        formats[2], 48, _IOFBF, BUFSIZ, LG_FMODE_ROTATE, false, 1,
+        BENCH_SINK_FILE, duration_ms
+    };
+    bench_config_t config;
+    char dir[LG_MAX_FPATH_SIZE];
+    bool failed = false;
+
+    if (!bench_make_dir(dir))
+    {
+        fprintf(stderr, "bench: could not create a temporary directory\n");
+        return false;
+    }
+    printf("BENCHMARKS (%u ms per run, files in %s)\n", (unsigned)duration_ms, dir);
+    bench_print_header();
+
+#define BENCH_SWEEP(values, field) \
+    for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) \
+    { \
+        config = baseline; \
+        config.field = values[i]; \
+        failed = !bench_run(&config, dir) || failed; \
+    }
+
+    BENCH_SWEEP(formats, e_format);
+    BENCH_SWEEP(msg_sizes, msg_size);
+    BENCH_SWEEP(bmodes, bmode);
+    BENCH_SWEEP(bsizes, bsize);
+    BENCH_SWEEP(fmodes, fmode);
+    BENCH_SWEEP(strict_fsizes, is_strict_fsize_enabled);
+    BENCH_SWEEP(thread_counts, thread_count);
+    BENCH_SWEEP(sinks, sink);
+
+#undef BENCH_SWEEP
+
+    _remove_dir(dir);
+    return !failed;
+}
+
+#endif /* BENCH_H */
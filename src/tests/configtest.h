@@ -0,0 +1,279 @@
+/*
+ * File: configtest.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This file contains the test of the configuration parser. Texts are
+ * loaded in a log with log_load_config_str, and the result is checked
+ * through the settings of the log and through the entries it writes,
+ * which are captured by a user output. Invalid texts are checked to
+ * leave the log untouched and to name the offending line.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef CONFIGTEST_H
+#define CONFIGTEST_H
+
+#include "../prod/config.h"
+#include "../prod/log.h"
+#include "../prod/tz.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static char configtest_output[LG_MAX_MSG_SIZE];
+
+static bool configtest_capture(const char* entry)
+{
+    snprintf(configtest_output, sizeof(configtest_output), "%s", entry);
+    return true;
+}
+
+/* Initializes log to write only to the user output. */
+static void configtest_init(log_t* log)
+{
+    log_init(log);
+    log_file_disable(log, LG_ALL_LEVELS);
+    log_stdout_disable(log, LG_ALL_LEVELS);
+    log_stderr_disable(log, LG_ALL_LEVELS);
+    log_set_user_output(log, LG_ALL_LEVELS, configtest_capture);
+    log_user_output_enable(log, LG_ALL_LEVELS);
+}
+
+/* Writes msg at level and checks that the entry written is expected. */
+static bool configtest_expect_entry(log_t* log,
+                                    LG_LEVEL level,
+                                    const char* msg,
+                                    const char* expected)
+{
+    configtest_output[0] = '\0';
+    log_write(log, level, msg);
+    log_flush(log);
+    return strcmp(configtest_output, expected) == 0;
+}
+
+/* Checks that text is rejected with an error message that starts with
+expected, and that the threshold of log is left alone. */
+static bool configtest_expect_error(log_t* log,
+                                    const char* text,
+                                    const char* expected)
+{
+    log_clear_error(log);
+    LG_LEVEL threshold = log_threshold(log);
+    bool ok = !log_load_config_str(log, text)
+              && log_get_error(log) == LG_E_INVALID_CONFIG
+              && strncmp(log->error_msg, expected, strlen(expected)) == 0
+              && log_threshold(log) == threshold;
+    log_clear_error(log);
+    return ok;
+}
+
+/* Quoted values are unescaped, and neither a semicolon nor a hash
+inside quotes ends them. Unquoted values are trimmed. */
+static bool configtest_quoting(void)
+{
+    log_t log;
+    configtest_init(&log);
+
+    bool ok = log_load_config_str(&log,
+        "entry_format = \"<%(MSG)>\\t\\\"q\\\";# \\\\\\n\"  ")
+        && configtest_expect_entry(&log, LG_INFO, "m", "<m>\t\"q\";# \\\n");
+    ok = log_load_config_str(&log, "entry_format =   [%(MSG)]   ")
+         && configtest_expect_entry(&log, LG_INFO, "m", "[m]")
+         && ok;
+    ok = configtest_expect_error(&log, "entry_format = \"%(MSG)",
+                                 "line 1: unbalanced quotes")
+         && ok;
+
+    log_free(&log);
+    return ok;
+}
+
+/* A level prefix restricts a setting to one level, all applies it to
+every level, and global settings take no prefix. */
+static bool configtest_levels(void)
+{
+    log_t log;
+    configtest_init(&log);
+
+    bool ok = log_load_config_str(&log,
+        "entry_format = %(MSG)\n"
+        "error.entry_format = E %(MSG)\n"
+        "all.enabled = yes\n"
+        "debug.enabled = off\n");
+    ok = ok
+         && configtest_expect_entry(&log, LG_ERROR, "m", "E m")
+         && configtest_expect_entry(&log, LG_INFO, "m", "m")
+         && !log_enabled(&log, LG_DEBUG)
+         && log_enabled(&log, LG_TRACE)
+         && log_enabled(&log, LG_FATAL);
+
+    ok = configtest_expect_error(&log, "verbose.enabled = on",
+                                 "line 1: unknown level")
+         && ok;
+    ok = configtest_expect_error(&log, "info.threshold = error",
+                                 "line 1: the setting does not apply to levels")
+         && ok;
+
+    log_free(&log);
+    return ok;
+}
+
+/* In a string, semicolons outside quotes separate settings as newlines
+do. */
+static bool configtest_semicolons(void)
+{
+    log_t log;
+    configtest_init(&log);
+
+    bool ok = log_load_config_str(&log,
+        "threshold = warning;entry_format = \"a;b %(MSG)\" ; "
+        "info.enabled = no\n;;dedup = off")
+        && log_threshold(&log) == LG_WARNING
+        && !log_enabled(&log, LG_INFO)
+        && configtest_expect_entry(&log, LG_ERROR, "m", "a;b m");
+
+    log_free(&log);
+    return ok;
+}
+
+/* An invalid line rejects the whole text, names the line and leaves
+the earlier lines unapplied. Blank lines and comments are counted. */
+static bool configtest_invalid(void)
+{
+    log_t log;
+    configtest_init(&log);
+    log_set_threshold(&log, LG_INFO);
+
+    bool ok = configtest_expect_error(&log,
+        "threshold = error\n\n# A comment.\nno_such_setting = 1\n",
+        "line 4: unknown setting");
+    ok = configtest_expect_error(&log, "threshold = error\nthreshold",
+                                 "line 2: expected key = value")
+         && ok;
+    ok = configtest_expect_error(&log, "threshold = error\r\nstdout = maybe",
+                                 "line 2: invalid value")
+         && ok;
+    ok = configtest_expect_error(&log, "tbuf_timeout = 0",
+                                 "line 1: invalid value")
+         && ok;
+    ok = configtest_expect_error(&log, "sampling = 4294967296",
+                                 "line 1: invalid value")
+         && ok;
+    ok = configtest_expect_error(&log, "\n\nthreshold = loud",
+                                 "line 3: invalid value")
+         && ok;
+
+    log_free(&log);
+    return ok;
+}
+
+/* Sizes may be suffixed with K, M or G in either case, but must not
+overflow size_t. */
+static bool configtest_sizes(void)
+{
+    log_t log;
+    configtest_init(&log);
+    handler_t* handler = &log.handlers[LG_INFO];
+    char text[64];
+
+    bool ok = log_load_config_str(&log, "max_fsize = 1536")
+              && handler_max_fsize(handler) == 1536;
+    ok = log_load_config_str(&log, "max_fsize = 2K")
+         && handler_max_fsize(handler) == 2048
+         && ok;
+    ok = log_load_config_str(&log, "max_fsize = 3m")
+         && handler_max_fsize(handler) == (size_t)3 << 20
+         && ok;
+    ok = log_load_config_str(&log, "max_fsize = 1G")
+         && handler_max_fsize(handler) == (size_t)1 << 30
+         && ok;
+
+    snprintf(text, sizeof(text), "max_fsize = %zuK", (size_t)(SIZE_MAX >> 10));
+    ok = log_load_config_str(&log, text)
+         && handler_max_fsize(handler) == (SIZE_MAX & ~(size_t)1023)
+         && ok;
+    snprintf(text, sizeof(text), "max_fsize = %zuK", (size_t)(SIZE_MAX >> 10) + 1);
+    ok = configtest_expect_error(&log, text, "line 1: invalid value") && ok;
+    snprintf(text, sizeof(text), "max_fsize = %zuG", (size_t)(SIZE_MAX >> 30) + 1);
+    ok = configtest_expect_error(&log, text, "line 1: invalid value") && ok;
+    ok = configtest_expect_error(&log, "max_fsize = 1T", "line 1: invalid value") && ok;
+    ok = configtest_expect_error(&log, "max_fsize = K", "line 1: invalid value") && ok;
+    ok = configtest_expect_error(&log, "max_fsize = 1KK", "line 1: invalid value") && ok;
+
+    log_free(&log);
+    return ok;
+}
+
+/* Checks that the time mode of level in log is mode, at offset_s
+seconds from UTC in the fixed mode. */
+static bool configtest_expect_tmode(log_t* log,
+                                    LG_LEVEL level,
+                                    LG_TMODE mode,
+                                    int32_t offset_s)
+{
+    log_config_t* config = malloc(sizeof(log_config_t));
+    bool ok = config
+              && log_config(log, config)
+              && log_tmode(log, level) == mode
+              && config->formatters[level].tmode == mode
+              && config->formatters[level].utc_offset_s == offset_s;
+    free(config);
+    return ok;
+}
+
+/* The time mode is a name or an offset from UTC, which stands for the
+fixed mode. */
+static bool configtest_tmodes(void)
+{
+    log_t log;
+    configtest_init(&log);
+
+    bool ok = log_load_config_str(&log, "tmode = utc; error.tmode = +05:30")
+              && configtest_expect_tmode(&log, LG_INFO, LG_TMODE_UTC, 0)
+              && configtest_expect_tmode(&log, LG_ERROR, LG_TMODE_FIXED, 19800);
+    ok = log_load_config_str(&log, "tmode = -08")
+         && configtest_expect_tmode(&log, LG_INFO, LG_TMODE_FIXED, -8 * 3600)
+         && ok;
+    ok = log_load_config_str(&log, "tmode = fixed")
+         && configtest_expect_tmode(&log, LG_INFO, LG_TMODE_FIXED,
+                                    tz_local_offset((int64_t)time(NULL)))
+         && ok;
+    ok = log_load_config_str(&log, "tmode = local")
+         && configtest_expect_tmode(&log, LG_INFO, LG_TMODE_LOCAL, 0)
+         && ok;
+
+    ok = configtest_expect_error(&log, "tmode = 05:30", "line 1: invalid value") && ok;
+    ok = configtest_expect_error(&log, "tmode = +15", "line 1: invalid value") && ok;
+    ok = configtest_expect_error(&log, "tmode = +01:60", "line 1: invalid value") && ok;
+    ok = configtest_expect_error(&log, "tmode = +01:00x", "line 1: invalid value") && ok;
+
+    log_free(&log);
+    return ok;
+}
+
+static bool configtest_run(void)
+{
+    bool quoting_ok = configtest_quoting();
+    bool levels_ok = configtest_levels();
+    bool semicolons_ok = configtest_semicolons();
+    bool invalid_ok = configtest_invalid();
+    bool sizes_ok = configtest_sizes();
+    bool tmodes_ok = configtest_tmodes();
+
+    printf("CONFIG: quoting %s, levels %s, semicolons %s, invalid %s, sizes %s, "
+           "tmodes %s\n",
+           quoting_ok ? "passed" : "failed",
+           levels_ok ? "passed" : "failed",
+           semicolons_ok ? "passed" : "failed",
+           invalid_ok ? "passed" : "failed",
+           sizes_ok ? "passed" : "failed",
+           tmodes_ok ? "passed" : "failed");
+    return quoting_ok && levels_ok && semicolons_ok && invalid_ok && sizes_ok
+           && tmodes_ok;
+}
+
+#endif /* CONFIGTEST_H */
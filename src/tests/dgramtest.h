@@ -0,0 +1,185 @@
+/*
+ * File: dgramtest.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This file contains the test of the syslog and journald output. The
+ * log is pointed at a datagram socket bound by the test itself, which
+ * receives the entries and checks their framing.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef DGRAMTEST_H
+#define DGRAMTEST_H
+
+#include "../prod/dgram.h"
+#include "../prod/log.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef LG_USE_WINAPI
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define DGRAMTEST_ENTRY_COUNT 100
+#define DGRAMTEST_BATCH 5
+
+/* Far more than the receive queue of a datagram socket holds. */
+#define DGRAMTEST_FULL_COUNT 5000
+
+/* Binds a socket to path and returns it, or -1 on failure. */
+static int dgramtest_bind(const char* path)
+{
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    unlink(path);
+
+    struct timeval timeout = { 1, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/* Writes entries in batches at LG_WARNING and checks that every one of
+them arrives as a datagram of its own, starting with the expected
+header and ending with the expected message. */
+static bool dgramtest_run_proto(LG_DGRAM_PROTO proto, const char* header)
+{
+    char path[64];
+    sprintf(path, "/tmp/lg_dgramtest_%ld.sock", (long)getpid());
+    int fd = dgramtest_bind(path);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    log_t log;
+    log_init(&log);
+    log_set_entry_format(&log, LG_ALL_LEVELS, "%(LVL) %(MSG)\n");
+    bool failed = !log_dgram_enable(&log, LG_WARNING, proto, path, "dgramtest");
+
+    /* The receive queue of a datagram socket is short, so the entries
+    are written in small batches and received in between. */
+    for (size_t i = 0; i < DGRAMTEST_ENTRY_COUNT && !failed; i += DGRAMTEST_BATCH)
+    {
+        log_entry_t entries[DGRAMTEST_BATCH];
+        char msgs[DGRAMTEST_BATCH][16];
+        for (size_t j = 0; j < DGRAMTEST_BATCH; ++j)
+        {
+            sprintf(msgs[j], "entry %u", (unsigned)(i + j));
+            entries[j].level = LG_WARNING;
+            entries[j].msg = msgs[j];
+            entries[j].msg_len = 0;
+            entries[j].kvs = NULL;
+            entries[j].kv_count = 0;
+        }
+        failed = !log_write_batch(&log, entries, DGRAMTEST_BATCH);
+
+        for (size_t j = 0; j < DGRAMTEST_BATCH && !failed; ++j)
+        {
+            char data[256];
+            ssize_t size = recv(fd, data, sizeof(data) - 1, 0);
+            if (size <= 0)
+            {
+                failed = true;
+                break;
+            }
+            data[size] = '\0';
+
+            char expected[64];
+            sprintf(expected, "WARNING   %s", msgs[j]);
+            size_t len = strlen(expected);
+            size_t trailer = proto == LG_DGRAM_JOURNALD ? 1 : 0;
+            failed = strncmp(data, header, strlen(header)) != 0
+                     || (size_t)size < len + trailer
+                     || memcmp(data + size - trailer - len, expected, len) != 0;
+        }
+    }
+
+    log_free(&log);
+    close(fd);
+    unlink(path);
+    return !failed;
+}
+
+/* Writes more entries than the receive queue holds without receiving
+any, and checks that the writes return and that every entry is either
+received or counted as dropped. */
+static bool dgramtest_full(void)
+{
+    char path[64];
+    sprintf(path, "/tmp/lg_dgramtest_full_%ld.sock", (long)getpid());
+    int fd = dgramtest_bind(path);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    log_t log;
+    log_init(&log);
+    bool failed = !log_dgram_enable(&log, LG_WARNING, LG_DGRAM_SYSLOG,
+                                    path, "dgramtest");
+    for (size_t i = 0; i < DGRAMTEST_FULL_COUNT && !failed; ++i)
+    {
+        log_write(&log, LG_WARNING, "entry");
+    }
+    log_flush(&log);
+
+    struct timeval timeout = { 0, 10000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    uint64_t received = 0;
+    char data[256];
+    while (recv(fd, data, sizeof(data), 0) > 0)
+    {
+        ++received;
+    }
+
+    uint64_t dropped = failed ? 0 : dgram_dropped(log.handlers[LG_WARNING].dgram);
+    failed = failed || dropped == 0 || received + dropped != DGRAMTEST_FULL_COUNT;
+
+    log_free(&log);
+    close(fd);
+    unlink(path);
+    return !failed;
+}
+
+static bool dgramtest_run(void)
+{
+    char header[64];
+    sprintf(header, "<%d>dgramtest[%ld]: ",
+            LG_DGRAM_FACILITY * 8 + dgram_severity(LG_WARNING),
+            (long)getpid());
+    bool syslog_ok = dgramtest_run_proto(LG_DGRAM_SYSLOG, header);
+    bool journald_ok = dgramtest_run_proto(LG_DGRAM_JOURNALD, "PRIORITY=4\n");
+    bool full_ok = dgramtest_full();
+    printf("DGRAM: syslog %s, journald %s, full %s\n",
+           syslog_ok ? "passed" : "failed",
+           journald_ok ? "passed" : "failed",
+           full_ok ? "passed" : "failed");
+    return syslog_ok && journald_ok && full_ok;
+}
+
+#else
+
+static bool dgramtest_run(void)
+{
+    return true;
+}
+
+#endif /* LG_USE_WINAPI */
+
+#endif /* DGRAMTEST_H */
@@ -0,0 +1,125 @@
+/*
+ * File: fmbench.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This file contains micro-benchmarks of the formatter. They
+ * call formatter_entry and formatter_path in a tight loop without
+ * any output, so that changes to the expansion of format macros
+ * can be measured without disk noise. Every macro in _FM_TABLE
+ * is measured on its own, followed by a few realistic composite
+ * formats. The results are reported in nanoseconds per call and
+ * expanded bytes per nanosecond.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef FMBENCH_H
+#define FMBENCH_H
+
+#include "../prod/fmacro.h"
+#include "../prod/formatter.h"
+#include "../prod/os.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/* The number of calls between reads of the clock. */
+#define FMBENCH_BATCH_SIZE 1024
+
+#define FMBENCH_MSG "Hello! This is just a tiny little test message!"
+
+/* Keeps the compiler from optimizing the formatting away. */
+static volatile char fmbench_sink;
+
+/* Formats with the given format for duration_ms and prints the
+results. Returns false if the format is not valid for the flags. */
+static bool fmbench_run(const char* format, uint16_t flags, uint32_t duration_ms)
+{
+    formatter_t formatter;
+    char dest[LG_MAX_ENTRY_SIZE + LG_MAX_MSG_SIZE];
+    uint64_t calls = 0;
+    uint64_t bytes = 0;
+
+    if (!formatter_init(&formatter, format, flags))
+    {
+        return false;
+    }
+
+    uint64_t begin_time = _monotonic_time_ns();
+    uint64_t end_time = begin_time + (uint64_t)duration_ms * 1000000;
+    uint64_t curr_time = begin_time;
+    while (curr_time < end_time)
+    {
+        for (size_t i = 0; i < FMBENCH_BATCH_SIZE; ++i)
+        {
+            if (flags & LG_FORMAT_ENTRIES)
+            {
+                formatter_entry(&formatter, dest, FMBENCH_MSG, LG_INFO);
+            }
+            else
+            {
+                formatter_path(&formatter, dest);
+            }
+            fmbench_sink = dest[0];
+        }
+        bytes += FMBENCH_BATCH_SIZE * strlen(dest);
+        calls += FMBENCH_BATCH_SIZE;
+        curr_time = _monotonic_time_ns();
+    }
+    formatter_free(&formatter);
+
+    double elapsed = (double)(curr_time - begin_time);
+    printf("%-5s %-60.60s %9.1f %9.3f\n",
+           flags & LG_FORMAT_ENTRIES ? "entry" : "path",
+           format,
+           elapsed / (double)calls,
+           (double)bytes / elapsed);
+    fflush(stdout);
+    return true;
+}
+
+/* Runs every benchmark for duration_ms. */
+static bool fmbench_run_all(uint32_t duration_ms)
+{
+    static const char* const entry_formats[] = {
+        "%(MSG)",
+        "%(LVL) %(MSG)",
+        "%(year)-%(month)-%(mday) %(hour):%(min):%(sec) %(LVL) %(MSG)",
+        "[%(Wday_s) %(mday) %(Mname_s) %(year) %(hour):%(min):%(sec)] "
+            "%(Lvl): %(MSG)"
+    };
+    static const char* const path_formats[] = {
+        "app.log",
+        "app_%(year)_%(month)_%(mday).log",
+        "%(year)%(month)%(mday)_%(hour)%(min)%(sec)_%(WDAY_L).log"
+    };
+    char format[LG_MAX_FM_S_LEN + 4];
+    bool failed = false;
+
+    printf("FORMATTER BENCHMARKS (%u ms per run)\n", (unsigned)duration_ms);
+    printf("%-5s %-60s %9s %9s\n", "kind", "format", "ns/call", "bytes/ns");
+
+    for (size_t i = 0; i < LG_FM_COUNT; ++i)
+    {
+        snprintf(format, sizeof format, "%c%c%s%c", LG_FM_BEGIN_INDIC,
+                 LG_FM_LEFT_DELIM, _FM_TABLE[i].str, LG_FM_RIGHT_DELIM);
+        failed = !fmbench_run(format, LG_FORMAT_ENTRIES, duration_ms) || failed;
+
+        /* The level and the message cannot be used in paths. */
+        fmbench_run(format, LG_FORMAT_PATHS, duration_ms);
+    }
+    for (size_t i = 0; i < sizeof(entry_formats) / sizeof(entry_formats[0]); ++i)
+    {
+        failed = !fmbench_run(entry_formats[i], LG_FORMAT_ENTRIES, duration_ms)
+                 || failed;
+    }
+    for (size_t i = 0; i < sizeof(path_formats) / sizeof(path_formats[0]); ++i)
+    {
+        failed = !fmbench_run(path_formats[i], LG_FORMAT_PATHS, duration_ms)
+                 || failed;
+    }
+    return !failed;
+}
+
+#endif /* FMBENCH_H */
@@ -0,0 +1,372 @@
+/*
+ * File: kvtest.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This file contains the test of the key-value encoding. The escapes
+ * of control characters, quotes and backslashes, empty strings and
+ * values JSON cannot represent are compared with the expected text,
+ * and everything that is written in JSON mode, truncated or not, is
+ * checked to be valid JSON.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef KVTEST_H
+#define KVTEST_H
+
+#include "../prod/kv.h"
+#include "../prod/log.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define KVTEST_MAX_OUTPUTS 4
+
+static char   kvtest_outputs[KVTEST_MAX_OUTPUTS][LG_MAX_ENTRY_SIZE + LG_MAX_MSG_SIZE];
+static size_t kvtest_output_count = 0;
+
+static bool kvtest_capture(const char* entry)
+{
+    if (kvtest_output_count < KVTEST_MAX_OUTPUTS)
+    {
+        snprintf(kvtest_outputs[kvtest_output_count++],
+                 sizeof(kvtest_outputs[0]), "%s", entry);
+    }
+    return true;
+}
+
+/* The JSON checker below returns the end of the value that begins at
+pos, or NULL if there is none. */
+static const char* kvtest_json_value(const char* pos, int depth);
+
+static const char* kvtest_json_space(const char* pos)
+{
+    while (*pos == ' ' || *pos == '\t' || *pos == '\n' || *pos == '\r')
+    {
+        ++pos;
+    }
+    return pos;
+}
+
+static const char* kvtest_json_string(const char* pos)
+{
+    if (*pos++ != '"')
+    {
+        return NULL;
+    }
+    while (*pos != '"')
+    {
+        unsigned char c = (unsigned char)*pos;
+        if (c < 0x20)
+        {
+            return NULL;
+        }
+        if (c == '\\')
+        {
+            ++pos;
+            if (*pos == 'u')
+            {
+                for (int i = 1; i <= 4; ++i)
+                {
+                    if (!strchr("0123456789abcdefABCDEF", pos[i]) || !pos[i])
+                    {
+                        return NULL;
+                    }
+                }
+                pos += 4;
+            }
+            else if (!*pos || !strchr("\"\\/bfnrt", *pos))
+            {
+                return NULL;
+            }
+        }
+        ++pos;
+    }
+    return pos + 1;
+}
+
+static const char* kvtest_json_number(const char* pos)
+{
+    const char* begin = pos;
+    if (*pos == '-')
+    {
+        ++pos;
+    }
+    if (*pos == '0')
+    {
+        ++pos;
+    }
+    else if (*pos >= '1' && *pos <= '9')
+    {
+        while (*pos >= '0' && *pos <= '9')
+        {
+            ++pos;
+        }
+    }
+    else
+    {
+        return NULL;
+    }
+    if (*pos == '.')
+    {
+        if (!(*++pos >= '0' && *pos <= '9'))
+        {
+            return NULL;
+        }
+        while (*pos >= '0' && *pos <= '9')
+        {
+            ++pos;
+        }
+    }
+    if (*pos == 'e' || *pos == 'E')
+    {
+        ++pos;
+        if (*pos == '+' || *pos == '-')
+        {
+            ++pos;
+        }
+        if (!(*pos >= '0' && *pos <= '9'))
+        {
+            return NULL;
+        }
+        while (*pos >= '0' && *pos <= '9')
+        {
+            ++pos;
+        }
+    }
+    return pos > begin ? pos : NULL;
+}
+
+static const char* kvtest_json_object(const char* pos, int depth)
+{
+    pos = kvtest_json_space(pos + 1);
+    if (*pos == '}')
+    {
+        return pos + 1;
+    }
+    for (;;)
+    {
+        pos = kvtest_json_string(pos);
+        if (!pos)
+        {
+            return NULL;
+        }
+        pos = kvtest_json_space(pos);
+        if (*pos++ != ':')
+        {
+            return NULL;
+        }
+        pos = kvtest_json_value(pos, depth + 1);
+        if (!pos)
+        {
+            return NULL;
+        }
+        pos = kvtest_json_space(pos);
+        if (*pos == '}')
+        {
+            return pos + 1;
+        }
+        if (*pos++ != ',')
+        {
+            return NULL;
+        }
+        pos = kvtest_json_space(pos);
+    }
+}
+
+static const char* kvtest_json_value(const char* pos, int depth)
+{
+    if (depth > 16)
+    {
+        return NULL;
+    }
+    pos = kvtest_json_space(pos);
+    switch (*pos)
+    {
+        case '{':
+            return kvtest_json_object(pos, depth);
+        case '"':
+            return kvtest_json_string(pos);
+        case 't':
+            return strncmp(pos, "true", 4) == 0 ? pos + 4 : NULL;
+        case 'f':
+            return strncmp(pos, "false", 5) == 0 ? pos + 5 : NULL;
+        case 'n':
+            return strncmp(pos, "null", 4) == 0 ? pos + 4 : NULL;
+        default:
+            return kvtest_json_number(pos);
+    }
+}
+
+/* Returns true if text is a single JSON value, optionally followed by
+whitespace. */
+static bool kvtest_is_json(const char* text)
+{
+    const char* end = kvtest_json_value(text, 0);
+    return end && *kvtest_json_space(end) == '\0';
+}
+
+/* Escapes src and compares the result with expected. */
+static bool kvtest_expect_escape(const char* src, size_t src_len, const char* expected)
+{
+    char dest[64];
+    size_t len = kv_escape(dest, sizeof(dest), src, src_len);
+    return len == strlen(expected) && memcmp(dest, expected, len) == 0;
+}
+
+/* Encodes kv in mode and compares the result with expected. */
+static bool kvtest_expect_value(const kv_t* kv, LG_EMODE mode, const char* expected)
+{
+    char dest[64];
+    size_t len = kv_encode_value(dest, sizeof(dest), kv, mode);
+    dest[len] = '\0';
+    return strcmp(dest, expected) == 0;
+}
+
+static bool kvtest_escapes(void)
+{
+    bool ok = true;
+    ok = kvtest_expect_escape("", 0, "") && ok;
+    ok = kvtest_expect_escape("plain", 5, "plain") && ok;
+    ok = kvtest_expect_escape("a\"b", 3, "a\\\"b") && ok;
+    ok = kvtest_expect_escape("a\\b", 3, "a\\\\b") && ok;
+    ok = kvtest_expect_escape("\b\t\n\f\r", 5, "\\b\\t\\n\\f\\r") && ok;
+    ok = kvtest_expect_escape("\x01\x1f", 2, "\\u0001\\u001f") && ok;
+    ok = kvtest_expect_escape("\x7f/", 2, "\x7f/") && ok;
+
+    /* The null character ends the input. */
+    ok = kvtest_expect_escape("ab\0cd", 5, "ab") && ok;
+    return ok;
+}
+
+static bool kvtest_values(void)
+{
+    const kv_t nan_kv = LG_KV_DOUBLE("d", NAN);
+    const kv_t inf_kv = LG_KV_DOUBLE("d", INFINITY);
+    const kv_t ninf_kv = LG_KV_DOUBLE("d", -INFINITY);
+    const kv_t half_kv = LG_KV_DOUBLE("d", 0.5);
+    const kv_t empty_kv = LG_KV_STR("s", "");
+    const kv_t null_kv = LG_KV_STR("s", NULL);
+    const kv_t quote_kv = LG_KV_STR("s", "say \"hi\"");
+    const kv_t min_kv = LG_KV_INT("i", INT64_MIN);
+    const kv_t max_kv = LG_KV_UINT("u", UINT64_MAX);
+    bool ok = true;
+
+    ok = kvtest_expect_value(&nan_kv, LG_EMODE_JSON, "null") && ok;
+    ok = kvtest_expect_value(&inf_kv, LG_EMODE_JSON, "null") && ok;
+    ok = kvtest_expect_value(&ninf_kv, LG_EMODE_JSON, "null") && ok;
+    ok = kvtest_expect_value(&half_kv, LG_EMODE_JSON, "0.5") && ok;
+    ok = kvtest_expect_value(&empty_kv, LG_EMODE_JSON, "\"\"") && ok;
+    ok = kvtest_expect_value(&empty_kv, LG_EMODE_LOGFMT, "\"\"") && ok;
+    ok = kvtest_expect_value(&null_kv, LG_EMODE_JSON, "null") && ok;
+    ok = kvtest_expect_value(&null_kv, LG_EMODE_LOGFMT, "\"\"") && ok;
+    ok = kvtest_expect_value(&quote_kv, LG_EMODE_JSON, "\"say \\\"hi\\\"\"") && ok;
+    ok = kvtest_expect_value(&quote_kv, LG_EMODE_LOGFMT, "\"say \\\"hi\\\"\"") && ok;
+    ok = kvtest_expect_value(&min_kv, LG_EMODE_JSON, "-9223372036854775808") && ok;
+    ok = kvtest_expect_value(&max_kv, LG_EMODE_JSON, "18446744073709551615") && ok;
+    return ok;
+}
+
+/* Encodes a string that needs every kind of escape with every capacity
+up to the length of the whole encoding, and checks that the result is
+always a prefix of the whole encoding that does not end inside an
+escape sequence, and that the quoted form is a valid JSON string. */
+static bool kvtest_truncation(void)
+{
+    static const char src[] = "a\"b\\c\nd\x01" "e";
+    size_t src_len = sizeof(src) - 1;
+    char full[64];
+    char dest[64];
+    bool is_boundary[64] = { false };
+    size_t full_len = kv_escape(full, sizeof(full), src, src_len);
+    bool ok = true;
+
+    for (size_t i = 0; i <= full_len; )
+    {
+        is_boundary[i] = true;
+        i += full[i] != '\\' ? 1 : full[i + 1] == 'u' ? 6 : 2;
+    }
+    for (size_t capacity = 0; capacity <= full_len; ++capacity)
+    {
+        size_t len = kv_escape(dest, capacity, src, src_len);
+        ok = len <= capacity
+             && is_boundary[len]
+             && memcmp(dest, full, len) == 0
+             && ok;
+    }
+    for (size_t capacity = 2; capacity <= full_len + 2; ++capacity)
+    {
+        size_t len = kv_encode_str(dest, capacity, src, src_len, LG_EMODE_JSON);
+        dest[len] = '\0';
+        ok = len <= capacity && kvtest_is_json(dest) && ok;
+    }
+    return ok;
+}
+
+/* Writes entries with awkward fields through a log in JSON mode,
+including messages long enough to be truncated at every possible
+point, and checks that each one is a valid JSON object. */
+static bool kvtest_log(void)
+{
+    static char message[LG_MAX_MSG_SIZE];
+    const kv_t kvs[] = {
+        LG_KV_STR("ctl", "\x01\x02\x1f\t"),
+        LG_KV_STR("quote\"key", "\"\\"),
+        LG_KV_STR("", ""),
+        LG_KV_STR("null", NULL),
+        LG_KV_DOUBLE("nan", NAN),
+        LG_KV_DOUBLE("inf", -INFINITY),
+        LG_KV_BOOL("b", true)
+    };
+    size_t kv_count = sizeof(kvs) / sizeof(kvs[0]);
+    log_t log;
+    bool ok = true;
+
+    log_init(&log);
+    log_file_disable(&log, LG_ALL_LEVELS);
+    log_stdout_disable(&log, LG_ALL_LEVELS);
+    log_stderr_disable(&log, LG_ALL_LEVELS);
+    log_set_user_output(&log, LG_ALL_LEVELS, kvtest_capture);
+    log_user_output_enable(&log, LG_ALL_LEVELS);
+    ok = log_set_entry_format(&log, LG_ALL_LEVELS, "%(LVL) msg=%(MSG)") && ok;
+    ok = log_set_emode(&log, LG_ALL_LEVELS, LG_EMODE_JSON) && ok;
+
+    kvtest_output_count = 0;
+    log_writekv(&log, LG_INFO, "", kvs, kv_count);
+    ok = kvtest_output_count == 1 && kvtest_is_json(kvtest_outputs[0]) && ok;
+
+    /* Each control character takes six bytes escaped, so the message
+    alone can fill the entry. */
+    for (size_t len = 0; len < LG_MAX_MSG_SIZE - 1; len += 7)
+    {
+        for (size_t i = 0; i < len; ++i)
+        {
+            message[i] = i % 3 == 0 ? '\x01' : i % 3 == 1 ? '"' : 'x';
+        }
+        message[len] = '\0';
+        kvtest_output_count = 0;
+        log_writekv(&log, LG_INFO, message, kvs, kv_count);
+        ok = kvtest_output_count == 1 && kvtest_is_json(kvtest_outputs[0]) && ok;
+    }
+
+    log_free(&log);
+    return ok;
+}
+
+static bool kvtest_run(void)
+{
+    bool escapes_ok = kvtest_escapes();
+    bool values_ok = kvtest_values();
+    bool truncation_ok = kvtest_truncation();
+    bool log_ok = kvtest_log();
+
+    printf("KV: escapes %s, values %s, truncation %s, log %s\n",
+           escapes_ok ? "passed" : "failed",
+           values_ok ? "passed" : "failed",
+           truncation_ok ? "passed" : "failed",
+           log_ok ? "passed" : "failed");
+    return escapes_ok && values_ok && truncation_ok && log_ok;
+}
+
+#endif /* KVTEST_H */
@@ -0,0 +1,178 @@
+/*
+ * File: limitertest.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This file contains the test of the rate limiter. The token bucket
+ * and the summary interval are driven with made-up times through
+ * limiter_allow_at, so the results do not depend on the speed of the
+ * machine. The summary entry is also checked through a log, whose
+ * entries are captured by a user output.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef LIMITERTEST_H
+#define LIMITERTEST_H
+
+#include "../prod/limiter.h"
+#include "../prod/log.h"
+#include <stdio.h>
+#include <string.h>
+
+#define LIMITERTEST_MS 1000000ULL
+#define LIMITERTEST_START (1000 * LIMITERTEST_MS)
+#define LIMITERTEST_MAX_OUTPUTS 8
+
+static char   limitertest_outputs[LIMITERTEST_MAX_OUTPUTS][LG_MAX_MSG_SIZE];
+static size_t limitertest_output_count = 0;
+
+static bool limitertest_capture(const char* entry)
+{
+    if (limitertest_output_count < LIMITERTEST_MAX_OUTPUTS)
+    {
+        char* dest = limitertest_outputs[limitertest_output_count++];
+        snprintf(dest, LG_MAX_MSG_SIZE, "%s", entry);
+        dest[strcspn(dest, "\n")] = '\0';
+    }
+    return true;
+}
+
+/* Checks that limiter_allow_at at now returns is_allowed and reports
+expected suppressed entries. */
+static bool limitertest_expect(limiter_t* limiter,
+                               uint64_t now,
+                               bool is_allowed,
+                               uint64_t expected)
+{
+    uint64_t suppressed = 0;
+    return limiter_allow_at(limiter, now, &suppressed) == is_allowed
+           && suppressed == expected;
+}
+
+/* 10 entries per second with bursts of 3: the burst is let through at
+once, then one entry per 100 ms, and the full burst again after a
+quiet period. */
+static bool limitertest_bucket(void)
+{
+    limiter_t limiter;
+    limiter_init(&limiter);
+    limiter_set_rate(&limiter, 10, 3);
+    uint64_t t = LIMITERTEST_START;
+    bool ok = true;
+
+    for (int i = 0; i < 3; ++i)
+    {
+        ok = limitertest_expect(&limiter, t, true, 0) && ok;
+    }
+    ok = limitertest_expect(&limiter, t, false, 0) && ok;
+    ok = limitertest_expect(&limiter, t + 99 * LIMITERTEST_MS, false, 0) && ok;
+
+    /* The first summary is due at once. */
+    ok = limitertest_expect(&limiter, t + 100 * LIMITERTEST_MS, true, 2) && ok;
+    ok = limitertest_expect(&limiter, t + 100 * LIMITERTEST_MS, false, 0) && ok;
+    ok = limitertest_expect(&limiter, t + 200 * LIMITERTEST_MS, true, 0) && ok;
+
+    t += 10000 * LIMITERTEST_MS;
+    for (int i = 0; i < 3; ++i)
+    {
+        ok = limitertest_expect(&limiter, t, true, i == 0 ? 1 : 0) && ok;
+    }
+    ok = limitertest_expect(&limiter, t, false, 0) && ok;
+
+    limiter_free(&limiter);
+    return ok;
+}
+
+/* 1 in 4 lets through the first of every four entries. */
+static bool limitertest_sampling(void)
+{
+    limiter_t limiter;
+    limiter_init(&limiter);
+    limiter_set_sampling(&limiter, 4);
+    uint64_t suppressed = 0;
+    bool ok = true;
+
+    for (int i = 0; i < 12; ++i)
+    {
+        bool is_allowed = limiter_allow_at(&limiter, LIMITERTEST_START, &suppressed);
+        ok = is_allowed == (i % 4 == 0) && ok;
+    }
+
+    limiter_free(&limiter);
+    return ok;
+}
+
+/* The suppressed entries are reported with the next entry let through,
+at most once every LG_LIMIT_SUMMARY_MS. */
+static bool limitertest_summary(void)
+{
+    limiter_t limiter;
+    limiter_init(&limiter);
+    limiter_set_sampling(&limiter, 2);
+    uint64_t t = LIMITERTEST_START;
+    uint64_t half = LG_LIMIT_SUMMARY_MS / 2 * LIMITERTEST_MS;
+    bool ok = true;
+
+    ok = limitertest_expect(&limiter, t, true, 0) && ok;
+    ok = limitertest_expect(&limiter, t, false, 0) && ok;
+    ok = limitertest_expect(&limiter, t, true, 1) && ok;
+    ok = limitertest_expect(&limiter, t, false, 0) && ok;
+    ok = limitertest_expect(&limiter, t + half, true, 0) && ok;
+    ok = limitertest_expect(&limiter, t + half, false, 0) && ok;
+    ok = limitertest_expect(&limiter, t + 2 * half - 1, true, 0) && ok;
+    ok = limitertest_expect(&limiter, t + 2 * half - 1, false, 0) && ok;
+    ok = limitertest_expect(&limiter, t + 2 * half, true, 3) && ok;
+
+    limiter_free(&limiter);
+    return ok;
+}
+
+/* Writes entries through a log that samples 1 in 2 and checks that the
+summary entry goes right before the next entry let through. */
+static bool limitertest_log(void)
+{
+    log_t log;
+    log_init(&log);
+    log_file_disable(&log, LG_ALL_LEVELS);
+    log_stdout_disable(&log, LG_ALL_LEVELS);
+    log_stderr_disable(&log, LG_ALL_LEVELS);
+    log_set_entry_format(&log, LG_ALL_LEVELS, "%(MSG)");
+    log_set_user_output(&log, LG_ALL_LEVELS, limitertest_capture);
+    log_user_output_enable(&log, LG_ALL_LEVELS);
+    log_set_sampling(&log, LG_INFO, 2);
+    limitertest_output_count = 0;
+
+    log_write(&log, LG_INFO, "a");
+    log_write(&log, LG_INFO, "b");
+    log_write(&log, LG_INFO, "c");
+    log_flush(&log);
+
+    log_stats_t stats;
+    log_stats(&log, &stats);
+    bool ok = limitertest_output_count == 3
+              && strcmp(limitertest_outputs[0], "a") == 0
+              && strcmp(limitertest_outputs[1], "1 messages suppressed") == 0
+              && strcmp(limitertest_outputs[2], "c") == 0
+              && stats.levels[LG_INFO].entries_suppressed == 1;
+
+    log_free(&log);
+    return ok;
+}
+
+static bool limitertest_run(void)
+{
+    bool bucket_ok = limitertest_bucket();
+    bool sampling_ok = limitertest_sampling();
+    bool summary_ok = limitertest_summary();
+    bool log_ok = limitertest_log();
+
+    printf("LIMITER: bucket %s, sampling %s, summary %s, log %s\n",
+           bucket_ok ? "passed" : "failed",
+           sampling_ok ? "passed" : "failed",
+           summary_ok ? "passed" : "failed",
+           log_ok ? "passed" : "failed");
+    return bucket_ok && sampling_ok && summary_ok && log_ok;
+}
+
+#endif /* LIMITERTEST_H */
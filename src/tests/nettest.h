@@ -0,0 +1,226 @@
+/*
+ * File: nettest.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This file contains the test of the network output. The log sends
+ * to a TCP and a UDP listener on the loopback interface, and to a
+ * port nobody listens on, in which case the entries must end up in
+ * the spill file without the writer waiting for the network.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef NETTEST_H
+#define NETTEST_H
+
+#include "../prod/log.h"
+#include <stdio.h>
+#include <string.h>
+
+#ifndef LG_USE_WINAPI
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define NETTEST_ENTRY_COUNT 100
+
+/* Binds a loopback socket to a free port, writes the port in port and
+returns the socket, or -1 on failure. */
+static int nettest_bind(int type, char* port)
+{
+    int fd = socket(AF_INET, type, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    struct timeval timeout = { 2, 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0
+        || getsockname(fd, (struct sockaddr*)&addr, &len) != 0
+        || (type == SOCK_STREAM && listen(fd, 1) != 0))
+    {
+        close(fd);
+        return -1;
+    }
+    sprintf(port, "%u", (unsigned)ntohs(addr.sin_port));
+    return fd;
+}
+
+/* Writes the entries in one batch, and the expected output in dest. */
+static bool nettest_write(log_t* log, char* dest)
+{
+    log_entry_t entries[NETTEST_ENTRY_COUNT];
+    char msgs[NETTEST_ENTRY_COUNT][16];
+    dest[0] = '\0';
+    for (size_t i = 0; i < NETTEST_ENTRY_COUNT; ++i)
+    {
+        sprintf(msgs[i], "entry %u", (unsigned)i);
+        entries[i].level = LG_INFO;
+        entries[i].msg = msgs[i];
+        entries[i].msg_len = 0;
+        entries[i].kvs = NULL;
+        entries[i].kv_count = 0;
+        strcat(dest, msgs[i]);
+        strcat(dest, "\n");
+    }
+    return log_write_batch(log, entries, NETTEST_ENTRY_COUNT);
+}
+
+static bool nettest_run_tcp(void)
+{
+    char port[16];
+    int listener = nettest_bind(SOCK_STREAM, port);
+    if (listener < 0)
+    {
+        return false;
+    }
+
+    log_t log;
+    log_init(&log);
+    char expected[NETTEST_ENTRY_COUNT * 16];
+    expected[0] = '\0';
+    if (!log_net_enable(&log, LG_INFO, LG_NET_TCP, "127.0.0.1", port, 0, NULL))
+    {
+        /* Nothing would connect, so accept would only time out. */
+        log_free(&log);
+        close(listener);
+        return false;
+    }
+    bool failed = !nettest_write(&log, expected);
+
+    int fd = accept(listener, NULL, NULL);
+    char received[NETTEST_ENTRY_COUNT * 16];
+    size_t len = 0;
+    size_t expected_len = strlen(expected);
+    while (fd >= 0 && len < expected_len)
+    {
+        ssize_t size = recv(fd, received + len, sizeof(received) - len, 0);
+        if (size <= 0)
+        {
+            break;
+        }
+        len += (size_t)size;
+    }
+    failed = failed || len != expected_len || memcmp(received, expected, len) != 0;
+
+    log_free(&log);
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+    close(listener);
+    return !failed;
+}
+
+static bool nettest_run_udp(void)
+{
+    char port[16];
+    int fd = nettest_bind(SOCK_DGRAM, port);
+    if (fd < 0)
+    {
+        return false;
+    }
+    int rcvbuf = 1 << 20;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    log_t log;
+    log_init(&log);
+    char expected[NETTEST_ENTRY_COUNT * 16];
+    expected[0] = '\0';
+    if (!log_net_enable(&log, LG_INFO, LG_NET_UDP, "127.0.0.1", port, 0, NULL))
+    {
+        log_free(&log);
+        close(fd);
+        return false;
+    }
+    bool failed = !nettest_write(&log, expected);
+
+    /* Every entry is a datagram of its own. */
+    const char* next = expected;
+    for (size_t i = 0; i < NETTEST_ENTRY_COUNT && !failed; ++i)
+    {
+        char data[64];
+        ssize_t size = recv(fd, data, sizeof(data), 0);
+        failed = size <= 0 || memcmp(data, next, (size_t)size) != 0;
+        next += size;
+    }
+
+    log_free(&log);
+    close(fd);
+    return !failed;
+}
+
+static bool nettest_run_spill(void)
+{
+    /* A port that was free a moment ago, so that connecting fails. */
+    char port[16];
+    int fd = nettest_bind(SOCK_STREAM, port);
+    if (fd < 0)
+    {
+        return false;
+    }
+    close(fd);
+
+    char path[64];
+    sprintf(path, "/tmp/lg_nettest_%ld.spill", (long)getpid());
+    remove(path);
+
+    /* The queue only fits a few entries, so most of them are spilled
+    by the writer and the rest when the log is freed. */
+    log_t log;
+    log_init(&log);
+    char expected[NETTEST_ENTRY_COUNT * 16];
+    expected[0] = '\0';
+    bool failed = !log_net_enable(&log, LG_INFO, LG_NET_TCP, "127.0.0.1", port, 64, path)
+                  || !nettest_write(&log, expected);
+    log_free(&log);
+
+    char spilled[NETTEST_ENTRY_COUNT * 16];
+    size_t len = 0;
+    FILE* file = fopen(path, "rb");
+    if (file)
+    {
+        len = fread(spilled, 1, sizeof(spilled), file);
+        fclose(file);
+    }
+    remove(path);
+
+    /* The order is not kept: the queued entries are spilled last. */
+    size_t lines = 0;
+    for (size_t i = 0; i < len; ++i)
+    {
+        lines += spilled[i] == '\n';
+    }
+    return !failed && len == strlen(expected) && lines == NETTEST_ENTRY_COUNT;
+}
+
+static bool nettest_run(void)
+{
+    bool tcp_ok = nettest_run_tcp();
+    bool udp_ok = nettest_run_udp();
+    bool spill_ok = nettest_run_spill();
+    printf("NET: tcp %s, udp %s, spill %s\n",
+           tcp_ok ? "passed" : "failed",
+           udp_ok ? "passed" : "failed",
+           spill_ok ? "passed" : "failed");
+    return tcp_ok && udp_ok && spill_ok;
+}
+
+#else
+
+static bool nettest_run(void)
+{
+    return true;
+}
+
+#endif /* LG_USE_WINAPI */
+
+#endif /* NETTEST_H */
@@ -0,0 +1,50 @@
+/*
+ * File: run_bench.c
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This file contains the main function of the benchmark
+ * suite. The optional arguments are the duration of every
+ * run in milliseconds and the benchmarks to run: "files" for
+ * the end-to-end benchmarks (bench.h), "formatter" for the
+ * formatter micro-benchmarks (fmbench.h). Both are run by
+ * default.
+ *
+ * Usage: run_bench [duration_ms] [files|formatter]
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+/* Exposes the POSIX functions used by the benchmarks. */
+#define _GNU_SOURCE
+
+#include "bench.h"
+#include "fmbench.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+int main(int argc, char** argv)
+{
+	uint32_t duration_ms = 2000;
+	const char* suite = NULL;
+	bool success = true;
+	if (argc > 1)
+	{
+		duration_ms = (uint32_t)strtoul(argv[1], NULL, 10);
+	}
+	if (argc > 2)
+	{
+		suite = argv[2];
+	}
+
+	if (!suite || strcmp(suite, "formatter") == 0)
+	{
+		success = fmbench_run_all(duration_ms) && success;
+	}
+	if (!suite || strcmp(suite, "files") == 0)
+	{
+		success = bench_run_matrix(duration_ms) && success;
+	}
+	return success ? 0 : 1;
+}
@@ -9,16 +9,29 @@
  * Copyright (C) 2019. Anton Ihonen
  */
 
-#include "perftest.h"
+/* Exposes the POSIX functions used by the benchmarks. */
+#define _GNU_SOURCE
+
+#include "bench.h"
+#include "configtest.h"
+#include "dgramtest.h"
+#include "kvtest.h"
+#include "limitertest.h"
+#include "nettest.h"
+#include "tztest.h"
 #include <stdio.h>
 
 int main()
 {
-	run_perftest("%(year)-%(month)-%(mday) %(hour):%(min):%(sec) %(LVL) %(MSG)\n",
-		"Hello! This is just a tiny little test message!",
-		15);
-	printf("\nTests passed, press Enter to finish.\n");
+	bool success = tztest_run();
+	success = limitertest_run() && success;
+	success = kvtest_run() && success;
+	success = configtest_run() && success;
+	success = dgramtest_run() && success;
+	success = nettest_run() && success;
+	success = bench_run_matrix(1000) && success;
+	printf("\nTests %s, press Enter to finish.\n", success ? "passed" : "failed");
 	char str[2];
 	fgets(str, 2, stdin);
-	return 0;
+	return success ? 0 : 1;
 }
@@ -0,0 +1,216 @@
+/*
+ * File: tztest.h
+ * Project: logger
+ * Author: Anton Ihonen, anton@ihonen.net
+ *
+ * This file contains the test of the calendar time conversions of
+ * the time modes. tz_utc is compared with the C library over several
+ * centuries on both sides of 1970, including the days around leap
+ * days and around 2100-03-01, and tz_fixed with the UTC conversion of
+ * the offset time. tz_local is compared with localtime_r in a zone
+ * with daylight saving time, forwards and backwards across a spring
+ * forward and a fall back transition.
+ *
+ * Copyright (C) 2019. Anton Ihonen
+ */
+
+#ifndef TZTEST_H
+#define TZTEST_H
+
+#include "../prod/os.h"
+#include "../prod/tz.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* 1800-01-01T00:00:00Z and 2200-01-01T00:00:00Z. */
+#define TZTEST_FIRST -5364662400LL
+#define TZTEST_LAST 7258118400LL
+
+/* An odd step so that every time of day and every weekday is hit. */
+#define TZTEST_STEP 608401LL
+
+static bool tztest_gmtime(int64_t t, struct tm* dest)
+{
+    time_t time = (time_t)t;
+#ifdef LG_USE_WINAPI
+    return gmtime_s(dest, &time) == 0;
+#else
+    return gmtime_r(&time, dest) != NULL;
+#endif
+}
+
+static bool tztest_equal(const struct tm* a, const struct tm* b)
+{
+    return a->tm_year == b->tm_year
+           && a->tm_mon == b->tm_mon
+           && a->tm_mday == b->tm_mday
+           && a->tm_hour == b->tm_hour
+           && a->tm_min == b->tm_min
+           && a->tm_sec == b->tm_sec
+           && a->tm_wday == b->tm_wday
+           && a->tm_yday == b->tm_yday
+           && a->tm_isdst == b->tm_isdst;
+}
+
+/* Compares tz_utc with the C library at t. A time the library cannot
+represent is skipped. */
+static bool tztest_utc_at(int64_t t)
+{
+    struct tm expected;
+    struct tm actual;
+    if (!tztest_gmtime(t, &expected))
+    {
+        return true;
+    }
+    return tz_utc(t, &actual) && tztest_equal(&actual, &expected);
+}
+
+/* Compares tz_fixed at offset_s with the UTC conversion of the offset
+time at t. */
+static bool tztest_fixed_at(int64_t t, int32_t offset_s)
+{
+    struct tm expected;
+    struct tm actual;
+    if (!tztest_gmtime(t + offset_s, &expected))
+    {
+        return true;
+    }
+    return tz_fixed(t, offset_s, &actual) && tztest_equal(&actual, &expected);
+}
+
+#ifndef LG_USE_WINAPI
+
+/* The transitions of America/New_York in 2024: 2024-03-10T07:00:00Z,
+when 02:00 EST becomes 03:00 EDT, and 2024-11-03T06:00:00Z, when 02:00
+EDT becomes 01:00 EST. */
+#define TZTEST_ZONE "America/New_York"
+#define TZTEST_SPRING 1710054000LL
+#define TZTEST_FALL 1730613600LL
+
+/* Compares tz_local with localtime_r at t. */
+static bool tztest_local_at(int64_t t)
+{
+    time_t time = (time_t)t;
+    struct tm expected;
+    struct tm actual;
+    return localtime_r(&time, &expected)
+           && tz_local(t, &actual)
+           && tztest_equal(&actual, &expected);
+}
+
+/* Walks from first to last in steps of step, which may be negative, so
+that the cached offset is left both at its end and at its start. */
+static bool tztest_local_walk(int64_t first, int64_t last, int64_t step)
+{
+    bool ok = true;
+    for (int64_t t = first; step > 0 ? t <= last : t >= last; t += step)
+    {
+        ok = tztest_local_at(t) && ok;
+    }
+    return ok;
+}
+
+/* The time zone of the process is changed for the test and restored
+afterwards. The times are far from the present, so the offset that the
+cache held before the test cannot be used for them. */
+static bool tztest_local(void)
+{
+    const char* saved = getenv("TZ");
+    char saved_tz[256];
+    if (saved)
+    {
+        snprintf(saved_tz, sizeof(saved_tz), "%s", saved);
+    }
+    setenv("TZ", TZTEST_ZONE, 1);
+    tzset();
+
+    bool ok = true;
+    static const int64_t transitions[] = { TZTEST_SPRING, TZTEST_FALL };
+    for (size_t i = 0; i < sizeof(transitions) / sizeof(transitions[0]); ++i)
+    {
+        int64_t t = transitions[i];
+        ok = tztest_local_walk(t - 3 * 3600, t + 3 * 3600, 59) && ok;
+        ok = tztest_local_walk(t + 3 * 3600, t - 3 * 3600, -59) && ok;
+        ok = tztest_local_walk(t - 2, t + 2, 1) && ok;
+        ok = tztest_local_walk(t + 2, t - 2, -1) && ok;
+    }
+    ok = tztest_local_walk(TZTEST_SPRING - 30 * 86400, TZTEST_FALL + 30 * 86400, 3607)
+         && ok;
+    ok = tztest_local_walk(TZTEST_FALL + 30 * 86400, TZTEST_SPRING - 30 * 86400, -3607)
+         && ok;
+
+    /* The local hours themselves, so that the test fails rather than
+    compares UTC with UTC if the zone is not installed. */
+    struct tm tm;
+    ok = tz_local(TZTEST_SPRING - 1, &tm) && tm.tm_hour == 1 && !tm.tm_isdst && ok;
+    ok = tz_local(TZTEST_SPRING, &tm) && tm.tm_hour == 3 && tm.tm_isdst && ok;
+    ok = tz_local(TZTEST_FALL - 1, &tm) && tm.tm_hour == 1 && tm.tm_isdst && ok;
+    ok = tz_local(TZTEST_FALL, &tm) && tm.tm_hour == 1 && !tm.tm_isdst && ok;
+
+    if (saved)
+    {
+        setenv("TZ", saved_tz, 1);
+    }
+    else
+    {
+        unsetenv("TZ");
+    }
+    tzset();
+    return ok;
+}
+
+#else
+
+static bool tztest_local(void)
+{
+    return true;
+}
+
+#endif /* LG_USE_WINAPI */
+
+static bool tztest_run(void)
+{
+    /* Every second around the epoch, and every hour of the days
+    around leap days and days that are not leap days. */
+    static const int64_t days[] =
+    {
+        -2203977600LL, /* 1900-02-28 */
+        -1, /* 1969-12-31T23:59:59Z */
+        951696000LL, /* 2000-02-28 */
+        1709078400LL, /* 2024-02-28 */
+        4107369600LL, /* 2100-02-27 */
+        4107542400LL /* 2100-03-01 */
+    };
+    bool utc_ok = true;
+    bool fixed_ok = true;
+
+    for (int64_t t = -86400; t < 86400 && utc_ok; ++t)
+    {
+        utc_ok = tztest_utc_at(t);
+    }
+    for (size_t i = 0; i < sizeof(days) / sizeof(days[0]); ++i)
+    {
+        for (int64_t t = days[i] - 86400; t < days[i] + 3 * 86400; t += 3600)
+        {
+            utc_ok = tztest_utc_at(t) && utc_ok;
+            fixed_ok = tztest_fixed_at(t, 5 * 3600 + 1800) && fixed_ok;
+            fixed_ok = tztest_fixed_at(t, -8 * 3600) && fixed_ok;
+        }
+    }
+    for (int64_t t = TZTEST_FIRST; t < TZTEST_LAST; t += TZTEST_STEP)
+    {
+        utc_ok = tztest_utc_at(t) && utc_ok;
+        fixed_ok = tztest_fixed_at(t, 3600) && fixed_ok;
+    }
+
+    bool local_ok = tztest_local();
+
+    printf("TZ: utc %s, fixed %s, local %s\n",
+           utc_ok ? "passed" : "failed",
+           fixed_ok ? "passed" : "failed",
+           local_ok ? "passed" : "failed");
+    return utc_ok && fixed_ok && local_ok;
+}
+
+#endif /* TZTEST_H */